@@ -1,9 +1,18 @@
 @echo off
 set THIS_DIR=%~sdp0
 
+copy /y %THIS_DIR%..\..\src\pro_msg\msg_affinity.h                 %THIS_DIR%promsg\
+copy /y %THIS_DIR%..\..\src\pro_msg\msg_auth.h                     %THIS_DIR%promsg\
+copy /y %THIS_DIR%..\..\src\pro_msg\msg_buffer.h                   %THIS_DIR%promsg\
 copy /y %THIS_DIR%..\..\src\pro_msg\msg_client.h                   %THIS_DIR%promsg\
 copy /y %THIS_DIR%..\..\src\pro_msg\msg_client2.h                  %THIS_DIR%promsg\
+copy /y %THIS_DIR%..\..\src\pro_msg\msg_coalesce.h                 %THIS_DIR%promsg\
+copy /y %THIS_DIR%..\..\src\pro_msg\msg_endpoint.h                 %THIS_DIR%promsg\
+copy /y %THIS_DIR%..\..\src\pro_msg\msg_group.h                    %THIS_DIR%promsg\
+copy /y %THIS_DIR%..\..\src\pro_msg\msg_metrics.h                  %THIS_DIR%promsg\
+copy /y %THIS_DIR%..\..\src\pro_msg\msg_pending.h                  %THIS_DIR%promsg\
 copy /y %THIS_DIR%..\..\src\pro_msg\msg_server.h                   %THIS_DIR%promsg\
+copy /y %THIS_DIR%..\..\src\pro_msg\msg_watermark.h                %THIS_DIR%promsg\
 
 copy /y %THIS_DIR%..\..\src\pro_msg_jni\com\pro\msg\ProMsgJni.java %THIS_DIR%com\pro\msg\
 
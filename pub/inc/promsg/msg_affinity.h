@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * Reactors whose threads are pinned to a set of CPUs. A new thread inherits
+ * the CPU affinity of the thread that creates it, so the calling thread is
+ * pinned while ProCreateReactor() runs, and then it's restored.
+ *
+ * Pinning is supported on Linux only. Elsewhere, MsgCreateReactor() creates
+ * an unpinned reactor.
+ *
+ * A CPU list is written as in the msgs_reactor_cpus/msgc_reactor_cpus
+ * config items, e.g., "0-3,8,10-11".
+ */
+
+#if !defined(MSG_AFFINITY_H)
+#define MSG_AFFINITY_H
+
+#include "pronet/pro_stl.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class IProReactor;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+/*
+ * cpus is empty for unpinned. NULL if no cpu in cpus can be used
+ */
+IProReactor*
+MsgCreateReactor(unsigned int                       threadCount,
+                 const CProStlVector<unsigned int>& cpus);
+
+bool
+MsgIsPinningSupported();
+
+/*
+ * an empty text gives an empty list. false if the text is malformed
+ */
+bool
+MsgParseCpuList(const char*                  text,
+                CProStlVector<unsigned int>& cpus);
+
+/*
+ * A buffer whose pages are placed by the first thread that writes them.
+ * A buffer written mostly by one pinned reactor thread should come from
+ * here rather than from the pool, whose blocks may have been touched on
+ * another NUMA node already. It's ProMalloc() on non-Linux systems.
+ */
+void*
+MsgAllocLocal(size_t size);
+
+void
+MsgFreeLocal(void*  buf,
+             size_t size);
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_AFFINITY_H */
@@ -67,6 +67,38 @@ public:
         CMsgClient2* msgClient,
         int64_t      peerAliveTick
         ) = 0;
+
+    /*
+     * called on the sending thread when the queued bytes reach the high mark
+     */
+    virtual void OnOutputHighWater(
+        CMsgClient2* msgClient,
+        size_t       sendingBytes
+        )
+    {
+    }
+
+    /*
+     * called on the reactor when the queued bytes fall to the low mark
+     */
+    virtual void OnOutputLowWater(
+        CMsgClient2* msgClient,
+        size_t       sendingBytes
+        )
+    {
+    }
+
+    /*
+     * called when held sends or coalesced batches are dropped. see
+     * msg_pending.h and msg_coalesce.h
+     */
+    virtual void OnSendDropped(
+        CMsgClient2* msgClient,
+        size_t       msgCount,
+        size_t       bytes
+        )
+    {
+    }
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -125,9 +157,20 @@ private:
         int64_t        peerAliveTick
         );
 
-private:
+    virtual void OnOutputHighWater(
+        const RTP_MSG_USER& user,
+        size_t              sendingBytes
+        );
+
+    virtual void OnOutputLowWater(
+        const RTP_MSG_USER& user,
+        size_t              sendingBytes
+        );
 
-    IMsgClientObserver* m_observer;
+    virtual void OnSendDropped(
+        size_t msgCount,
+        size_t bytes
+        );
 
     DECLARE_SGI_POOL(0)
 };
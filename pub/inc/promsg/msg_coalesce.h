@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+/*
+ * Nagle-style coalescing of small client messages. Consecutive messages to
+ * the same destination list are packed into one message with the charset
+ * MSG_COALESCE_CHARSET, which is flushed when it reaches maxBytes or
+ * maxMsgs, or when its first message is maxDelayInUs old. A flush of one
+ * message sends it as it is.
+ *
+ * The body of a batch is a sequence of records:
+ *
+ *     [0..3]   size of the message, big-endian
+ *     [4..5]   charset of the message, big-endian
+ *     [6..]    the message
+ *
+ * CMsgClient and CMsgServer unpack a batch into one OnRecvMsg() call per
+ * record, so coalescing must be enabled only when every receiver is built
+ * with this version. The deadline is kept by a reactor timer, which has a
+ * resolution of 1 ms.
+ *
+ * A flushed batch is queued, and sent without the coalescer locked by one
+ * thread at a time, so the batches go out in order and the observer can add
+ * messages again from inside OnCoalescedMsg(). Such messages are sent after
+ * the current batch by the same thread.
+ */
+
+#if !defined(MSG_COALESCE_H)
+#define MSG_COALESCE_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_timer_factory.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define MSG_COALESCE_CHARSET     65534
+#define MSG_COALESCE_HEADER_SIZE 6
+#define MSG_COALESCE_MAX_BYTES   (1024 * 1024)
+
+class IProReactor;
+
+/*
+ * gets the record at *offset and moves *offset to the next one. false at
+ * the end of the batch, or if the rest of it is malformed
+ */
+bool
+MsgCoalesceNext(const void*  buf,
+                size_t       size,
+                size_t*      offset,
+                const void** item,
+                size_t*      itemSize,
+                uint16_t*    itemCharset);
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class IMsgCoalescerObserver
+{
+public:
+
+    virtual ~IMsgCoalescerObserver() {}
+
+    virtual unsigned long AddRef() = 0;
+
+    virtual unsigned long Release() = 0;
+
+    /*
+     * called without the coalescer locked, one batch at a time
+     */
+    virtual bool OnCoalescedMsg(
+        const void*         buf,
+        size_t              size,
+        uint16_t            charset,
+        const RTP_MSG_USER* dstUsers,
+        unsigned char       dstUserCount
+        ) = 0;
+
+    /*
+     * a batch of msgCount messages of bytes in total has been refused by
+     * OnCoalescedMsg()
+     */
+    virtual void OnCoalescedDropped(
+        size_t msgCount,
+        size_t bytes
+        )
+    {
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgCoalescer : public IProOnTimer, public CProRefCount
+{
+public:
+
+    static CMsgCoalescer* CreateInstance();
+
+    bool Init(
+        IMsgCoalescerObserver* observer,
+        IProReactor*           reactor,
+        size_t                 maxBytes,    /* 0 for disabled */
+        size_t                 maxMsgs,
+        unsigned int           maxDelayInUs
+        );
+
+    void Fini();
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+    /*
+     * the pending batch is flushed first
+     */
+    void SetParams(
+        size_t       maxBytes,
+        size_t       maxMsgs,
+        unsigned int maxDelayInUs
+        );
+
+    void GetParams(
+        size_t*       maxBytes,
+        size_t*       maxMsgs,
+        unsigned int* maxDelayInUs
+        ) const;
+
+    bool IsEnabled() const
+    {
+        return m_maxBytes.load() > 0;
+    }
+
+    /*
+     * false if the message can't be coalesced, e.g., it's too large. The
+     * pending batch has been sent then, so the caller can send the message
+     * by itself without reordering. While another batch is being sent, such
+     * a message is queued as a batch of its own instead. A batch refused
+     * later, e.g., over the redline, is reported by OnCoalescedDropped()
+     */
+    bool Add(
+        const void*         buf1,
+        size_t              size1,
+        const void*         buf2,  /* = NULL */
+        size_t              size2, /* = 0 */
+        uint16_t            charset,
+        const RTP_MSG_USER* dstUsers,
+        unsigned char       dstUserCount
+        );
+
+    void Flush();
+
+private:
+
+    CMsgCoalescer();
+
+    virtual ~CMsgCoalescer();
+
+    virtual void OnTimer(
+        void*    factory,
+        uint64_t timerId,
+        int64_t  tick,
+        int64_t  userData
+        );
+
+    /*
+     * moves the pending batch to m_batches
+     */
+    void Flush_i();
+
+    /*
+     * non-NULL if the caller becomes the sender. it should call Send_i()
+     * with the return value after unlocking
+     */
+    IMsgCoalescerObserver* Claim_i();
+
+    /*
+     * sends the queued batches, and releases observer
+     */
+    void Send_i(IMsgCoalescerObserver* observer);
+
+private:
+
+    struct MSG_COALESCE_BATCH
+    {
+        CProStlVector<char> buf;
+        size_t              msgCount;
+        uint16_t            firstCharset;
+        RTP_MSG_USER        dstUsers[255];
+        unsigned char       dstUserCount;
+
+        DECLARE_SGI_POOL(0)
+    };
+
+    IMsgCoalescerObserver*            m_observer;
+    IProReactor*                      m_reactor;
+    uint64_t                          m_timerId;  /* armed by the first message of a batch */
+    std::atomic<size_t>               m_maxBytes; /* read by IsEnabled() without m_lock */
+    size_t                            m_maxMsgs;
+    unsigned int                      m_maxDelayInUs;
+    CProStlVector<char>               m_buf;
+    CProStlVector<char>               m_spareBuf; /* recycled by Send_i() */
+    size_t                            m_msgCount;
+    uint16_t                          m_firstCharset;
+    int64_t                           m_firstUs;
+    RTP_MSG_USER                      m_dstUsers[255];
+    unsigned char                     m_dstUserCount;
+    CProStlDeque<MSG_COALESCE_BATCH*> m_batches;  /* flushed, to be sent */
+    bool                              m_sending;  /* a thread is in Send_i() */
+    mutable CProThreadMutex           m_lock;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_COALESCE_H */
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+/*
+ * Groups are kept by CMsgServer. A message published to a group is fanned
+ * out by the server itself, in batches of at most 255 users.
+ *
+ * A client joins or leaves a group by sending a control message to the
+ * server user (1-1-0) with the charset MSG_GROUP_CTRL_CHARSET. The body is
+ * MSG_GROUP_CTRL_SIZE bytes:
+ *
+ *     [0]      op, MSG_GROUP_OP_JOIN or MSG_GROUP_OP_LEAVE
+ *     [1..7]   reserved, zeros
+ *     [8..15]  groupId, big-endian
+ *
+ * Only existing groups can be joined. The memberships of a user are dropped
+ * when its connection is closed.
+ */
+
+#if !defined(____MSG_GROUP_H____)
+#define ____MSG_GROUP_H____
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define MSG_GROUP_CTRL_CHARSET 65535
+#define MSG_GROUP_CTRL_SIZE    16
+#define MSG_GROUP_OP_JOIN      1
+#define MSG_GROUP_OP_LEAVE     2
+#define MSG_GROUP_SERVER_CID   1
+#define MSG_GROUP_SERVER_UID   1
+
+void
+MsgGroupPackCtrl(unsigned char op,
+                 uint64_t      groupId,
+                 unsigned char buf[MSG_GROUP_CTRL_SIZE]);
+
+bool
+MsgGroupUnpackCtrl(const void*    buf,
+                   size_t         size,
+                   unsigned char* op,
+                   uint64_t*      groupId);
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+/*
+ * An immutable member list. It stays valid while a publisher is sending,
+ * even if the group is changed or deleted in the meantime.
+ */
+class CMsgGroupMembers : public CProRefCount
+{
+public:
+
+    static CMsgGroupMembers* CreateInstance(const CProStlVector<RTP_MSG_USER>& users);
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+    const CProStlVector<RTP_MSG_USER> users;
+
+private:
+
+    CMsgGroupMembers(const CProStlVector<RTP_MSG_USER>& users2);
+
+    virtual ~CMsgGroupMembers()
+    {
+    }
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgGroupTable
+{
+public:
+
+    CMsgGroupTable();
+
+    ~CMsgGroupTable();
+
+    bool CreateGroup(uint64_t groupId);
+
+    void DeleteGroup(uint64_t groupId);
+
+    bool JoinGroup(
+        uint64_t            groupId,
+        const RTP_MSG_USER& user
+        );
+
+    void LeaveGroup(
+        uint64_t            groupId,
+        const RTP_MSG_USER& user
+        );
+
+    void LeaveAllGroups(const RTP_MSG_USER& user);
+
+    /*
+     * the caller should release the return value. NULL if no such group
+     */
+    CMsgGroupMembers* GetMembers(uint64_t groupId);
+
+    size_t GetMemberCount(uint64_t groupId) const;
+
+    void Clear();
+
+private:
+
+    struct MSG_GROUP
+    {
+        MSG_GROUP()
+        {
+            published = NULL;
+        }
+
+        CProStlVector<RTP_MSG_USER> members;   /* sorted */
+        CMsgGroupMembers*           published; /* NULL if out of date */
+
+        DECLARE_SGI_POOL(0)
+    };
+
+    bool RemoveMember_i(
+        MSG_GROUP*          group,
+        const RTP_MSG_USER& user
+        );
+
+    void RemoveUserGroup_i(
+        const RTP_MSG_USER& user,
+        uint64_t            groupId
+        );
+
+private:
+
+    CProStlMap<uint64_t, MSG_GROUP*>                   m_groups;
+    CProStlMap<RTP_MSG_USER, CProStlVector<uint64_t> > m_userGroups;
+    mutable CProThreadMutex                            m_lock;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* ____MSG_GROUP_H____ */
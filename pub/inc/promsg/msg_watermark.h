@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+/*
+ * Edge-triggered output watermarks. The sender calls Check() with the queued
+ * bytes of each destination of a message. A destination that reaches the
+ * high mark is reported once, and then it's polled on the reactor until its
+ * queued bytes fall to the low mark, which is reported once too.
+ *
+ * Only the destinations above the high mark are polled, so an idle tracker
+ * costs nothing but a timer.
+ */
+
+#if !defined(MSG_WATERMARK_H)
+#define MSG_WATERMARK_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_timer_factory.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define MSG_WATERMARK_POLL_INTERVAL 100 /* ms */
+
+class IProReactor;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class IMsgWatermarkObserver
+{
+public:
+
+    virtual ~IMsgWatermarkObserver() {}
+
+    virtual unsigned long AddRef() = 0;
+
+    virtual unsigned long Release() = 0;
+
+    virtual size_t GetSendingBytes(const RTP_MSG_USER& user) const = 0;
+
+    virtual void OnOutputHighWater(
+        const RTP_MSG_USER& user,
+        size_t              sendingBytes
+        ) = 0;
+
+    virtual void OnOutputLowWater(
+        const RTP_MSG_USER& user,
+        size_t              sendingBytes
+        ) = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgWatermark : public IProOnTimer, public CProRefCount
+{
+public:
+
+    static CMsgWatermark* CreateInstance();
+
+    bool Init(
+        IMsgWatermarkObserver* observer,
+        IProReactor*           reactor,
+        size_t                 highBytes, /* 0 for disabled */
+        size_t                 lowBytes   /* < highBytes */
+        );
+
+    void Fini();
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+    void SetMarks(
+        size_t highBytes,
+        size_t lowBytes
+        );
+
+    void GetMarks(
+        size_t* highBytes,
+        size_t* lowBytes
+        ) const;
+
+    bool IsEnabled() const
+    {
+        return m_highBytes.load() > 0;
+    }
+
+    /*
+     * lock-free unless sendingBytes reaches the high mark
+     */
+    void Check(
+        const RTP_MSG_USER& user,
+        size_t              sendingBytes
+        );
+
+    /*
+     * forgets a destination silently, e.g., when it has gone
+     */
+    void Remove(const RTP_MSG_USER& user);
+
+private:
+
+    CMsgWatermark();
+
+    virtual ~CMsgWatermark();
+
+    virtual void OnTimer(
+        void*    factory,
+        uint64_t timerId,
+        int64_t  tick,
+        int64_t  userData
+        );
+
+private:
+
+    IMsgWatermarkObserver*   m_observer;
+    IProReactor*             m_reactor;
+    uint64_t                 m_timerId;
+    std::atomic<size_t>      m_highBytes; /* read by Check() without m_lock */
+    std::atomic<size_t>      m_lowBytes;
+    CProStlSet<RTP_MSG_USER> m_highUsers;
+    mutable CProThreadMutex  m_lock;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_WATERMARK_H */
@@ -0,0 +1,596 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+package com.pro.msg;
+
+import java.lang.management.GarbageCollectorMXBean;
+import java.lang.management.ManagementFactory;
+import java.nio.ByteBuffer;
+import java.util.concurrent.atomic.AtomicLong;
+
+/*
+ * ProMsgJniBench starts a server and 2 clients on loopback in this process,
+ * through ProMsgJni, and measures the JNI bridge:
+ *
+ * recv   : msgClientOnRecv() calls/s and the cost of a call, with and
+ *          without persistent attaching (see ProMsgJni.setPersistentAttach())
+ * direct : the same for byte[], MsgClientDirectListener with views, and
+ *          MsgClientDirectListener with a pooled buffer, and the GCs of each
+ * send   : msgClientSendMsg() with byte[] vs msgClientSendMsgDirect() with a
+ *          direct ByteBuffer, for sizes from 64 B to 1 MB
+ * batch  : one msgClientOnRecv() per message vs MsgClientBatchListener with a
+ *          few maxBytes/maxDelayInMs settings, and the messages per upcall
+ * packed : PRO_MSG_USER objects vs packed users, on both the send side
+ *          (msgClientSendMsgPacked()) and the receive side
+ *          (MsgClientPackedListener)
+ *
+ * usage: java -cp <classes> com.pro.msg.ProMsgJniBench \
+ *            <mode> [serverConfig] [clientConfig] [port] [seconds] [size]
+ */
+public class ProMsgJniBench
+{
+    static final short CLASS_ID     = 2;
+    static final long  USER_ID_BASE = 1000000;
+    static final long  WINDOW       = 10000; /* msgs in flight */
+
+    static class Client implements ProMsgJni.MsgClientListener
+    {
+        volatile boolean ok        = false;
+        final AtomicLong recvMsgs  = new AtomicLong();
+        final AtomicLong recvBytes = new AtomicLong();
+
+        public void msgClientOnOk(
+            long                   msgClient,
+            ProMsgJni.PRO_MSG_USER myUser,
+            String                 myPublicIp
+            )
+        {
+            ok = true;
+        }
+
+        public void msgClientOnRecv(
+            long                   msgClient,
+            byte[]                 buf,
+            int                    charset,
+            ProMsgJni.PRO_MSG_USER srcUser
+            )
+        {
+            recvMsgs.incrementAndGet();
+            recvBytes.addAndGet(buf.length);
+        }
+
+        public void msgClientOnClose(
+            long    msgClient,
+            int     errorCode,
+            int     sslCode,
+            boolean tcpConnected
+            )
+        {
+            ok = false;
+        }
+
+        public void msgClientOnHeartbeat(
+            long msgClient,
+            long peerAliveTick
+            )
+        {
+        }
+    }
+
+    static class DirectClient extends Client implements ProMsgJni.MsgClientDirectListener
+    {
+        public void msgClientOnRecvDirect(
+            long       msgClient,
+            ByteBuffer buf,
+            int        size,
+            int        charset,
+            short      srcClassId,
+            long       srcUserId,
+            int        srcInstId
+            )
+        {
+            recvMsgs.incrementAndGet();
+            recvBytes.addAndGet(size);
+        }
+    }
+
+    static class BatchClient extends Client implements ProMsgJni.MsgClientBatchListener
+    {
+        final AtomicLong batches = new AtomicLong();
+
+        public void msgClientOnRecvBatch(
+            long       msgClient,
+            ByteBuffer buf,
+            int        size,
+            int        count
+            )
+        {
+            long msgs  = 0;
+            long bytes = 0;
+
+            for (int pos = 0; pos + 16 <= size; ++msgs)
+            {
+                int   size2     = buf.getInt(pos);
+                int   charset   = buf.getShort(pos + 4) & 0xFFFF;
+                int   srcInstId = buf.getShort(pos + 6) & 0xFFFF;
+                long  src       = buf.getLong(pos + 8);
+                short classId   = (short)(src >>> 40);
+                long  userId    = src & 0xFFFFFFFFFFL;
+
+                bytes += size2;
+                pos   += 16 + size2;
+            }
+
+            batches.incrementAndGet();
+            recvBytes.addAndGet(bytes);
+            recvMsgs.addAndGet(msgs);
+        }
+    }
+
+    static class PackedClient extends Client implements ProMsgJni.MsgClientPackedListener
+    {
+        public void msgClientOnRecvPacked(
+            long   msgClient,
+            byte[] buf,
+            int    charset,
+            long   srcUser
+            )
+        {
+            recvMsgs.incrementAndGet();
+            recvBytes.addAndGet(buf.length);
+        }
+    }
+
+    static class Server implements ProMsgJni.MsgServerListener
+    {
+        public void msgServerOnOkUser(
+            long                   msgServer,
+            ProMsgJni.PRO_MSG_USER user,
+            String                 userPublicIp
+            )
+        {
+        }
+
+        public void msgServerOnCloseUser(
+            long                   msgServer,
+            ProMsgJni.PRO_MSG_USER user,
+            int                    errorCode,
+            int                    sslCode
+            )
+        {
+        }
+
+        public void msgServerOnHeartbeatUser(
+            long                   msgServer,
+            ProMsgJni.PRO_MSG_USER user,
+            long                   peerAliveTick
+            )
+        {
+        }
+
+        public void msgServerOnRecvMsg(
+            long                   msgServer,
+            byte[]                 buf,
+            int                    charset,
+            ProMsgJni.PRO_MSG_USER srcUser
+            )
+        {
+        }
+    }
+
+    /*---------------------------------------------------------------------*/
+
+    String   serverConfig = "../cfg/msg_server-java.cfg";
+    String   clientConfig = "../cfg/msg_client.cfg";
+    int      port         = 3100;
+    int      seconds      = 10;
+    int      size         = 64;
+
+    long     server       = 0;
+    /*
+     * [0] sends. [1] receives byte[]s, [2] views, [3] a pooled buffer, [4]
+     * batches and [5] packed users
+     */
+    long[]   clients      = new long[6];
+    Client[] listeners    = new Client[6];
+
+    ProMsgJni.PRO_MSG_USER[] users = new ProMsgJni.PRO_MSG_USER[6];
+
+    boolean setup()
+    {
+        server = ProMsgJni.msgServerCreate(new Server(), serverConfig, (short)0, port);
+        if (server == 0)
+        {
+            System.out.println(" ProMsgJniBench: failed to start the server, port : " + port);
+
+            return false;
+        }
+
+        for (int i = 0; i < clients.length; ++i)
+        {
+            users[i]     = new ProMsgJni.PRO_MSG_USER(CLASS_ID, USER_ID_BASE + i, 1);
+            listeners[i] = i == 5 ? new PackedClient() : i == 4 ? new BatchClient() :
+                i >= 2 ? new DirectClient() : new Client();
+            clients[i]   = ProMsgJni.msgClientCreate(listeners[i], clientConfig, (short)0,
+                "127.0.0.1", port, users[i], null, null);
+            if (clients[i] == 0)
+            {
+                System.out.println(" ProMsgJniBench: failed to create client " + i);
+
+                return false;
+            }
+        }
+
+        if (!ProMsgJni.msgClientAddRecvBuffer(clients[3], ByteBuffer.allocateDirect(size)))
+        {
+            System.out.println(" ProMsgJniBench: failed to add the receive buffer");
+
+            return false;
+        }
+
+        long deadline = System.currentTimeMillis() + 60 * 1000;
+
+        while (!isAllOk())
+        {
+            if (System.currentTimeMillis() > deadline)
+            {
+                System.out.println(" ProMsgJniBench: the clients failed to log in");
+
+                return false;
+            }
+
+            sleep(100);
+        }
+
+        return true;
+    }
+
+    boolean isAllOk()
+    {
+        for (int i = 0; i < listeners.length; ++i)
+        {
+            if (!listeners[i].ok)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void teardown()
+    {
+        for (int i = 0; i < clients.length; ++i)
+        {
+            if (clients[i] != 0)
+            {
+                ProMsgJni.msgClientDelete(clients[i]);
+                clients[i] = 0;
+            }
+        }
+
+        if (server != 0)
+        {
+            ProMsgJni.msgServerDelete(server);
+            server = 0;
+        }
+    }
+
+    double runRecv(
+        String title,
+        int    dst
+        )
+    {
+        return runRecv(title, dst, false);
+    }
+
+    /*
+     * clients[0] sends to clients[dst] for the duration, at most WINDOW msgs
+     * in flight. the return value is msgs/s
+     */
+    double runRecv(
+        String  title,
+        int     dst,
+        boolean packed
+        )
+    {
+        Client                   receiver       = listeners[dst];
+        ProMsgJni.PRO_MSG_USER[] dstUsers       = { users[dst] };
+        long[]                   packedDstUsers = { ProMsgJni.packUser(
+            users[dst].classId, users[dst].userId, users[dst].instId) };
+        byte[]                   buf            = new byte[size];
+        long                     sent           = 0;
+
+        long recv0   = receiver.recvMsgs.get();
+        long gcs0    = getGcCount();
+        long startNs = System.nanoTime();
+        long endNs   = startNs + seconds * 1000000000L;
+
+        while (System.nanoTime() < endNs)
+        {
+            if (sent - (receiver.recvMsgs.get() - recv0) >= WINDOW)
+            {
+                Thread.yield();
+                continue;
+            }
+
+            boolean ret = packed
+                ? ProMsgJni.msgClientSendMsgPacked(clients[0], buf, 0, packedDstUsers)
+                : ProMsgJni.msgClientSendMsg(clients[0], buf, 0, dstUsers);
+            if (ret)
+            {
+                ++sent;
+            }
+        }
+
+        long   recvMsgs = receiver.recvMsgs.get() - recv0;
+        double elapsed  = (System.nanoTime() - startNs) / 1e9;
+        double rate     = recvMsgs / elapsed;
+
+        System.out.printf(" %-12s: %d msgs, %.0f msgs/s, %.0f ns/msg, %d GCs %n",
+            title, recvMsgs, rate, rate > 0 ? 1e9 / rate : 0.0, getGcCount() - gcs0);
+
+        /*
+         * let the queued messages drain
+         */
+        sleep(1000);
+
+        return rate;
+    }
+
+    void benchRecv()
+    {
+        System.out.printf("%n recv: msgClientOnRecv(), size : %d, seconds : %d %n", size, seconds);
+
+        ProMsgJni.setPersistentAttach(false);
+        double detached = runRecv("per-callback", 1);
+
+        ProMsgJni.setPersistentAttach(true);
+        double attached = runRecv("persistent", 1);
+
+        if (detached > 0)
+        {
+            System.out.printf(" speedup     : %.2fx %n", attached / detached);
+        }
+    }
+
+    void benchDirect()
+    {
+        System.out.printf("%n direct: size : %d, seconds : %d %n", size, seconds);
+
+        runRecv("byte[]", 1);
+        runRecv("view", 2);
+        runRecv("pooled", 3);
+    }
+
+    void benchBatch()
+    {
+        System.out.printf("%n batch: size : %d, seconds : %d each %n", size, seconds);
+
+        runRecv("per-message", 1);
+
+        BatchClient batchClient = (BatchClient)listeners[4];
+        int[][]     settings    = { { 4096, 1 }, { 65536, 5 }, { 262144, 20 } };
+
+        for (int i = 0; i < settings.length; ++i)
+        {
+            int maxBytes     = settings[i][0];
+            int maxDelayInMs = settings[i][1];
+
+            if (!ProMsgJni.msgClientSetRecvBatch(clients[4], maxBytes, maxDelayInMs))
+            {
+                System.out.println(" ProMsgJniBench: msgClientSetRecvBatch() failed");
+
+                return;
+            }
+
+            long msgs0    = batchClient.recvMsgs.get();
+            long batches0 = batchClient.batches.get();
+
+            runRecv(maxBytes / 1024 + "K/" + maxDelayInMs + "ms", 4);
+
+            long msgs    = batchClient.recvMsgs.get() - msgs0;
+            long batches = batchClient.batches.get() - batches0;
+
+            System.out.printf(" %-12s  %d upcalls, %.1f msgs/upcall %n",
+                "", batches, batches > 0 ? (double)msgs / batches : 0.0);
+        }
+
+        ProMsgJni.msgClientSetRecvBatch(clients[4], 0, 0);
+    }
+
+    void benchPacked()
+    {
+        System.out.printf("%n packed: size : %d, seconds : %d each %n", size, seconds);
+
+        double objects = runRecv("objects", 1, false);
+        double packed  = runRecv("packed", 5, true);
+
+        if (objects > 0)
+        {
+            System.out.printf(" speedup     : %.2fx %n", packed / objects);
+        }
+    }
+
+    static long getGcCount()
+    {
+        long count = 0;
+
+        for (GarbageCollectorMXBean gc : ManagementFactory.getGarbageCollectorMXBeans())
+        {
+            count += Math.max(gc.getCollectionCount(), 0);
+        }
+
+        return count;
+    }
+
+    /*
+     * clients[0] sends to clients[1], at most 4 MB in flight. the return
+     * value is MB/s
+     */
+    double runSend(
+        int     size2,
+        boolean direct
+        )
+    {
+        Client                   receiver  = listeners[1];
+        ProMsgJni.PRO_MSG_USER[] dstUsers  = { users[1] };
+        byte[]                   buf       = new byte[size2];
+        ByteBuffer               directBuf = ByteBuffer.allocateDirect(size2);
+        long                     window    = Math.max(4L * 1024 * 1024 / size2, 1);
+        long                     sent      = 0;
+
+        long recv0   = receiver.recvMsgs.get();
+        long startNs = System.nanoTime();
+        long endNs   = startNs + seconds * 1000000000L;
+
+        while (System.nanoTime() < endNs)
+        {
+            if (sent - (receiver.recvMsgs.get() - recv0) >= window)
+            {
+                Thread.yield();
+                continue;
+            }
+
+            boolean ret = direct
+                ? ProMsgJni.msgClientSendMsgDirect(clients[0], directBuf, 0, size2, 0, dstUsers)
+                : ProMsgJni.msgClientSendMsg(clients[0], buf, 0, dstUsers);
+            if (ret)
+            {
+                ++sent;
+            }
+        }
+
+        double elapsed = (System.nanoTime() - startNs) / 1e9;
+
+        /*
+         * let the queued messages drain
+         */
+        sleep(1000);
+
+        return sent * (double)size2 / elapsed / (1024 * 1024);
+    }
+
+    void benchSend()
+    {
+        System.out.printf("%n send: byte[] vs direct ByteBuffer, seconds : %d each %n", seconds);
+        System.out.printf(" %10s %14s %14s %8s %n", "size", "byte[] MB/s", "direct MB/s", "ratio");
+
+        ProMsgJni.msgClientSetOutputRedline(clients[0], 64 * 1024 * 1024);
+
+        for (int size2 = 64; size2 <= 1024 * 1024; size2 *= 4)
+        {
+            double heap   = runSend(size2, false);
+            double direct = runSend(size2, true);
+
+            System.out.printf(" %10d %14.1f %14.1f %7.2fx %n",
+                size2, heap, direct, heap > 0 ? direct / heap : 0.0);
+        }
+    }
+
+    static void sleep(long millis)
+    {
+        try
+        {
+            Thread.sleep(millis);
+        }
+        catch (InterruptedException e)
+        {
+        }
+    }
+
+    static void printUsage()
+    {
+        System.out.println(
+            "\n" +
+            " usage: ProMsgJniBench <mode> [serverConfig] [clientConfig] [port] [seconds] [size] \n" +
+            "\n" +
+            "  mode : recv | direct | send | batch | packed \n"
+            );
+    }
+
+    public static void main(String[] args)
+    {
+        if (args.length < 1 ||
+            (!args[0].equals("recv") && !args[0].equals("direct") && !args[0].equals("send") &&
+            !args[0].equals("batch") && !args[0].equals("packed")))
+        {
+            printUsage();
+
+            return;
+        }
+
+        ProMsgJniBench bench = new ProMsgJniBench();
+
+        if (args.length > 1)
+        {
+            bench.serverConfig = args[1];
+        }
+        if (args.length > 2)
+        {
+            bench.clientConfig = args[2];
+        }
+        if (args.length > 3)
+        {
+            bench.port = Integer.parseInt(args[3]);
+        }
+        if (args.length > 4)
+        {
+            bench.seconds = Integer.parseInt(args[4]);
+        }
+        if (args.length > 5)
+        {
+            bench.size = Integer.parseInt(args[5]);
+        }
+
+        if (!ProMsgJni.init(4))
+        {
+            System.out.println(" ProMsgJniBench: ProMsgJni.init() failed");
+
+            return;
+        }
+
+        if (bench.setup())
+        {
+            if (args[0].equals("recv"))
+            {
+                bench.benchRecv();
+            }
+            else if (args[0].equals("direct"))
+            {
+                bench.benchDirect();
+            }
+            else if (args[0].equals("send"))
+            {
+                bench.benchSend();
+            }
+            else if (args[0].equals("batch"))
+            {
+                bench.benchBatch();
+            }
+            else
+            {
+                bench.benchPacked();
+            }
+        }
+
+        bench.teardown();
+        ProMsgJni.fini();
+    }
+}
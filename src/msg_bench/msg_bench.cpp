@@ -0,0 +1,1324 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+/*
+ * msg_bench starts a CMsgServer on loopback, connects N CMsgClient2 to it
+ * over one or more reactors, and measures:
+ *
+ * e2e   : msgs/s, bytes/s and the end-to-end latency of client-to-client
+ *         messages with a given size, fan-out and rate
+ * csend : CMsgClient::SendMsg2() calls/s with 1 ~ N concurrent threads
+ * ssend : CMsgServer::SendMsg2() calls/s with 1 ~ N concurrent threads
+ * storm : handshakes/s after all clients but 2 are kicked out at once, and
+ *         the latency between the 2 remaining clients meanwhile. every user
+ *         check takes auth_delay, so msgs_auth_threads 0 and > 0 can be
+ *         compared. with msgs_auth_threads > 0, a client gets in on the
+ *         retry after its check
+ * pin   : e2e with unpinned reactors, and then with the reactors pinned to
+ *         server_cpus/client_cpus (or msgs_reactor_cpus/msgc_reactor_cpus)
+ */
+
+#include "msg_bench.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_net.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_time_util.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include "../pro_msg/msg_affinity.h"
+#include "../pro_msg/msg_client2.h"
+#include "../pro_msg/msg_server.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define BENCH_CLASS_ID      2
+#define BENCH_USER_ID_BASE  1000000
+#define BENCH_LOGIN_TIMEOUT 60
+#define BENCH_DOWNTIME      2000 /* ms, for restart */
+#define BENCH_SAMPLE        100  /* ms, for restart */
+
+struct BENCH_ENV
+{
+    BENCH_ENV()
+    {
+        serverReactor = NULL;
+        server        = NULL;
+    }
+
+    IProReactor*                 serverReactor;
+    CMsgServer*                  server;
+    CProStlVector<IProReactor*>  clientReactors;
+    CProStlVector<CMsgClient2*>  clients;
+    CProStlVector<CBenchClient*> observers;
+    CProStlVector<RTP_MSG_USER>  users;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static
+int64_t
+NowUs_i()
+{
+    return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static
+void
+PrintUsage_i()
+{
+    printf(
+        "\n"
+        " usage: msg_bench [options] \n"
+        "\n"
+        "  -m <mode>         e2e | csend | ssend | sendv | storm | pin | restart, default: e2e \n"
+        "  -S <file>         server config file, default: ../cfg/msg_server.cfg \n"
+        "  -C <file>         client config file, default: ../cfg/msg_client.cfg \n"
+        "  -p <port>         server port, default: 3100 \n"
+        "  -st <threads>     server reactor threads, default: 4 \n"
+        "  -n <count>        client count, default: 100 \n"
+        "  -cr <count>       client reactors, default: 1 \n"
+        "  -ct <threads>     threads per client reactor, default: 4 \n"
+        "  -t <threads>      sender threads (e2e), default: 1 \n"
+        "  -s <bytes>        message size (>= 8), default: 64 \n"
+        "  -f <count>        fan-out (dstUserCount, 1 ~ 255), default: 1 \n"
+        "  -r <msgs/s>       total send rate, 0 for unlimited, default: 0 \n"
+        "  -d <seconds>      duration, default: 10 \n"
+        "  -x <threads>      max concurrent threads (csend/ssend), default: 16 \n"
+        "  -g <count>        segments per message (sendv), default: 4 \n"
+        "  -ad <us>          delay of every user check (storm, restart), default: 2000 \n"
+        "  -cb <bytes>       client coalescing bytes, default: msgc_coalesce_bytes \n"
+        "  -rb <seconds>     client reconnect backoff, 0 for none, default: msgc_reconnect_backoff \n"
+        "  -sc <cpus>        server reactor CPUs, e.g., 0-3,8, default: msgs_reactor_cpus \n"
+        "  -cc <cpus>        client reactor CPUs, e.g., 4-7, default: msgc_reactor_cpus \n"
+        "\n"
+        );
+}
+
+static
+bool
+ReadArgs_i(int                    argc,
+           char*                  argv[],
+           MSG_BENCH_CONFIG_INFO& configInfo)
+{
+    CProStlVector<unsigned int> cpus;
+
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+
+        const char* name   = argv[i];
+        const char* value  = argv[i + 1];
+        int         value2 = atoi(value);
+
+        if (strcmp(name, "-m") == 0)
+        {
+            configInfo.mode = value;
+        }
+        else if (strcmp(name, "-S") == 0)
+        {
+            configInfo.server_config = value;
+        }
+        else if (strcmp(name, "-C") == 0)
+        {
+            configInfo.client_config = value;
+        }
+        else if (strcmp(name, "-p") == 0 && value2 > 0 && value2 <= 65535)
+        {
+            configInfo.server_port = (unsigned short)value2;
+        }
+        else if (strcmp(name, "-st") == 0 && value2 > 0)
+        {
+            configInfo.server_threads = value2;
+        }
+        else if (strcmp(name, "-n") == 0 && value2 > 0)
+        {
+            configInfo.client_count = value2;
+        }
+        else if (strcmp(name, "-cr") == 0 && value2 > 0)
+        {
+            configInfo.client_reactors = value2;
+        }
+        else if (strcmp(name, "-ct") == 0 && value2 > 0)
+        {
+            configInfo.client_threads = value2;
+        }
+        else if (strcmp(name, "-t") == 0 && value2 > 0)
+        {
+            configInfo.sender_threads = value2;
+        }
+        else if (strcmp(name, "-s") == 0 && value2 >= 8)
+        {
+            configInfo.msg_size = value2;
+        }
+        else if (strcmp(name, "-f") == 0 && value2 > 0 && value2 <= 255)
+        {
+            configInfo.fanout = value2;
+        }
+        else if (strcmp(name, "-r") == 0 && value2 >= 0)
+        {
+            configInfo.rate = value2;
+        }
+        else if (strcmp(name, "-d") == 0 && value2 > 0)
+        {
+            configInfo.seconds = value2;
+        }
+        else if (strcmp(name, "-x") == 0 && value2 > 0)
+        {
+            configInfo.max_send_threads = value2;
+        }
+        else if (strcmp(name, "-g") == 0 && value2 > 0)
+        {
+            configInfo.segments = value2;
+        }
+        else if (strcmp(name, "-ad") == 0 && value2 >= 0)
+        {
+            configInfo.auth_delay = value2;
+        }
+        else if (strcmp(name, "-cb") == 0 && value2 >= 0)
+        {
+            configInfo.coalesce_bytes = value2;
+        }
+        else if (strcmp(name, "-rb") == 0 && value2 >= 0)
+        {
+            configInfo.backoff = value2;
+        }
+        else if (strcmp(name, "-sc") == 0 && MsgParseCpuList(value, cpus))
+        {
+            configInfo.server_cpus = value;
+        }
+        else if (strcmp(name, "-cc") == 0 && MsgParseCpuList(value, cpus))
+        {
+            configInfo.client_cpus = value;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (configInfo.mode != "e2e" && configInfo.mode != "csend" && configInfo.mode != "ssend" &&
+        configInfo.mode != "sendv" && configInfo.mode != "storm" && configInfo.mode != "pin" &&
+        configInfo.mode != "restart")
+    {
+        return false;
+    }
+
+    if (configInfo.segments > configInfo.msg_size / 8)
+    {
+        configInfo.segments = configInfo.msg_size / 8;
+    }
+
+    if (configInfo.fanout >= configInfo.client_count)
+    {
+        configInfo.fanout = configInfo.client_count > 1 ? configInfo.client_count - 1 : 1;
+    }
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CBenchHistogram::CBenchHistogram()
+{
+    Reset();
+}
+
+void
+CBenchHistogram::Add(int64_t value)
+{
+    if (value < 0)
+    {
+        value = 0;
+    }
+
+    unsigned int index = 0;
+
+    if (value < 64)
+    {
+        index = (unsigned int)value;
+    }
+    else
+    {
+        unsigned int e = 6;
+        while (e < 40 && (value >> (e + 1)) != 0)
+        {
+            ++e;
+        }
+
+        unsigned int sub = (unsigned int)(value >> (e - 5)) & 31;
+        index = 64 + (e - 6) * 32 + sub;
+    }
+
+    if (index >= BENCH_HISTOGRAM_BUCKETS)
+    {
+        index = BENCH_HISTOGRAM_BUCKETS - 1;
+    }
+
+    m_buckets[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+int64_t
+CBenchHistogram::Percentile(double percent) const
+{
+    uint64_t count = GetCount();
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(count * percent / 100);
+    if (target >= count)
+    {
+        target = count - 1;
+    }
+
+    uint64_t sum = 0;
+
+    for (unsigned int i = 0; i < BENCH_HISTOGRAM_BUCKETS; ++i)
+    {
+        sum += m_buckets[i].load(std::memory_order_relaxed);
+        if (sum > target)
+        {
+            if (i < 64)
+            {
+                return i;
+            }
+
+            unsigned int e   = 6 + (i - 64) / 32;
+            unsigned int sub = (i - 64) % 32;
+
+            return (int64_t)(32 + sub) << (e - 5);
+        }
+    }
+
+    return 0;
+}
+
+uint64_t
+CBenchHistogram::GetCount() const
+{
+    uint64_t count = 0;
+
+    for (unsigned int i = 0; i < BENCH_HISTOGRAM_BUCKETS; ++i)
+    {
+        count += m_buckets[i].load(std::memory_order_relaxed);
+    }
+
+    return count;
+}
+
+void
+CBenchHistogram::Reset()
+{
+    for (unsigned int i = 0; i < BENCH_HISTOGRAM_BUCKETS; ++i)
+    {
+        m_buckets[i] = 0;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CBenchClient*
+CBenchClient::CreateInstance(CBenchHistogram* histogram)
+{
+    return new CBenchClient(histogram);
+}
+
+CBenchClient::CBenchClient(CBenchHistogram* histogram)
+: m_histogram(histogram)
+{
+    m_ok        = false;
+    m_okUs      = 0;
+    m_recvMsgs  = 0;
+    m_recvBytes = 0;
+}
+
+unsigned long
+CBenchClient::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CBenchClient::Release()
+{
+    return CProRefCount::Release();
+}
+
+void
+CBenchClient::OnOkMsg(CMsgClient2*        msgClient,
+                      const RTP_MSG_USER* myUser,
+                      const char*         myPublicIp)
+{
+    m_okUs = NowUs_i();
+    m_ok   = true;
+}
+
+void
+CBenchClient::OnRecvMsg(CMsgClient2*        msgClient,
+                        const void*         buf,
+                        size_t              size,
+                        uint16_t            charset,
+                        const RTP_MSG_USER* srcUser)
+{
+    m_recvMsgs.fetch_add(1, std::memory_order_relaxed);
+    m_recvBytes.fetch_add(size, std::memory_order_relaxed);
+
+    if (size < sizeof(int64_t) || m_histogram == NULL)
+    {
+        return;
+    }
+
+    int64_t sendUs = 0;
+    memcpy(&sendUs, buf, sizeof(int64_t));
+
+    m_histogram->Add(NowUs_i() - sendUs);
+}
+
+void
+CBenchClient::OnCloseMsg(CMsgClient2* msgClient,
+                         int          errorCode,
+                         int          sslCode,
+                         bool         tcpConnected)
+{
+    m_ok = false;
+
+    msgClient->Reconnect();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CBenchServer*
+CBenchServer::CreateInstance(unsigned int authDelayUs)
+{
+    return new CBenchServer(authDelayUs);
+}
+
+CBenchServer::CBenchServer(unsigned int authDelayUs)
+: m_authDelayUs(authDelayUs)
+{
+}
+
+bool
+CBenchServer::OnCheckUser(IRtpMsgServer*      msgServer,
+                          const RTP_MSG_USER* user,
+                          const char*         userPublicIp,
+                          const RTP_MSG_USER* c2sUser, /* = NULL */
+                          const unsigned char hash[32],
+                          const unsigned char nonce[32],
+                          uint64_t*           userId,
+                          uint16_t*           instId,
+                          int64_t*            appData,
+                          bool*               isC2s)
+{
+    if (!IsAuthAsync() && m_authDelayUs > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(m_authDelayUs));
+    }
+
+    return CMsgServer::OnCheckUser(msgServer, user, userPublicIp, c2sUser,
+        hash, nonce, userId, instId, appData, isC2s);
+}
+
+void
+CBenchServer::OnCheckUserAsync(const MSG_AUTH_REQUEST& request)
+{
+    if (m_authDelayUs > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(m_authDelayUs));
+    }
+
+    CMsgServer::OnCheckUserAsync(request);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static
+bool
+Setup_i(const char*                  argv0,
+        const MSG_BENCH_CONFIG_INFO& configInfo,
+        bool                         unpinned,
+        CBenchHistogram*             histogram,
+        BENCH_ENV&                   env)
+{
+    /*
+     * NULL for the config items
+     */
+    CProStlVector<unsigned int>  serverCpus;
+    CProStlVector<unsigned int>  clientCpus;
+    CProStlVector<unsigned int>* serverCpus2 = &serverCpus;
+    CProStlVector<unsigned int>* clientCpus2 = &clientCpus;
+
+    if (!unpinned)
+    {
+        MsgParseCpuList(configInfo.server_cpus.c_str(), serverCpus);
+        MsgParseCpuList(configInfo.client_cpus.c_str(), clientCpus);
+        if (serverCpus.size() == 0)
+        {
+            serverCpus2 = NULL;
+        }
+        if (clientCpus.size() == 0)
+        {
+            clientCpus2 = NULL;
+        }
+    }
+
+    env.serverReactor = CMsgServer::CreateReactor(
+        configInfo.server_threads, argv0, configInfo.server_config.c_str(), serverCpus2);
+    if (env.serverReactor == NULL)
+    {
+        printf(" msg_bench: failed to create the server reactor \n");
+
+        return false;
+    }
+
+    if (configInfo.mode == "storm" || configInfo.mode == "restart")
+    {
+        env.server = CBenchServer::CreateInstance(configInfo.auth_delay);
+    }
+    else
+    {
+        env.server = CMsgServer::CreateInstance();
+    }
+    if (env.server == NULL ||
+        !env.server->Init(env.serverReactor, argv0, configInfo.server_config.c_str(),
+        0, configInfo.server_port))
+    {
+        printf(" msg_bench: failed to start the server, port : %u \n",
+            (unsigned int)configInfo.server_port);
+
+        return false;
+    }
+
+    env.server->SetOutputRedline(1024 * 1024 * 64);
+
+    for (unsigned int i = 0; i < configInfo.client_reactors; ++i)
+    {
+        IProReactor* reactor = CMsgClient::CreateReactor(
+            configInfo.client_threads, argv0, configInfo.client_config.c_str(), clientCpus2);
+        if (reactor == NULL)
+        {
+            printf(" msg_bench: failed to create a client reactor \n");
+
+            return false;
+        }
+
+        env.clientReactors.push_back(reactor);
+    }
+
+    for (unsigned int i = 0; i < configInfo.client_count; ++i)
+    {
+        RTP_MSG_USER user;
+        user.classId = BENCH_CLASS_ID;
+        user.UserId(BENCH_USER_ID_BASE + i);
+        user.instId  = 1;
+
+        CBenchClient* observer = CBenchClient::CreateInstance(histogram);
+        CMsgClient2*  client   = CMsgClient2::CreateInstance();
+        if (observer == NULL || client == NULL)
+        {
+            return false;
+        }
+
+        env.observers.push_back(observer);
+        env.users.push_back(user);
+
+        if (!client->Init(
+            observer,
+            env.clientReactors[i % env.clientReactors.size()],
+            argv0,
+            configInfo.client_config.c_str(),
+            0,
+            configInfo.server_ip.c_str(),
+            configInfo.server_port,
+            &user,
+            NULL,
+            NULL
+            ))
+        {
+            client->Release();
+            printf(" msg_bench: failed to create client %u \n", i);
+
+            return false;
+        }
+
+        client->SetOutputRedline(1024 * 1024 * 64);
+        if (configInfo.coalesce_bytes > 0)
+        {
+            size_t       maxBytes     = 0;
+            size_t       maxMsgs      = 0;
+            unsigned int maxDelayInUs = 0;
+            client->GetCoalescing(&maxBytes, &maxMsgs, &maxDelayInUs);
+            client->SetCoalescing(configInfo.coalesce_bytes, maxMsgs, maxDelayInUs);
+        }
+        if (configInfo.backoff >= 0)
+        {
+            unsigned int intervalInSeconds = 0;
+            client->GetReconnectInterval(&intervalInSeconds, NULL);
+            client->SetReconnectInterval(intervalInSeconds, configInfo.backoff);
+        }
+        env.clients.push_back(client);
+    }
+
+    int64_t deadline = ProGetTickCount64() + BENCH_LOGIN_TIMEOUT * 1000;
+
+    while (1)
+    {
+        unsigned int okCount = 0;
+
+        for (unsigned int i = 0; i < env.observers.size(); ++i)
+        {
+            if (env.observers[i]->IsOk())
+            {
+                ++okCount;
+            }
+        }
+
+        if (okCount == configInfo.client_count)
+        {
+            break;
+        }
+
+        if (ProGetTickCount64() > deadline)
+        {
+            printf(" msg_bench: only %u of %u clients logged in \n",
+                okCount, configInfo.client_count);
+
+            return false;
+        }
+
+        ProSleep(100);
+    }
+
+    return true;
+}
+
+static
+void
+Teardown_i(BENCH_ENV& env)
+{
+    for (unsigned int i = 0; i < env.clients.size(); ++i)
+    {
+        env.clients[i]->Fini();
+        env.clients[i]->Release();
+    }
+
+    for (unsigned int i = 0; i < env.observers.size(); ++i)
+    {
+        env.observers[i]->Release();
+    }
+
+    if (env.server != NULL)
+    {
+        env.server->Fini();
+        env.server->Release();
+    }
+
+    for (unsigned int i = 0; i < env.clientReactors.size(); ++i)
+    {
+        ProDeleteReactor(env.clientReactors[i]);
+    }
+
+    ProDeleteReactor(env.serverReactor);
+
+    env.clients.clear();
+    env.observers.clear();
+    env.users.clear();
+    env.clientReactors.clear();
+    env.server        = NULL;
+    env.serverReactor = NULL;
+}
+
+/*
+ * client-to-client messages are relayed below CMsgServer, so only ssend
+ * counts messages here
+ */
+static
+void
+PrintMetrics_i(const BENCH_ENV& env)
+{
+    MSG_SERVER_METRICS metrics;
+    env.server->GetMetrics(metrics);
+
+    printf(
+        "\n"
+        " server metrics: \n"
+        "\t handshakes : %llu ok, %llu failed \n"
+        "\t users      : %llu (closes : %llu, kickouts : %llu) \n"
+        "\t msgs       : %llu in, %llu out (redline drops : %llu) \n"
+        "\t bytes      : %llu in, %llu out \n"
+        ,
+        (unsigned long long)metrics.handshakesOk,
+        (unsigned long long)metrics.handshakesFailed,
+        (unsigned long long)metrics.users,
+        (unsigned long long)metrics.closes,
+        (unsigned long long)metrics.kickouts,
+        (unsigned long long)metrics.msgsIn,
+        (unsigned long long)metrics.msgsOut,
+        (unsigned long long)metrics.redlineDrops,
+        (unsigned long long)metrics.bytesIn,
+        (unsigned long long)metrics.bytesOut
+        );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static
+void
+RunE2e_i(const MSG_BENCH_CONFIG_INFO& configInfo,
+         CBenchHistogram&             histogram,
+         BENCH_ENV&                   env)
+{
+    std::atomic<uint64_t> sentMsgs(0);
+    std::atomic<uint64_t> failedMsgs(0);
+    CProStlVector<std::thread> threads;
+
+    const unsigned int senderCount   = configInfo.sender_threads;
+    const unsigned int clientCount   = (unsigned int)env.clients.size();
+    const double       ratePerThread = (double)configInfo.rate / senderCount;
+    const int64_t      startUs       = NowUs_i();
+    const int64_t      endUs         = startUs + (int64_t)configInfo.seconds * 1000000;
+
+    histogram.Reset();
+
+    for (unsigned int t = 0; t < senderCount; ++t)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            CProStlVector<char>         buf(configInfo.msg_size, 'x');
+            CProStlVector<RTP_MSG_USER> dstUsers(configInfo.fanout);
+            uint64_t                    sent = 0;
+            unsigned int                i    = t % clientCount;
+
+            while (1)
+            {
+                int64_t nowUs = NowUs_i();
+                if (nowUs >= endUs)
+                {
+                    break;
+                }
+
+                if (ratePerThread > 0 && sent >= (uint64_t)(ratePerThread * (nowUs - startUs) / 1000000))
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    continue;
+                }
+
+                /*
+                 * sender i, receivers i+1 ~ i+fanout
+                 */
+                for (unsigned int j = 0; j < configInfo.fanout; ++j)
+                {
+                    dstUsers[j] = env.users[(i + 1 + j) % clientCount];
+                }
+
+                memcpy(&buf[0], &nowUs, sizeof(int64_t));
+
+                if (env.clients[i]->SendMsg(&buf[0], buf.size(), 0,
+                    &dstUsers[0], (unsigned char)dstUsers.size()))
+                {
+                    sentMsgs.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    failedMsgs.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                ++sent;
+                i += senderCount;
+                if (i >= clientCount)
+                {
+                    i = t % clientCount;
+                }
+            }
+        }));
+    }
+
+    for (unsigned int t = 0; t < threads.size(); ++t)
+    {
+        threads[t].join();
+    }
+
+    /*
+     * let the queued messages drain
+     */
+    ProSleep(1000);
+
+    uint64_t recvMsgs  = 0;
+    uint64_t recvBytes = 0;
+
+    for (unsigned int i = 0; i < env.observers.size(); ++i)
+    {
+        recvMsgs  += env.observers[i]->GetRecvMsgs();
+        recvBytes += env.observers[i]->GetRecvBytes();
+    }
+
+    double seconds = (double)configInfo.seconds;
+
+    printf(
+        "\n"
+        " e2e: clients : %u, size : %u, fanout : %u, rate : %u, seconds : %u \n"
+        "\t sent     : %llu (failed : %llu) \n"
+        "\t received : %llu \n"
+        "\t msgs/s   : %.0f \n"
+        "\t bytes/s  : %.0f \n"
+        "\t latency  : p50 %lld us, p99 %lld us, p999 %lld us \n"
+        ,
+        clientCount,
+        configInfo.msg_size,
+        configInfo.fanout,
+        configInfo.rate,
+        configInfo.seconds,
+        (unsigned long long)sentMsgs.load(),
+        (unsigned long long)failedMsgs.load(),
+        (unsigned long long)recvMsgs,
+        recvMsgs / seconds,
+        recvBytes / seconds,
+        (long long)histogram.Percentile(50),
+        (long long)histogram.Percentile(99),
+        (long long)histogram.Percentile(99.9)
+        );
+}
+
+static
+void
+RunSend_i(const MSG_BENCH_CONFIG_INFO& configInfo,
+          BENCH_ENV&                   env)
+{
+    const bool fromServer = configInfo.mode == "ssend";
+
+    printf("\n %s: SendMsg2() calls/s with concurrent threads \n", configInfo.mode.c_str());
+
+    for (unsigned int threadCount = 1; threadCount <= configInfo.max_send_threads;
+        threadCount *= 2)
+    {
+        std::atomic<uint64_t>      calls(0);
+        std::atomic<uint64_t>      okCalls(0);
+        CProStlVector<std::thread> threads;
+
+        const int64_t endUs = NowUs_i() + (int64_t)configInfo.seconds * 1000000;
+
+        for (unsigned int t = 0; t < threadCount; ++t)
+        {
+            threads.push_back(std::thread([&]()
+            {
+                CProStlVector<char> buf(configInfo.msg_size, 'x');
+                const RTP_MSG_USER& dstUser = env.users[env.users.size() - 1];
+                uint64_t            n       = 0;
+                uint64_t            ok      = 0;
+
+                while (1)
+                {
+                    int64_t nowUs = NowUs_i();
+                    if (nowUs >= endUs)
+                    {
+                        break;
+                    }
+
+                    memcpy(&buf[0], &nowUs, sizeof(int64_t));
+
+                    bool ret = fromServer
+                        ? env.server->SendMsg(&buf[0], buf.size(), 0, &dstUser, 1)
+                        : env.clients[0]->SendMsg(&buf[0], buf.size(), 0, &dstUser, 1);
+                    ++n;
+                    if (ret)
+                    {
+                        ++ok;
+                    }
+                }
+
+                calls   += n;
+                okCalls += ok;
+            }));
+        }
+
+        for (unsigned int t = 0; t < threads.size(); ++t)
+        {
+            threads[t].join();
+        }
+
+        printf("\t threads : %2u, calls/s : %.0f (ok : %.0f) \n",
+            threadCount,
+            calls.load() / (double)configInfo.seconds,
+            okCalls.load() / (double)configInfo.seconds);
+
+        /*
+         * let the queued messages drain
+         */
+        ProSleep(1000);
+    }
+}
+
+static
+void
+RunSendV_i(const MSG_BENCH_CONFIG_INFO& configInfo,
+           BENCH_ENV&                   env)
+{
+    printf("\n sendv: %u segments, %u bytes in all \n",
+        configInfo.segments, configInfo.msg_size);
+
+    /*
+     * the producer's view of a message: a header with the timestamp and
+     * some fragments that live somewhere else
+     */
+    const unsigned int  segmentSize = configInfo.msg_size / configInfo.segments;
+    CProStlVector<char> fragments(configInfo.msg_size, 'x');
+
+    for (int variant = 0; variant < 2; ++variant)
+    {
+        const bool          useV    = variant == 1;
+        const RTP_MSG_USER& dstUser = env.users[env.users.size() - 1];
+        uint64_t            calls   = 0;
+        uint64_t            okCalls = 0;
+        int64_t             nowUs   = NowUs_i();
+
+        const int64_t endUs = nowUs + (int64_t)configInfo.seconds * 1000000;
+
+        CProStlVector<MSG_SEGMENT> segments(configInfo.segments);
+        CProStlVector<char>        concat;
+
+        while (nowUs < endUs)
+        {
+            memcpy(&fragments[0], &nowUs, sizeof(int64_t));
+
+            for (unsigned int i = 0; i < configInfo.segments; ++i)
+            {
+                segments[i].buf  = &fragments[i * segmentSize];
+                segments[i].size = i + 1 < configInfo.segments
+                    ? segmentSize : configInfo.msg_size - i * segmentSize;
+            }
+
+            bool ret = false;
+
+            if (useV)
+            {
+                ret = env.clients[0]->SendMsgV(
+                    &segments[0], segments.size(), 0, &dstUser, 1);
+            }
+            else
+            {
+                concat.clear();
+
+                for (unsigned int i = 0; i < configInfo.segments; ++i)
+                {
+                    const char* p = (const char*)segments[i].buf;
+                    concat.insert(concat.end(), p, p + segments[i].size);
+                }
+
+                ret = env.clients[0]->SendMsg(&concat[0], concat.size(), 0, &dstUser, 1);
+            }
+
+            ++calls;
+            if (ret)
+            {
+                ++okCalls;
+            }
+
+            nowUs = NowUs_i();
+        }
+
+        printf("\t %-8s : calls/s : %.0f (ok : %.0f) \n",
+            useV ? "SendMsgV" : "concat",
+            calls / (double)configInfo.seconds,
+            okCalls / (double)configInfo.seconds);
+
+        /*
+         * let the queued messages drain
+         */
+        ProSleep(1000);
+    }
+}
+
+static
+void
+RunStorm_i(const MSG_BENCH_CONFIG_INFO& configInfo,
+           CBenchHistogram&             histogram,
+           BENCH_ENV&                   env)
+{
+    const unsigned int clientCount = (unsigned int)env.clients.size();
+    if (clientCount < 3)
+    {
+        printf(" msg_bench: storm needs at least 3 clients \n");
+
+        return;
+    }
+
+    /*
+     * clients[0] keeps sending to clients[1] during the storm
+     */
+    const unsigned int rate = configInfo.rate > 0 ? configInfo.rate : 1000;
+    std::atomic<bool>  stopping(false);
+
+    histogram.Reset();
+
+    std::thread prober([&]()
+    {
+        CProStlVector<char> buf(configInfo.msg_size, 'x');
+        const int64_t       startUs = NowUs_i();
+        uint64_t            sent    = 0;
+
+        while (!stopping.load())
+        {
+            int64_t nowUs = NowUs_i();
+            if (sent >= (uint64_t)((double)rate * (nowUs - startUs) / 1000000))
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+
+            memcpy(&buf[0], &nowUs, sizeof(int64_t));
+            env.clients[0]->SendMsg(&buf[0], buf.size(), 0, &env.users[1], 1);
+            ++sent;
+        }
+    });
+
+    /*
+     * the kicked clients reconnect in CBenchClient::OnCloseMsg()
+     */
+    const int64_t kickUs = NowUs_i();
+
+    for (unsigned int i = 2; i < clientCount; ++i)
+    {
+        env.server->KickoutUser(env.users[i]);
+    }
+
+    int64_t      deadline = ProGetTickCount64() + BENCH_LOGIN_TIMEOUT * 1000;
+    unsigned int okCount  = 0;
+    int64_t      lastOkUs = kickUs;
+
+    while (1)
+    {
+        okCount  = 0;
+        lastOkUs = kickUs;
+
+        for (unsigned int i = 2; i < clientCount; ++i)
+        {
+            const CBenchClient* observer = env.observers[i];
+            if (observer->IsOk() && observer->GetOkUs() > kickUs)
+            {
+                ++okCount;
+                if (observer->GetOkUs() > lastOkUs)
+                {
+                    lastOkUs = observer->GetOkUs();
+                }
+            }
+        }
+
+        if (okCount == clientCount - 2 || ProGetTickCount64() > deadline)
+        {
+            break;
+        }
+
+        ProSleep(10);
+    }
+
+    stopping = true;
+    prober.join();
+
+    double seconds = (lastOkUs - kickUs) / 1000000.0;
+
+    printf(
+        "\n"
+        " storm: clients : %u, auth delay : %u us, auth threads : %s \n"
+        "\t reconnected  : %u of %u \n"
+        "\t seconds      : %.3f \n"
+        "\t handshakes/s : %.0f \n"
+        "\t probe        : %llu msgs, p50 %lld us, p99 %lld us, p999 %lld us \n"
+        ,
+        clientCount,
+        configInfo.auth_delay,
+        env.server->IsAuthAsync() ? "yes" : "no (reactor)",
+        okCount,
+        clientCount - 2,
+        seconds,
+        seconds > 0 ? okCount / seconds : 0.0,
+        (unsigned long long)histogram.GetCount(),
+        (long long)histogram.Percentile(50),
+        (long long)histogram.Percentile(99),
+        (long long)histogram.Percentile(99.9)
+        );
+}
+
+/*
+ * restarts the server, and samples the handshakes it sees while all the
+ * clients come back
+ */
+static
+void
+RunRestart_i(const char*                  argv0,
+             const MSG_BENCH_CONFIG_INFO& configInfo,
+             BENCH_ENV&                   env)
+{
+    const unsigned int clientCount = (unsigned int)env.clients.size();
+
+    env.server->Fini();
+    ProSleep(BENCH_DOWNTIME);
+
+    if (!env.server->Init(env.serverReactor, argv0, configInfo.server_config.c_str(),
+        0, configInfo.server_port))
+    {
+        printf(" msg_bench: failed to restart the server, port : %u \n",
+            (unsigned int)configInfo.server_port);
+
+        return;
+    }
+
+    env.server->SetOutputRedline(1024 * 1024 * 64);
+
+    unsigned int intervalInSeconds    = 0;
+    unsigned int maxIntervalInSeconds = 0;
+    env.clients[0]->GetReconnectInterval(&intervalInSeconds, &maxIntervalInSeconds);
+
+    printf(
+        "\n"
+        " restart: clients : %u, down : %u ms, auth delay : %u us,"
+        " reconnect : %u s, backoff : %u s \n"
+        ,
+        clientCount,
+        (unsigned int)BENCH_DOWNTIME,
+        configInfo.auth_delay,
+        intervalInSeconds,
+        maxIntervalInSeconds
+        );
+
+    MSG_SERVER_METRICS metrics;
+    env.server->GetMetrics(metrics);
+
+    const int64_t startUs     = NowUs_i();
+    const int     sampleCount = (int)configInfo.seconds * 1000 / BENCH_SAMPLE;
+    uint64_t      lastOk      = metrics.handshakesOk;
+    uint64_t      secondOk    = 0;
+    uint64_t      secondPeak  = 0;
+    uint64_t      peak        = 0;
+    int64_t       allOkUs     = 0;
+
+    for (int i = 1; i <= sampleCount; ++i)
+    {
+        int64_t sleepUs = startUs + (int64_t)i * BENCH_SAMPLE * 1000 - NowUs_i();
+        if (sleepUs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(sleepUs));
+        }
+
+        env.server->GetMetrics(metrics);
+
+        const uint64_t ok = metrics.handshakesOk - lastOk;
+        lastOk    = metrics.handshakesOk;
+        secondOk += ok;
+        if (ok > secondPeak)
+        {
+            secondPeak = ok;
+        }
+        if (ok > peak)
+        {
+            peak = ok;
+        }
+
+        unsigned int okCount = 0;
+
+        for (unsigned int j = 0; j < clientCount; ++j)
+        {
+            if (env.observers[j]->IsOk())
+            {
+                ++okCount;
+            }
+        }
+
+        if (okCount == clientCount && allOkUs == 0)
+        {
+            allOkUs = NowUs_i();
+        }
+
+        if (i % (1000 / BENCH_SAMPLE) == 0)
+        {
+            printf("\t %4d s : %6llu handshakes/s, peak %5llu per %u ms, %u clients ok \n",
+                i * BENCH_SAMPLE / 1000,
+                (unsigned long long)secondOk,
+                (unsigned long long)secondPeak,
+                (unsigned int)BENCH_SAMPLE,
+                okCount);
+
+            secondOk   = 0;
+            secondPeak = 0;
+        }
+    }
+
+    if (allOkUs > 0)
+    {
+        printf("\t all back : %.3f s, peak : %llu handshakes per %u ms \n",
+            (allOkUs - startUs) / 1000000.0,
+            (unsigned long long)peak,
+            (unsigned int)BENCH_SAMPLE);
+    }
+    else
+    {
+        printf("\t not all back in %u s, peak : %llu handshakes per %u ms \n",
+            configInfo.seconds,
+            (unsigned long long)peak,
+            (unsigned int)BENCH_SAMPLE);
+    }
+}
+
+static
+bool
+RunPin_i(const char*                  argv0,
+         const MSG_BENCH_CONFIG_INFO& configInfo,
+         CBenchHistogram&             histogram)
+{
+    if (!MsgIsPinningSupported())
+    {
+        printf(" msg_bench: pinning is not supported on this system \n");
+
+        return false;
+    }
+
+    int64_t p50[2]  = { 0, 0 };
+    int64_t p99[2]  = { 0, 0 };
+    int64_t p999[2] = { 0, 0 };
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        /*
+         * another port, so the second server doesn't wait for the first
+         * one's port to be released
+         */
+        MSG_BENCH_CONFIG_INFO configInfo2 = configInfo;
+        configInfo2.server_port = (unsigned short)(configInfo.server_port + pass);
+
+        BENCH_ENV env;
+
+        printf("\n pin: %s reactors \n", pass == 0 ? "unpinned" : "pinned");
+
+        if (!Setup_i(argv0, configInfo2, pass == 0, &histogram, env))
+        {
+            Teardown_i(env);
+
+            return false;
+        }
+
+        RunE2e_i(configInfo2, histogram, env);
+
+        p50[pass]  = histogram.Percentile(50);
+        p99[pass]  = histogram.Percentile(99);
+        p999[pass] = histogram.Percentile(99.9);
+
+        Teardown_i(env);
+    }
+
+    printf(
+        "\n"
+        " pin: server cpus : %s, client cpus : %s \n"
+        "\t unpinned : p50 %lld us, p99 %lld us, p999 %lld us \n"
+        "\t pinned   : p50 %lld us, p99 %lld us, p999 %lld us \n"
+        ,
+        configInfo.server_cpus.empty() ? "(msgs_reactor_cpus)" : configInfo.server_cpus.c_str(),
+        configInfo.client_cpus.empty() ? "(msgc_reactor_cpus)" : configInfo.client_cpus.c_str(),
+        (long long)p50[0],
+        (long long)p99[0],
+        (long long)p999[0],
+        (long long)p50[1],
+        (long long)p99[1],
+        (long long)p999[1]
+        );
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+int main(int argc, char* argv[])
+{
+    MSG_BENCH_CONFIG_INFO configInfo;
+    if (!ReadArgs_i(argc, argv, configInfo))
+    {
+        PrintUsage_i();
+
+        return -1;
+    }
+
+    if (configInfo.mode != "e2e" && configInfo.mode != "storm" && configInfo.mode != "pin" &&
+        configInfo.mode != "restart")
+    {
+        configInfo.client_count = 2;
+    }
+
+    CBenchHistogram* histogram = new CBenchHistogram;
+    BENCH_ENV        env;
+
+    if (configInfo.mode == "pin")
+    {
+        const bool ret = RunPin_i(argv[0], configInfo, *histogram);
+        delete histogram;
+
+        return ret ? 0 : -1;
+    }
+
+    if (!Setup_i(argv[0], configInfo, false, histogram, env))
+    {
+        Teardown_i(env);
+        delete histogram;
+
+        return -1;
+    }
+
+    if (configInfo.mode == "e2e")
+    {
+        RunE2e_i(configInfo, *histogram, env);
+    }
+    else if (configInfo.mode == "sendv")
+    {
+        RunSendV_i(configInfo, env);
+    }
+    else if (configInfo.mode == "storm")
+    {
+        RunStorm_i(configInfo, *histogram, env);
+    }
+    else if (configInfo.mode == "restart")
+    {
+        RunRestart_i(argv[0], configInfo, env);
+    }
+    else
+    {
+        RunSend_i(configInfo, env);
+    }
+
+    PrintMetrics_i(env);
+    Teardown_i(env);
+    delete histogram;
+
+    return 0;
+}
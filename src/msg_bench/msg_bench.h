@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+#if !defined(MSG_BENCH_H)
+#define MSG_BENCH_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include "../pro_msg/msg_client2.h"
+#include "../pro_msg/msg_server.h"
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define BENCH_HISTOGRAM_BUCKETS (64 + 35 * 32)
+
+struct MSG_BENCH_CONFIG_INFO
+{
+    MSG_BENCH_CONFIG_INFO()
+    {
+        mode              = "e2e";
+        server_config     = "../cfg/msg_server.cfg";
+        client_config     = "../cfg/msg_client.cfg";
+        server_ip         = "127.0.0.1";
+        server_port       = 3100;
+        server_threads    = 4;
+        client_count      = 100;
+        client_reactors   = 1;
+        client_threads    = 4;
+        sender_threads    = 1;
+        msg_size          = 64;
+        fanout            = 1;
+        rate              = 0;
+        seconds           = 10;
+        max_send_threads  = 16;
+        segments          = 4;
+        auth_delay        = 2000;
+        coalesce_bytes    = 0;
+        backoff           = -1;
+    }
+
+    CProStlString  mode;             /* e2e, csend, ssend, sendv, storm, pin, restart */
+    CProStlString  server_config;
+    CProStlString  client_config;
+    CProStlString  server_ip;
+    unsigned short server_port;
+    unsigned int   server_threads;
+    unsigned int   client_count;
+    unsigned int   client_reactors;
+    unsigned int   client_threads;   /* per reactor */
+    unsigned int   sender_threads;
+    unsigned int   msg_size;         /* >= 8 */
+    unsigned int   fanout;           /* 1 ~ 255 */
+    unsigned int   rate;             /* msgs/s of all senders, 0 for unlimited */
+    unsigned int   seconds;
+    unsigned int   max_send_threads; /* for csend/ssend */
+    unsigned int   segments;         /* for sendv, 1 ~ msg_size/8 */
+    unsigned int   auth_delay;       /* for storm, microseconds per check */
+    unsigned int   coalesce_bytes;   /* 0 for msgc_coalesce_bytes */
+    int            backoff;          /* -1 for msgc_reconnect_backoff */
+    CProStlString  server_cpus;      /* msgs_reactor_cpus if empty */
+    CProStlString  client_cpus;      /* msgc_reactor_cpus if empty */
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+/*
+ * A log-linear latency histogram in microseconds. Values below 64 have their
+ * own buckets; above that, every power of 2 is split into 32 buckets.
+ */
+class CBenchHistogram
+{
+public:
+
+    CBenchHistogram();
+
+    void Add(int64_t value);
+
+    int64_t Percentile(double percent) const;
+
+    uint64_t GetCount() const;
+
+    void Reset();
+
+private:
+
+    std::atomic<uint64_t> m_buckets[BENCH_HISTOGRAM_BUCKETS];
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CBenchClient : public IMsgClientObserver, public CProRefCount
+{
+public:
+
+    static CBenchClient* CreateInstance(CBenchHistogram* histogram);
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+    bool IsOk() const
+    {
+        return m_ok.load();
+    }
+
+    uint64_t GetRecvMsgs() const
+    {
+        return m_recvMsgs.load();
+    }
+
+    uint64_t GetRecvBytes() const
+    {
+        return m_recvBytes.load();
+    }
+
+    /*
+     * the time of the last OnOkMsg(), in microseconds
+     */
+    int64_t GetOkUs() const
+    {
+        return m_okUs.load();
+    }
+
+private:
+
+    CBenchClient(CBenchHistogram* histogram);
+
+    virtual ~CBenchClient()
+    {
+    }
+
+    virtual void OnOkMsg(
+        CMsgClient2*        msgClient,
+        const RTP_MSG_USER* myUser,
+        const char*         myPublicIp
+        );
+
+    virtual void OnRecvMsg(
+        CMsgClient2*        msgClient,
+        const void*         buf,
+        size_t              size,
+        uint16_t            charset,
+        const RTP_MSG_USER* srcUser
+        );
+
+    virtual void OnCloseMsg(
+        CMsgClient2* msgClient,
+        int          errorCode,
+        int          sslCode,
+        bool         tcpConnected
+        );
+
+    virtual void OnHeartbeatMsg(
+        CMsgClient2* msgClient,
+        int64_t      peerAliveTick
+        )
+    {
+    }
+
+private:
+
+    CBenchHistogram* const m_histogram;
+    std::atomic<bool>      m_ok;
+    std::atomic<int64_t>   m_okUs;
+    std::atomic<uint64_t>  m_recvMsgs;
+    std::atomic<uint64_t>  m_recvBytes;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+/*
+ * A server whose user checks take authDelayUs, as if a credential store
+ * were queried. The delay is spent on the reactor, or on an auth worker if
+ * msgs_auth_threads > 0
+ */
+class CBenchServer : public CMsgServer
+{
+public:
+
+    static CBenchServer* CreateInstance(unsigned int authDelayUs);
+
+private:
+
+    CBenchServer(unsigned int authDelayUs);
+
+    virtual ~CBenchServer()
+    {
+    }
+
+    virtual bool OnCheckUser(
+        IRtpMsgServer*      msgServer,
+        const RTP_MSG_USER* user,
+        const char*         userPublicIp,
+        const RTP_MSG_USER* c2sUser, /* = NULL */
+        const unsigned char hash[32],
+        const unsigned char nonce[32],
+        uint64_t*           userId,
+        uint16_t*           instId,
+        int64_t*            appData,
+        bool*               isC2s
+        );
+
+    virtual void OnCheckUserAsync(const MSG_AUTH_REQUEST& request);
+
+private:
+
+    const unsigned int m_authDelayUs;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_BENCH_H */
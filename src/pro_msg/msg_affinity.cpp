@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "msg_affinity.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_net.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_z.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+IProReactor*
+MsgCreateReactor(unsigned int                       threadCount,
+                 const CProStlVector<unsigned int>& cpus)
+{
+    if (cpus.size() == 0 || !MsgIsPinningSupported())
+    {
+        return ProCreateReactor(threadCount);
+    }
+
+#if defined(__linux__)
+
+    cpu_set_t newSet;
+    cpu_set_t oldSet;
+    CPU_ZERO(&newSet);
+    CPU_ZERO(&oldSet);
+
+    int i = 0;
+    int c = (int)cpus.size();
+
+    for (; i < c; ++i)
+    {
+        if (cpus[i] < CPU_SETSIZE)
+        {
+            CPU_SET(cpus[i], &newSet);
+        }
+    }
+
+    if (CPU_COUNT(&newSet) == 0)
+    {
+        return NULL;
+    }
+
+    const pthread_t self = pthread_self();
+
+    if (pthread_getaffinity_np(self, sizeof(oldSet), &oldSet) != 0 ||
+        pthread_setaffinity_np(self, sizeof(newSet), &newSet) != 0)
+    {
+        return NULL;
+    }
+
+    IProReactor* const reactor = ProCreateReactor(threadCount);
+
+    pthread_setaffinity_np(self, sizeof(oldSet), &oldSet);
+
+    return reactor;
+
+#else  /* __linux__ */
+
+    return NULL;
+
+#endif /* __linux__ */
+}
+
+bool
+MsgIsPinningSupported()
+{
+#if defined(__linux__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool
+MsgParseCpuList(const char*                  text,
+                CProStlVector<unsigned int>& cpus)
+{
+    cpus.clear();
+
+    if (text == NULL)
+    {
+        return true;
+    }
+
+    const char* p = text;
+
+    while (1)
+    {
+        while (*p == ' ' || *p == '\t')
+        {
+            ++p;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+
+        char*               end   = NULL;
+        const unsigned long first = strtoul(p, &end, 10);
+        if (end == p)
+        {
+            cpus.clear();
+
+            return false;
+        }
+
+        unsigned long last = first;
+        p = end;
+
+        if (*p == '-')
+        {
+            ++p;
+            last = strtoul(p, &end, 10);
+            if (end == p || last < first || last - first >= 4096)
+            {
+                cpus.clear();
+
+                return false;
+            }
+
+            p = end;
+        }
+
+        for (unsigned long i = first; i <= last; ++i)
+        {
+            cpus.push_back((unsigned int)i);
+        }
+
+        while (*p == ' ' || *p == '\t')
+        {
+            ++p;
+        }
+        if (*p == ',')
+        {
+            ++p;
+        }
+        else if (*p != '\0')
+        {
+            cpus.clear();
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void*
+MsgAllocLocal(size_t size)
+{
+    if (size == 0)
+    {
+        return NULL;
+    }
+
+#if defined(__linux__)
+
+    /*
+     * untouched anonymous pages, so the first-touch policy of the kernel
+     * decides their node
+     */
+    void* const buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    return buf != MAP_FAILED ? buf : NULL;
+
+#else  /* __linux__ */
+
+    return ProMalloc(size);
+
+#endif /* __linux__ */
+}
+
+void
+MsgFreeLocal(void*  buf,
+             size_t size)
+{
+    if (buf == NULL)
+    {
+        return;
+    }
+
+#if defined(__linux__)
+    munmap(buf, size);
+#else
+    ProFree(buf);
+#endif
+}
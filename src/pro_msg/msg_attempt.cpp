@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+#include "msg_attempt.h"
+#include "msg_client.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgConnectAttempt*
+CMsgConnectAttempt::CreateInstance(CMsgClient* client,
+                                   uint64_t    attemptId)
+{
+    assert(client != NULL);
+    assert(attemptId > 0);
+    if (client == NULL || attemptId == 0)
+    {
+        return NULL;
+    }
+
+    return new CMsgConnectAttempt(client, attemptId);
+}
+
+CMsgConnectAttempt::CMsgConnectAttempt(CMsgClient* client,
+                                       uint64_t    attemptId)
+:
+m_client(client),
+m_attemptId(attemptId),
+m_claimed(false)
+{
+    m_client->AddRef();
+}
+
+CMsgConnectAttempt::~CMsgConnectAttempt()
+{
+    m_client->Release();
+}
+
+unsigned long
+CMsgConnectAttempt::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CMsgConnectAttempt::Release()
+{
+    return CProRefCount::Release();
+}
+
+void
+CMsgConnectAttempt::OnOkMsg(IRtpMsgClient*      msgClient,
+                            const RTP_MSG_USER* myUser,
+                            const char*         myPublicIp)
+{
+    Claim_i(msgClient);
+    m_client->OnOkMsg(msgClient, myUser, myPublicIp);
+}
+
+void
+CMsgConnectAttempt::OnRecvMsg(IRtpMsgClient*      msgClient,
+                              const void*         buf,
+                              size_t              size,
+                              uint16_t            charset,
+                              const RTP_MSG_USER* srcUser)
+{
+    Claim_i(msgClient);
+    m_client->OnRecvMsg(msgClient, buf, size, charset, srcUser);
+}
+
+void
+CMsgConnectAttempt::OnCloseMsg(IRtpMsgClient* msgClient,
+                               int            errorCode,
+                               int            sslCode,
+                               bool           tcpConnected)
+{
+    Claim_i(msgClient);
+    m_client->OnCloseMsg(msgClient, errorCode, sslCode, tcpConnected);
+}
+
+void
+CMsgConnectAttempt::OnHeartbeatMsg(IRtpMsgClient* msgClient,
+                                   int64_t        peerAliveTick)
+{
+    Claim_i(msgClient);
+    m_client->OnHeartbeatMsg(msgClient, peerAliveTick);
+}
+
+void
+CMsgConnectAttempt::Claim_i(IRtpMsgClient* msgClient)
+{
+    if (msgClient == NULL || m_claimed.load())
+    {
+        return;
+    }
+
+    m_client->ClaimConnection(m_attemptId, msgClient);
+    m_claimed = true;
+}
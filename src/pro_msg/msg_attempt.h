@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+/*
+ * The observer of a connection created by CMsgClient::Reconnect_i(). A new
+ * connection can call back before CreateRtpMsgClient() returns it, so each
+ * attempt has its own observer, which tells the client which attempt the
+ * connection belongs to before its first callback. The connection of the
+ * latest attempt is recorded as the pending one then, and CMsgClient::
+ * IsCurrent() never waits for the attempt. A late callback of a superseded
+ * connection is not recorded.
+ */
+
+#if !defined(MSG_ATTEMPT_H)
+#define MSG_ATTEMPT_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgClient;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgConnectAttempt : public IRtpMsgClientObserver, public CProRefCount
+{
+public:
+
+    static CMsgConnectAttempt* CreateInstance(
+        CMsgClient* client,
+        uint64_t    attemptId
+        );
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+private:
+
+    CMsgConnectAttempt(
+        CMsgClient* client,
+        uint64_t    attemptId
+        );
+
+    virtual ~CMsgConnectAttempt();
+
+    virtual void OnOkMsg(
+        IRtpMsgClient*      msgClient,
+        const RTP_MSG_USER* myUser,
+        const char*         myPublicIp
+        );
+
+    virtual void OnRecvMsg(
+        IRtpMsgClient*      msgClient,
+        const void*         buf,
+        size_t              size,
+        uint16_t            charset,
+        const RTP_MSG_USER* srcUser
+        );
+
+    virtual void OnCloseMsg(
+        IRtpMsgClient* msgClient,
+        int            errorCode,
+        int            sslCode,
+        bool           tcpConnected
+        );
+
+    virtual void OnHeartbeatMsg(
+        IRtpMsgClient* msgClient,
+        int64_t        peerAliveTick
+        );
+
+    /*
+     * lock-free after the first callback
+     */
+    void Claim_i(IRtpMsgClient* msgClient);
+
+private:
+
+    CMsgClient* const m_client;
+    const uint64_t    m_attemptId;
+    std::atomic<bool> m_claimed;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_ATTEMPT_H */
@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "msg_auth.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_net.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_time_util.h"
+#include "pronet/pro_timer_factory.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgAuthPool*
+CMsgAuthPool::CreateInstance()
+{
+    return new CMsgAuthPool;
+}
+
+CMsgAuthPool::CMsgAuthPool()
+{
+    m_observer         = NULL;
+    m_reactor          = NULL;
+    m_timerId          = 0;
+    m_queueSize        = 0;
+    m_timeoutInSeconds = 0;
+    m_nextSeq          = 0;
+    m_stopping         = false;
+}
+
+CMsgAuthPool::~CMsgAuthPool()
+{
+    Fini();
+}
+
+bool
+CMsgAuthPool::Init(IMsgAuthObserver* observer,
+                   IProReactor*      reactor,
+                   unsigned int      threadCount,
+                   size_t            queueSize,
+                   unsigned int      timeoutInSeconds)
+{
+    assert(observer != NULL);
+    assert(reactor != NULL);
+    assert(threadCount > 0);
+    assert(queueSize > 0);
+    assert(timeoutInSeconds > 0);
+    if (observer == NULL || reactor == NULL || threadCount == 0 || queueSize == 0 ||
+        timeoutInSeconds == 0)
+    {
+        return false;
+    }
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        assert(m_observer == NULL);
+        assert(m_reactor == NULL);
+        if (m_observer != NULL || m_reactor != NULL)
+        {
+            return false;
+        }
+
+        m_stopping = false;
+    }
+
+    unsigned int i = 0;
+
+    for (; i < threadCount; ++i)
+    {
+        if (!Spawn(false))
+        {
+            break;
+        }
+    }
+
+    bool ret = false;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (i == threadCount)
+        {
+            m_timerId = reactor->SetupTimer(
+                this, MSG_AUTH_CHECK_INTERVAL, MSG_AUTH_CHECK_INTERVAL);
+        }
+
+        if (m_timerId == 0)
+        {
+            m_stopping = true;
+            m_cond.Signal();
+        }
+        else
+        {
+            observer->AddRef();
+            m_observer         = observer;
+            m_reactor          = reactor;
+            m_queueSize        = queueSize;
+            m_timeoutInSeconds = timeoutInSeconds;
+
+            ret = true;
+        }
+    }
+
+    if (!ret)
+    {
+        Wait();
+    }
+
+    return ret;
+}
+
+void
+CMsgAuthPool::Fini()
+{
+    IMsgAuthObserver* observer = NULL;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_observer == NULL || m_reactor == NULL)
+        {
+            return;
+        }
+
+        m_reactor->CancelTimer(m_timerId);
+        m_timerId = 0;
+
+        m_stopping = true;
+        m_cond.Signal();
+    }
+
+    Wait();
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        m_requests.clear();
+
+        while (m_states.size() > 0)
+        {
+            Erase_i(m_states.begin());
+        }
+
+        m_reactor = NULL;
+        observer = m_observer;
+        m_observer = NULL;
+    }
+
+    observer->Release();
+}
+
+unsigned long
+CMsgAuthPool::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CMsgAuthPool::Release()
+{
+    return CProRefCount::Release();
+}
+
+MSG_AUTH_RESULT
+CMsgAuthPool::Check(MSG_AUTH_REQUEST& request)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_observer == NULL || m_reactor == NULL || m_stopping)
+    {
+        return MSG_AUTH_BUSY;
+    }
+
+    CProStlMap<RTP_MSG_USER, MSG_AUTH_STATE>::iterator const itr = m_states.find(request.user);
+    if (itr != m_states.end())
+    {
+        const MSG_AUTH_STATE& state = itr->second;
+        if (!state.done)
+        {
+            return MSG_AUTH_PENDING;
+        }
+
+        if (state.accepted &&
+            CheckRtpServiceData(request.nonce, state.password.c_str(), request.hash))
+        {
+            return MSG_AUTH_OK;
+        }
+
+        /*
+         * the next handshake is checked again, e.g., after a password change
+         */
+        Erase_i(itr);
+
+        return MSG_AUTH_REJECTED;
+    }
+
+    if (m_requests.size() >= m_queueSize)
+    {
+        return MSG_AUTH_BUSY;
+    }
+
+    ++m_nextSeq;
+    request.seq = m_nextSeq;
+
+    MSG_AUTH_STATE& state = m_states[request.user];
+    state.seq      = request.seq;
+    state.tick     = ProGetTickCount64();
+    state.done     = false;
+    state.accepted = false;
+
+    m_requests.push_back(request);
+    m_cond.Signal();
+
+    return MSG_AUTH_PENDING;
+}
+
+void
+CMsgAuthPool::Complete(const MSG_AUTH_REQUEST& request,
+                       const char*             password) /* = NULL */
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_observer == NULL || m_reactor == NULL)
+    {
+        return;
+    }
+
+    CProStlMap<RTP_MSG_USER, MSG_AUTH_STATE>::iterator const itr = m_states.find(request.user);
+    if (itr == m_states.end() || itr->second.seq != request.seq || itr->second.done)
+    {
+        return;
+    }
+
+    MSG_AUTH_STATE& state = itr->second;
+    state.tick     = ProGetTickCount64();
+    state.done     = true;
+    state.accepted =
+        password != NULL && CheckRtpServiceData(request.nonce, password, request.hash);
+    if (state.accepted)
+    {
+        state.password = password;
+    }
+}
+
+void
+CMsgAuthPool::Svc()
+{
+    while (1)
+    {
+        IMsgAuthObserver* observer = NULL;
+        MSG_AUTH_REQUEST  request;
+
+        {
+            CProThreadMutexGuard mon(m_lock);
+
+            while (!m_stopping && m_requests.size() == 0)
+            {
+                m_cond.Waitf(&m_lock);
+            }
+
+            /*
+             * wakes up the next worker, for both the stop and the rest
+             */
+            if (m_stopping)
+            {
+                m_cond.Signal();
+                break;
+            }
+
+            request = m_requests.front();
+            m_requests.pop_front();
+
+            if (m_requests.size() > 0)
+            {
+                m_cond.Signal();
+            }
+
+            m_observer->AddRef();
+            observer = m_observer;
+        }
+
+        observer->OnAuthRequest(request);
+        observer->Release();
+    }
+}
+
+void
+CMsgAuthPool::OnTimer(void*    factory,
+                      uint64_t timerId,
+                      int64_t  tick,
+                      int64_t  userData)
+{
+    assert(factory != NULL);
+    assert(timerId > 0);
+    if (factory == NULL || timerId == 0)
+    {
+        return;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_observer == NULL || m_reactor == NULL)
+    {
+        return;
+    }
+
+    if (timerId != m_timerId)
+    {
+        return;
+    }
+
+    const int64_t timeout = (int64_t)m_timeoutInSeconds * 1000;
+
+    CProStlMap<RTP_MSG_USER, MSG_AUTH_STATE>::iterator       itr = m_states.begin();
+    CProStlMap<RTP_MSG_USER, MSG_AUTH_STATE>::iterator const end = m_states.end();
+
+    while (itr != end)
+    {
+        if (tick - itr->second.tick >= timeout)
+        {
+            Erase_i(itr++);
+        }
+        else
+        {
+            ++itr;
+        }
+    }
+}
+
+void
+CMsgAuthPool::Erase_i(CProStlMap<RTP_MSG_USER, MSG_AUTH_STATE>::iterator itr)
+{
+    CProStlString& password = itr->second.password;
+    if (!password.empty())
+    {
+        ProZeroMemory(&password[0], password.length());
+    }
+
+    m_states.erase(itr);
+}
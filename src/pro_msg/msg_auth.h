@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * The asynchronous authentication of CMsgServer (msgs_auth_threads > 0).
+ *
+ * libpronet wants the verdict of a handshake at once, and a handshake that
+ * is let through is routable at once, so no handshake is let through before
+ * its verdict. OnCheckUser() refuses the first handshake of a user and
+ * queues a MSG_AUTH_REQUEST for it. CMsgServer::AcceptUser() or
+ * CMsgServer::RejectUser() gives the verdict, e.g., by
+ * CMsgServer::OnCheckUserAsync() on a worker.
+ *
+ * An accepted verdict caches the password that the request has been checked
+ * against, and the retry of the client is checked with it on the reactor.
+ * The password still has to be proven by each handshake, so a verdict never
+ * lets another client in as the user. A rejected verdict refuses the next
+ * handshake of the user, and the one after it is checked again.
+ *
+ * Each check has its own sequence number, so a late verdict never settles
+ * another check of the same user. A check without a verdict in
+ * msgs_auth_timeout seconds is dropped, and so is a verdict that is older
+ * than msgs_auth_timeout seconds. It should be longer than the reconnect
+ * interval of the clients, or a retry may come after its verdict is gone.
+ *
+ * The queue is bounded. A handshake is refused without a check when the
+ * queue is full, and the client will try again later.
+ */
+
+#if !defined(____MSG_AUTH_H____)
+#define ____MSG_AUTH_H____
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_timer_factory.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define MSG_AUTH_CHECK_INTERVAL 1000 /* ms */
+
+class IProReactor;
+
+enum MSG_AUTH_RESULT
+{
+    MSG_AUTH_OK       = 0, /* proven with the password of an accepted verdict */
+    MSG_AUTH_REJECTED = 1, /* the password is wrong */
+    MSG_AUTH_PENDING  = 2, /* the user is being checked */
+    MSG_AUTH_BUSY     = 3  /* the queue is full */
+};
+
+struct MSG_AUTH_REQUEST
+{
+    MSG_AUTH_REQUEST()
+    {
+        userPublicIp[0] = '\0';
+        memset(hash, 0, sizeof(hash));
+        memset(nonce, 0, sizeof(nonce));
+        seq = 0;
+    }
+
+    RTP_MSG_USER  user;
+    RTP_MSG_USER  c2sUser;          /* 0-0-0 for a direct user */
+    char          userPublicIp[64];
+    unsigned char hash[32];
+    unsigned char nonce[32];
+    uint64_t      seq;              /* set by CMsgAuthPool::Check() */
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class IMsgAuthObserver
+{
+public:
+
+    virtual ~IMsgAuthObserver() {}
+
+    virtual unsigned long AddRef() = 0;
+
+    virtual unsigned long Release() = 0;
+
+    /*
+     * called on a worker
+     */
+    virtual void OnAuthRequest(const MSG_AUTH_REQUEST& request) = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgAuthPool : public IProOnTimer, public CProThreadBase, public CProRefCount
+{
+public:
+
+    static CMsgAuthPool* CreateInstance();
+
+    bool Init(
+        IMsgAuthObserver* observer,
+        IProReactor*      reactor,
+        unsigned int      threadCount,
+        size_t            queueSize,
+        unsigned int      timeoutInSeconds
+        );
+
+    void Fini();
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+    /*
+     * only MSG_AUTH_OK lets the handshake through. a user without a verdict
+     * gets a check queued, with request.seq set, and MSG_AUTH_PENDING
+     */
+    MSG_AUTH_RESULT Check(MSG_AUTH_REQUEST& request);
+
+    /*
+     * password is the one that the request has been checked against, or
+     * NULL for a rejection. a password that doesn't prove the request is
+     * taken as a rejection, and a verdict for another check of the user is
+     * ignored
+     */
+    void Complete(
+        const MSG_AUTH_REQUEST& request,
+        const char*             password /* = NULL */
+        );
+
+private:
+
+    struct MSG_AUTH_STATE
+    {
+        uint64_t      seq;
+        int64_t       tick;     /* of the check, or of the verdict */
+        bool          done;     /* has a verdict */
+        bool          accepted;
+        CProStlString password; /* of an accepted verdict */
+    };
+
+    CMsgAuthPool();
+
+    virtual ~CMsgAuthPool();
+
+    virtual void Svc();
+
+    virtual void OnTimer(
+        void*    factory,
+        uint64_t timerId,
+        int64_t  tick,
+        int64_t  userData
+        );
+
+    /*
+     * zeroes the password before it's freed
+     */
+    void Erase_i(CProStlMap<RTP_MSG_USER, MSG_AUTH_STATE>::iterator itr);
+
+private:
+
+    IMsgAuthObserver*                        m_observer;
+    IProReactor*                             m_reactor;
+    uint64_t                                 m_timerId;
+    size_t                                   m_queueSize;
+    unsigned int                             m_timeoutInSeconds;
+    uint64_t                                 m_nextSeq;
+    bool                                     m_stopping;
+    CProStlDeque<MSG_AUTH_REQUEST>           m_requests;
+    CProStlMap<RTP_MSG_USER, MSG_AUTH_STATE> m_states;
+    CProThreadMutex                          m_lock;
+    CProThreadMutexCondition                 m_cond;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* ____MSG_AUTH_H____ */
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+#include "msg_buffer.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_z.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define MAX_IDLE_SCRATCH_BYTES (1024 * 64)
+
+static thread_local CProStlVector<char> g_s_scratch;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static
+void
+Gather_i(const MSG_SEGMENT* segments,
+         size_t             segmentCount,
+         const void**       buf,
+         size_t*            size)
+{
+    size_t total = 0;
+
+    for (size_t i = 0; i < segmentCount; ++i)
+    {
+        total += segments[i].size;
+    }
+
+    *buf  = NULL;
+    *size = 0;
+
+    if (total == 0)
+    {
+        return;
+    }
+
+    /*
+     * don't let a single big message pin the memory of a thread
+     */
+    if (total <= MAX_IDLE_SCRATCH_BYTES && g_s_scratch.capacity() > MAX_IDLE_SCRATCH_BYTES)
+    {
+        CProStlVector<char>().swap(g_s_scratch);
+    }
+
+    g_s_scratch.resize(total);
+
+    char* p = &g_s_scratch[0];
+
+    for (size_t i = 0; i < segmentCount; ++i)
+    {
+        if (segments[i].size > 0)
+        {
+            memcpy(p, segments[i].buf, segments[i].size);
+            p += segments[i].size;
+        }
+    }
+
+    *buf  = &g_s_scratch[0];
+    *size = total;
+}
+
+bool
+MsgSegmentsToPair(const MSG_SEGMENT* segments,
+                  size_t             segmentCount,
+                  const void**       buf1,
+                  size_t*            size1,
+                  const void**       buf2,
+                  size_t*            size2)
+{
+    assert(segments != NULL);
+    assert(segmentCount > 0);
+    assert(buf1 != NULL);
+    assert(size1 != NULL);
+    assert(buf2 != NULL);
+    assert(size2 != NULL);
+    if (segments == NULL || segmentCount == 0 ||
+        buf1 == NULL || size1 == NULL || buf2 == NULL || size2 == NULL)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < segmentCount; ++i)
+    {
+        if (segments[i].buf == NULL && segments[i].size > 0)
+        {
+            return false;
+        }
+    }
+
+    *buf1  = NULL;
+    *size1 = 0;
+    *buf2  = NULL;
+    *size2 = 0;
+
+    if (segmentCount == 1)
+    {
+        *buf1  = segments[0].buf;
+        *size1 = segments[0].size;
+    }
+    else if (segmentCount == 2)
+    {
+        *buf1  = segments[0].buf;
+        *size1 = segments[0].size;
+        *buf2  = segments[1].buf;
+        *size2 = segments[1].size;
+    }
+    else if (segments[0].size >= segments[segmentCount - 1].size)
+    {
+        *buf1  = segments[0].buf;
+        *size1 = segments[0].size;
+        Gather_i(segments + 1, segmentCount - 1, buf2, size2);
+    }
+    else
+    {
+        Gather_i(segments, segmentCount - 1, buf1, size1);
+        *buf2  = segments[segmentCount - 1].buf;
+        *size2 = segments[segmentCount - 1].size;
+    }
+
+    /*
+     * SendMsg2() wants a non-empty buf1
+     */
+    if (*size1 == 0)
+    {
+        *buf1  = *buf2;
+        *size1 = *size2;
+        *buf2  = NULL;
+        *size2 = 0;
+    }
+    if (*size2 == 0)
+    {
+        *buf2 = NULL;
+    }
+
+    return *size1 > 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgBuffer*
+CMsgBuffer::CreateInstance(const void* buf1,
+                           size_t      size1,
+                           const void* buf2,  /* = NULL */
+                           size_t      size2) /* = 0 */
+{
+    assert(buf1 != NULL);
+    assert(size1 > 0);
+    if (buf1 == NULL || size1 == 0)
+    {
+        return NULL;
+    }
+
+    if (buf2 == NULL || size2 == 0)
+    {
+        buf2  = NULL;
+        size2 = 0;
+    }
+
+    void* data = ProMalloc(size1 + size2);
+    if (data == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(data, buf1, size1);
+    if (buf2 != NULL)
+    {
+        memcpy((char*)data + size1, buf2, size2);
+    }
+
+    return new CMsgBuffer(data, size1 + size2);
+}
+
+CMsgBuffer::CMsgBuffer(void*  data,
+                       size_t size)
+:
+m_data(data),
+m_size(size)
+{
+}
+
+CMsgBuffer::~CMsgBuffer()
+{
+    ProFree(m_data);
+}
+
+unsigned long
+CMsgBuffer::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CMsgBuffer::Release()
+{
+    return CProRefCount::Release();
+}
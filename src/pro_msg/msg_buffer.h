@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+/*
+ * An immutable, reference-counted message body. It is built once and then
+ * handed to any number of SendBuffer()/PublishBuffer() calls, so a message
+ * that goes to many user lists or groups is neither rebuilt nor copied by
+ * this library. The bytes are freed when the last reference is released.
+ */
+
+#if !defined(____MSG_BUFFER_H____)
+#define ____MSG_BUFFER_H____
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+struct MSG_SEGMENT
+{
+    const void* buf;
+    size_t      size;
+};
+
+/*
+ * Maps segments onto the (buf1, buf2) pair of SendMsg2(). The larger of
+ * the first and the last segment is passed through as it is, and the others
+ * are gathered into a per-thread scratch buffer. The results are valid
+ * until the next call on the same thread.
+ */
+bool
+MsgSegmentsToPair(const MSG_SEGMENT* segments,
+                  size_t             segmentCount,
+                  const void**       buf1,
+                  size_t*            size1,
+                  const void**       buf2,
+                  size_t*            size2);
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgBuffer : public CProRefCount
+{
+public:
+
+    static CMsgBuffer* CreateInstance(
+        const void* buf1,
+        size_t      size1,
+        const void* buf2,  /* = NULL */
+        size_t      size2  /* = 0 */
+        );
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+    const void* GetData() const
+    {
+        return m_data;
+    }
+
+    size_t GetSize() const
+    {
+        return m_size;
+    }
+
+private:
+
+    CMsgBuffer(
+        void*  data,
+        size_t size
+        );
+
+    virtual ~CMsgBuffer();
+
+private:
+
+    void* const  m_data;
+    const size_t m_size;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* ____MSG_BUFFER_H____ */
@@ -17,7 +17,18 @@
  */
 
 #include "msg_client.h"
+#include "msg_affinity.h"
+#include "msg_attempt.h"
+#include "msg_buffer.h"
+#include "msg_client2.h"
+#include "msg_coalesce.h"
+#include "msg_endpoint.h"
+#include "msg_group.h"
+#include "msg_pending.h"
 #include "msg_reconnector.h"
+#include "msg_resolver.h"
+#include "msg_snapshot.h"
+#include "msg_watermark.h"
 #include "pronet/pro_bsd_wrapper.h"
 #include "pronet/pro_config_file.h"
 #include "pronet/pro_memory_pool.h"
@@ -76,6 +87,37 @@ ReadConfig_i(const char*                     argv0,
                 configInfo.msgc_server_port = (unsigned short)value;
             }
         }
+        else if (stricmp(configName.c_str(), "msgc_server_list") == 0)
+        {
+            configInfo.msgc_server_list = configValue;
+        }
+        else if (stricmp(configName.c_str(), "msgc_server_ordered") == 0)
+        {
+            configInfo.msgc_server_ordered = atoi(configValue.c_str()) != 0;
+        }
+        else if (stricmp(configName.c_str(), "msgc_dns_ttl") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value >= 0)
+            {
+                configInfo.msgc_dns_ttl = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgc_hosts_file") == 0)
+        {
+            if (!configValue.empty())
+            {
+                if (configValue[0] == '.' ||
+                    configValue.find_first_of("\\/") == CProStlString::npos)
+                {
+                    CProStlString fileName = exeRoot;
+                    fileName += configValue;
+                    configValue = fileName;
+                }
+            }
+
+            configInfo.msgc_hosts_file = configValue;
+        }
         else if (stricmp(configName.c_str(), "msgc_id") == 0)
         {
             if (!configValue.empty())
@@ -116,6 +158,38 @@ ReadConfig_i(const char*                     argv0,
                 configInfo.msgc_reconnect_interval = value;
             }
         }
+        else if (stricmp(configName.c_str(), "msgc_reconnect_backoff") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value >= 0)
+            {
+                configInfo.msgc_reconnect_backoff = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgc_pending_msgs") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value >= 0)
+            {
+                configInfo.msgc_pending_msgs = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgc_offline_bytes") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value >= 0)
+            {
+                configInfo.msgc_offline_bytes = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgc_offline_age") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value >= 0)
+            {
+                configInfo.msgc_offline_age = value;
+            }
+        }
         else if (stricmp(configName.c_str(), "msgc_redline_bytes") == 0)
         {
             int value = atoi(configValue.c_str());
@@ -124,6 +198,54 @@ ReadConfig_i(const char*                     argv0,
                 configInfo.msgc_redline_bytes = value;
             }
         }
+        else if (stricmp(configName.c_str(), "msgc_output_high_water") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value >= 0)
+            {
+                configInfo.msgc_output_high_water = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgc_output_low_water") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value >= 0)
+            {
+                configInfo.msgc_output_low_water = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgc_reactor_cpus") == 0)
+        {
+            CProStlVector<unsigned int> cpus;
+            if (MsgParseCpuList(configValue.c_str(), cpus))
+            {
+                configInfo.msgc_reactor_cpus = cpus;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgc_coalesce_bytes") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value >= 0 && value <= MSG_COALESCE_MAX_BYTES)
+            {
+                configInfo.msgc_coalesce_bytes = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgc_coalesce_msgs") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value > 1)
+            {
+                configInfo.msgc_coalesce_msgs = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgc_coalesce_delay") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value > 0)
+            {
+                configInfo.msgc_coalesce_delay = value;
+            }
+        }
         else if (stricmp(configName.c_str(), "msgc_enable_ssl") == 0)
         {
             configInfo.msgc_enable_ssl = atoi(configValue.c_str()) != 0;
@@ -182,6 +304,73 @@ ReadConfig_i(const char*                     argv0,
     } /* end of for () */
 }
 
+static
+bool
+LoadConfig_i(const char*             argv0,
+             const char*             configFileName,
+             MSG_CLIENT_CONFIG_INFO& configInfo)
+{
+    assert(configFileName != NULL);
+    assert(configFileName[0] != '\0');
+    if (configFileName == NULL || configFileName[0] == '\0')
+    {
+        return false;
+    }
+
+    char exeRoot[1024] = "";
+    ProGetExeDir_(exeRoot, argv0);
+
+    CProStlString configFileName2 = configFileName;
+    if (configFileName2[0] == '.' ||
+        configFileName2.find_first_of("\\/") == CProStlString::npos)
+    {
+        CProStlString fileName = exeRoot;
+        fileName += configFileName2;
+        configFileName2 = fileName;
+    }
+
+    CProConfigFile configFile;
+    configFile.Init(configFileName2.c_str());
+
+    CProStlVector<PRO_CONFIG_ITEM> configs;
+    if (!configFile.Read(configs))
+    {
+        return false;
+    }
+
+    ReadConfig_i(argv0, configs, configInfo);
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+/*
+ * without a usable connection, the sends are held for the new one, and
+ * they queue up behind the held ones until those are drained
+ */
+static
+bool
+SendMsg2_i(CMsgClientSnapshot* snapshot,
+           const void*         buf1,
+           size_t              size1,
+           const void*         buf2,
+           size_t              size2,
+           uint16_t            charset,
+           const RTP_MSG_USER* dstUsers,
+           unsigned char       dstUserCount)
+{
+    if (snapshot->pending != NULL)
+    {
+        return snapshot->pending->Push(
+            buf1, size1, buf2, size2, charset, dstUsers, dstUserCount);
+    }
+
+    return snapshot->msgClient->SendMsg2(
+        buf1, size1, buf2, size2, charset, dstUsers, dstUserCount);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 ////
 
@@ -191,17 +380,57 @@ CMsgClient::CreateInstance()
     return new CMsgClient;
 }
 
+IProReactor*
+CMsgClient::CreateReactor(unsigned int                       threadCount,
+                          const char*                        argv0,         /* = NULL */
+                          const char*                        configFileName,
+                          const CProStlVector<unsigned int>* cpus)          /* = NULL */
+{
+    assert(threadCount > 0);
+    if (threadCount == 0)
+    {
+        return NULL;
+    }
+
+    if (cpus != NULL)
+    {
+        return MsgCreateReactor(threadCount, *cpus);
+    }
+
+    MSG_CLIENT_CONFIG_INFO configInfo;
+    if (!LoadConfig_i(argv0, configFileName, configInfo))
+    {
+        return NULL;
+    }
+
+    return MsgCreateReactor(threadCount, configInfo.msgc_reactor_cpus);
+}
+
 CMsgClient::CMsgClient()
 {
-    m_reactor     = NULL;
-    m_sslConfig   = NULL;
-    m_msgClient   = NULL;
-    m_reconnector = NULL;
+    m_reactor        = NULL;
+    m_sslConfig      = NULL;
+    m_msgClient      = NULL;
+    m_pendingClient  = NULL;
+    m_attemptId      = 0;
+    m_attemptClaimed = false;
+    m_connected      = false;
+    m_pendingQueue   = NULL;
+    m_observer       = NULL;
+    m_reconnector    = NULL;
+    m_endpoints      = NULL;
+    m_resolver       = NULL;
+    m_watermark      = NULL;
+    m_coalescer      = NULL;
+    m_snapshotSlot   = new CMsgSnapshotSlot;
 }
 
 CMsgClient::~CMsgClient()
 {
     Fini();
+
+    delete m_snapshotSlot;
+    m_snapshotSlot = NULL;
 }
 
 bool
@@ -223,30 +452,12 @@ CMsgClient::Init(IProReactor*        reactor,
         return false;
     }
 
-    char exeRoot[1024] = "";
-    ProGetExeDir_(exeRoot, argv0);
-
-    CProStlString configFileName2 = configFileName;
-    if (configFileName2[0] == '.' ||
-        configFileName2.find_first_of("\\/") == CProStlString::npos)
-    {
-        CProStlString fileName = exeRoot;
-        fileName += configFileName2;
-        configFileName2 = fileName;
-    }
-
-    CProConfigFile configFile;
-    configFile.Init(configFileName2.c_str());
-
-    CProStlVector<PRO_CONFIG_ITEM> configs;
-    if (!configFile.Read(configs))
+    MSG_CLIENT_CONFIG_INFO configInfo;
+    if (!LoadConfig_i(argv0, configFileName, configInfo))
     {
         return false;
     }
 
-    MSG_CLIENT_CONFIG_INFO configInfo;
-    ReadConfig_i(argv0, configs, configInfo);
-
     /*
      * override
      */
@@ -276,24 +487,77 @@ CMsgClient::Init(IProReactor*        reactor,
     }
 
     /*
-     * DNS, for reconnecting
+     * an explicit serverIp replaces msgc_server_list
+     */
+    CProStlVector<MSG_ENDPOINT> endpoints;
+
+    if ((serverIp != NULL && serverIp[0] != '\0') || configInfo.msgc_server_list.empty())
+    {
+        MSG_ENDPOINT endpoint;
+        endpoint.host = configInfo.msgc_server_ip;
+        endpoint.port = configInfo.msgc_server_port;
+        endpoints.push_back(endpoint);
+    }
+    else if (!MsgParseEndpoints(
+        configInfo.msgc_server_list.c_str(), configInfo.msgc_server_port, endpoints))
+    {
+        return false;
+    }
+
+    /*
+     * the endpoints that can't be resolved now are kept without an ip. They
+     * are skipped until Reconnect_i() gets their addresses from the resolver
      */
+    CMsgResolver* const resolver = CMsgResolver::GetInstance();
+    if (resolver == NULL)
+    {
+        return false;
+    }
+
     {
-        uint32_t serverIp2 = pbsd_inet_aton(configInfo.msgc_server_ip.c_str());
-        if (serverIp2 == (uint32_t)-1 || serverIp2 == 0)
+        bool anyIp = false;
+
+        for (int i = 0; i < (int)endpoints.size(); ++i)
         {
-            return false;
+            if (resolver->Resolve(endpoints[i].host.c_str(),
+                configInfo.msgc_hosts_file.c_str(), endpoints[i].ip))
+            {
+                anyIp = true;
+            }
+            else
+            {
+                endpoints[i].ip = "";
+            }
         }
 
-        char serverIpByDNS[64] = "";
-        pbsd_inet_ntoa(serverIp2, serverIpByDNS);
+        if (!anyIp)
+        {
+            CMsgResolver::ReleaseInstance();
+
+            return false;
+        }
+    }
 
-        configInfo.msgc_server_ip = serverIpByDNS;
+    /*
+     * the endpoints are ranked by the user. a user to be assigned by the
+     * server is ranked randomly
+     */
+    uint64_t endpointKey = ((uint64_t)configInfo.msgc_id.classId << 56) |
+        (configInfo.msgc_id.UserId() << 16) | configInfo.msgc_id.instId;
+    if (configInfo.msgc_id.UserId() == 0)
+    {
+        endpointKey ^= ((uint64_t)ProRand_0_32767() << 32) ^ (uint64_t)ProGetTickCount64() ^
+            (uint64_t)(uintptr_t)this;
     }
 
     PRO_SSL_CLIENT_CONFIG* sslConfig   = NULL;
     IRtpMsgClient*         msgClient   = NULL;
+    CMsgEndpointTable*     endpoints2  = NULL;
     CMsgReconnector*       reconnector = NULL;
+    CMsgWatermark*         watermark   = NULL;
+    CMsgCoalescer*         coalescer   = NULL;
+    size_t                 highBytes   = 0;
+    size_t                 lowBytes    = 0;
 
     {
         CProThreadMutexGuard mon(m_lock);
@@ -305,6 +569,8 @@ CMsgClient::Init(IProReactor*        reactor,
         if (m_reactor != NULL || m_sslConfig != NULL || m_msgClient != NULL ||
             m_reconnector != NULL)
         {
+            CMsgResolver::ReleaseInstance();
+
             return false;
         }
 
@@ -377,6 +643,15 @@ CMsgClient::Init(IProReactor*        reactor,
             }
         }
 
+        endpoints2 = new CMsgEndpointTable(
+            endpoints, endpointKey, configInfo.msgc_server_ordered);
+
+        {
+            const MSG_ENDPOINT& endpoint = endpoints2->Connect(ProGetTickCount64());
+            configInfo.msgc_server_ip   = endpoint.ip;
+            configInfo.msgc_server_port = endpoint.port;
+        }
+
         msgClient = CreateRtpMsgClient(
             this,
             reactor,
@@ -405,17 +680,54 @@ CMsgClient::Init(IProReactor*        reactor,
             goto EXIT;
         }
 
+        watermark = CMsgWatermark::CreateInstance();
+        if (!watermark->Init(this, reactor,
+            configInfo.msgc_output_high_water, configInfo.msgc_output_low_water))
+        {
+            goto EXIT;
+        }
+
+        watermark->GetMarks(&highBytes, &lowBytes);
+        configInfo.msgc_output_high_water = (unsigned int)highBytes;
+        configInfo.msgc_output_low_water  = (unsigned int)lowBytes;
+
+        coalescer = CMsgCoalescer::CreateInstance();
+        if (!coalescer->Init(this, reactor, configInfo.msgc_coalesce_bytes,
+            configInfo.msgc_coalesce_msgs, configInfo.msgc_coalesce_delay))
+        {
+            goto EXIT;
+        }
+
         m_reactor       = reactor;
         m_msgConfigInfo = configInfo;
         m_sslConfig     = sslConfig;
         m_msgClient     = msgClient;
         m_reconnector   = reconnector;
+        m_endpoints     = endpoints2;
+        m_resolver      = resolver;
+        m_watermark     = watermark;
+        m_coalescer     = coalescer;
+
+        m_snapshotSlot->Publish(
+            CMsgClientSnapshot::CreateInstance(msgClient, m_observer, watermark, coalescer, NULL));
     }
 
     return true;
 
 EXIT:
 
+    if (coalescer != NULL)
+    {
+        coalescer->Fini();
+        coalescer->Release();
+    }
+
+    if (watermark != NULL)
+    {
+        watermark->Fini();
+        watermark->Release();
+    }
+
     if (reconnector != NULL)
     {
         reconnector->Fini();
@@ -423,7 +735,9 @@ EXIT:
     }
 
     DeleteRtpMsgClient(msgClient);
+    delete endpoints2;
     ProSslClientConfig_Delete(sslConfig);
+    CMsgResolver::ReleaseInstance();
 
     return false;
 }
@@ -431,9 +745,28 @@ EXIT:
 void
 CMsgClient::Fini()
 {
-    PRO_SSL_CLIENT_CONFIG* sslConfig   = NULL;
-    IRtpMsgClient*         msgClient   = NULL;
-    CMsgReconnector*       reconnector = NULL;
+    PRO_SSL_CLIENT_CONFIG* sslConfig     = NULL;
+    IRtpMsgClient*         msgClient     = NULL;
+    IRtpMsgClient*         pendingClient = NULL;
+    CMsgPendingQueue*      pendingQueue  = NULL;
+    IMsgClientObserver*    observer      = NULL;
+    CMsgReconnector*       reconnector   = NULL;
+    CMsgEndpointTable*     endpoints     = NULL;
+    CMsgWatermark*         watermark     = NULL;
+    CMsgCoalescer*         coalescer     = NULL;
+
+    /*
+     * the pending batch goes out while the connection is still there
+     */
+    {
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
+
+        CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+        if (snapshot != NULL && snapshot->coalescer != NULL)
+        {
+            snapshot->coalescer->Flush();
+        }
+    }
 
     {
         CProThreadMutexGuard mon(m_lock);
@@ -443,23 +776,73 @@ CMsgClient::Fini()
             return;
         }
 
+        m_snapshotSlot->Publish(NULL);
+
+        coalescer = m_coalescer;
+        m_coalescer = NULL;
+        watermark = m_watermark;
+        m_watermark = NULL;
+        observer = m_observer;
+        m_observer = NULL;
         reconnector = m_reconnector;
         m_reconnector = NULL;
+        endpoints = m_endpoints;
+        m_endpoints = NULL;
+        m_resolver = NULL;
+        pendingQueue = m_pendingQueue;
+        m_pendingQueue = NULL;
+        pendingClient = m_pendingClient;
+        m_pendingClient = NULL;
         msgClient = m_msgClient;
         m_msgClient = NULL;
+        m_connected = false;
         sslConfig = m_sslConfig;
         m_sslConfig = NULL;
         m_reactor = NULL;
     }
 
+    /*
+     * waits for a Reconnect_i() that is still using m_sslConfig. It'll
+     * find the client gone, and delete its connection by itself
+     */
+    {
+        CProThreadMutexGuard mon(m_connectLock);
+    }
+
     if (reconnector != NULL)
     {
         reconnector->Fini();
         reconnector->Release();
     }
 
+    if (coalescer != NULL)
+    {
+        coalescer->Fini();
+        coalescer->Release();
+    }
+
+    if (watermark != NULL)
+    {
+        watermark->Fini();
+        watermark->Release();
+    }
+
+    DeleteRtpMsgClient(pendingClient);
     DeleteRtpMsgClient(msgClient);
+    delete endpoints;
     ProSslClientConfig_Delete(sslConfig);
+    CMsgResolver::ReleaseInstance();
+
+    if (pendingQueue != NULL)
+    {
+        pendingQueue->Fini();
+        pendingQueue->Release();
+    }
+
+    if (observer != NULL)
+    {
+        observer->Release();
+    }
 }
 
 unsigned long
@@ -494,11 +877,12 @@ CMsgClient::GetUser(RTP_MSG_USER& user) const
     user.Zero();
 
     {
-        CProThreadMutexGuard mon(m_lock);
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        if (m_msgClient != NULL)
+        CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+        if (snapshot != NULL)
         {
-            m_msgClient->GetUser(&user);
+            snapshot->msgClient->GetUser(&user);
         }
     }
 }
@@ -509,11 +893,12 @@ CMsgClient::GetSslSuite(char suiteName[64]) const
     strcpy(suiteName, "NONE");
 
     {
-        CProThreadMutexGuard mon(m_lock);
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        if (m_msgClient != NULL)
+        CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+        if (snapshot != NULL)
         {
-            m_msgClient->GetSslSuite(suiteName);
+            snapshot->msgClient->GetSslSuite(suiteName);
         }
     }
 
@@ -526,11 +911,12 @@ CMsgClient::GetLocalIp(char localIp[64]) const
     strcpy(localIp, "0.0.0.0");
 
     {
-        CProThreadMutexGuard mon(m_lock);
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        if (m_msgClient != NULL)
+        CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+        if (snapshot != NULL)
         {
-            m_msgClient->GetLocalIp(localIp);
+            snapshot->msgClient->GetLocalIp(localIp);
         }
     }
 
@@ -543,11 +929,12 @@ CMsgClient::GetLocalPort() const
     unsigned short localPort = 0;
 
     {
-        CProThreadMutexGuard mon(m_lock);
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        if (m_msgClient != NULL)
+        CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+        if (snapshot != NULL)
         {
-            localPort = m_msgClient->GetLocalPort();
+            localPort = snapshot->msgClient->GetLocalPort();
         }
     }
 
@@ -599,34 +986,84 @@ CMsgClient::SendMsg2(const void*         buf1,
                      const RTP_MSG_USER* dstUsers,
                      unsigned char       dstUserCount)
 {
-    IRtpMsgClient* msgClient = NULL;
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
 
+    CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+    if (snapshot == NULL)
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgClient == NULL)
-        {
-            return false;
-        }
-
-        m_msgClient->AddRef();
-        msgClient = m_msgClient;
+        return false;
     }
 
-    bool ret = msgClient->SendMsg2(buf1, size1, buf2, size2, charset, dstUsers, dstUserCount);
-    msgClient->Release();
-
-    return ret;
-}
+    bool coalesced = false;
 
-void
-CMsgClient::SetOutputRedline(size_t redlineBytes)
-{
-    CProThreadMutexGuard mon(m_lock);
+    CMsgCoalescer* const coalescer = snapshot->coalescer;
+    if (coalescer != NULL && coalescer->IsEnabled())
+    {
+        coalesced = coalescer->Add(buf1, size1, buf2, size2, charset, dstUsers, dstUserCount);
+    }
 
-    if (m_reactor == NULL || m_msgClient == NULL)
+    if (!coalesced && !SendMsg2_i(
+        snapshot, buf1, size1, buf2, size2, charset, dstUsers, dstUserCount))
     {
-        return;
+        return false;
+    }
+
+    /*
+     * the held sends aren't counted, the old connection is going away
+     */
+    CMsgWatermark* const watermark = snapshot->watermark;
+    if (watermark != NULL && watermark->IsEnabled() && snapshot->pending == NULL)
+    {
+        watermark->Check(RTP_MSG_USER(), snapshot->msgClient->GetSendingBytes());
+    }
+
+    return true;
+}
+
+bool
+CMsgClient::SendMsgV(const MSG_SEGMENT*  segments,
+                     size_t              segmentCount,
+                     uint16_t            charset,
+                     const RTP_MSG_USER* dstUsers,
+                     unsigned char       dstUserCount)
+{
+    const void* buf1  = NULL;
+    size_t      size1 = 0;
+    const void* buf2  = NULL;
+    size_t      size2 = 0;
+
+    if (!MsgSegmentsToPair(segments, segmentCount, &buf1, &size1, &buf2, &size2))
+    {
+        return false;
+    }
+
+    return SendMsg2(buf1, size1, buf2, size2, charset, dstUsers, dstUserCount);
+}
+
+bool
+CMsgClient::SendBuffer(const CMsgBuffer*   msgBuffer,
+                       uint16_t            charset,
+                       const RTP_MSG_USER* dstUsers,
+                       unsigned char       dstUserCount)
+{
+    assert(msgBuffer != NULL);
+    if (msgBuffer == NULL)
+    {
+        return false;
+    }
+
+    return SendMsg2(msgBuffer->GetData(), msgBuffer->GetSize(), NULL, 0,
+        charset, dstUsers, dstUserCount);
+}
+
+void
+CMsgClient::SetOutputRedline(size_t redlineBytes)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_reactor == NULL || m_msgClient == NULL)
+    {
+        return;
     }
 
     m_msgClient->SetOutputRedline(redlineBytes);
@@ -653,17 +1090,196 @@ CMsgClient::GetSendingBytes() const
     size_t sendingBytes = 0;
 
     {
-        CProThreadMutexGuard mon(m_lock);
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        if (m_msgClient != NULL)
+        CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+        if (snapshot != NULL)
         {
-            sendingBytes = m_msgClient->GetSendingBytes();
+            sendingBytes = snapshot->msgClient->GetSendingBytes();
         }
     }
 
     return sendingBytes;
 }
 
+void
+CMsgClient::SetOutputWatermarks(size_t highBytes,
+                                size_t lowBytes)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_reactor == NULL || m_watermark == NULL)
+    {
+        return;
+    }
+
+    m_watermark->SetMarks(highBytes, lowBytes);
+    m_watermark->GetMarks(&highBytes, &lowBytes);
+    m_msgConfigInfo.msgc_output_high_water = (unsigned int)highBytes;
+    m_msgConfigInfo.msgc_output_low_water  = (unsigned int)lowBytes;
+}
+
+void
+CMsgClient::GetOutputWatermarks(size_t* highBytes,
+                                size_t* lowBytes) const
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (highBytes != NULL)
+    {
+        *highBytes = m_msgConfigInfo.msgc_output_high_water;
+    }
+    if (lowBytes != NULL)
+    {
+        *lowBytes  = m_msgConfigInfo.msgc_output_low_water;
+    }
+}
+
+void
+CMsgClient::SetCoalescing(size_t       maxBytes,
+                          size_t       maxMsgs,
+                          unsigned int maxDelayInUs)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_reactor == NULL || m_coalescer == NULL)
+    {
+        return;
+    }
+
+    m_coalescer->SetParams(maxBytes, maxMsgs, maxDelayInUs);
+    m_coalescer->GetParams(&maxBytes, &maxMsgs, &maxDelayInUs);
+    m_msgConfigInfo.msgc_coalesce_bytes = (unsigned int)maxBytes;
+    m_msgConfigInfo.msgc_coalesce_msgs  = (unsigned int)maxMsgs;
+    m_msgConfigInfo.msgc_coalesce_delay = maxDelayInUs;
+}
+
+void
+CMsgClient::GetCoalescing(size_t*       maxBytes,
+                          size_t*       maxMsgs,
+                          unsigned int* maxDelayInUs) const
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (maxBytes != NULL)
+    {
+        *maxBytes     = m_msgConfigInfo.msgc_coalesce_bytes;
+    }
+    if (maxMsgs != NULL)
+    {
+        *maxMsgs      = m_msgConfigInfo.msgc_coalesce_msgs;
+    }
+    if (maxDelayInUs != NULL)
+    {
+        *maxDelayInUs = m_msgConfigInfo.msgc_coalesce_delay;
+    }
+}
+
+void
+CMsgClient::SetReconnectInterval(unsigned int intervalInSeconds,
+                                 unsigned int maxIntervalInSeconds)
+{
+    if (intervalInSeconds == 0)
+    {
+        intervalInSeconds = 1;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    m_msgConfigInfo.msgc_reconnect_interval = intervalInSeconds;
+    m_msgConfigInfo.msgc_reconnect_backoff  = maxIntervalInSeconds;
+}
+
+void
+CMsgClient::GetReconnectInterval(unsigned int* intervalInSeconds,
+                                 unsigned int* maxIntervalInSeconds) const
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (intervalInSeconds != NULL)
+    {
+        *intervalInSeconds    = m_msgConfigInfo.msgc_reconnect_interval;
+    }
+    if (maxIntervalInSeconds != NULL)
+    {
+        *maxIntervalInSeconds = m_msgConfigInfo.msgc_reconnect_backoff;
+    }
+}
+
+bool
+CMsgClient::JoinGroup(uint64_t groupId)
+{
+    unsigned char buf[MSG_GROUP_CTRL_SIZE];
+    MsgGroupPackCtrl(MSG_GROUP_OP_JOIN, groupId, buf);
+
+    RTP_MSG_USER server(MSG_GROUP_SERVER_CID, MSG_GROUP_SERVER_UID, 0);
+
+    return SendMsg(buf, sizeof(buf), MSG_GROUP_CTRL_CHARSET, &server, 1);
+}
+
+bool
+CMsgClient::LeaveGroup(uint64_t groupId)
+{
+    unsigned char buf[MSG_GROUP_CTRL_SIZE];
+    MsgGroupPackCtrl(MSG_GROUP_OP_LEAVE, groupId, buf);
+
+    RTP_MSG_USER server(MSG_GROUP_SERVER_CID, MSG_GROUP_SERVER_UID, 0);
+
+    return SendMsg(buf, sizeof(buf), MSG_GROUP_CTRL_CHARSET, &server, 1);
+}
+
+bool
+CMsgClient::IsCurrent(IRtpMsgClient* msgClient) const
+{
+    if (msgClient == NULL)
+    {
+        return false;
+    }
+
+    {
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
+
+        CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+        if (snapshot != NULL && snapshot->msgClient == msgClient)
+        {
+            return true;
+        }
+    }
+
+    /*
+     * a new connection that calls back before Reconnect_i() has recorded
+     * it has been claimed by its CMsgConnectAttempt already
+     */
+    CProThreadMutexGuard mon(m_lock);
+
+    return msgClient == m_pendingClient || msgClient == m_msgClient;
+}
+
+bool
+CMsgClient::UnpackCoalesced(IRtpMsgClient*      msgClient,
+                            const void*         buf,
+                            size_t              size,
+                            uint16_t            charset,
+                            const RTP_MSG_USER* srcUser)
+{
+    if (charset != MSG_COALESCE_CHARSET)
+    {
+        return false;
+    }
+
+    size_t      offset      = 0;
+    const void* item        = NULL;
+    size_t      itemSize    = 0;
+    uint16_t    itemCharset = 0;
+
+    while (MsgCoalesceNext(buf, size, &offset, &item, &itemSize, &itemCharset))
+    {
+        OnRecvMsg(msgClient, item, itemSize, itemCharset, srcUser);
+    }
+
+    return true;
+}
+
 bool
 CMsgClient::Reconnect()
 {
@@ -675,54 +1291,347 @@ CMsgClient::Reconnect()
             return false;
         }
 
-        m_reconnector->Reconnect(m_msgConfigInfo.msgc_reconnect_interval);
+        m_reconnector->Reconnect(
+            m_msgConfigInfo.msgc_reconnect_interval, m_msgConfigInfo.msgc_reconnect_backoff);
     }
 
     return true;
 }
 
+void
+CMsgClient::GetEndpoints(CProStlVector<MSG_ENDPOINT>& endpoints,
+                         size_t*                      current) const
+{
+    endpoints.clear();
+    if (current != NULL)
+    {
+        *current = 0;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_endpoints == NULL)
+    {
+        return;
+    }
+
+    m_endpoints->GetEndpoints(endpoints);
+    if (current != NULL)
+    {
+        *current = m_endpoints->GetCurrent();
+    }
+}
+
+bool
+CMsgClient::AcceptConnection(IRtpMsgClient* msgClient)
+{
+    if (msgClient == NULL)
+    {
+        return false;
+    }
+
+    IRtpMsgClient*    oldMsgClient = NULL;
+    CMsgPendingQueue* pendingQueue = NULL;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_reactor == NULL || m_reconnector == NULL || m_endpoints == NULL)
+        {
+            return false;
+        }
+
+        if (msgClient != m_msgClient && msgClient != m_pendingClient)
+        {
+            return false;
+        }
+
+        m_reconnector->Reset();
+        m_endpoints->SetOk(ProGetTickCount64());
+
+        if (msgClient == m_pendingClient)
+        {
+            oldMsgClient    = m_msgClient;
+            m_msgClient     = msgClient;
+            m_pendingClient = NULL;
+
+            m_snapshotSlot->Publish(CMsgClientSnapshot::CreateInstance(
+                msgClient, m_observer, m_watermark, m_coalescer, m_pendingQueue));
+        }
+
+        m_connected = true;
+
+        /*
+         * the queue stays in the snapshot until it's drained, so the sends
+         * that see the new connection go out behind the held ones. see
+         * OnSendsDrained()
+         */
+        if (m_pendingQueue != NULL)
+        {
+            m_pendingQueue->SetTarget(msgClient);
+            m_pendingQueue->AddRef();
+            pendingQueue = m_pendingQueue;
+        }
+    }
+
+    DeleteRtpMsgClient(oldMsgClient);
+
+    if (pendingQueue != NULL)
+    {
+        pendingQueue->Drain();
+        pendingQueue->Release();
+    }
+
+    return true;
+}
+
+bool
+CMsgClient::LoseConnection(IRtpMsgClient* msgClient)
+{
+    if (!IsCurrent(msgClient))
+    {
+        return false;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_reactor == NULL || msgClient != m_msgClient)
+    {
+        return true;
+    }
+
+    m_connected = false;
+
+    /*
+     * a queue still draining to it holds its messages again
+     */
+    if (m_msgConfigInfo.msgc_offline_bytes > 0 || m_pendingClient != NULL ||
+        m_pendingQueue != NULL)
+    {
+        HoldSends_i();
+    }
+
+    return true;
+}
+
+/*
+ * The new connection is created without m_lock, so the getters and the
+ * settings aren't blocked by the socket and SSL setup. It's swapped in by
+ * AcceptConnection() when its handshake is done; until then, the old one
+ * stays current. The sends keep going to it while it's usable, and are
+ * held in m_pendingQueue otherwise.
+ */
 void
 CMsgClient::Reconnect_i()
 {
-    IRtpMsgClient* oldMsgClient = NULL;
+    MSG_CLIENT_CONFIG_INFO configInfo;
 
     {
         CProThreadMutexGuard mon(m_lock);
 
-        if (m_reactor == NULL || m_reconnector == NULL)
+        if (m_reactor == NULL || m_reconnector == NULL || m_endpoints == NULL)
         {
             return;
         }
 
-        IRtpMsgClient* msgClient = CreateRtpMsgClient(
-            this,
-            m_reactor,
-            m_msgConfigInfo.msgc_mm_type,
-            m_sslConfig,
-            m_msgConfigInfo.msgc_ssl_sni.c_str(),
-            m_msgConfigInfo.msgc_server_ip.c_str(),
-            m_msgConfigInfo.msgc_server_port,
-            &m_msgConfigInfo.msgc_id,
-            m_msgConfigInfo.msgc_password.c_str(),
-            m_msgConfigInfo.msgc_local_ip.c_str(),
-            m_msgConfigInfo.msgc_handshake_timeout
-            );
-        if (msgClient == NULL)
+        /*
+         * the endpoints that have never been resolved are looked up again,
+         * even with msgc_dns_ttl 0, so they can be picked once the resolver
+         * has their addresses
+         */
+        if (m_resolver != NULL)
         {
-            m_reconnector->Reconnect(m_msgConfigInfo.msgc_reconnect_interval);
+            for (size_t i = 0; i < m_endpoints->GetCount(); ++i)
+            {
+                const MSG_ENDPOINT& endpoint = m_endpoints->GetEndpoint(i);
+                if (!endpoint.ip.empty())
+                {
+                    continue;
+                }
 
-            return;
+                CProStlString ip;
+                if (m_resolver->Lookup(endpoint.host.c_str(),
+                    m_msgConfigInfo.msgc_hosts_file.c_str(), m_msgConfigInfo.msgc_dns_ttl, ip))
+                {
+                    m_endpoints->SetIp(i, ip.c_str());
+                }
+            }
+        }
+
+        /*
+         * the previous connection is a failure of its endpoint if it has
+         * never reached OnOkMsg()
+         */
+        const MSG_ENDPOINT& endpoint = m_endpoints->Connect(ProGetTickCount64());
+
+        /*
+         * the freshest cached address. The cache is refreshed in the
+         * background, so the reactor never waits for DNS
+         */
+        CProStlString ip = endpoint.ip;
+        if (m_resolver != NULL && m_msgConfigInfo.msgc_dns_ttl > 0 &&
+            m_resolver->Lookup(endpoint.host.c_str(), m_msgConfigInfo.msgc_hosts_file.c_str(),
+            m_msgConfigInfo.msgc_dns_ttl, ip))
+        {
+            m_endpoints->SetIp(m_endpoints->GetCurrent(), ip.c_str());
         }
 
-        msgClient->SetOutputRedline(m_msgConfigInfo.msgc_redline_bytes);
+        m_msgConfigInfo.msgc_server_ip   = ip;
+        m_msgConfigInfo.msgc_server_port = endpoint.port;
 
-        oldMsgClient = m_msgClient;
-        m_msgClient  = msgClient;
+        configInfo = m_msgConfigInfo;
+
+        if (!m_connected)
+        {
+            HoldSends_i();
+        }
     }
 
+    IRtpMsgClient*      msgClient    = NULL;
+    IRtpMsgClient*      oldMsgClient = NULL;
+    CMsgConnectAttempt* attempt      = NULL;
+
+    {
+        CProThreadMutexGuard mon(m_connectLock);
+
+        IProReactor*           reactor   = NULL;
+        PRO_SSL_CLIENT_CONFIG* sslConfig = NULL;
+        uint64_t               attemptId = 0;
+
+        {
+            CProThreadMutexGuard mon2(m_lock);
+
+            reactor   = m_reactor;
+            sslConfig = m_sslConfig;
+
+            /*
+             * an attempt that is still handshaking is superseded, and the
+             * pending slot is left to the new one. see msg_attempt.h
+             */
+            if (reactor != NULL)
+            {
+                ++m_attemptId;
+                attemptId        = m_attemptId;
+                m_attemptClaimed = false;
+                oldMsgClient     = m_pendingClient;
+                m_pendingClient  = NULL;
+            }
+        }
+
+        /*
+         * Fini() waits for m_connectLock before it deletes m_sslConfig. no
+         * endpoint has an ip yet if msgc_server_ip is empty, and the
+         * reconnector tries again
+         */
+        if (reactor != NULL && !configInfo.msgc_server_ip.empty())
+        {
+            attempt   = CMsgConnectAttempt::CreateInstance(this, attemptId);
+            msgClient = CreateRtpMsgClient(
+                attempt,
+                reactor,
+                configInfo.msgc_mm_type,
+                sslConfig,
+                configInfo.msgc_ssl_sni.c_str(),
+                configInfo.msgc_server_ip.c_str(),
+                configInfo.msgc_server_port,
+                &configInfo.msgc_id,
+                configInfo.msgc_password.c_str(),
+                configInfo.msgc_local_ip.c_str(),
+                configInfo.msgc_handshake_timeout
+                );
+            if (msgClient != NULL)
+            {
+                msgClient->SetOutputRedline(configInfo.msgc_redline_bytes);
+            }
+        }
+
+        {
+            CProThreadMutexGuard mon2(m_lock);
+
+            /*
+             * if Fini() has been called meanwhile, the new connection is
+             * deleted below, unless Fini() has taken it as a claimed one
+             */
+            if (m_reactor != NULL && m_reconnector != NULL)
+            {
+                if (msgClient == NULL)
+                {
+                    m_reconnector->Reconnect(m_msgConfigInfo.msgc_reconnect_interval,
+                        m_msgConfigInfo.msgc_reconnect_backoff);
+                }
+                else
+                {
+                    /*
+                     * a claimed one may have been accepted already
+                     */
+                    if (msgClient != m_msgClient)
+                    {
+                        m_pendingClient = msgClient;
+                    }
+
+                    m_attemptClaimed = true;
+                    msgClient        = NULL;
+                }
+            }
+            else if (m_attemptClaimed)
+            {
+                msgClient = NULL;
+            }
+        }
+    }
+
+    if (attempt != NULL)
+    {
+        attempt->Release();
+    }
+
+    DeleteRtpMsgClient(msgClient);
     DeleteRtpMsgClient(oldMsgClient);
 }
 
+void
+CMsgClient::ClaimConnection(uint64_t       attemptId,
+                            IRtpMsgClient* msgClient)
+{
+    assert(msgClient != NULL);
+    if (msgClient == NULL)
+    {
+        return;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_reactor == NULL || attemptId != m_attemptId || m_attemptClaimed)
+    {
+        return;
+    }
+
+    m_pendingClient  = msgClient;
+    m_attemptClaimed = true;
+}
+
+void
+CMsgClient::HoldSends_i()
+{
+    /*
+     * kept over the attempts until one of them is accepted. one that is
+     * draining to a lost connection holds the rest again
+     */
+    if (m_pendingQueue != NULL)
+    {
+        m_pendingQueue->SetTarget(NULL);
+
+        return;
+    }
+
+    m_pendingQueue = CMsgPendingQueue::CreateInstance(this, m_reactor,
+        m_msgConfigInfo.msgc_pending_msgs, m_msgConfigInfo.msgc_offline_bytes,
+        m_msgConfigInfo.msgc_offline_age);
+
+    m_snapshotSlot->Publish(CMsgClientSnapshot::CreateInstance(
+        m_msgClient, m_observer, m_watermark, m_coalescer, m_pendingQueue));
+}
+
 void
 CMsgClient::OnOkMsg(IRtpMsgClient*      msgClient,
                     const RTP_MSG_USER* myUser,
@@ -737,18 +1646,9 @@ CMsgClient::OnOkMsg(IRtpMsgClient*      msgClient,
         return;
     }
 
+    if (!AcceptConnection(msgClient))
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgClient == NULL)
-        {
-            return;
-        }
-
-        if (msgClient != m_msgClient)
-        {
-            return;
-        }
+        return;
     }
 
     if (0)
@@ -793,18 +1693,14 @@ CMsgClient::OnRecvMsg(IRtpMsgClient*      msgClient,
         return;
     }
 
+    if (!IsCurrent(msgClient))
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgClient == NULL)
-        {
-            return;
-        }
+        return;
+    }
 
-        if (msgClient != m_msgClient)
-        {
-            return;
-        }
+    if (UnpackCoalesced(msgClient, buf, size, charset, srcUser))
+    {
+        return;
     }
 
     if (0)
@@ -847,18 +1743,9 @@ CMsgClient::OnCloseMsg(IRtpMsgClient* msgClient,
         return;
     }
 
+    if (!LoseConnection(msgClient))
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgClient == NULL)
-        {
-            return;
-        }
-
-        if (msgClient != m_msgClient)
-        {
-            return;
-        }
+        return;
     }
 
     if (0)
@@ -887,3 +1774,61 @@ CMsgClient::OnCloseMsg(IRtpMsgClient* msgClient,
             );
     }}}
 }
+
+bool
+CMsgClient::OnCoalescedMsg(const void*         buf,
+                           size_t              size,
+                           uint16_t            charset,
+                           const RTP_MSG_USER* dstUsers,
+                           unsigned char       dstUserCount)
+{
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
+
+    CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+    if (snapshot == NULL)
+    {
+        return false;
+    }
+
+    /*
+     * the watermark is checked by the next SendMsg2()
+     */
+    return SendMsg2_i(snapshot, buf, size, NULL, 0, charset, dstUsers, dstUserCount);
+}
+
+void
+CMsgClient::OnCoalescedDropped(size_t msgCount,
+                               size_t bytes)
+{
+    OnSendDropped(msgCount, bytes);
+}
+
+void
+CMsgClient::OnSendsDrained(CMsgPendingQueue* queue)
+{
+    assert(queue != NULL);
+    if (queue == NULL)
+    {
+        return;
+    }
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_reactor == NULL || queue != m_pendingQueue || !queue->IsDrained())
+        {
+            return;
+        }
+
+        m_pendingQueue = NULL;
+
+        /*
+         * a sender still holding the old snapshot is passed through
+         */
+        m_snapshotSlot->Publish(CMsgClientSnapshot::CreateInstance(
+            m_msgClient, m_observer, m_watermark, m_coalescer, NULL));
+    }
+
+    queue->Fini();
+    queue->Release();
+}
@@ -19,6 +19,11 @@
 #if !defined(____MSG_CLIENT_H____)
 #define ____MSG_CLIENT_H____
 
+#include "msg_buffer.h"
+#include "msg_coalesce.h"
+#include "msg_endpoint.h"
+#include "msg_pending.h"
+#include "msg_watermark.h"
 #include "pronet/pro_memory_pool.h"
 #include "pronet/pro_ref_count.h"
 #include "pronet/pro_ssl_util.h"
@@ -31,7 +36,12 @@
 /////////////////////////////////////////////////////////////////////////////
 ////
 
+class CMsgEndpointTable;
+class CMsgPendingQueue;
 class CMsgReconnector;
+class CMsgResolver;
+class CMsgSnapshotSlot;
+class IMsgClientObserver;
 
 struct MSG_CLIENT_CONFIG_INFO
 {
@@ -40,11 +50,22 @@ struct MSG_CLIENT_CONFIG_INFO
         msgc_mm_type             = RTP_MMT_MSG;
         msgc_server_ip           = "127.0.0.1";
         msgc_server_port         = 3000;
+        msgc_server_ordered      = false;
+        msgc_dns_ttl             = 60;
         msgc_password            = "test";
         msgc_local_ip            = "0.0.0.0";
         msgc_handshake_timeout   = 20;
         msgc_reconnect_interval  = 5;
+        msgc_reconnect_backoff   = 0;
+        msgc_pending_msgs        = 1000;
+        msgc_offline_bytes       = 0;
+        msgc_offline_age         = 60;
         msgc_redline_bytes       = 1024000;
+        msgc_output_high_water   = 0;
+        msgc_output_low_water    = 0;
+        msgc_coalesce_bytes      = 0;
+        msgc_coalesce_msgs       = 64;
+        msgc_coalesce_delay      = 1000;
 
         msgc_enable_ssl          = false;
         msgc_ssl_enable_sha1cert = true;
@@ -70,12 +91,26 @@ struct MSG_CLIENT_CONFIG_INFO
     RTP_MM_TYPE                  msgc_mm_type; /* RTP_MMT_MSG_MIN ~ RTP_MMT_MSG_MAX */
     CProStlString                msgc_server_ip;
     unsigned short               msgc_server_port;
+    CProStlString                msgc_server_list;       /* empty for msgc_server_ip. see msg_endpoint.h */
+    bool                         msgc_server_ordered;
+    unsigned int                 msgc_dns_ttl;           /* seconds, 0 for resolving only once. see msg_resolver.h */
+    CProStlString                msgc_hosts_file;        /* empty for DNS only */
     RTP_MSG_USER                 msgc_id;
     CProStlString                msgc_password;
     CProStlString                msgc_local_ip;
     unsigned int                 msgc_handshake_timeout;
     unsigned int                 msgc_reconnect_interval;
+    unsigned int                 msgc_reconnect_backoff; /* max seconds, 0 for no backoff. see msg_reconnector.h */
+    unsigned int                 msgc_pending_msgs;      /* held while reconnecting. see msg_pending.h */
+    unsigned int                 msgc_offline_bytes;     /* 0 for not holding while disconnected */
+    unsigned int                 msgc_offline_age;       /* seconds, 0 for unlimited */
     unsigned int                 msgc_redline_bytes;
+    unsigned int                 msgc_output_high_water; /* 0 for disabled */
+    unsigned int                 msgc_output_low_water;  /* < msgc_output_high_water */
+    CProStlVector<unsigned int>  msgc_reactor_cpus;      /* empty for unpinned. see CreateReactor() */
+    unsigned int                 msgc_coalesce_bytes;    /* 0 for disabled. see msg_coalesce.h */
+    unsigned int                 msgc_coalesce_msgs;
+    unsigned int                 msgc_coalesce_delay;    /* microseconds */
 
     bool                         msgc_enable_ssl;
     bool                         msgc_ssl_enable_sha1cert;
@@ -90,14 +125,33 @@ struct MSG_CLIENT_CONFIG_INFO
 /////////////////////////////////////////////////////////////////////////////
 ////
 
-class CMsgClient : public IRtpMsgClientObserver, public CProRefCount
+class CMsgClient
+:
+public IRtpMsgClientObserver,
+public IMsgWatermarkObserver,
+public IMsgCoalescerObserver,
+public IMsgPendingObserver,
+public CProRefCount
 {
+    friend class CMsgConnectAttempt;
     friend class CMsgReconnector;
 
 public:
 
     static CMsgClient* CreateInstance();
 
+    /*
+     * creates a reactor for Init(). Its threads are pinned to cpus, or to
+     * msgc_reactor_cpus if cpus is NULL. The caller should delete it with
+     * ProDeleteReactor() after Fini(). see msg_affinity.h
+     */
+    static IProReactor* CreateReactor(
+        unsigned int                       threadCount,
+        const char*                        argv0,         /* = NULL */
+        const char*                        configFileName,
+        const CProStlVector<unsigned int>* cpus           /* = NULL */
+        );
+
     bool Init(
         IProReactor*        reactor,
         const char*         argv0,      /* = NULL */
@@ -148,20 +202,140 @@ public:
         unsigned char       dstUserCount
         );
 
+    /*
+     * segments[0 ~ segmentCount-1] are sent as one message
+     */
+    bool SendMsgV(
+        const MSG_SEGMENT*  segments,
+        size_t              segmentCount,
+        uint16_t            charset,
+        const RTP_MSG_USER* dstUsers,
+        unsigned char       dstUserCount
+        );
+
+    /*
+     * the same msgBuffer can be sent again and again without being copied
+     */
+    bool SendBuffer(
+        const CMsgBuffer*   msgBuffer,
+        uint16_t            charset,
+        const RTP_MSG_USER* dstUsers,
+        unsigned char       dstUserCount
+        );
+
     void SetOutputRedline(size_t redlineBytes);
 
     size_t GetOutputRedline() const;
 
     size_t GetSendingBytes() const;
 
+    /*
+     * OnOutputHighWater() is called once when the queued bytes reach
+     * highBytes, and OnOutputLowWater() is called once when they fall to
+     * lowBytes again. highBytes 0 for disabled
+     */
+    void SetOutputWatermarks(
+        size_t highBytes,
+        size_t lowBytes
+        );
+
+    void GetOutputWatermarks(
+        size_t* highBytes,
+        size_t* lowBytes
+        ) const;
+
+    /*
+     * sends a group control message to the server. the memberships are
+     * dropped by the server when the connection is closed, so join again
+     * in OnOkMsg()
+     */
+    bool JoinGroup(uint64_t groupId);
+
+    bool LeaveGroup(uint64_t groupId);
+
+    /*
+     * packs consecutive small messages to the same destinations into one
+     * message. maxBytes 0 for disabled. see msg_coalesce.h
+     */
+    void SetCoalescing(
+        size_t       maxBytes,
+        size_t       maxMsgs,
+        unsigned int maxDelayInUs
+        );
+
+    void GetCoalescing(
+        size_t*       maxBytes,
+        size_t*       maxMsgs,
+        unsigned int* maxDelayInUs
+        ) const;
+
+    /*
+     * maxIntervalInSeconds is the cap of the exponential backoff, 0 for a
+     * fixed interval. see msg_reconnector.h
+     */
+    void SetReconnectInterval(
+        unsigned int intervalInSeconds,
+        unsigned int maxIntervalInSeconds
+        );
+
+    void GetReconnectInterval(
+        unsigned int* intervalInSeconds,
+        unsigned int* maxIntervalInSeconds
+        ) const;
+
     bool Reconnect();
 
+    /*
+     * the servers with their health. current is the index of the one
+     * being used. see msg_endpoint.h
+     */
+    void GetEndpoints(
+        CProStlVector<MSG_ENDPOINT>& endpoints,
+        size_t*                      current
+        ) const;
+
 protected:
 
     CMsgClient();
 
     virtual ~CMsgClient();
 
+    /*
+     * true if msgClient is the current one of this client, or the one
+     * being connected. lock-free for the current one, and never waits for
+     * a connection being created
+     */
+    bool IsCurrent(IRtpMsgClient* msgClient) const;
+
+    /*
+     * swaps a reconnected msgClient in, and drains the sends held while
+     * reconnecting to it, out of m_lock. Resets the reconnect backoff, and
+     * records the handshake of the endpoint. false if msgClient isn't
+     * IsCurrent(). An override of OnOkMsg() should call it first
+     */
+    bool AcceptConnection(IRtpMsgClient* msgClient);
+
+    /*
+     * starts holding the sends for the next connection if msgClient is the
+     * current one, and msgc_offline_bytes > 0 or a new connection is on the
+     * way. false if msgClient isn't IsCurrent(). An override of OnCloseMsg()
+     * should call it first
+     */
+    bool LoseConnection(IRtpMsgClient* msgClient);
+
+    /*
+     * true if buf is a batch of coalesced messages. Its messages have been
+     * passed to OnRecvMsg() one by one then. An override of OnRecvMsg()
+     * should call it first
+     */
+    bool UnpackCoalesced(
+        IRtpMsgClient*      msgClient,
+        const void*         buf,
+        size_t              size,
+        uint16_t            charset,
+        const RTP_MSG_USER* srcUser
+        );
+
     virtual void OnOkMsg(
         IRtpMsgClient*      msgClient,
         const RTP_MSG_USER* myUser,
@@ -190,19 +364,106 @@ protected:
     {
     }
 
+    /*
+     * for CMsgWatermark. user is ignored, there is only one destination
+     */
+    virtual size_t GetSendingBytes(const RTP_MSG_USER& user) const
+    {
+        return GetSendingBytes();
+    }
+
+    /*
+     * called on the sending thread. user is always 0-0-0
+     */
+    virtual void OnOutputHighWater(
+        const RTP_MSG_USER& user,
+        size_t              sendingBytes
+        )
+    {
+    }
+
+    /*
+     * called on the reactor. user is always 0-0-0
+     */
+    virtual void OnOutputLowWater(
+        const RTP_MSG_USER& user,
+        size_t              sendingBytes
+        )
+    {
+    }
+
+    /*
+     * held sends have been dropped by the limits, or refused by the new
+     * connection, or a coalesced batch has been refused. see msg_pending.h
+     * and msg_coalesce.h
+     */
+    virtual void OnSendDropped(
+        size_t msgCount,
+        size_t bytes
+        )
+    {
+    }
+
 protected:
 
     IProReactor*                     m_reactor;
     MSG_CLIENT_CONFIG_INFO           m_msgConfigInfo;
     PRO_SSL_CLIENT_CONFIG*           m_sslConfig;
     IRtpMsgClient*                   m_msgClient;
+    IRtpMsgClient*                   m_pendingClient;  /* being handshaked */
+    uint64_t                         m_attemptId;      /* of the latest Reconnect_i() */
+    bool                             m_attemptClaimed; /* its connection has been recorded */
+    bool                             m_connected;      /* m_msgClient is handshaked and open */
+    CMsgPendingQueue*                m_pendingQueue;   /* non-NULL until the held sends are drained */
+    IMsgClientObserver*              m_observer;       /* for CMsgClient2 */
     CMsgReconnector*                 m_reconnector;
-    mutable CProRecursiveThreadMutex m_lock;
+    CMsgEndpointTable*               m_endpoints;
+    CMsgResolver*                    m_resolver;       /* shared */
+    CMsgWatermark*                   m_watermark;
+    CMsgCoalescer*                   m_coalescer;
+    CMsgSnapshotSlot*                m_snapshotSlot;   /* for the hot paths */
+    mutable CProRecursiveThreadMutex m_lock;           /* for Init()/Fini()/Reconnect_i() and the settings */
+    mutable CProRecursiveThreadMutex m_connectLock;    /* held by Reconnect_i() while connecting */
 
 private:
 
     void Reconnect_i();
 
+    /*
+     * for CMsgConnectAttempt. records msgClient as the pending one if it's
+     * of the latest attempt
+     */
+    void ClaimConnection(
+        uint64_t       attemptId,
+        IRtpMsgClient* msgClient
+        );
+
+    /*
+     * called with m_lock held
+     */
+    void HoldSends_i();
+
+    /*
+     * for CMsgCoalescer
+     */
+    virtual bool OnCoalescedMsg(
+        const void*         buf,
+        size_t              size,
+        uint16_t            charset,
+        const RTP_MSG_USER* dstUsers,
+        unsigned char       dstUserCount
+        );
+
+    virtual void OnCoalescedDropped(
+        size_t msgCount,
+        size_t bytes
+        );
+
+    /*
+     * for CMsgPendingQueue
+     */
+    virtual void OnSendsDrained(CMsgPendingQueue* queue);
+
     DECLARE_SGI_POOL(0)
 };
 
@@ -18,6 +18,7 @@
 
 #include "msg_client2.h"
 #include "msg_client.h"
+#include "msg_snapshot.h"
 #include "pronet/pro_memory_pool.h"
 #include "pronet/pro_thread_mutex.h"
 #include "pronet/pro_time_util.h"
@@ -36,7 +37,6 @@ CMsgClient2::CreateInstance()
 
 CMsgClient2::CMsgClient2()
 {
-    m_observer = NULL;
 }
 
 CMsgClient2::~CMsgClient2()
@@ -71,14 +71,20 @@ CMsgClient2::Init(IMsgClientObserver* observer,
             return false;
         }
 
+        /*
+         * CMsgClient::Init() publishes the observer with the first snapshot
+         */
+        observer->AddRef();
+        m_observer = observer;
+
         if (!CMsgClient::Init(reactor, argv0, configFileName, mmType,
             serverIp, serverPort, user, password, localIp))
         {
+            m_observer = NULL;
+            observer->Release();
+
             return false;
         }
-
-        observer->AddRef();
-        m_observer = observer;
     }
 
     return true;
@@ -87,22 +93,9 @@ CMsgClient2::Init(IMsgClientObserver* observer,
 void
 CMsgClient2::Fini()
 {
-    IMsgClientObserver* observer = NULL;
-
-    {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_observer == NULL)
-        {
-            return;
-        }
-
-        observer = m_observer;
-        m_observer = NULL;
-    }
-
-    observer->Release();
-
+    /*
+     * the observer is released together with the last snapshot
+     */
     CMsgClient::Fini();
 }
 
@@ -120,25 +113,26 @@ CMsgClient2::OnOkMsg(IRtpMsgClient*      msgClient,
         return;
     }
 
-    IMsgClientObserver* observer = NULL;
-
+    if (!AcceptConnection(msgClient))
     {
-        CProThreadMutexGuard mon(m_lock);
+        return;
+    }
 
-        if (m_observer == NULL || m_msgClient == NULL)
-        {
-            return;
-        }
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        if (msgClient != m_msgClient)
-        {
-            return;
-        }
+    CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+    if (snapshot == NULL || snapshot->observer == NULL)
+    {
+        return;
+    }
 
-        m_observer->AddRef();
-        observer = m_observer;
+    if (msgClient != snapshot->msgClient)
+    {
+        return;
     }
 
+    IMsgClientObserver* observer = snapshot->observer;
+
     if (0)
     {{{
         char suiteName[64] = "";
@@ -165,7 +159,6 @@ CMsgClient2::OnOkMsg(IRtpMsgClient*      msgClient,
     }}}
 
     observer->OnOkMsg(this, myUser, myPublicIp);
-    observer->Release();
 }
 
 void
@@ -184,25 +177,26 @@ CMsgClient2::OnRecvMsg(IRtpMsgClient*      msgClient,
         return;
     }
 
-    IMsgClientObserver* observer = NULL;
-
+    if (UnpackCoalesced(msgClient, buf, size, charset, srcUser))
     {
-        CProThreadMutexGuard mon(m_lock);
+        return;
+    }
 
-        if (m_observer == NULL || m_msgClient == NULL)
-        {
-            return;
-        }
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        if (msgClient != m_msgClient)
-        {
-            return;
-        }
+    CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+    if (snapshot == NULL || snapshot->observer == NULL)
+    {
+        return;
+    }
 
-        m_observer->AddRef();
-        observer = m_observer;
+    if (msgClient != snapshot->msgClient)
+    {
+        return;
     }
 
+    IMsgClientObserver* observer = snapshot->observer;
+
     if (0)
     {{{
         CProStlString msg((char*)buf, size);
@@ -231,7 +225,6 @@ CMsgClient2::OnRecvMsg(IRtpMsgClient*      msgClient,
     }}}
 
     observer->OnRecvMsg(this, buf, size, charset, srcUser);
-    observer->Release();
 }
 
 void
@@ -246,25 +239,24 @@ CMsgClient2::OnCloseMsg(IRtpMsgClient* msgClient,
         return;
     }
 
-    IMsgClientObserver* observer = NULL;
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
 
+    CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+    if (snapshot == NULL || snapshot->observer == NULL)
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_observer == NULL || m_msgClient == NULL)
-        {
-            return;
-        }
-
-        if (msgClient != m_msgClient)
-        {
-            return;
-        }
+        return;
+    }
 
-        m_observer->AddRef();
-        observer = m_observer;
+    /*
+     * a reconnection that fails before its handshake is reported too
+     */
+    if (!LoseConnection(msgClient))
+    {
+        return;
     }
 
+    IMsgClientObserver* observer = snapshot->observer;
+
     if (0)
     {{{
         RTP_MSG_USER myUser;
@@ -292,7 +284,6 @@ CMsgClient2::OnCloseMsg(IRtpMsgClient* msgClient,
     }}}
 
     observer->OnCloseMsg(this, errorCode, sslCode, tcpConnected);
-    observer->Release();
 }
 
 void
@@ -305,25 +296,71 @@ CMsgClient2::OnHeartbeatMsg(IRtpMsgClient* msgClient,
         return;
     }
 
-    IMsgClientObserver* observer = NULL;
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
 
+    CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+    if (snapshot == NULL || snapshot->observer == NULL)
     {
-        CProThreadMutexGuard mon(m_lock);
+        return;
+    }
 
-        if (m_observer == NULL || m_msgClient == NULL)
-        {
-            return;
-        }
+    if (msgClient != snapshot->msgClient)
+    {
+        return;
+    }
 
-        if (msgClient != m_msgClient)
-        {
-            return;
-        }
+    IMsgClientObserver* observer = snapshot->observer;
+
+    observer->OnHeartbeatMsg(this, peerAliveTick);
+}
+
+void
+CMsgClient2::OnOutputHighWater(const RTP_MSG_USER& user,
+                               size_t              sendingBytes)
+{
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        m_observer->AddRef();
-        observer = m_observer;
+    CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+    if (snapshot == NULL || snapshot->observer == NULL)
+    {
+        return;
     }
 
-    observer->OnHeartbeatMsg(this, peerAliveTick);
-    observer->Release();
+    IMsgClientObserver* observer = snapshot->observer;
+
+    observer->OnOutputHighWater(this, sendingBytes);
+}
+
+void
+CMsgClient2::OnOutputLowWater(const RTP_MSG_USER& user,
+                              size_t              sendingBytes)
+{
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
+
+    CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+    if (snapshot == NULL || snapshot->observer == NULL)
+    {
+        return;
+    }
+
+    IMsgClientObserver* observer = snapshot->observer;
+
+    observer->OnOutputLowWater(this, sendingBytes);
+}
+
+void
+CMsgClient2::OnSendDropped(size_t msgCount,
+                           size_t bytes)
+{
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
+
+    CMsgClientSnapshot* snapshot = (CMsgClientSnapshot*)guard.Get();
+    if (snapshot == NULL || snapshot->observer == NULL)
+    {
+        return;
+    }
+
+    IMsgClientObserver* observer = snapshot->observer;
+
+    observer->OnSendDropped(this, msgCount, bytes);
 }
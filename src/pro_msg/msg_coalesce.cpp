@@ -0,0 +1,615 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+#include "msg_coalesce.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_net.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_timer_factory.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <atomic>
+#include <chrono>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static
+int64_t
+NowUs_i()
+{
+    return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static
+void
+AppendRecord_i(CProStlVector<char>& buf,
+               const void*          buf1,
+               size_t               size1,
+               const void*          buf2,
+               size_t               size2,
+               uint16_t             charset)
+{
+    const size_t size   = size1 + size2;
+    const size_t offset = buf.size();
+    buf.resize(offset + MSG_COALESCE_HEADER_SIZE + size);
+
+    unsigned char* const p = (unsigned char*)&buf[offset];
+    p[0] = (unsigned char)(size >> 24);
+    p[1] = (unsigned char)(size >> 16);
+    p[2] = (unsigned char)(size >> 8);
+    p[3] = (unsigned char)size;
+    p[4] = (unsigned char)(charset >> 8);
+    p[5] = (unsigned char)charset;
+    memcpy(p + MSG_COALESCE_HEADER_SIZE, buf1, size1);
+    if (size2 > 0)
+    {
+        memcpy(p + MSG_COALESCE_HEADER_SIZE + size1, buf2, size2);
+    }
+}
+
+bool
+MsgCoalesceNext(const void*  buf,
+                size_t       size,
+                size_t*      offset,
+                const void** item,
+                size_t*      itemSize,
+                uint16_t*    itemCharset)
+{
+    assert(buf != NULL);
+    assert(offset != NULL);
+    assert(item != NULL);
+    assert(itemSize != NULL);
+    assert(itemCharset != NULL);
+    if (buf == NULL || offset == NULL || item == NULL || itemSize == NULL || itemCharset == NULL)
+    {
+        return false;
+    }
+
+    const unsigned char* const p = (const unsigned char*)buf;
+
+    while (*offset + MSG_COALESCE_HEADER_SIZE <= size)
+    {
+        const unsigned char* const q = p + *offset;
+
+        const size_t   size2    = ((size_t)q[0] << 24) | ((size_t)q[1] << 16) |
+                                  ((size_t)q[2] << 8)  |  (size_t)q[3];
+        const uint16_t charset2 = (uint16_t)((q[4] << 8) | q[5]);
+
+        if (size2 > size - *offset - MSG_COALESCE_HEADER_SIZE)
+        {
+            return false;
+        }
+
+        *offset += MSG_COALESCE_HEADER_SIZE + size2;
+
+        /*
+         * a nested batch is never built, so it's skipped
+         */
+        if (size2 == 0 || charset2 == MSG_COALESCE_CHARSET)
+        {
+            continue;
+        }
+
+        *item        = q + MSG_COALESCE_HEADER_SIZE;
+        *itemSize    = size2;
+        *itemCharset = charset2;
+
+        return true;
+    }
+
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgCoalescer*
+CMsgCoalescer::CreateInstance()
+{
+    return new CMsgCoalescer;
+}
+
+CMsgCoalescer::CMsgCoalescer()
+: m_maxBytes(0)
+{
+    m_observer     = NULL;
+    m_reactor      = NULL;
+    m_timerId      = 0;
+    m_maxMsgs      = 0;
+    m_maxDelayInUs = 0;
+    m_msgCount     = 0;
+    m_firstCharset = 0;
+    m_firstUs      = 0;
+    m_dstUserCount = 0;
+    m_sending      = false;
+}
+
+CMsgCoalescer::~CMsgCoalescer()
+{
+    Fini();
+
+    /*
+     * left by a Fini() while another thread was sending
+     */
+    int i = 0;
+    int c = (int)m_batches.size();
+
+    for (; i < c; ++i)
+    {
+        delete m_batches[i];
+    }
+
+    m_batches.clear();
+}
+
+bool
+CMsgCoalescer::Init(IMsgCoalescerObserver* observer,
+                    IProReactor*           reactor,
+                    size_t                 maxBytes,     /* 0 for disabled */
+                    size_t                 maxMsgs,
+                    unsigned int           maxDelayInUs)
+{
+    assert(observer != NULL);
+    assert(reactor != NULL);
+    if (observer == NULL || reactor == NULL)
+    {
+        return false;
+    }
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        assert(m_observer == NULL);
+        assert(m_reactor == NULL);
+        if (m_observer != NULL || m_reactor != NULL)
+        {
+            return false;
+        }
+
+        observer->AddRef();
+        m_observer = observer;
+        m_reactor  = reactor;
+    }
+
+    SetParams(maxBytes, maxMsgs, maxDelayInUs);
+
+    return true;
+}
+
+void
+CMsgCoalescer::Fini()
+{
+    IMsgCoalescerObserver* observer = NULL;
+    IMsgCoalescerObserver* sender   = NULL;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_observer == NULL || m_reactor == NULL)
+        {
+            return;
+        }
+
+        Flush_i();
+        sender = Claim_i();
+
+        m_maxBytes = 0;
+        CProStlVector<char>().swap(m_buf);
+        CProStlVector<char>().swap(m_spareBuf);
+
+        m_reactor = NULL;
+    }
+
+    if (sender != NULL)
+    {
+        Send_i(sender);
+    }
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        observer = m_observer;
+        m_observer = NULL;
+    }
+
+    observer->Release();
+}
+
+unsigned long
+CMsgCoalescer::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CMsgCoalescer::Release()
+{
+    return CProRefCount::Release();
+}
+
+void
+CMsgCoalescer::SetParams(size_t       maxBytes,
+                         size_t       maxMsgs,
+                         unsigned int maxDelayInUs)
+{
+    if (maxBytes > MSG_COALESCE_MAX_BYTES)
+    {
+        maxBytes = MSG_COALESCE_MAX_BYTES;
+    }
+    if (maxMsgs < 2)
+    {
+        maxMsgs = 2;
+    }
+    if (maxDelayInUs == 0)
+    {
+        maxDelayInUs = 1;
+    }
+
+    IMsgCoalescerObserver* sender = NULL;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_observer == NULL || m_reactor == NULL)
+        {
+            return;
+        }
+
+        Flush_i();
+        sender = Claim_i();
+
+        m_maxBytes     = maxBytes;
+        m_maxMsgs      = maxMsgs;
+        m_maxDelayInUs = maxDelayInUs;
+
+        if (maxBytes == 0)
+        {
+            CProStlVector<char>().swap(m_buf);
+            CProStlVector<char>().swap(m_spareBuf);
+        }
+        else
+        {
+            m_buf.reserve(maxBytes);
+        }
+    }
+
+    if (sender != NULL)
+    {
+        Send_i(sender);
+    }
+}
+
+void
+CMsgCoalescer::GetParams(size_t*       maxBytes,
+                         size_t*       maxMsgs,
+                         unsigned int* maxDelayInUs) const
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (maxBytes != NULL)
+    {
+        *maxBytes     = m_maxBytes.load();
+    }
+    if (maxMsgs != NULL)
+    {
+        *maxMsgs      = m_maxMsgs;
+    }
+    if (maxDelayInUs != NULL)
+    {
+        *maxDelayInUs = m_maxDelayInUs;
+    }
+}
+
+bool
+CMsgCoalescer::Add(const void*         buf1,
+                   size_t              size1,
+                   const void*         buf2,  /* = NULL */
+                   size_t              size2, /* = 0 */
+                   uint16_t            charset,
+                   const RTP_MSG_USER* dstUsers,
+                   unsigned char       dstUserCount)
+{
+    if (buf2 == NULL)
+    {
+        size2 = 0;
+    }
+
+    const size_t size       = size1 + size2;
+    const size_t recordSize = MSG_COALESCE_HEADER_SIZE + size;
+
+    IMsgCoalescerObserver* sender = NULL;
+    bool                   ret    = true;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_observer == NULL || m_reactor == NULL)
+        {
+            return false;
+        }
+
+        const size_t maxBytes = m_maxBytes.load();
+
+        if (buf1 == NULL || size1 == 0 || dstUsers == NULL || dstUserCount == 0)
+        {
+            Flush_i();
+            sender = Claim_i();
+            ret    = false;
+        }
+        else if (charset == MSG_COALESCE_CHARSET || recordSize > maxBytes)
+        {
+            Flush_i();
+
+            if (m_sending)
+            {
+                /*
+                 * queued behind the batches being sent, to keep the order
+                 */
+                MSG_COALESCE_BATCH* const batch = new MSG_COALESCE_BATCH;
+                batch->msgCount     = 1;
+                batch->firstCharset = charset;
+                batch->dstUserCount = dstUserCount;
+                for (int i = 0; i < (int)dstUserCount; ++i)
+                {
+                    batch->dstUsers[i] = dstUsers[i];
+                }
+                AppendRecord_i(batch->buf, buf1, size1, buf2, size2, charset);
+
+                m_batches.push_back(batch);
+            }
+            else
+            {
+                sender = Claim_i();
+                ret    = false;
+            }
+        }
+        else
+        {
+            if (m_msgCount > 0)
+            {
+                bool sameDsts = dstUserCount == m_dstUserCount;
+
+                for (int i = 0; sameDsts && i < (int)dstUserCount; ++i)
+                {
+                    sameDsts = dstUsers[i] == m_dstUsers[i];
+                }
+
+                if (!sameDsts || m_buf.size() + recordSize > maxBytes)
+                {
+                    Flush_i();
+                }
+            }
+
+            const int64_t nowUs = NowUs_i();
+
+            if (m_msgCount == 0)
+            {
+                for (int i = 0; i < (int)dstUserCount; ++i)
+                {
+                    m_dstUsers[i] = dstUsers[i];
+                }
+
+                m_dstUserCount = dstUserCount;
+                m_firstCharset = charset;
+                m_firstUs      = nowUs;
+
+                /*
+                 * rounded up to the resolution of the timer
+                 */
+                m_timerId = m_reactor->SetupTimer(this, (m_maxDelayInUs + 999) / 1000, 0);
+            }
+
+            AppendRecord_i(m_buf, buf1, size1, buf2, size2, charset);
+            ++m_msgCount;
+
+            if (m_msgCount >= m_maxMsgs ||
+                m_buf.size() + MSG_COALESCE_HEADER_SIZE >= maxBytes ||
+                nowUs - m_firstUs >= (int64_t)m_maxDelayInUs)
+            {
+                Flush_i();
+            }
+
+            sender = Claim_i();
+        }
+    }
+
+    /*
+     * the caller of a false return sends its message after this, so the
+     * batches before it have been sent by now
+     */
+    if (sender != NULL)
+    {
+        Send_i(sender);
+    }
+
+    return ret;
+}
+
+void
+CMsgCoalescer::Flush()
+{
+    IMsgCoalescerObserver* sender = NULL;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_observer == NULL || m_reactor == NULL)
+        {
+            return;
+        }
+
+        Flush_i();
+        sender = Claim_i();
+    }
+
+    if (sender != NULL)
+    {
+        Send_i(sender);
+    }
+}
+
+void
+CMsgCoalescer::OnTimer(void*    factory,
+                       uint64_t timerId,
+                       int64_t  tick,
+                       int64_t  userData)
+{
+    assert(factory != NULL);
+    assert(timerId > 0);
+    if (factory == NULL || timerId == 0)
+    {
+        return;
+    }
+
+    IMsgCoalescerObserver* sender = NULL;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_observer == NULL || m_reactor == NULL)
+        {
+            return;
+        }
+
+        /*
+         * the batch that armed it may have been flushed already
+         */
+        if (timerId != m_timerId)
+        {
+            return;
+        }
+
+        m_timerId = 0;
+        Flush_i();
+        sender = Claim_i();
+    }
+
+    if (sender != NULL)
+    {
+        Send_i(sender);
+    }
+}
+
+void
+CMsgCoalescer::Flush_i()
+{
+    if (m_timerId != 0)
+    {
+        m_reactor->CancelTimer(m_timerId);
+        m_timerId = 0;
+    }
+
+    if (m_msgCount == 0)
+    {
+        return;
+    }
+
+    MSG_COALESCE_BATCH* const batch = new MSG_COALESCE_BATCH;
+    batch->msgCount     = m_msgCount;
+    batch->firstCharset = m_firstCharset;
+    batch->dstUserCount = m_dstUserCount;
+    for (int i = 0; i < (int)m_dstUserCount; ++i)
+    {
+        batch->dstUsers[i] = m_dstUsers[i];
+    }
+    batch->buf.swap(m_buf);
+
+    m_batches.push_back(batch);
+
+    m_buf.swap(m_spareBuf);
+    m_buf.clear();
+    m_buf.reserve(m_maxBytes.load());
+    m_msgCount     = 0;
+    m_dstUserCount = 0;
+}
+
+IMsgCoalescerObserver*
+CMsgCoalescer::Claim_i()
+{
+    if (m_sending || m_batches.size() == 0)
+    {
+        return NULL;
+    }
+
+    m_sending = true;
+    m_observer->AddRef();
+
+    return m_observer;
+}
+
+void
+CMsgCoalescer::Send_i(IMsgCoalescerObserver* observer)
+{
+    assert(observer != NULL);
+
+    MSG_COALESCE_BATCH* batch = NULL;
+
+    while (1)
+    {
+        {
+            CProThreadMutexGuard mon(m_lock);
+
+            if (batch != NULL && m_spareBuf.capacity() == 0 && m_maxBytes.load() > 0)
+            {
+                batch->buf.clear();
+                batch->buf.swap(m_spareBuf);
+            }
+
+            delete batch;
+            batch = NULL;
+
+            if (m_batches.size() == 0)
+            {
+                m_sending = false;
+                break;
+            }
+
+            batch = m_batches.front();
+            m_batches.pop_front();
+        }
+
+        /*
+         * a batch of one message is sent as it is
+         */
+        bool ret = false;
+        if (batch->msgCount == 1)
+        {
+            ret = observer->OnCoalescedMsg(&batch->buf[MSG_COALESCE_HEADER_SIZE],
+                batch->buf.size() - MSG_COALESCE_HEADER_SIZE, batch->firstCharset,
+                batch->dstUsers, batch->dstUserCount);
+        }
+        else
+        {
+            ret = observer->OnCoalescedMsg(&batch->buf[0], batch->buf.size(),
+                MSG_COALESCE_CHARSET, batch->dstUsers, batch->dstUserCount);
+        }
+
+        if (!ret)
+        {
+            observer->OnCoalescedDropped(batch->msgCount,
+                batch->buf.size() - batch->msgCount * MSG_COALESCE_HEADER_SIZE);
+        }
+    }
+
+    observer->Release();
+}
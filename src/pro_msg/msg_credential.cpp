@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "msg_credential.h"
+#include "pronet/pro_config_file.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgCredentialTable*
+CMsgCredentialTable::CreateInstance(const char* fileName)
+{
+    assert(fileName != NULL);
+    assert(fileName[0] != '\0');
+    if (fileName == NULL || fileName[0] == '\0')
+    {
+        return NULL;
+    }
+
+    CMsgCredentialTable* const table = new CMsgCredentialTable;
+    if (!table->Load_i(fileName))
+    {
+        table->Release();
+
+        return NULL;
+    }
+
+    return table;
+}
+
+CMsgCredentialTable::CMsgCredentialTable()
+{
+    m_mask  = 0;
+    m_count = 0;
+}
+
+CMsgCredentialTable::~CMsgCredentialTable()
+{
+    if (m_passwords.size() > 0)
+    {
+        ProZeroMemory(&m_passwords[0], m_passwords.size());
+    }
+}
+
+unsigned long
+CMsgCredentialTable::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CMsgCredentialTable::Release()
+{
+    return CProRefCount::Release();
+}
+
+const char*
+CMsgCredentialTable::Find(const RTP_MSG_USER& user) const
+{
+    if (m_count == 0)
+    {
+        return NULL;
+    }
+
+    const uint64_t key = MakeKey_i(user);
+    if (key == 0)
+    {
+        return NULL;
+    }
+
+    for (uint64_t i = Hash_i(key) & m_mask; ; i = (i + 1) & m_mask)
+    {
+        const MSG_CREDENTIAL& slot = m_slots[(size_t)i];
+        if (slot.key == key)
+        {
+            return &m_passwords[slot.offset];
+        }
+        if (slot.key == 0)
+        {
+            return NULL;
+        }
+    }
+}
+
+bool
+CMsgCredentialTable::Load_i(const char* fileName)
+{
+    CProConfigFile configFile;
+    configFile.Init(fileName);
+
+    CProStlVector<PRO_CONFIG_ITEM> configs;
+    if (!configFile.Read(configs))
+    {
+        return false;
+    }
+
+    /*
+     * at most half full, so that a miss stops at an empty slot soon
+     */
+    size_t slotCount = 16;
+    while (slotCount < configs.size() * 2)
+    {
+        slotCount *= 2;
+    }
+
+    MSG_CREDENTIAL empty;
+    empty.key    = 0;
+    empty.offset = 0;
+
+    m_slots.assign(slotCount, empty);
+    m_mask = slotCount - 1;
+
+    int i = 0;
+    int c = (int)configs.size();
+
+    /*
+     * the buffer is sized once, up front. growing it would free the old
+     * copy of the passwords without zeroing it
+     */
+    size_t passwordBytes = 0;
+
+    for (; i < c; ++i)
+    {
+        passwordBytes += configs[i].configValue.length() + 1;
+    }
+
+    m_passwords.reserve(passwordBytes);
+
+    for (i = 0; i < c; ++i)
+    {
+        CProStlString& configName  = configs[i].configName;
+        CProStlString& configValue = configs[i].configValue;
+
+        RTP_MSG_USER user;
+        RtpMsgString2User(configName.c_str(), &user);
+
+        const uint64_t key = MakeKey_i(user);
+        if (user.classId > 0 && user.UserId() > 0)
+        {
+            Insert_i(key, configValue);
+        }
+
+        if (!configValue.empty())
+        {
+            ProZeroMemory(&configValue[0], configValue.length());
+            configValue = "";
+        }
+    }
+
+    return true;
+}
+
+void
+CMsgCredentialTable::Insert_i(uint64_t             key,
+                              const CProStlString& password)
+{
+    assert(key > 0);
+
+    for (uint64_t i = Hash_i(key) & m_mask; ; i = (i + 1) & m_mask)
+    {
+        MSG_CREDENTIAL& slot = m_slots[(size_t)i];
+        if (slot.key == 0)
+        {
+            slot.key = key;
+            ++m_count;
+        }
+        else if (slot.key != key)
+        {
+            continue;
+        }
+
+        else
+        {
+            /*
+             * the last record of a user wins. the old password is wiped
+             */
+            char* const oldPassword = &m_passwords[slot.offset];
+            ProZeroMemory(oldPassword, strlen(oldPassword));
+        }
+
+        assert(m_passwords.size() + password.length() + 1 <=
+            m_passwords.capacity());
+
+        slot.offset = m_passwords.size();
+        m_passwords.insert(m_passwords.end(), password.begin(), password.end());
+        m_passwords.push_back('\0');
+        break;
+    }
+}
+
+uint64_t
+CMsgCredentialTable::Hash_i(uint64_t key)
+{
+    /*
+     * the finalizer of splitmix64. userIds are often sequential
+     */
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    key ^= key >> 31;
+
+    return key;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * Per-user passwords, loaded from a file in the format of the config files:
+ *
+ *     "2-10001"    "password of 2-10001"
+ *     "2-10002"    "password of 2-10002"
+ *
+ * A record is keyed by classId-userId (instId is ignored), and it overrides
+ * the password of the user's class.
+ *
+ * The table is immutable once loaded. It's an open-addressing hash with
+ * linear probing, at most half full, and all the passwords live in one
+ * buffer, so a lookup is a few probes on adjacent slots and no allocation,
+ * even with millions of records.
+ */
+
+#if !defined(MSG_CREDENTIAL_H)
+#define MSG_CREDENTIAL_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgCredentialTable : public CProRefCount
+{
+public:
+
+    /*
+     * NULL if the file can't be read
+     */
+    static CMsgCredentialTable* CreateInstance(const char* fileName);
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+    /*
+     * lock-free. NULL if the user has no record
+     */
+    const char* Find(const RTP_MSG_USER& user) const;
+
+    size_t GetCount() const
+    {
+        return m_count;
+    }
+
+private:
+
+    CMsgCredentialTable();
+
+    virtual ~CMsgCredentialTable();
+
+    bool Load_i(const char* fileName);
+
+    void Insert_i(
+        uint64_t             key,
+        const CProStlString& password
+        );
+
+    static uint64_t MakeKey_i(const RTP_MSG_USER& user)
+    {
+        return ((uint64_t)user.classId << 40) | user.UserId();
+    }
+
+    static uint64_t Hash_i(uint64_t key);
+
+private:
+
+    struct MSG_CREDENTIAL
+    {
+        uint64_t key;    /* 0 for an empty slot */
+        size_t   offset; /* into m_passwords */
+    };
+
+    CProStlVector<MSG_CREDENTIAL> m_slots;     /* 2^n */
+    CProStlVector<char>           m_passwords; /* '\0' terminated */
+    uint64_t                      m_mask;
+    size_t                        m_count;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_CREDENTIAL_H */
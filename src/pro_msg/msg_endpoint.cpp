@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "msg_endpoint.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_z.h"
+#include <algorithm>
+#include <cmath>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+struct ENDPOINT_SCORE
+{
+    double score;
+    size_t index;
+
+    bool operator<(const ENDPOINT_SCORE& other) const
+    {
+        return score > other.score; /* descending */
+    }
+};
+
+static
+uint64_t
+Mix64_i(uint64_t value)
+{
+    /*
+     * splitmix64
+     */
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+
+    return value ^ (value >> 31);
+}
+
+static
+uint64_t
+HashEndpoint_i(const MSG_ENDPOINT& endpoint)
+{
+    /*
+     * FNV-1a of "host:port"
+     */
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (size_t i = 0; i < endpoint.host.length(); ++i)
+    {
+        hash = (hash ^ (unsigned char)endpoint.host[i]) * 0x100000001B3ULL;
+    }
+
+    hash = (hash ^ ':') * 0x100000001B3ULL;
+    hash = (hash ^ (endpoint.port >> 8)) * 0x100000001B3ULL;
+    hash = (hash ^ (endpoint.port & 0xFF)) * 0x100000001B3ULL;
+
+    return hash;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+bool
+MsgParseEndpoints(const char*                  text,
+                  unsigned short               defaultPort,
+                  CProStlVector<MSG_ENDPOINT>& endpoints)
+{
+    endpoints.clear();
+
+    if (text == NULL)
+    {
+        return false;
+    }
+
+    const char* p = text;
+
+    while (1)
+    {
+        while (*p == ' ' || *p == '\t')
+        {
+            ++p;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+
+        MSG_ENDPOINT endpoint;
+        endpoint.port = defaultPort;
+
+        const char* host = p;
+        while (*p != '\0' && *p != ':' && *p != '*' && *p != ',' && *p != ' ' && *p != '\t')
+        {
+            ++p;
+        }
+        if (p == host)
+        {
+            endpoints.clear();
+
+            return false;
+        }
+
+        endpoint.host.assign(host, p - host);
+
+        char* end = NULL;
+
+        if (*p == ':')
+        {
+            ++p;
+            const unsigned long port = strtoul(p, &end, 10);
+            if (end == p || port == 0 || port > 65535)
+            {
+                endpoints.clear();
+
+                return false;
+            }
+
+            endpoint.port = (unsigned short)port;
+            p = end;
+        }
+
+        if (*p == '*')
+        {
+            ++p;
+            const unsigned long weight = strtoul(p, &end, 10);
+            if (end == p || weight == 0 || weight > 65535)
+            {
+                endpoints.clear();
+
+                return false;
+            }
+
+            endpoint.weight = (unsigned int)weight;
+            p = end;
+        }
+
+        if (endpoint.port == 0)
+        {
+            endpoints.clear();
+
+            return false;
+        }
+
+        endpoints.push_back(endpoint);
+
+        while (*p == ' ' || *p == '\t')
+        {
+            ++p;
+        }
+        if (*p == ',')
+        {
+            ++p;
+        }
+        else if (*p != '\0')
+        {
+            endpoints.clear();
+
+            return false;
+        }
+    }
+
+    return endpoints.size() > 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgEndpointTable::CMsgEndpointTable(const CProStlVector<MSG_ENDPOINT>& endpoints,
+                                     uint64_t                           key,
+                                     bool                               ordered)
+: m_endpoints(endpoints)
+{
+    assert(endpoints.size() > 0);
+
+    m_current     = 0;
+    m_connectTick = 0;
+    m_connecting  = false;
+
+    CProStlVector<ENDPOINT_SCORE> scores;
+
+    for (size_t i = 0; i < m_endpoints.size(); ++i)
+    {
+        ENDPOINT_SCORE score;
+        score.index = i;
+
+        if (ordered)
+        {
+            score.score = -(double)i;
+        }
+        else
+        {
+            /*
+             * weighted rendezvous hashing. u is uniform in (0, 1), and
+             * -weight / ln(u) is the largest for an endpoint with the
+             * probability of weight / sum(weights)
+             */
+            const uint64_t hash = Mix64_i(key ^ HashEndpoint_i(m_endpoints[i]));
+            const double   u    = ((hash >> 11) + 0.5) / 9007199254740992.0; /* 2^53 */
+
+            score.score = -(double)m_endpoints[i].weight / log(u);
+        }
+
+        scores.push_back(score);
+    }
+
+    std::stable_sort(scores.begin(), scores.end());
+
+    for (size_t i = 0; i < scores.size(); ++i)
+    {
+        m_rank.push_back(scores[i].index);
+    }
+}
+
+const MSG_ENDPOINT&
+CMsgEndpointTable::Connect(int64_t tick)
+{
+    if (m_connecting)
+    {
+        MSG_ENDPOINT& endpoint = m_endpoints[m_current];
+        ++endpoint.failures;
+        endpoint.failureTick = tick;
+    }
+
+    m_current     = Pick_i(tick);
+    m_connectTick = tick;
+    m_connecting  = true;
+
+    return m_endpoints[m_current];
+}
+
+void
+CMsgEndpointTable::SetOk(int64_t tick)
+{
+    if (!m_connecting)
+    {
+        return;
+    }
+
+    MSG_ENDPOINT& endpoint = m_endpoints[m_current];
+    endpoint.failures  = 0;
+    endpoint.latencyMs = tick > m_connectTick ? tick - m_connectTick : 0;
+
+    m_connecting = false;
+}
+
+void
+CMsgEndpointTable::SetIp(size_t      index,
+                         const char* ip)
+{
+    assert(index < m_endpoints.size());
+    assert(ip != NULL);
+    assert(ip[0] != '\0');
+    if (index >= m_endpoints.size() || ip == NULL || ip[0] == '\0')
+    {
+        return;
+    }
+
+    m_endpoints[index].ip = ip;
+}
+
+size_t
+CMsgEndpointTable::Pick_i(int64_t tick) const
+{
+    bool anyIp = false;
+
+    for (size_t i = 0; i < m_endpoints.size(); ++i)
+    {
+        if (!m_endpoints[i].ip.empty())
+        {
+            anyIp = true;
+            break;
+        }
+    }
+
+    unsigned int minFailures = (unsigned int)-1;
+    int64_t      minLatency  = -1;
+
+    for (size_t i = 0; i < m_endpoints.size(); ++i)
+    {
+        const MSG_ENDPOINT& endpoint = m_endpoints[i];
+        if (anyIp && endpoint.ip.empty())
+        {
+            continue;
+        }
+
+        unsigned int failures = endpoint.failures;
+        if (tick - endpoint.failureTick > (int64_t)MSG_ENDPOINT_RETRY_INTERVAL * 1000)
+        {
+            failures = 0;
+        }
+
+        if (failures < minFailures)
+        {
+            minFailures = failures;
+        }
+
+        if (failures == 0 && endpoint.latencyMs >= 0 &&
+            (minLatency < 0 || endpoint.latencyMs < minLatency))
+        {
+            minLatency = endpoint.latencyMs;
+        }
+    }
+
+    size_t picked = (size_t)-1;
+
+    for (size_t i = 0; i < m_rank.size(); ++i)
+    {
+        const MSG_ENDPOINT& endpoint = m_endpoints[m_rank[i]];
+        if (anyIp && endpoint.ip.empty())
+        {
+            continue;
+        }
+
+        unsigned int failures = endpoint.failures;
+        if (tick - endpoint.failureTick > (int64_t)MSG_ENDPOINT_RETRY_INTERVAL * 1000)
+        {
+            failures = 0;
+        }
+
+        if (failures != minFailures)
+        {
+            continue;
+        }
+
+        if (picked == (size_t)-1)
+        {
+            picked = m_rank[i];
+        }
+
+        /*
+         * an unknown latency isn't slow
+         */
+        if (minFailures == 0 && minLatency >= 0 && endpoint.latencyMs >= 0 &&
+            endpoint.latencyMs > minLatency * MSG_ENDPOINT_SLOW_FACTOR)
+        {
+            continue;
+        }
+
+        return m_rank[i];
+    }
+
+    return picked;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * The servers a client can connect to, e.g., several CMsgServer hubs. A
+ * list is written as in the msgc_server_list config item:
+ *
+ *     "10.0.0.1:3000*2, 10.0.0.2, 10.0.0.3:3001"
+ *
+ * A missing port is msgc_server_port, and a missing weight is 1. A host can
+ * be a name; it's resolved again before each connection, by CMsgResolver.
+ * An endpoint whose host has never been resolved is kept, and skipped until
+ * the resolver has an address for it.
+ *
+ * Each client ranks the endpoints once, by weighted rendezvous hashing of
+ * its user, so the clients are spread in proportion to the weights, and an
+ * endpoint that is added or removed moves only its own share. With
+ * msgc_server_ordered, the rank is the order of the list.
+ *
+ * Every connection goes to the first endpoint in the rank among the ones
+ * with the fewest failures, skipping those whose last handshake was more
+ * than MSG_ENDPOINT_SLOW_FACTOR times slower than the fastest one. A
+ * connection that is closed before its handshake is done is a failure of
+ * its endpoint. Failures are forgotten MSG_ENDPOINT_RETRY_INTERVAL seconds
+ * after the last one, so a recovered endpoint gets its share back.
+ */
+
+#if !defined(MSG_ENDPOINT_H)
+#define MSG_ENDPOINT_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_stl.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define MSG_ENDPOINT_SLOW_FACTOR    2
+#define MSG_ENDPOINT_RETRY_INTERVAL 60
+
+struct MSG_ENDPOINT
+{
+    MSG_ENDPOINT()
+    {
+        port        = 0;
+        weight      = 1;
+        failures    = 0;
+        failureTick = 0;
+        latencyMs   = -1;
+    }
+
+    CProStlString  host;        /* as configured */
+    CProStlString  ip;          /* the latest address of host, empty if unknown */
+    unsigned short port;
+    unsigned int   weight;      /* > 0 */
+    unsigned int   failures;    /* consecutive */
+    int64_t        failureTick; /* of the last failure */
+    int64_t        latencyMs;   /* of the last handshake, -1 if unknown */
+
+    DECLARE_SGI_POOL(0)
+};
+
+/*
+ * false if the text is malformed, or no endpoint is in it
+ */
+bool
+MsgParseEndpoints(const char*                  text,
+                  unsigned short               defaultPort,
+                  CProStlVector<MSG_ENDPOINT>& endpoints);
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+/*
+ * not thread-safe. CMsgClient keeps it under its lock
+ */
+class CMsgEndpointTable
+{
+public:
+
+    /*
+     * key identifies the client, e.g., its user
+     */
+    CMsgEndpointTable(
+        const CProStlVector<MSG_ENDPOINT>& endpoints, /* not empty */
+        uint64_t                           key,
+        bool                               ordered
+        );
+
+    /*
+     * picks the endpoint of a new connection, skipping the ones without an
+     * ip unless no endpoint has one. The previous connection is a failure
+     * if SetOk() hasn't been called since
+     */
+    const MSG_ENDPOINT& Connect(int64_t tick);
+
+    /*
+     * the handshake of the current connection is done
+     */
+    void SetOk(int64_t tick);
+
+    /*
+     * the host of an endpoint has been resolved again
+     */
+    void SetIp(
+        size_t      index,
+        const char* ip
+        );
+
+    size_t GetCurrent() const
+    {
+        return m_current;
+    }
+
+    size_t GetCount() const
+    {
+        return m_endpoints.size();
+    }
+
+    const MSG_ENDPOINT& GetEndpoint(size_t index) const
+    {
+        return m_endpoints[index];
+    }
+
+    void GetEndpoints(CProStlVector<MSG_ENDPOINT>& endpoints) const
+    {
+        endpoints = m_endpoints;
+    }
+
+private:
+
+    size_t Pick_i(int64_t tick) const;
+
+private:
+
+    CProStlVector<MSG_ENDPOINT> m_endpoints;
+    CProStlVector<size_t>       m_rank;
+    size_t                      m_current;
+    int64_t                     m_connectTick;
+    bool                        m_connecting; /* no SetOk() since Connect() */
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_ENDPOINT_H */
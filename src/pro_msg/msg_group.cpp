@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+#include "msg_group.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <algorithm>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+void
+MsgGroupPackCtrl(unsigned char op,
+                 uint64_t      groupId,
+                 unsigned char buf[MSG_GROUP_CTRL_SIZE])
+{
+    memset(buf, 0, MSG_GROUP_CTRL_SIZE);
+
+    buf[0] = op;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        buf[15 - i] = (unsigned char)(groupId >> (i * 8));
+    }
+}
+
+bool
+MsgGroupUnpackCtrl(const void*    buf,
+                   size_t         size,
+                   unsigned char* op,
+                   uint64_t*      groupId)
+{
+    assert(buf != NULL);
+    assert(op != NULL);
+    assert(groupId != NULL);
+    if (buf == NULL || size != MSG_GROUP_CTRL_SIZE || op == NULL || groupId == NULL)
+    {
+        return false;
+    }
+
+    const unsigned char* p = (const unsigned char*)buf;
+
+    *op      = p[0];
+    *groupId = 0;
+
+    for (int i = 8; i < 16; ++i)
+    {
+        *groupId = (*groupId << 8) | p[i];
+    }
+
+    return *op == MSG_GROUP_OP_JOIN || *op == MSG_GROUP_OP_LEAVE;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgGroupMembers*
+CMsgGroupMembers::CreateInstance(const CProStlVector<RTP_MSG_USER>& users)
+{
+    return new CMsgGroupMembers(users);
+}
+
+CMsgGroupMembers::CMsgGroupMembers(const CProStlVector<RTP_MSG_USER>& users2)
+: users(users2)
+{
+}
+
+unsigned long
+CMsgGroupMembers::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CMsgGroupMembers::Release()
+{
+    return CProRefCount::Release();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgGroupTable::CMsgGroupTable()
+{
+}
+
+CMsgGroupTable::~CMsgGroupTable()
+{
+    Clear();
+}
+
+bool
+CMsgGroupTable::CreateGroup(uint64_t groupId)
+{
+    assert(groupId > 0);
+    if (groupId == 0)
+    {
+        return false;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_groups.find(groupId) != m_groups.end())
+    {
+        return false;
+    }
+
+    m_groups[groupId] = new MSG_GROUP;
+
+    return true;
+}
+
+void
+CMsgGroupTable::DeleteGroup(uint64_t groupId)
+{
+    MSG_GROUP* group = NULL;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        CProStlMap<uint64_t, MSG_GROUP*>::iterator const itr = m_groups.find(groupId);
+        if (itr == m_groups.end())
+        {
+            return;
+        }
+
+        group = itr->second;
+        m_groups.erase(itr);
+
+        int i = 0;
+        int c = (int)group->members.size();
+
+        for (; i < c; ++i)
+        {
+            RemoveUserGroup_i(group->members[i], groupId);
+        }
+    }
+
+    if (group->published != NULL)
+    {
+        group->published->Release();
+    }
+    delete group;
+}
+
+bool
+CMsgGroupTable::JoinGroup(uint64_t            groupId,
+                          const RTP_MSG_USER& user)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    CProStlMap<uint64_t, MSG_GROUP*>::iterator const itr = m_groups.find(groupId);
+    if (itr == m_groups.end())
+    {
+        return false;
+    }
+
+    MSG_GROUP* const group = itr->second;
+
+    CProStlVector<RTP_MSG_USER>::iterator const itr2 =
+        std::lower_bound(group->members.begin(), group->members.end(), user);
+    if (itr2 != group->members.end() && *itr2 == user)
+    {
+        return true;
+    }
+
+    group->members.insert(itr2, user);
+    if (group->published != NULL)
+    {
+        group->published->Release();
+        group->published = NULL;
+    }
+
+    m_userGroups[user].push_back(groupId);
+
+    return true;
+}
+
+void
+CMsgGroupTable::LeaveGroup(uint64_t            groupId,
+                           const RTP_MSG_USER& user)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    CProStlMap<uint64_t, MSG_GROUP*>::iterator const itr = m_groups.find(groupId);
+    if (itr == m_groups.end())
+    {
+        return;
+    }
+
+    if (RemoveMember_i(itr->second, user))
+    {
+        RemoveUserGroup_i(user, groupId);
+    }
+}
+
+void
+CMsgGroupTable::LeaveAllGroups(const RTP_MSG_USER& user)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    CProStlMap<RTP_MSG_USER, CProStlVector<uint64_t> >::iterator const itr =
+        m_userGroups.find(user);
+    if (itr == m_userGroups.end())
+    {
+        return;
+    }
+
+    const CProStlVector<uint64_t>& groupIds = itr->second;
+
+    int i = 0;
+    int c = (int)groupIds.size();
+
+    for (; i < c; ++i)
+    {
+        CProStlMap<uint64_t, MSG_GROUP*>::iterator const itr2 = m_groups.find(groupIds[i]);
+        if (itr2 != m_groups.end())
+        {
+            RemoveMember_i(itr2->second, user);
+        }
+    }
+
+    m_userGroups.erase(itr);
+}
+
+CMsgGroupMembers*
+CMsgGroupTable::GetMembers(uint64_t groupId)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    CProStlMap<uint64_t, MSG_GROUP*>::iterator const itr = m_groups.find(groupId);
+    if (itr == m_groups.end())
+    {
+        return NULL;
+    }
+
+    MSG_GROUP* const group = itr->second;
+
+    /*
+     * Rebuilt only after the group has been changed, so a stable group is
+     * published again and again without copying.
+     */
+    if (group->published == NULL)
+    {
+        group->published = CMsgGroupMembers::CreateInstance(group->members);
+    }
+
+    group->published->AddRef();
+
+    return group->published;
+}
+
+size_t
+CMsgGroupTable::GetMemberCount(uint64_t groupId) const
+{
+    size_t memberCount = 0;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        CProStlMap<uint64_t, MSG_GROUP*>::const_iterator const itr = m_groups.find(groupId);
+        if (itr != m_groups.end())
+        {
+            memberCount = itr->second->members.size();
+        }
+    }
+
+    return memberCount;
+}
+
+void
+CMsgGroupTable::Clear()
+{
+    CProStlMap<uint64_t, MSG_GROUP*> groups;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        groups = m_groups;
+        m_groups.clear();
+        m_userGroups.clear();
+    }
+
+    CProStlMap<uint64_t, MSG_GROUP*>::iterator       itr = groups.begin();
+    CProStlMap<uint64_t, MSG_GROUP*>::iterator const end = groups.end();
+
+    for (; itr != end; ++itr)
+    {
+        MSG_GROUP* const group = itr->second;
+        if (group->published != NULL)
+        {
+            group->published->Release();
+        }
+        delete group;
+    }
+}
+
+bool
+CMsgGroupTable::RemoveMember_i(MSG_GROUP*          group,
+                               const RTP_MSG_USER& user)
+{
+    assert(group != NULL);
+
+    CProStlVector<RTP_MSG_USER>::iterator const itr =
+        std::lower_bound(group->members.begin(), group->members.end(), user);
+    if (itr == group->members.end() || !(*itr == user))
+    {
+        return false;
+    }
+
+    group->members.erase(itr);
+    if (group->published != NULL)
+    {
+        group->published->Release();
+        group->published = NULL;
+    }
+
+    return true;
+}
+
+void
+CMsgGroupTable::RemoveUserGroup_i(const RTP_MSG_USER& user,
+                                  uint64_t            groupId)
+{
+    CProStlMap<RTP_MSG_USER, CProStlVector<uint64_t> >::iterator const itr =
+        m_userGroups.find(user);
+    if (itr == m_userGroups.end())
+    {
+        return;
+    }
+
+    CProStlVector<uint64_t>& groupIds = itr->second;
+
+    int i = 0;
+    int c = (int)groupIds.size();
+
+    for (; i < c; ++i)
+    {
+        if (groupIds[i] == groupId)
+        {
+            groupIds[i] = groupIds[c - 1];
+            groupIds.pop_back();
+            break;
+        }
+    }
+
+    if (groupIds.size() == 0)
+    {
+        m_userGroups.erase(itr);
+    }
+}
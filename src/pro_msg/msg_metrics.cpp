@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "msg_metrics.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <algorithm>
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static std::atomic<unsigned int> g_s_nextStripe(0);
+static thread_local unsigned int g_s_stripe = (unsigned int)-1;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static
+unsigned int
+GetStripe_i()
+{
+    if (g_s_stripe == (unsigned int)-1)
+    {
+        g_s_stripe = g_s_nextStripe++ % MSG_METRICS_STRIPES;
+    }
+
+    return g_s_stripe;
+}
+
+static
+bool
+CloseReasonGreater_i(const MSG_CLOSE_REASON& reason1,
+                     const MSG_CLOSE_REASON& reason2)
+{
+    return reason1.count > reason2.count;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgMetrics::CMsgMetrics()
+{
+    for (int i = 0; i < MSG_METRICS_STRIPES; ++i)
+    {
+        m_stripes[i].msgsIn       = 0;
+        m_stripes[i].bytesIn      = 0;
+        m_stripes[i].msgsOut      = 0;
+        m_stripes[i].bytesOut     = 0;
+        m_stripes[i].redlineDrops = 0;
+    }
+
+    for (int i = 0; i < 256; ++i)
+    {
+        m_authRejectsCid[i] = 0;
+        m_usersCid[i]       = 0;
+    }
+
+    for (int i = 0; i < MSG_METRICS_CLOSE_REASONS; ++i)
+    {
+        m_closeSlots[i].key   = 0;
+        m_closeSlots[i].count = 0;
+    }
+
+    m_handshakesOk     = 0;
+    m_handshakesFailed = 0;
+    m_kickouts         = 0;
+    m_closes           = 0;
+    m_closesDropped    = 0;
+    m_closeSlotCount   = 0;
+}
+
+void
+CMsgMetrics::AddRecv(size_t size)
+{
+    COUNTER_STRIPE& stripe = m_stripes[GetStripe_i()];
+
+    stripe.msgsIn.fetch_add(1, std::memory_order_relaxed);
+    stripe.bytesIn.fetch_add(size, std::memory_order_relaxed);
+}
+
+void
+CMsgMetrics::AddSend(size_t        size,
+                     unsigned char sentCount,
+                     unsigned char droppedCount)
+{
+    COUNTER_STRIPE& stripe = m_stripes[GetStripe_i()];
+
+    if (sentCount > 0)
+    {
+        stripe.msgsOut.fetch_add(sentCount, std::memory_order_relaxed);
+        stripe.bytesOut.fetch_add((uint64_t)size * sentCount, std::memory_order_relaxed);
+    }
+
+    if (droppedCount > 0)
+    {
+        stripe.redlineDrops.fetch_add(droppedCount, std::memory_order_relaxed);
+    }
+}
+
+void
+CMsgMetrics::AddHandshakeOk(const RTP_MSG_USER& user)
+{
+    m_handshakesOk.fetch_add(1, std::memory_order_relaxed);
+    m_usersCid[user.classId].fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+CMsgMetrics::AddHandshakeFailed(const RTP_MSG_USER& user,
+                                bool                authRejected)
+{
+    m_handshakesFailed.fetch_add(1, std::memory_order_relaxed);
+
+    if (authRejected)
+    {
+        m_authRejectsCid[user.classId].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void
+CMsgMetrics::AddClose(const RTP_MSG_USER& user,
+                      int                 errorCode,
+                      int                 sslCode)
+{
+    m_closes.fetch_add(1, std::memory_order_relaxed);
+    m_usersCid[user.classId].fetch_sub(1, std::memory_order_relaxed);
+
+    const uint64_t key = ((uint64_t)(uint32_t)errorCode << 32) | (uint32_t)sslCode;
+
+    /*
+     * a known reason is counted without the lock. The slots are claimed
+     * once and never reused, so a key never changes under a reader
+     */
+    size_t slotCount = m_closeSlotCount.load();
+
+    for (size_t i = 0; i < slotCount; ++i)
+    {
+        if (m_closeSlots[i].key.load() == key)
+        {
+            m_closeSlots[i].count.fetch_add(1, std::memory_order_relaxed);
+
+            return;
+        }
+    }
+
+    CProThreadMutexGuard mon(m_closeLock);
+
+    slotCount = m_closeSlotCount.load();
+
+    for (size_t i = 0; i < slotCount; ++i)
+    {
+        if (m_closeSlots[i].key.load() == key)
+        {
+            m_closeSlots[i].count.fetch_add(1, std::memory_order_relaxed);
+
+            return;
+        }
+    }
+
+    if (slotCount == MSG_METRICS_CLOSE_REASONS)
+    {
+        m_closesDropped.fetch_add(1, std::memory_order_relaxed);
+
+        return;
+    }
+
+    m_closeSlots[slotCount].key   = key;
+    m_closeSlots[slotCount].count = 1;
+    m_closeSlotCount              = slotCount + 1;
+}
+
+void
+CMsgMetrics::AddKickout()
+{
+    m_kickouts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+CMsgMetrics::GetSnapshot(MSG_SERVER_METRICS& metrics) const
+{
+    metrics = MSG_SERVER_METRICS();
+
+    for (int i = 0; i < MSG_METRICS_STRIPES; ++i)
+    {
+        const COUNTER_STRIPE& stripe = m_stripes[i];
+
+        metrics.msgsIn       += stripe.msgsIn.load(std::memory_order_relaxed);
+        metrics.bytesIn      += stripe.bytesIn.load(std::memory_order_relaxed);
+        metrics.msgsOut      += stripe.msgsOut.load(std::memory_order_relaxed);
+        metrics.bytesOut     += stripe.bytesOut.load(std::memory_order_relaxed);
+        metrics.redlineDrops += stripe.redlineDrops.load(std::memory_order_relaxed);
+    }
+
+    metrics.handshakesOk     = m_handshakesOk.load(std::memory_order_relaxed);
+    metrics.handshakesFailed = m_handshakesFailed.load(std::memory_order_relaxed);
+    metrics.kickouts         = m_kickouts.load(std::memory_order_relaxed);
+    metrics.closes           = m_closes.load(std::memory_order_relaxed);
+    metrics.closesDropped    = m_closesDropped.load(std::memory_order_relaxed);
+
+    for (int i = 0; i < 256; ++i)
+    {
+        /*
+         * a close may be counted before its handshake is seen here
+         */
+        const int64_t users = m_usersCid[i].load(std::memory_order_relaxed);
+
+        metrics.authRejectsCid[i] = m_authRejectsCid[i].load(std::memory_order_relaxed);
+        metrics.usersCid[i]       = users > 0 ? (uint64_t)users : 0;
+        metrics.users            += metrics.usersCid[i];
+    }
+
+    const size_t slotCount = m_closeSlotCount.load();
+
+    for (size_t i = 0; i < slotCount; ++i)
+    {
+        MSG_CLOSE_REASON reason;
+        reason.count = m_closeSlots[i].count.load(std::memory_order_relaxed);
+        if (reason.count == 0)
+        {
+            continue;
+        }
+
+        const uint64_t key = m_closeSlots[i].key.load();
+
+        reason.errorCode = (int)(uint32_t)(key >> 32);
+        reason.sslCode   = (int)(uint32_t)key;
+        metrics.closeReasons.push_back(reason);
+    }
+
+    std::stable_sort(
+        metrics.closeReasons.begin(), metrics.closeReasons.end(), &CloseReasonGreater_i);
+}
+
+void
+CMsgMetrics::Reset()
+{
+    for (int i = 0; i < MSG_METRICS_STRIPES; ++i)
+    {
+        m_stripes[i].msgsIn       = 0;
+        m_stripes[i].bytesIn      = 0;
+        m_stripes[i].msgsOut      = 0;
+        m_stripes[i].bytesOut     = 0;
+        m_stripes[i].redlineDrops = 0;
+    }
+
+    for (int i = 0; i < 256; ++i)
+    {
+        m_authRejectsCid[i] = 0;
+    }
+
+    /*
+     * the keys are kept. see AddClose()
+     */
+    for (int i = 0; i < MSG_METRICS_CLOSE_REASONS; ++i)
+    {
+        m_closeSlots[i].count = 0;
+    }
+
+    m_handshakesOk     = 0;
+    m_handshakesFailed = 0;
+    m_kickouts         = 0;
+    m_closes           = 0;
+    m_closesDropped    = 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * The counters of CMsgServer. The hot ones (messages, bytes and drops) are
+ * kept on per-thread stripes of one cache line each, so the reactor threads
+ * don't bounce a shared line; GetSnapshot() sums the stripes. The rare ones
+ * (handshakes, closes, users) are plain atomics. Nothing here takes a lock
+ * but the close-reason table on a new reason.
+ *
+ * A snapshot is not atomic as a whole: each counter is exact, but the
+ * counters may be read at slightly different moments. Handshakes that fail
+ * inside libpronet (e.g., a timeout or an SSL error before OnCheckUser())
+ * are not visible to CMsgServer, so they are not counted. With
+ * msgs_auth_threads > 0, the handshake refused while the user is being
+ * checked is counted as a failed one, but not as a rejected one.
+ */
+
+#if !defined(MSG_METRICS_H)
+#define MSG_METRICS_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define MSG_METRICS_STRIPES       16
+#define MSG_METRICS_CLOSE_REASONS 32
+
+struct MSG_CLOSE_REASON
+{
+    MSG_CLOSE_REASON()
+    {
+        errorCode = 0;
+        sslCode   = 0;
+        count     = 0;
+    }
+
+    int      errorCode;
+    int      sslCode;
+    uint64_t count;
+
+    DECLARE_SGI_POOL(0)
+};
+
+struct MSG_SERVER_METRICS
+{
+    MSG_SERVER_METRICS()
+    {
+        msgsIn           = 0;
+        bytesIn          = 0;
+        msgsOut          = 0;
+        bytesOut         = 0;
+        redlineDrops     = 0;
+        handshakesOk     = 0;
+        handshakesFailed = 0;
+        kickouts         = 0;
+        closes           = 0;
+        closesDropped    = 0;
+        users            = 0;
+
+        memset(authRejectsCid, 0, sizeof(authRejectsCid));
+        memset(usersCid, 0, sizeof(usersCid));
+    }
+
+    uint64_t                        msgsIn;           /* after unpacking */
+    uint64_t                        bytesIn;
+    uint64_t                        msgsOut;          /* per destination */
+    uint64_t                        bytesOut;
+    uint64_t                        redlineDrops;     /* per destination, with send failures */
+    uint64_t                        handshakesOk;
+    uint64_t                        handshakesFailed;
+    uint64_t                        kickouts;
+    uint64_t                        closes;
+    uint64_t                        closesDropped;    /* not in closeReasons */
+    uint64_t                        users;
+    uint64_t                        authRejectsCid[256];
+    uint64_t                        usersCid[256];
+    CProStlVector<MSG_CLOSE_REASON> closeReasons;     /* by count, descending */
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgMetrics
+{
+public:
+
+    CMsgMetrics();
+
+    ~CMsgMetrics()
+    {
+    }
+
+    void AddRecv(size_t size);
+
+    /*
+     * sentCount destinations got the message, and droppedCount ones didn't
+     */
+    void AddSend(
+        size_t        size,
+        unsigned char sentCount,
+        unsigned char droppedCount
+        );
+
+    void AddHandshakeOk(const RTP_MSG_USER& user);
+
+    /*
+     * authRejected is true if the password is wrong, and false if the user
+     * can't be checked, e.g., the auth queue is full
+     */
+    void AddHandshakeFailed(
+        const RTP_MSG_USER& user,
+        bool                authRejected
+        );
+
+    void AddClose(
+        const RTP_MSG_USER& user,
+        int                 errorCode,
+        int                 sslCode
+        );
+
+    void AddKickout();
+
+    void GetSnapshot(MSG_SERVER_METRICS& metrics) const;
+
+    /*
+     * clears the counters but usersCid, which is a level, not a count
+     */
+    void Reset();
+
+private:
+
+    struct COUNTER_STRIPE
+    {
+        std::atomic<uint64_t> msgsIn;
+        std::atomic<uint64_t> bytesIn;
+        std::atomic<uint64_t> msgsOut;
+        std::atomic<uint64_t> bytesOut;
+        std::atomic<uint64_t> redlineDrops;
+        char                  reserved[64 - 5 * sizeof(std::atomic<uint64_t>)];
+    };
+
+    struct CLOSE_SLOT
+    {
+        std::atomic<uint64_t> key;   /* errorCode << 32 | sslCode */
+        std::atomic<uint64_t> count;
+    };
+
+    COUNTER_STRIPE        m_stripes[MSG_METRICS_STRIPES];
+    std::atomic<uint64_t> m_handshakesOk;
+    std::atomic<uint64_t> m_handshakesFailed;
+    std::atomic<uint64_t> m_kickouts;
+    std::atomic<uint64_t> m_closes;
+    std::atomic<uint64_t> m_closesDropped;
+    std::atomic<uint64_t> m_authRejectsCid[256];
+    std::atomic<int64_t>  m_usersCid[256];
+    CLOSE_SLOT            m_closeSlots[MSG_METRICS_CLOSE_REASONS];
+    std::atomic<size_t>   m_closeSlotCount; /* claimed slots, never shrinks */
+    CProThreadMutex       m_closeLock;      /* for claiming a slot */
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_METRICS_H */
@@ -0,0 +1,661 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "msg_pending.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_net.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_time_util.h"
+#include "pronet/pro_timer_factory.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static
+size_t
+RecordSize_i(size_t        msgSize,
+             unsigned char dstUserCount)
+{
+    size_t size = MSG_PENDING_HEADER_SIZE + sizeof(RTP_MSG_USER) * dstUserCount + msgSize;
+
+    return (size + 7) & ~(size_t)7;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgSendRing::CMsgSendRing(size_t maxBytes) /* 0 for unlimited */
+: m_maxBytes(maxBytes)
+{
+    m_head     = 0;
+    m_tail     = 0;
+    m_wrapEnd  = 0;
+    m_wrapped  = false;
+    m_msgCount = 0;
+}
+
+bool
+CMsgSendRing::Push(int64_t             tick,
+                   const void*         buf1,
+                   size_t              size1,
+                   const void*         buf2,  /* = NULL */
+                   size_t              size2, /* = 0 */
+                   uint16_t            charset,
+                   const RTP_MSG_USER* dstUsers,
+                   unsigned char       dstUserCount,
+                   size_t*             droppedMsgs,
+                   size_t*             droppedBytes)
+{
+    assert(buf1 != NULL);
+    assert(size1 > 0);
+    assert(dstUsers != NULL);
+    assert(dstUserCount > 0);
+    assert(droppedMsgs != NULL);
+    assert(droppedBytes != NULL);
+    if (buf1 == NULL || size1 == 0 || dstUsers == NULL || dstUserCount == 0 ||
+        droppedMsgs == NULL || droppedBytes == NULL)
+    {
+        return false;
+    }
+
+    if (buf2 == NULL)
+    {
+        size2 = 0;
+    }
+
+    const size_t   msgSize     = size1 + size2;
+    const size_t   recordSize  = RecordSize_i(msgSize, dstUserCount);
+    const uint32_t recordSize2 = (uint32_t)recordSize;
+    const uint32_t msgSize2    = (uint32_t)msgSize;
+
+    if (recordSize2 != recordSize || !Reserve_i(recordSize, droppedMsgs, droppedBytes))
+    {
+        return false;
+    }
+
+    char* const p = &m_buf[m_tail];
+
+    memset(p, 0, MSG_PENDING_HEADER_SIZE);
+    memcpy(p,      &tick,         8);
+    memcpy(p + 8,  &recordSize2,  4);
+    memcpy(p + 12, &msgSize2,     4);
+    memcpy(p + 16, &charset,      2);
+    memcpy(p + 18, &dstUserCount, 1);
+
+    char* q = p + MSG_PENDING_HEADER_SIZE;
+
+    memcpy(q, dstUsers, sizeof(RTP_MSG_USER) * dstUserCount);
+    q += sizeof(RTP_MSG_USER) * dstUserCount;
+
+    memcpy(q, buf1, size1);
+    if (size2 > 0)
+    {
+        memcpy(q + size1, buf2, size2);
+    }
+
+    m_tail += recordSize;
+    ++m_msgCount;
+
+    return true;
+}
+
+bool
+CMsgSendRing::Front(int64_t*             tick,
+                    const void**         buf,
+                    size_t*              size,
+                    uint16_t*            charset,
+                    const RTP_MSG_USER** dstUsers,
+                    unsigned char*       dstUserCount) const
+{
+    if (m_msgCount == 0)
+    {
+        return false;
+    }
+
+    const char* const p = &m_buf[m_head];
+
+    uint32_t msgSize = 0;
+
+    memcpy(tick,         p,      8);
+    memcpy(&msgSize,     p + 12, 4);
+    memcpy(charset,      p + 16, 2);
+    memcpy(dstUserCount, p + 18, 1);
+
+    *dstUsers = (const RTP_MSG_USER*)(p + MSG_PENDING_HEADER_SIZE);
+    *buf      = p + MSG_PENDING_HEADER_SIZE + sizeof(RTP_MSG_USER) * *dstUserCount;
+    *size     = msgSize;
+
+    return true;
+}
+
+size_t
+CMsgSendRing::Pop()
+{
+    if (m_msgCount == 0)
+    {
+        return 0;
+    }
+
+    const char* const p = &m_buf[m_head];
+
+    uint32_t recordSize = 0;
+    uint32_t msgSize    = 0;
+
+    memcpy(&recordSize, p + 8,  4);
+    memcpy(&msgSize,    p + 12, 4);
+
+    m_head += recordSize;
+    --m_msgCount;
+
+    if (m_msgCount == 0)
+    {
+        m_head    = 0;
+        m_tail    = 0;
+        m_wrapped = false;
+    }
+    else if (m_wrapped && m_head == m_wrapEnd)
+    {
+        m_head    = 0;
+        m_wrapped = false;
+    }
+
+    return msgSize;
+}
+
+bool
+CMsgSendRing::Reserve_i(size_t  recordSize,
+                        size_t* droppedMsgs,
+                        size_t* droppedBytes)
+{
+    if (m_maxBytes > 0 && recordSize > m_maxBytes)
+    {
+        return false;
+    }
+
+    while (1)
+    {
+        const size_t capacity = m_buf.size();
+
+        if (!m_wrapped)
+        {
+            if (capacity - m_tail >= recordSize)
+            {
+                return true;
+            }
+
+            /*
+             * the rest of the end is skipped
+             */
+            if (m_msgCount > 0 && m_head >= recordSize)
+            {
+                m_wrapEnd = m_tail;
+                m_wrapped = true;
+                m_tail    = 0;
+
+                return true;
+            }
+        }
+        else if (m_head - m_tail >= recordSize)
+        {
+            return true;
+        }
+
+        if (m_maxBytes == 0 || capacity < m_maxBytes)
+        {
+            const size_t used = m_wrapped ? m_wrapEnd - m_head + m_tail : m_tail - m_head;
+
+            size_t capacity2 = capacity > MSG_PENDING_MIN_RING / 2 ? capacity * 2 : MSG_PENDING_MIN_RING;
+            while (capacity2 < used + recordSize)
+            {
+                capacity2 *= 2;
+            }
+
+            if (m_maxBytes > 0 && capacity2 > m_maxBytes)
+            {
+                capacity2 = m_maxBytes;
+            }
+
+            Grow_i(capacity2);
+            continue;
+        }
+
+        /*
+         * full. A record that fits in the ring fits in an empty one, so
+         * this ends before the ring is empty
+         */
+        assert(m_msgCount > 0);
+
+        ++*droppedMsgs;
+        *droppedBytes += Pop();
+    }
+}
+
+void
+CMsgSendRing::Grow_i(size_t capacity)
+{
+    CProStlVector<char> buf(capacity);
+    size_t              size = 0;
+
+    if (m_wrapped)
+    {
+        size = m_wrapEnd - m_head;
+        memcpy(&buf[0], &m_buf[m_head], size);
+        memcpy(&buf[size], &m_buf[0], m_tail);
+        size += m_tail;
+    }
+    else if (m_tail > m_head)
+    {
+        size = m_tail - m_head;
+        memcpy(&buf[0], &m_buf[m_head], size);
+    }
+
+    m_buf.swap(buf);
+    m_head    = 0;
+    m_tail    = size;
+    m_wrapEnd = 0;
+    m_wrapped = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgPendingQueue*
+CMsgPendingQueue::CreateInstance(IMsgPendingObserver* observer,        /* = NULL */
+                                 IProReactor*         reactor,         /* = NULL, for no polling */
+                                 size_t               maxMsgs,         /* 0 for refusing all */
+                                 size_t               maxBytes,        /* 0 for unlimited */
+                                 unsigned int         maxAgeInSeconds) /* 0 for unlimited */
+{
+    return new CMsgPendingQueue(observer, reactor, maxMsgs, maxBytes, maxAgeInSeconds);
+}
+
+CMsgPendingQueue::CMsgPendingQueue(IMsgPendingObserver* observer,
+                                   IProReactor*         reactor,
+                                   size_t               maxMsgs,
+                                   size_t               maxBytes,
+                                   unsigned int         maxAgeInSeconds)
+:
+m_observer(observer),
+m_maxMsgs(maxMsgs),
+m_maxAgeMs((int64_t)maxAgeInSeconds * 1000),
+m_ring(maxBytes)
+{
+    m_reactor  = reactor;
+    m_timerId  = 0;
+    m_target   = NULL;
+    m_draining = false;
+
+    if (m_observer != NULL)
+    {
+        m_observer->AddRef();
+    }
+}
+
+CMsgPendingQueue::~CMsgPendingQueue()
+{
+    Fini();
+
+    if (m_target != NULL)
+    {
+        m_target->Release();
+        m_target = NULL;
+    }
+
+    if (m_observer != NULL)
+    {
+        m_observer->Release();
+    }
+}
+
+void
+CMsgPendingQueue::Fini()
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    SetPolling_i(false);
+    m_reactor = NULL;
+}
+
+unsigned long
+CMsgPendingQueue::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CMsgPendingQueue::Release()
+{
+    return CProRefCount::Release();
+}
+
+bool
+CMsgPendingQueue::Push(const void*         buf1,
+                       size_t              size1,
+                       const void*         buf2,  /* = NULL */
+                       size_t              size2, /* = 0 */
+                       uint16_t            charset,
+                       const RTP_MSG_USER* dstUsers,
+                       unsigned char       dstUserCount)
+{
+    assert(buf1 != NULL);
+    assert(size1 > 0);
+    assert(dstUsers != NULL);
+    assert(dstUserCount > 0);
+    if (buf1 == NULL || size1 == 0 || dstUsers == NULL || dstUserCount == 0)
+    {
+        return false;
+    }
+
+    bool           ret          = false;
+    size_t         droppedMsgs  = 0;
+    size_t         droppedBytes = 0;
+    IRtpMsgClient* target       = NULL;
+    bool           drain        = false; /* stopped at the redline */
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        /*
+         * behind the held ones until they are drained
+         */
+        if (m_target != NULL && !m_draining && m_ring.GetMsgCount() == 0)
+        {
+            m_target->AddRef();
+            target = m_target;
+        }
+        else if (m_maxMsgs == 0)
+        {
+            return false;
+        }
+        else
+        {
+            const int64_t tick = ProGetTickCount64();
+
+            Expire_i(tick, &droppedMsgs, &droppedBytes);
+
+            while (m_ring.GetMsgCount() >= m_maxMsgs)
+            {
+                ++droppedMsgs;
+                droppedBytes += m_ring.Pop();
+            }
+
+            ret = m_ring.Push(tick, buf1, size1, buf2, size2, charset, dstUsers, dstUserCount,
+                &droppedMsgs, &droppedBytes);
+
+            drain = m_target != NULL && !m_draining;
+        }
+    }
+
+    if (target != NULL)
+    {
+        ret = target->SendMsg2(buf1, size1, buf2, size2, charset, dstUsers, dstUserCount);
+        target->Release();
+    }
+
+    /*
+     * the observer may send again, so it's called without m_lock
+     */
+    if (droppedMsgs > 0 && m_observer != NULL)
+    {
+        m_observer->OnSendDropped(droppedMsgs, droppedBytes);
+    }
+
+    if (drain)
+    {
+        Drain();
+    }
+
+    return ret;
+}
+
+void
+CMsgPendingQueue::SetTarget(IRtpMsgClient* target)
+{
+    if (target != NULL)
+    {
+        target->AddRef();
+    }
+
+    IRtpMsgClient* oldTarget = NULL;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        oldTarget = m_target;
+        m_target  = target;
+
+        if (target == NULL)
+        {
+            SetPolling_i(false);
+        }
+    }
+
+    if (oldTarget != NULL)
+    {
+        oldTarget->Release();
+    }
+}
+
+void
+CMsgPendingQueue::Drain()
+{
+    IRtpMsgClient* target       = NULL;
+    size_t         droppedMsgs  = 0;
+    size_t         droppedBytes = 0;
+    bool           drained      = false;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_target == NULL || m_draining)
+        {
+            return;
+        }
+
+        m_draining = true;
+        m_target->AddRef();
+        target = m_target;
+
+        Expire_i(ProGetTickCount64(), &droppedMsgs, &droppedBytes);
+    }
+
+    CProStlVector<char> buf;
+    uint16_t            charset      = 0;
+    RTP_MSG_USER        dstUsers[255];
+    unsigned char       dstUserCount = 0;
+
+    while (1)
+    {
+        {
+            CProThreadMutexGuard mon(m_lock);
+
+            /*
+             * a newer connection takes over, and NULL stops the drain
+             */
+            if (m_target != target)
+            {
+                target->Release();
+                target = m_target;
+                if (target == NULL)
+                {
+                    m_draining = false;
+                    break;
+                }
+
+                target->AddRef();
+            }
+
+            int64_t             tick     = 0;
+            const void*         msg      = NULL;
+            size_t              size     = 0;
+            const RTP_MSG_USER* msgUsers = NULL;
+
+            if (!m_ring.Front(&tick, &msg, &size, &charset, &msgUsers, &dstUserCount))
+            {
+                SetPolling_i(false);
+                m_draining = false;
+                drained    = true;
+                break;
+            }
+
+            /*
+             * the rest waits for the target's queue to go down. A message
+             * larger than the redline is still tried on an empty queue
+             */
+            const size_t sendingBytes = target->GetSendingBytes();
+            if (sendingBytes > 0 && sendingBytes + size > target->GetOutputRedline())
+            {
+                SetPolling_i(true);
+                m_draining = false;
+                break;
+            }
+
+            /*
+             * copied, since the ring may grow while it's being sent
+             */
+            buf.assign((const char*)msg, (const char*)msg + size);
+            memcpy(dstUsers, msgUsers, sizeof(RTP_MSG_USER) * dstUserCount);
+            m_ring.Pop();
+        }
+
+        if (!target->SendMsg2(&buf[0], buf.size(), NULL, 0, charset, dstUsers, dstUserCount))
+        {
+            ++droppedMsgs;
+            droppedBytes += buf.size();
+        }
+    }
+
+    if (target != NULL)
+    {
+        target->Release();
+    }
+
+    if (droppedMsgs > 0 && m_observer != NULL)
+    {
+        m_observer->OnSendDropped(droppedMsgs, droppedBytes);
+    }
+
+    if (drained && m_observer != NULL)
+    {
+        m_observer->OnSendsDrained(this);
+    }
+}
+
+void
+CMsgPendingQueue::OnTimer(void*    factory,
+                          uint64_t timerId,
+                          int64_t  tick,
+                          int64_t  userData)
+{
+    assert(factory != NULL);
+    assert(timerId > 0);
+    if (factory == NULL || timerId == 0)
+    {
+        return;
+    }
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (timerId != m_timerId)
+        {
+            return;
+        }
+    }
+
+    Drain();
+}
+
+void
+CMsgPendingQueue::SetPolling_i(bool polling)
+{
+    if (m_reactor == NULL)
+    {
+        return;
+    }
+
+    if (polling && m_timerId == 0)
+    {
+        m_timerId = m_reactor->SetupTimer(
+            this, MSG_PENDING_DRAIN_INTERVAL, MSG_PENDING_DRAIN_INTERVAL);
+    }
+    else if (!polling && m_timerId != 0)
+    {
+        m_reactor->CancelTimer(m_timerId);
+        m_timerId = 0;
+    }
+}
+
+bool
+CMsgPendingQueue::IsDrained() const
+{
+    bool drained = false;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        drained = m_target != NULL && !m_draining && m_ring.GetMsgCount() == 0;
+    }
+
+    return drained;
+}
+
+size_t
+CMsgPendingQueue::GetMsgCount() const
+{
+    size_t msgCount = 0;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        msgCount = m_ring.GetMsgCount();
+    }
+
+    return msgCount;
+}
+
+void
+CMsgPendingQueue::Expire_i(int64_t tick,
+                           size_t* droppedMsgs,
+                           size_t* droppedBytes)
+{
+    if (m_maxAgeMs <= 0)
+    {
+        return;
+    }
+
+    int64_t             tick0        = 0;
+    const void*         buf          = NULL;
+    size_t              size         = 0;
+    uint16_t            charset      = 0;
+    const RTP_MSG_USER* dstUsers     = NULL;
+    unsigned char       dstUserCount = 0;
+
+    while (m_ring.Front(&tick0, &buf, &size, &charset, &dstUsers, &dstUserCount) &&
+        tick - tick0 > m_maxAgeMs)
+    {
+        ++*droppedMsgs;
+        *droppedBytes += m_ring.Pop();
+    }
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * The sends of a CMsgClient while it has no usable connection. The new
+ * connection is created and handshaked aside, and the messages sent in the
+ * meantime are held here, unless the old connection is still usable. With
+ * msgc_offline_bytes > 0, they are also held from the moment the old
+ * connection is closed, so an outage doesn't lose them.
+ *
+ * When the new connection is swapped in, it becomes the target, and the
+ * held messages are drained to it in order, without any lock held, by one
+ * thread at a time. The messages pushed meanwhile are queued behind them,
+ * and the queue passes any later message straight through, so a sender
+ * still holding an old snapshot can't overtake the drained ones.
+ *
+ * The drain stops where the next message would take the target over its
+ * redline, so a backlog larger than the redline isn't refused by it. The
+ * rest waits in the ring, and the drain goes on as the target's queue goes
+ * down, polled on the reactor and tried by each later push.
+ *
+ * The messages are kept in one contiguous ring of records:
+ *
+ *     [0..7]    the tick when it was held, in milliseconds
+ *     [8..11]   size of the record, a multiple of 8
+ *     [12..15]  size of the message
+ *     [16..17]  charset
+ *     [18]      count of the destination users
+ *     [19..23]  reserved
+ *     [24..]    the destination users, then the message
+ *
+ * A record never wraps. If it doesn't fit at the end of the ring, it's put
+ * at the beginning, and the rest of the end is skipped. The ring grows
+ * until maxBytes; after that, and beyond maxMsgs, the oldest messages are
+ * dropped to make room. Messages older than maxAgeInSeconds are dropped
+ * too, when the next one is held or when the queue is flushed. The drops
+ * are reported to the observer.
+ */
+
+#if !defined(MSG_PENDING_H)
+#define MSG_PENDING_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_timer_factory.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define MSG_PENDING_HEADER_SIZE    24
+#define MSG_PENDING_MIN_RING       (64 * 1024)
+#define MSG_PENDING_DRAIN_INTERVAL 20 /* ms, while stopped at the redline */
+
+class CMsgPendingQueue;
+class IProReactor;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class IMsgPendingObserver
+{
+public:
+
+    virtual ~IMsgPendingObserver() {}
+
+    virtual unsigned long AddRef() = 0;
+
+    virtual unsigned long Release() = 0;
+
+    /*
+     * msgCount messages of bytes in total have been dropped. called on the
+     * sending thread, or on the draining one
+     */
+    virtual void OnSendDropped(
+        size_t msgCount,
+        size_t bytes
+        ) = 0;
+
+    /*
+     * the held messages have all gone to the target. called on the draining
+     * thread
+     */
+    virtual void OnSendsDrained(CMsgPendingQueue* queue) = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+/*
+ * not thread-safe. CMsgPendingQueue keeps it under its lock
+ */
+class CMsgSendRing
+{
+public:
+
+    CMsgSendRing(size_t maxBytes); /* 0 for unlimited */
+
+    /*
+     * false if the message can't fit even in an empty ring. The oldest
+     * messages dropped to make room are added to *droppedMsgs and
+     * *droppedBytes
+     */
+    bool Push(
+        int64_t             tick,
+        const void*         buf1,
+        size_t              size1,
+        const void*         buf2,  /* = NULL */
+        size_t              size2, /* = 0 */
+        uint16_t            charset,
+        const RTP_MSG_USER* dstUsers,
+        unsigned char       dstUserCount,
+        size_t*             droppedMsgs,
+        size_t*             droppedBytes
+        );
+
+    /*
+     * the oldest message. false if the ring is empty
+     */
+    bool Front(
+        int64_t*             tick,
+        const void**         buf,
+        size_t*              size,
+        uint16_t*            charset,
+        const RTP_MSG_USER** dstUsers,
+        unsigned char*       dstUserCount
+        ) const;
+
+    /*
+     * drops the oldest message, and returns its size
+     */
+    size_t Pop();
+
+    size_t GetMsgCount() const
+    {
+        return m_msgCount;
+    }
+
+private:
+
+    bool Reserve_i(
+        size_t  recordSize,
+        size_t* droppedMsgs,
+        size_t* droppedBytes
+        );
+
+    void Grow_i(size_t capacity);
+
+private:
+
+    const size_t        m_maxBytes;
+    CProStlVector<char> m_buf;
+    size_t              m_head;     /* the oldest record */
+    size_t              m_tail;     /* where the next record goes */
+    size_t              m_wrapEnd;  /* the end of the records before the wrap */
+    bool                m_wrapped;  /* the records are [m_head, m_wrapEnd) + [0, m_tail) */
+    size_t              m_msgCount;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgPendingQueue : public IProOnTimer, public CProRefCount
+{
+public:
+
+    static CMsgPendingQueue* CreateInstance(
+        IMsgPendingObserver* observer,       /* = NULL */
+        IProReactor*         reactor,        /* = NULL, for no polling */
+        size_t               maxMsgs,        /* 0 for refusing all */
+        size_t               maxBytes,       /* 0 for unlimited */
+        unsigned int         maxAgeInSeconds /* 0 for unlimited */
+        );
+
+    /*
+     * stops the polling. call it before the last Release()
+     */
+    void Fini();
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+    /*
+     * false if the message is refused, by the limits or by the target
+     */
+    bool Push(
+        const void*         buf1,
+        size_t              size1,
+        const void*         buf2,  /* = NULL */
+        size_t              size2, /* = 0 */
+        uint16_t            charset,
+        const RTP_MSG_USER* dstUsers,
+        unsigned char       dstUserCount
+        );
+
+    /*
+     * the connection for Drain(). NULL for holding the messages again
+     */
+    void SetTarget(IRtpMsgClient* target);
+
+    /*
+     * sends the held messages to the target within its redline, and passes
+     * the later ones to it once none is left. The messages refused by the
+     * target are dropped. Call it without any lock held
+     */
+    void Drain();
+
+    /*
+     * true if there is a target, and nothing is left for it
+     */
+    bool IsDrained() const;
+
+    size_t GetMsgCount() const;
+
+private:
+
+    CMsgPendingQueue(
+        IMsgPendingObserver* observer,
+        IProReactor*         reactor,
+        size_t               maxMsgs,
+        size_t               maxBytes,
+        unsigned int         maxAgeInSeconds
+        );
+
+    virtual ~CMsgPendingQueue();
+
+    virtual void OnTimer(
+        void*    factory,
+        uint64_t timerId,
+        int64_t  tick,
+        int64_t  userData
+        );
+
+    /*
+     * with m_lock held
+     */
+    void SetPolling_i(bool polling);
+
+    void Expire_i(
+        int64_t tick,
+        size_t* droppedMsgs,
+        size_t* droppedBytes
+        );
+
+private:
+
+    IMsgPendingObserver* const m_observer;
+    IProReactor*               m_reactor;
+    uint64_t                   m_timerId;  /* while stopped at the redline */
+    const size_t               m_maxMsgs;
+    const int64_t              m_maxAgeMs;
+    CMsgSendRing               m_ring;
+    IRtpMsgClient*             m_target;
+    bool                       m_draining; /* a thread is in Drain() */
+    mutable CProThreadMutex    m_lock;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_PENDING_H */
@@ -29,6 +29,48 @@
 /////////////////////////////////////////////////////////////////////////////
 ////
 
+int64_t
+MsgReconnectBackoff(unsigned int intervalInSeconds,
+                    unsigned int maxIntervalInSeconds,
+                    unsigned int failures,
+                    double       random)
+{
+    if (intervalInSeconds == 0)
+    {
+        intervalInSeconds = 1;
+    }
+    if (maxIntervalInSeconds < intervalInSeconds)
+    {
+        maxIntervalInSeconds = intervalInSeconds;
+    }
+    if (random < 0)
+    {
+        random = 0;
+    }
+    if (random > 1)
+    {
+        random = 1;
+    }
+
+    const int64_t maxTickInterval = (int64_t)maxIntervalInSeconds * 1000;
+    int64_t       tickInterval    = (int64_t)intervalInSeconds * 1000;
+
+    for (unsigned int i = 0; i < failures && tickInterval < maxTickInterval; ++i)
+    {
+        tickInterval *= 2;
+    }
+
+    if (tickInterval > maxTickInterval)
+    {
+        tickInterval = maxTickInterval;
+    }
+
+    return (int64_t)(tickInterval * random);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
 CMsgReconnector*
 CMsgReconnector::CreateInstance()
 {
@@ -41,6 +83,7 @@ CMsgReconnector::CMsgReconnector()
     m_reactor     = NULL;
     m_timerId     = 0;
     m_connectTick = 0;
+    m_failures    = 0;
 }
 
 CMsgReconnector::~CMsgReconnector()
@@ -115,7 +158,8 @@ CMsgReconnector::Release()
 }
 
 void
-CMsgReconnector::Reconnect(unsigned int intervalInSeconds)
+CMsgReconnector::Reconnect(unsigned int intervalInSeconds,
+                           unsigned int maxIntervalInSeconds) /* = 0 */
 {
     if (intervalInSeconds == 0)
     {
@@ -130,6 +174,22 @@ CMsgReconnector::Reconnect(unsigned int intervalInSeconds)
             return;
         }
 
+        if (maxIntervalInSeconds > 0)
+        {
+            if (m_timerId != 0)
+            {
+                return;
+            }
+
+            const int64_t tickDelay = MsgReconnectBackoff(
+                intervalInSeconds, maxIntervalInSeconds, m_failures, ProRand_0_1());
+            ++m_failures;
+
+            m_timerId = m_reactor->SetupTimer(this, tickDelay, 0);
+
+            return;
+        }
+
         m_reactor->CancelTimer(m_timerId);
         m_timerId = 0;
 
@@ -146,6 +206,14 @@ CMsgReconnector::Reconnect(unsigned int intervalInSeconds)
     }
 }
 
+void
+CMsgReconnector::Reset()
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    m_failures = 0;
+}
+
 void
 CMsgReconnector::OnTimer(void*    factory,
                          uint64_t timerId,
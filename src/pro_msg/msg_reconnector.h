@@ -16,6 +16,15 @@
  * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
  */
 
+/*
+ * With a fixed interval, a reconnection is due intervalInSeconds after the
+ * last one. With maxIntervalInSeconds > 0, the delay of the n-th attempt
+ * since the last OnOkMsg() is drawn uniformly from
+ * [0, min(maxIntervalInSeconds, intervalInSeconds * 2^n)] ("full jitter"),
+ * so the clients of a restarted server come back spread out, and back off
+ * while it's still down.
+ */
+
 #if !defined(MSG_RECONNECTOR_H)
 #define MSG_RECONNECTOR_H
 
@@ -30,6 +39,16 @@
 class CMsgClient;
 class IProReactor;
 
+/*
+ * the delay of the attempt after failures failed ones, in milliseconds.
+ * random is in [0, 1]
+ */
+int64_t
+MsgReconnectBackoff(unsigned int intervalInSeconds,
+                    unsigned int maxIntervalInSeconds,
+                    unsigned int failures,
+                    double       random);
+
 /////////////////////////////////////////////////////////////////////////////
 ////
 
@@ -50,7 +69,19 @@ public:
 
     virtual unsigned long Release();
 
-    void Reconnect(unsigned int intervalInSeconds);
+    /*
+     * maxIntervalInSeconds 0 for a fixed interval. With backoff, a pending
+     * attempt is kept
+     */
+    void Reconnect(
+        unsigned int intervalInSeconds,
+        unsigned int maxIntervalInSeconds /* = 0 */
+        );
+
+    /*
+     * called on OnOkMsg(). the next attempt starts from intervalInSeconds
+     */
+    void Reset();
 
 private:
 
@@ -71,6 +102,7 @@ private:
     IProReactor*    m_reactor;
     uint64_t        m_timerId;
     int64_t         m_connectTick;
+    unsigned int    m_failures;
     CProThreadMutex m_lock;
 
     DECLARE_SGI_POOL(0)
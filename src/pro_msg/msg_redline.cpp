@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "msg_redline.h"
+#include "msg_snapshot.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgRedlineTable::CMsgRedlineTable()
+: m_defaultRedline(0),
+  m_classOverrides(0),
+  m_userOverrides(0)
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        m_classRedlines[i] = 0;
+    }
+}
+
+void
+CMsgRedlineTable::SetDefaultRedline(size_t redlineBytes)
+{
+    m_defaultRedline = redlineBytes;
+}
+
+void
+CMsgRedlineTable::SetClassRedline(unsigned char classId,
+                                  size_t        redlineBytes)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    const size_t oldRedlineBytes = m_classRedlines[classId].exchange(redlineBytes);
+    if (oldRedlineBytes == 0 && redlineBytes > 0)
+    {
+        ++m_classOverrides;
+    }
+    else if (oldRedlineBytes > 0 && redlineBytes == 0)
+    {
+        --m_classOverrides;
+    }
+}
+
+void
+CMsgRedlineTable::SetUserRedline(const RTP_MSG_USER& user,
+                                 size_t              redlineBytes)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (redlineBytes > 0)
+    {
+        m_userRedlines[user] = redlineBytes;
+    }
+    else if (m_userRedlines.erase(user) == 0)
+    {
+        return;
+    }
+
+    PublishUsers_i();
+}
+
+size_t
+CMsgRedlineTable::GetUserRedline(const RTP_MSG_USER& user) const
+{
+    if (m_userOverrides.load() == 0)
+    {
+        return 0;
+    }
+
+    CMsgSnapshotGuard guard(m_userSlot);
+
+    CMsgRedlineSnapshot* const snapshot = (CMsgRedlineSnapshot*)guard.Get();
+    if (snapshot == NULL)
+    {
+        return 0;
+    }
+
+    CProStlMap<RTP_MSG_USER, size_t>::const_iterator const itr =
+        snapshot->userRedlines.find(user);
+
+    return itr != snapshot->userRedlines.end() ? itr->second : 0;
+}
+
+size_t
+CMsgRedlineTable::GetRedline(const RTP_MSG_USER& user) const
+{
+    size_t redlineBytes = GetUserRedline(user);
+    if (redlineBytes == 0)
+    {
+        redlineBytes = m_classRedlines[user.classId].load();
+    }
+    if (redlineBytes == 0)
+    {
+        redlineBytes = m_defaultRedline.load();
+    }
+
+    return redlineBytes;
+}
+
+void
+CMsgRedlineTable::AddUser(const RTP_MSG_USER& user)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    m_classUsers[user.classId].insert(user);
+}
+
+void
+CMsgRedlineTable::RemoveUser(const RTP_MSG_USER& user)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    CProStlMap<unsigned char, CProStlSet<RTP_MSG_USER> >::iterator const itr =
+        m_classUsers.find(user.classId);
+    if (itr != m_classUsers.end())
+    {
+        itr->second.erase(user);
+        if (itr->second.size() == 0)
+        {
+            m_classUsers.erase(itr);
+        }
+    }
+
+    if (m_userRedlines.erase(user) > 0)
+    {
+        PublishUsers_i();
+    }
+}
+
+void
+CMsgRedlineTable::GetUsers(unsigned char                classId,
+                           CProStlVector<RTP_MSG_USER>& users) const
+{
+    users.clear();
+
+    CProThreadMutexGuard mon(m_lock);
+
+    CProStlMap<unsigned char, CProStlSet<RTP_MSG_USER> >::const_iterator const itr =
+        m_classUsers.find(classId);
+    if (itr != m_classUsers.end())
+    {
+        users.assign(itr->second.begin(), itr->second.end());
+    }
+}
+
+size_t
+CMsgRedlineTable::GetUserCount(unsigned char classId) const
+{
+    size_t userCount = 0;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        CProStlMap<unsigned char, CProStlSet<RTP_MSG_USER> >::const_iterator const itr =
+            m_classUsers.find(classId);
+        if (itr != m_classUsers.end())
+        {
+            userCount = itr->second.size();
+        }
+    }
+
+    return userCount;
+}
+
+void
+CMsgRedlineTable::Clear()
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    for (int i = 0; i < 256; ++i)
+    {
+        m_classRedlines[i] = 0;
+    }
+
+    m_userRedlines.clear();
+    m_classUsers.clear();
+    m_classOverrides = 0;
+
+    PublishUsers_i();
+}
+
+void
+CMsgRedlineTable::PublishUsers_i()
+{
+    m_userOverrides = (long)m_userRedlines.size();
+
+    /*
+     * the hot paths read the copy, and a change of the overrides is rare
+     */
+    if (m_userRedlines.size() == 0)
+    {
+        m_userSlot.Publish(NULL);
+    }
+    else
+    {
+        m_userSlot.Publish(CMsgRedlineSnapshot::CreateInstance(m_userRedlines));
+    }
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * libpronet applies one output redline to all users, and another one to
+ * all C2S links, also to the messages it routes between users. This table
+ * keeps the redlines overridden per classId and per user. CMsgServer never
+ * raises the redline of libpronet for them; it drops the destinations of
+ * its own messages whose queued bytes would exceed their own redlines with
+ * the message, and it applies the redline of class 255, the C2S links, to
+ * libpronet's C2S redline.
+ *
+ * The user overrides are published as an immutable snapshot, so a lookup
+ * takes no lock.
+ *
+ * It also keeps the direct users by classId, so that the queued bytes can
+ * be accounted per class.
+ */
+
+#if !defined(MSG_REDLINE_H)
+#define MSG_REDLINE_H
+
+#include "msg_snapshot.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgRedlineTable
+{
+public:
+
+    CMsgRedlineTable();
+
+    void SetDefaultRedline(size_t redlineBytes);
+
+    size_t GetDefaultRedline() const
+    {
+        return m_defaultRedline.load();
+    }
+
+    /*
+     * redlineBytes 0 for the default
+     */
+    void SetClassRedline(
+        unsigned char classId,
+        size_t        redlineBytes
+        );
+
+    /*
+     * 0 if not overridden
+     */
+    size_t GetClassRedline(unsigned char classId) const
+    {
+        return m_classRedlines[classId].load();
+    }
+
+    /*
+     * redlineBytes 0 for the class's one
+     */
+    void SetUserRedline(
+        const RTP_MSG_USER& user,
+        size_t              redlineBytes
+        );
+
+    /*
+     * lock-free. 0 if not overridden
+     */
+    size_t GetUserRedline(const RTP_MSG_USER& user) const;
+
+    bool HasOverrides() const
+    {
+        return m_classOverrides.load() > 0 || m_userOverrides.load() > 0;
+    }
+
+    /*
+     * lock-free. the effective redline of the user
+     */
+    size_t GetRedline(const RTP_MSG_USER& user) const;
+
+    /*
+     * a user's override is dropped when it's removed
+     */
+    void AddUser(const RTP_MSG_USER& user);
+
+    void RemoveUser(const RTP_MSG_USER& user);
+
+    void GetUsers(
+        unsigned char                classId,
+        CProStlVector<RTP_MSG_USER>& users
+        ) const;
+
+    size_t GetUserCount(unsigned char classId) const;
+
+    void Clear();
+
+private:
+
+    /*
+     * with m_lock held
+     */
+    void PublishUsers_i();
+
+private:
+
+    std::atomic<size_t>                                  m_defaultRedline;
+    std::atomic<size_t>                                  m_classRedlines[256];
+    std::atomic<long>                                    m_classOverrides;
+    std::atomic<long>                                    m_userOverrides;
+    CProStlMap<RTP_MSG_USER, size_t>                     m_userRedlines;
+    mutable CMsgSnapshotSlot                             m_userSlot; /* a copy of m_userRedlines */
+    CProStlMap<unsigned char, CProStlSet<RTP_MSG_USER> > m_classUsers;
+    mutable CProThreadMutex                              m_lock;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_REDLINE_H */
@@ -0,0 +1,445 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "msg_resolver.h"
+#include "pronet/pro_bsd_wrapper.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_time_util.h"
+#include "pronet/pro_z.h"
+#include <cstdio>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define MSG_HOSTS_LINE_SIZE 1024
+
+static CProThreadMutex g_s_lock;
+static CMsgResolver*   g_s_resolver = NULL;
+static unsigned long   g_s_users    = 0;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static
+bool
+IsSpace_i(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static
+bool
+IsIpLiteral_i(const char* text,
+              size_t      size)
+{
+    if (size == 0)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        if ((text[i] < '0' || text[i] > '9') && text[i] != '.')
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * the first line that names the host wins, as in /etc/hosts
+ */
+static
+bool
+LookupHostsFile_i(const char*    host,
+                  const char*    hostsFile,
+                  CProStlString& ip)
+{
+    FILE* const file = fopen(hostsFile, "r");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    bool ret = false;
+    char line[MSG_HOSTS_LINE_SIZE];
+
+    while (!ret && fgets(line, sizeof(line), file) != NULL)
+    {
+        char* const comment = strchr(line, '#');
+        if (comment != NULL)
+        {
+            *comment = '\0';
+        }
+
+        CProStlString address;
+        const char*   p = line;
+
+        while (*p != '\0')
+        {
+            while (IsSpace_i(*p))
+            {
+                ++p;
+            }
+
+            const char* const token = p;
+
+            while (*p != '\0' && !IsSpace_i(*p))
+            {
+                ++p;
+            }
+
+            if (p == token)
+            {
+                break;
+            }
+
+            if (address.empty())
+            {
+                if (!IsIpLiteral_i(token, p - token))
+                {
+                    break;
+                }
+
+                address.assign(token, p - token);
+            }
+            else if (strnicmp(token, host, p - token) == 0 && host[p - token] == '\0')
+            {
+                uint32_t ip2 = pbsd_inet_aton(address.c_str());
+                if (ip2 != (uint32_t)-1 && ip2 != 0)
+                {
+                    char ipString[64] = "";
+                    pbsd_inet_ntoa(ip2, ipString);
+
+                    ip  = ipString;
+                    ret = true;
+                }
+                break;
+            }
+        }
+    }
+
+    fclose(file);
+
+    return ret;
+}
+
+bool
+MsgResolveHost(const char*    host,
+               const char*    hostsFile,
+               CProStlString& ip)
+{
+    assert(host != NULL);
+    assert(host[0] != '\0');
+    if (host == NULL || host[0] == '\0')
+    {
+        return false;
+    }
+
+    if (hostsFile != NULL && hostsFile[0] != '\0' && LookupHostsFile_i(host, hostsFile, ip))
+    {
+        return true;
+    }
+
+    uint32_t ip2 = pbsd_inet_aton(host);
+    if (ip2 == (uint32_t)-1 || ip2 == 0)
+    {
+        return false;
+    }
+
+    char ipString[64] = "";
+    pbsd_inet_ntoa(ip2, ipString);
+
+    ip = ipString;
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgResolver*
+CMsgResolver::GetInstance()
+{
+    CProThreadMutexGuard mon(g_s_lock);
+
+    if (g_s_resolver == NULL)
+    {
+        CMsgResolver* const resolver = new CMsgResolver;
+        if (!resolver->Init())
+        {
+            resolver->Release();
+
+            return NULL;
+        }
+
+        g_s_resolver = resolver;
+    }
+
+    ++g_s_users;
+
+    return g_s_resolver;
+}
+
+void
+CMsgResolver::ReleaseInstance()
+{
+    CMsgResolver* resolver = NULL;
+
+    {
+        CProThreadMutexGuard mon(g_s_lock);
+
+        assert(g_s_users > 0);
+        if (g_s_users == 0)
+        {
+            return;
+        }
+
+        --g_s_users;
+        if (g_s_users > 0)
+        {
+            return;
+        }
+
+        resolver = g_s_resolver;
+        g_s_resolver = NULL;
+    }
+
+    resolver->Fini();
+    resolver->Release();
+}
+
+CMsgResolver::CMsgResolver()
+{
+    m_stopping = true;
+}
+
+CMsgResolver::~CMsgResolver()
+{
+    Fini();
+}
+
+bool
+CMsgResolver::Init()
+{
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        m_stopping = false;
+    }
+
+    if (Spawn(false))
+    {
+        return true;
+    }
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        m_stopping = true;
+    }
+
+    return false;
+}
+
+void
+CMsgResolver::Fini()
+{
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_stopping)
+        {
+            return;
+        }
+
+        m_stopping = true;
+        m_cond.Signal();
+    }
+
+    Wait();
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        m_requests.clear();
+        m_entries.clear();
+    }
+}
+
+unsigned long
+CMsgResolver::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CMsgResolver::Release()
+{
+    return CProRefCount::Release();
+}
+
+bool
+CMsgResolver::Resolve(const char*    host,
+                      const char*    hostsFile, /* = NULL */
+                      CProStlString& ip)
+{
+    assert(host != NULL);
+    assert(host[0] != '\0');
+    if (host == NULL || host[0] == '\0')
+    {
+        return false;
+    }
+
+    if (hostsFile == NULL)
+    {
+        hostsFile = "";
+    }
+
+    if (!MsgResolveHost(host, hostsFile, ip))
+    {
+        return false;
+    }
+
+    CProStlString key = hostsFile;
+    key += '\n';
+    key += host;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        MSG_RESOLVER_ENTRY& entry = m_entries[key];
+        entry.ip   = ip;
+        entry.tick = ProGetTickCount64();
+    }
+
+    return true;
+}
+
+bool
+CMsgResolver::Lookup(const char*    host,
+                     const char*    hostsFile, /* = NULL */
+                     unsigned int   ttlInSeconds,
+                     CProStlString& ip)
+{
+    assert(host != NULL);
+    assert(host[0] != '\0');
+    if (host == NULL || host[0] == '\0')
+    {
+        return false;
+    }
+
+    if (hostsFile == NULL)
+    {
+        hostsFile = "";
+    }
+
+    CProStlString key = hostsFile;
+    key += '\n';
+    key += host;
+
+    const int64_t tick = ProGetTickCount64();
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_stopping)
+        {
+            return false;
+        }
+
+        MSG_RESOLVER_ENTRY& entry = m_entries[key];
+
+        /*
+         * a stale address is still returned. It's the best one we have
+         * until the refresh is done. A host without an address is retried
+         * on each lookup
+         */
+        if (!entry.refreshing &&
+            (entry.ip.empty() || tick - entry.tick >= (int64_t)ttlInSeconds * 1000))
+        {
+            entry.refreshing = true;
+            m_requests.push_back(key);
+            m_cond.Signal();
+        }
+
+        if (entry.ip.empty())
+        {
+            return false;
+        }
+
+        ip = entry.ip;
+    }
+
+    return true;
+}
+
+void
+CMsgResolver::Svc()
+{
+    while (1)
+    {
+        CProStlString key;
+
+        {
+            CProThreadMutexGuard mon(m_lock);
+
+            while (!m_stopping && m_requests.size() == 0)
+            {
+                m_cond.Waitf(&m_lock);
+            }
+
+            if (m_stopping)
+            {
+                break;
+            }
+
+            key = m_requests.front();
+            m_requests.pop_front();
+        }
+
+        const CProStlString::size_type pos = key.find('\n');
+        assert(pos != CProStlString::npos);
+
+        CProStlString ip;
+        const bool    ok = MsgResolveHost(
+            key.c_str() + pos + 1, key.substr(0, pos).c_str(), ip);
+
+        {
+            CProThreadMutexGuard mon(m_lock);
+
+            /*
+             * a failed refresh keeps the last address for another TTL
+             */
+            MSG_RESOLVER_ENTRY& entry = m_entries[key];
+            if (ok)
+            {
+                entry.ip = ip;
+            }
+            entry.tick       = ProGetTickCount64();
+            entry.refreshing = false;
+        }
+    }
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * The host resolver of CMsgClient. A reconnection runs on a reactor thread,
+ * which must not wait for DNS, so it takes the cached address at once, and
+ * an address older than the TTL is refreshed by a worker in the background
+ * for the next one. The worker and the cache are shared by all the clients
+ * of the process.
+ *
+ * A hosts file overrides DNS. It's in the format of /etc/hosts:
+ *
+ *     # comment
+ *     10.0.0.1    hub1.example.com hub1
+ *
+ * and it's read again on every refresh, so an address can be moved by
+ * editing the file.
+ */
+
+#if !defined(MSG_RESOLVER_H)
+#define MSG_RESOLVER_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread.h"
+#include "pronet/pro_thread_mutex.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+/*
+ * blocking. hostsFile can be NULL or empty
+ */
+bool
+MsgResolveHost(const char*    host,
+               const char*    hostsFile,
+               CProStlString& ip);
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgResolver : public CProThreadBase, public CProRefCount
+{
+public:
+
+    /*
+     * the shared one. it's started by the first GetInstance(), and stopped
+     * by the last ReleaseInstance()
+     */
+    static CMsgResolver* GetInstance();
+
+    static void ReleaseInstance();
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+    /*
+     * blocking, e.g., for CMsgClient::Init(). the address is cached
+     */
+    bool Resolve(
+        const char*    host,
+        const char*    hostsFile, /* = NULL */
+        CProStlString& ip
+        );
+
+    /*
+     * never blocks. gets the cached address, and queues a refresh if it's
+     * older than ttlInSeconds or if there's none. false if nothing is cached
+     */
+    bool Lookup(
+        const char*    host,
+        const char*    hostsFile, /* = NULL */
+        unsigned int   ttlInSeconds,
+        CProStlString& ip
+        );
+
+private:
+
+    struct MSG_RESOLVER_ENTRY
+    {
+        MSG_RESOLVER_ENTRY()
+        {
+            tick       = 0;
+            refreshing = false;
+        }
+
+        CProStlString ip;
+        int64_t       tick;       /* of the last refresh */
+        bool          refreshing;
+
+        DECLARE_SGI_POOL(0)
+    };
+
+    CMsgResolver();
+
+    virtual ~CMsgResolver();
+
+    bool Init();
+
+    void Fini();
+
+    virtual void Svc();
+
+private:
+
+    bool                                          m_stopping;
+    CProStlMap<CProStlString, MSG_RESOLVER_ENTRY> m_entries; /* by hostsFile + '\n' + host */
+    CProStlDeque<CProStlString>                   m_requests;
+    CProThreadMutex                               m_lock;
+    CProThreadMutexCondition                      m_cond;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_RESOLVER_H */
@@ -17,6 +17,16 @@
  */
 
 #include "msg_server.h"
+#include "msg_affinity.h"
+#include "msg_auth.h"
+#include "msg_buffer.h"
+#include "msg_coalesce.h"
+#include "msg_credential.h"
+#include "msg_group.h"
+#include "msg_metrics.h"
+#include "msg_redline.h"
+#include "msg_snapshot.h"
+#include "msg_watermark.h"
 #include "pronet/pro_config_file.h"
 #include "pronet/pro_memory_pool.h"
 #include "pronet/pro_ref_count.h"
@@ -30,6 +40,38 @@
 /////////////////////////////////////////////////////////////////////////////
 ////
 
+/*
+ * the classId suffix of a config name, e.g., "2" of "msgs_password_cid2".
+ * 0 unless it's all digits, without a leading zero, and in [1, 255]
+ */
+static
+int
+ParseClassId_i(const char* suffix)
+{
+    if (suffix[0] < '1' || suffix[0] > '9')
+    {
+        return 0;
+    }
+
+    int classId = 0;
+
+    for (; *suffix != '\0'; ++suffix)
+    {
+        if (*suffix < '0' || *suffix > '9')
+        {
+            return 0;
+        }
+
+        classId = classId * 10 + (*suffix - '0');
+        if (classId > 255)
+        {
+            return 0;
+        }
+    }
+
+    return classId;
+}
+
 static
 void
 ReadConfig_i(const char*                     argv0,
@@ -43,6 +85,8 @@ ReadConfig_i(const char*                     argv0,
     configInfo.msgs_ssl_crlfiles.clear();
     configInfo.msgs_ssl_certfiles.clear();
 
+    CProStlVector<bool> passwordSet(256, false);
+
     int i = 0;
     int c = (int)configs.size();
 
@@ -67,9 +111,9 @@ ReadConfig_i(const char*                     argv0,
                 configInfo.msgs_hub_port = (unsigned short)value;
             }
         }
-        else if (stricmp(configName.c_str(), "msgs_password_cid1") == 0)
+        else if (stricmp(configName.c_str(), "msgs_password_cidx") == 0)
         {
-            configInfo.msgs_password_cid1 = configValue;
+            configInfo.msgs_password_cidx = configValue;
 
             if (!configValue.empty())
             {
@@ -77,19 +121,15 @@ ReadConfig_i(const char*                     argv0,
                 configValue = "";
             }
         }
-        else if (stricmp(configName.c_str(), "msgs_password_cid2") == 0)
+        else if (configName.length() > 17 &&
+            stricmp(configName.substr(0, 17).c_str(), "msgs_password_cid") == 0)
         {
-            configInfo.msgs_password_cid2 = configValue;
-
-            if (!configValue.empty())
+            int classId = ParseClassId_i(configName.c_str() + 17);
+            if (classId > 0)
             {
-                ProZeroMemory(&configValue[0], configValue.length());
-                configValue = "";
+                configInfo.msgs_password_cid[classId] = configValue;
+                passwordSet[classId]                  = true;
             }
-        }
-        else if (stricmp(configName.c_str(), "msgs_password_cid255") == 0)
-        {
-            configInfo.msgs_password_cid255 = configValue;
 
             if (!configValue.empty())
             {
@@ -97,15 +137,20 @@ ReadConfig_i(const char*                     argv0,
                 configValue = "";
             }
         }
-        else if (stricmp(configName.c_str(), "msgs_password_cidx") == 0)
+        else if (stricmp(configName.c_str(), "msgs_password_file") == 0)
         {
-            configInfo.msgs_password_cidx = configValue;
-
             if (!configValue.empty())
             {
-                ProZeroMemory(&configValue[0], configValue.length());
-                configValue = "";
+                if (configValue[0] == '.' ||
+                    configValue.find_first_of("\\/") == CProStlString::npos)
+                {
+                    CProStlString fileName = exeRoot;
+                    fileName += configValue;
+                    configValue = fileName;
+                }
             }
+
+            configInfo.msgs_password_file = configValue;
         }
         else if (stricmp(configName.c_str(), "msgs_handshake_timeout") == 0)
         {
@@ -123,6 +168,64 @@ ReadConfig_i(const char*                     argv0,
                 configInfo.msgs_redline_bytes = value;
             }
         }
+        else if (configName.length() > 22 &&
+            stricmp(configName.substr(0, 22).c_str(), "msgs_redline_bytes_cid") == 0)
+        {
+            int classId = ParseClassId_i(configName.c_str() + 22);
+            int value   = atoi(configValue.c_str());
+            if (classId > 0 && value > 0)
+            {
+                configInfo.msgs_redline_bytes_cid[classId] = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgs_output_high_water") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value >= 0)
+            {
+                configInfo.msgs_output_high_water = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgs_output_low_water") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value >= 0)
+            {
+                configInfo.msgs_output_low_water = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgs_reactor_cpus") == 0)
+        {
+            CProStlVector<unsigned int> cpus;
+            if (MsgParseCpuList(configValue.c_str(), cpus))
+            {
+                configInfo.msgs_reactor_cpus = cpus;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgs_auth_threads") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value >= 0 && value <= 100)
+            {
+                configInfo.msgs_auth_threads = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgs_auth_queue_size") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value > 0)
+            {
+                configInfo.msgs_auth_queue_size = value;
+            }
+        }
+        else if (stricmp(configName.c_str(), "msgs_auth_timeout") == 0)
+        {
+            int value = atoi(configValue.c_str());
+            if (value > 0)
+            {
+                configInfo.msgs_auth_timeout = value;
+            }
+        }
         else if (stricmp(configName.c_str(), "msgs_enable_ssl") == 0)
         {
             configInfo.msgs_enable_ssl = atoi(configValue.c_str()) != 0;
@@ -208,6 +311,162 @@ ReadConfig_i(const char*                     argv0,
         {
         }
     } /* end of for () */
+
+    /*
+     * the classes without their own password
+     */
+    for (i = 0; i < 256; ++i)
+    {
+        if (!passwordSet[i])
+        {
+            configInfo.msgs_password_cid[i] = configInfo.msgs_password_cidx;
+        }
+    }
+}
+
+static
+bool
+LoadConfig_i(const char*             argv0,
+             const char*             configFileName,
+             MSG_SERVER_CONFIG_INFO& configInfo)
+{
+    assert(configFileName != NULL);
+    assert(configFileName[0] != '\0');
+    if (configFileName == NULL || configFileName[0] == '\0')
+    {
+        return false;
+    }
+
+    char exeRoot[1024] = "";
+    ProGetExeDir_(exeRoot, argv0);
+
+    CProStlString configFileName2 = configFileName;
+    if (configFileName2[0] == '.' ||
+        configFileName2.find_first_of("\\/") == CProStlString::npos)
+    {
+        CProStlString fileName = exeRoot;
+        fileName += configFileName2;
+        configFileName2 = fileName;
+    }
+
+    CProConfigFile configFile;
+    configFile.Init(configFileName2.c_str());
+
+    CProStlVector<PRO_CONFIG_ITEM> configs;
+    if (!configFile.Read(configs))
+    {
+        return false;
+    }
+
+    ReadConfig_i(argv0, configs, configInfo);
+
+    return true;
+}
+
+static
+const char*
+FindPassword_i(const MSG_SERVER_CONFIG_INFO& configInfo,
+               const CMsgCredentialTable*    credentials, /* = NULL */
+               const RTP_MSG_USER&           user)
+{
+    const char* password = NULL;
+
+    if (credentials != NULL)
+    {
+        password = credentials->Find(user);
+    }
+
+    if (password == NULL)
+    {
+        password = configInfo.msgs_password_cid[user.classId].c_str();
+    }
+
+    return password;
+}
+
+static
+void
+CheckWatermark_i(CMsgServerSnapshot* snapshot,
+                 const RTP_MSG_USER* dstUsers,
+                 size_t              dstUserCount)
+{
+    CMsgWatermark* const watermark = snapshot->watermark;
+    if (watermark == NULL || !watermark->IsEnabled())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < dstUserCount; ++i)
+    {
+        watermark->Check(dstUsers[i], snapshot->msgServer->GetSendingBytes(&dstUsers[i]));
+    }
+}
+
+/*
+ * sends to the destinations whose queues stay within their own redlines
+ * with the message. false if any destination is dropped or libpronet fails
+ */
+static
+bool
+SendMsg2_i(CMsgServerSnapshot*     snapshot,
+           const CMsgRedlineTable* redlineTable,
+           CMsgMetrics*            metrics,
+           const void*             buf1,
+           size_t                  size1,
+           const void*             buf2,
+           size_t                  size2,
+           uint16_t                charset,
+           const RTP_MSG_USER*     dstUsers,
+           unsigned char           dstUserCount)
+{
+    if (!redlineTable->HasOverrides())
+    {
+        if (!snapshot->msgServer->SendMsg2(
+            buf1, size1, buf2, size2, charset, dstUsers, dstUserCount))
+        {
+            metrics->AddSend(size1 + size2, 0, dstUserCount);
+
+            return false;
+        }
+
+        metrics->AddSend(size1 + size2, dstUserCount, 0);
+        CheckWatermark_i(snapshot, dstUsers, dstUserCount);
+
+        return true;
+    }
+
+    RTP_MSG_USER  passedUsers[255];
+    unsigned char passedUserCount = 0;
+
+    for (int i = 0; i < (int)dstUserCount; ++i)
+    {
+        size_t redlineBytes = redlineTable->GetRedline(dstUsers[i]);
+        if (snapshot->msgServer->GetSendingBytes(&dstUsers[i]) + size1 + size2 <= redlineBytes)
+        {
+            passedUsers[passedUserCount] = dstUsers[i];
+            ++passedUserCount;
+        }
+    }
+
+    if (passedUserCount == 0)
+    {
+        metrics->AddSend(size1 + size2, 0, dstUserCount);
+
+        return false;
+    }
+
+    if (!snapshot->msgServer->SendMsg2(
+        buf1, size1, buf2, size2, charset, passedUsers, passedUserCount))
+    {
+        metrics->AddSend(size1 + size2, 0, dstUserCount);
+
+        return false;
+    }
+
+    metrics->AddSend(size1 + size2, passedUserCount, dstUserCount - passedUserCount);
+    CheckWatermark_i(snapshot, passedUsers, passedUserCount);
+
+    return passedUserCount == dstUserCount;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -219,16 +478,61 @@ CMsgServer::CreateInstance()
     return new CMsgServer;
 }
 
+IProReactor*
+CMsgServer::CreateReactor(unsigned int                       threadCount,
+                          const char*                        argv0,         /* = NULL */
+                          const char*                        configFileName,
+                          const CProStlVector<unsigned int>* cpus)          /* = NULL */
+{
+    assert(threadCount > 0);
+    if (threadCount == 0)
+    {
+        return NULL;
+    }
+
+    if (cpus != NULL)
+    {
+        return MsgCreateReactor(threadCount, *cpus);
+    }
+
+    MSG_SERVER_CONFIG_INFO configInfo;
+    if (!LoadConfig_i(argv0, configFileName, configInfo))
+    {
+        return NULL;
+    }
+
+    return MsgCreateReactor(threadCount, configInfo.msgs_reactor_cpus);
+}
+
 CMsgServer::CMsgServer()
 {
-    m_reactor   = NULL;
-    m_sslConfig = NULL;
-    m_msgServer = NULL;
+    m_reactor         = NULL;
+    m_sslConfig       = NULL;
+    m_msgServer       = NULL;
+    m_snapshotSlot    = new CMsgSnapshotSlot;
+    m_groupTable      = new CMsgGroupTable;
+    m_redlineTable    = new CMsgRedlineTable;
+    m_c2sRedlineBytes = 0;
+    m_authPool        = CMsgAuthPool::CreateInstance();
+    m_watermark       = NULL;
+    m_credentials     = NULL;
+    m_metrics         = new CMsgMetrics;
 }
 
 CMsgServer::~CMsgServer()
 {
     Fini();
+
+    m_authPool->Release();
+    m_authPool = NULL;
+    delete m_metrics;
+    m_metrics = NULL;
+    delete m_redlineTable;
+    m_redlineTable = NULL;
+    delete m_groupTable;
+    m_groupTable = NULL;
+    delete m_snapshotSlot;
+    m_snapshotSlot = NULL;
 }
 
 bool
@@ -246,30 +550,12 @@ CMsgServer::Init(IProReactor*   reactor,
         return false;
     }
 
-    char exeRoot[1024] = "";
-    ProGetExeDir_(exeRoot, argv0);
-
-    CProStlString configFileName2 = configFileName;
-    if (configFileName2[0] == '.' ||
-        configFileName2.find_first_of("\\/") == CProStlString::npos)
-    {
-        CProStlString fileName = exeRoot;
-        fileName += configFileName2;
-        configFileName2 = fileName;
-    }
-
-    CProConfigFile configFile;
-    configFile.Init(configFileName2.c_str());
-
-    CProStlVector<PRO_CONFIG_ITEM> configs;
-    if (!configFile.Read(configs))
+    MSG_SERVER_CONFIG_INFO configInfo;
+    if (!LoadConfig_i(argv0, configFileName, configInfo))
     {
         return false;
     }
 
-    MSG_SERVER_CONFIG_INFO configInfo;
-    ReadConfig_i(argv0, configs, configInfo);
-
     /*
      * override
      */
@@ -282,8 +568,25 @@ CMsgServer::Init(IProReactor*   reactor,
         configInfo.msgs_hub_port = serviceHubPort;
     }
 
-    PRO_SSL_SERVER_CONFIG* sslConfig = NULL;
-    IRtpMsgServer*         msgServer = NULL;
+    /*
+     * loaded out of the lock. it may have millions of records
+     */
+    CMsgCredentialTable* credentials = NULL;
+    if (!configInfo.msgs_password_file.empty())
+    {
+        credentials = CMsgCredentialTable::CreateInstance(configInfo.msgs_password_file.c_str());
+        if (credentials == NULL)
+        {
+            return false;
+        }
+    }
+
+    PRO_SSL_SERVER_CONFIG* sslConfig       = NULL;
+    IRtpMsgServer*         msgServer       = NULL;
+    CMsgWatermark*         watermark       = NULL;
+    size_t                 highBytes       = 0;
+    size_t                 lowBytes        = 0;
+    size_t                 c2sRedlineBytes = 0;
 
     {
         CProThreadMutexGuard mon(m_lock);
@@ -385,20 +688,68 @@ CMsgServer::Init(IProReactor*   reactor,
         else
         {
             msgServer->SetOutputRedlineToUsr(configInfo.msgs_redline_bytes);
+            configInfo.msgs_redline_bytes = (unsigned int)msgServer->GetOutputRedlineToUsr();
+            c2sRedlineBytes = msgServer->GetOutputRedlineToC2s();
+        }
+
+        watermark = CMsgWatermark::CreateInstance();
+        if (!watermark->Init(this, reactor,
+            configInfo.msgs_output_high_water, configInfo.msgs_output_low_water))
+        {
+            goto EXIT;
+        }
+
+        if (configInfo.msgs_auth_threads > 0 &&
+            !m_authPool->Init(this, reactor, configInfo.msgs_auth_threads,
+            configInfo.msgs_auth_queue_size, configInfo.msgs_auth_timeout))
+        {
+            goto EXIT;
         }
 
+        watermark->GetMarks(&highBytes, &lowBytes);
+        configInfo.msgs_output_high_water = (unsigned int)highBytes;
+        configInfo.msgs_output_low_water  = (unsigned int)lowBytes;
+
         m_reactor       = reactor;
         m_msgConfigInfo = configInfo;
         m_sslConfig     = sslConfig;
         m_msgServer     = msgServer;
+        m_watermark     = watermark;
+        m_credentials   = credentials;
+
+        m_c2sRedlineBytes = c2sRedlineBytes;
+
+        m_redlineTable->Clear();
+        m_redlineTable->SetDefaultRedline(configInfo.msgs_redline_bytes);
+
+        for (int i = 1; i < 256; ++i)
+        {
+            m_redlineTable->SetClassRedline((unsigned char)i, configInfo.msgs_redline_bytes_cid[i]);
+        }
+
+        ApplyRedline_i();
+
+        m_snapshotSlot->Publish(
+            CMsgServerSnapshot::CreateInstance(msgServer, configInfo, watermark, credentials));
     }
 
     return true;
 
 EXIT:
 
+    m_authPool->Fini();
+
+    if (watermark != NULL)
+    {
+        watermark->Fini();
+        watermark->Release();
+    }
     DeleteRtpMsgServer(msgServer);
     ProSslServerConfig_Delete(sslConfig);
+    if (credentials != NULL)
+    {
+        credentials->Release();
+    }
 
     return false;
 }
@@ -406,8 +757,10 @@ EXIT:
 void
 CMsgServer::Fini()
 {
-    PRO_SSL_SERVER_CONFIG* sslConfig = NULL;
-    IRtpMsgServer*         msgServer = NULL;
+    PRO_SSL_SERVER_CONFIG* sslConfig   = NULL;
+    IRtpMsgServer*         msgServer   = NULL;
+    CMsgWatermark*         watermark   = NULL;
+    CMsgCredentialTable*   credentials = NULL;
 
     {
         CProThreadMutexGuard mon(m_lock);
@@ -417,6 +770,12 @@ CMsgServer::Fini()
             return;
         }
 
+        m_snapshotSlot->Publish(NULL);
+
+        credentials = m_credentials;
+        m_credentials = NULL;
+        watermark = m_watermark;
+        m_watermark = NULL;
         msgServer = m_msgServer;
         m_msgServer = NULL;
         sslConfig = m_sslConfig;
@@ -424,8 +783,21 @@ CMsgServer::Fini()
         m_reactor = NULL;
     }
 
+    m_authPool->Fini();
+    watermark->Fini();
+    watermark->Release();
     DeleteRtpMsgServer(msgServer);
     ProSslServerConfig_Delete(sslConfig);
+    if (credentials != NULL)
+    {
+        credentials->Release();
+    }
+
+    /*
+     * no more users
+     */
+    m_groupTable->Clear();
+    m_redlineTable->Clear();
 }
 
 unsigned long
@@ -475,11 +847,12 @@ CMsgServer::GetSslSuite(const RTP_MSG_USER& user,
     strcpy(suiteName, "NONE");
 
     {
-        CProThreadMutexGuard mon(m_lock);
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        if (m_msgServer != NULL)
+        CMsgServerSnapshot* snapshot = (CMsgServerSnapshot*)guard.Get();
+        if (snapshot != NULL)
         {
-            m_msgServer->GetSslSuite(&user, suiteName);
+            snapshot->msgServer->GetSslSuite(&user, suiteName);
         }
     }
 
@@ -492,11 +865,12 @@ CMsgServer::GetUserCount() const
     size_t baseUserCount = 0;
 
     {
-        CProThreadMutexGuard mon(m_lock);
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        if (m_msgServer != NULL)
+        CMsgServerSnapshot* snapshot = (CMsgServerSnapshot*)guard.Get();
+        if (snapshot != NULL)
         {
-            m_msgServer->GetUserCount(NULL, &baseUserCount, NULL);
+            snapshot->msgServer->GetUserCount(NULL, &baseUserCount, NULL);
         }
     }
 
@@ -506,27 +880,76 @@ CMsgServer::GetUserCount() const
 void
 CMsgServer::KickoutUser(const RTP_MSG_USER& user)
 {
-    CProThreadMutexGuard mon(m_lock);
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-    if (m_reactor == NULL || m_msgServer == NULL)
+    CMsgServerSnapshot* snapshot = (CMsgServerSnapshot*)guard.Get();
+    if (snapshot == NULL)
     {
         return;
     }
 
-    m_msgServer->KickoutUser(&user);
+    snapshot->msgServer->KickoutUser(&user);
+    m_metrics->AddKickout();
 }
 
-bool
-CMsgServer::SendMsg(const void*         buf,
-                    size_t              size,
-                    uint16_t            charset,
-                    const RTP_MSG_USER* dstUsers,
-                    unsigned char       dstUserCount)
+void
+CMsgServer::GetMetrics(MSG_SERVER_METRICS& metrics) const
 {
-    return SendMsg2(buf, size, NULL, 0, charset, dstUsers, dstUserCount);
+    m_metrics->GetSnapshot(metrics);
 }
 
-bool
+void
+CMsgServer::ResetMetrics()
+{
+    m_metrics->Reset();
+}
+
+bool
+CMsgServer::IsAuthAsync() const
+{
+    bool async = false;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        async = m_msgConfigInfo.msgs_auth_threads > 0;
+    }
+
+    return async;
+}
+
+void
+CMsgServer::AcceptUser(const MSG_AUTH_REQUEST& request,
+                       const char*             password)
+{
+    assert(password != NULL);
+    if (password == NULL)
+    {
+        RejectUser(request);
+
+        return;
+    }
+
+    m_authPool->Complete(request, password);
+}
+
+void
+CMsgServer::RejectUser(const MSG_AUTH_REQUEST& request)
+{
+    m_authPool->Complete(request, NULL);
+}
+
+bool
+CMsgServer::SendMsg(const void*         buf,
+                    size_t              size,
+                    uint16_t            charset,
+                    const RTP_MSG_USER* dstUsers,
+                    unsigned char       dstUserCount)
+{
+    return SendMsg2(buf, size, NULL, 0, charset, dstUsers, dstUserCount);
+}
+
+bool
 CMsgServer::SendMsg2(const void*         buf1,
                      size_t              size1,
                      const void*         buf2,  /* = NULL */
@@ -535,24 +958,52 @@ CMsgServer::SendMsg2(const void*         buf1,
                      const RTP_MSG_USER* dstUsers,
                      unsigned char       dstUserCount)
 {
-    IRtpMsgServer* msgServer = NULL;
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
 
+    CMsgServerSnapshot* snapshot = (CMsgServerSnapshot*)guard.Get();
+    if (snapshot == NULL)
     {
-        CProThreadMutexGuard mon(m_lock);
+        return false;
+    }
 
-        if (m_reactor == NULL || m_msgServer == NULL)
-        {
-            return false;
-        }
+    return SendMsg2_i(snapshot, m_redlineTable, m_metrics,
+        buf1, size1, buf2, size2, charset, dstUsers, dstUserCount);
+}
 
-        m_msgServer->AddRef();
-        msgServer = m_msgServer;
+bool
+CMsgServer::SendMsgV(const MSG_SEGMENT*  segments,
+                     size_t              segmentCount,
+                     uint16_t            charset,
+                     const RTP_MSG_USER* dstUsers,
+                     unsigned char       dstUserCount)
+{
+    const void* buf1  = NULL;
+    size_t      size1 = 0;
+    const void* buf2  = NULL;
+    size_t      size2 = 0;
+
+    if (!MsgSegmentsToPair(segments, segmentCount, &buf1, &size1, &buf2, &size2))
+    {
+        return false;
     }
 
-    bool ret = msgServer->SendMsg2(buf1, size1, buf2, size2, charset, dstUsers, dstUserCount);
-    msgServer->Release();
+    return SendMsg2(buf1, size1, buf2, size2, charset, dstUsers, dstUserCount);
+}
 
-    return ret;
+bool
+CMsgServer::SendBuffer(const CMsgBuffer*   msgBuffer,
+                       uint16_t            charset,
+                       const RTP_MSG_USER* dstUsers,
+                       unsigned char       dstUserCount)
+{
+    assert(msgBuffer != NULL);
+    if (msgBuffer == NULL)
+    {
+        return false;
+    }
+
+    return SendMsg2(msgBuffer->GetData(), msgBuffer->GetSize(), NULL, 0,
+        charset, dstUsers, dstUserCount);
 }
 
 void
@@ -567,6 +1018,11 @@ CMsgServer::SetOutputRedline(size_t redlineBytes)
 
     m_msgServer->SetOutputRedlineToUsr(redlineBytes);
     m_msgConfigInfo.msgs_redline_bytes = (unsigned int)m_msgServer->GetOutputRedlineToUsr();
+    m_redlineTable->SetDefaultRedline(m_msgConfigInfo.msgs_redline_bytes);
+
+    m_snapshotSlot->Publish(
+        CMsgServerSnapshot::CreateInstance(
+            m_msgServer, m_msgConfigInfo, m_watermark, m_credentials));
 }
 
 size_t
@@ -583,23 +1039,382 @@ CMsgServer::GetOutputRedline() const
     return redlineBytes;
 }
 
+void
+CMsgServer::SetClassOutputRedline(unsigned char classId,
+                                  size_t        redlineBytes)
+{
+    assert(classId > 0);
+    if (classId == 0)
+    {
+        return;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_reactor == NULL || m_msgServer == NULL)
+    {
+        return;
+    }
+
+    m_redlineTable->SetClassRedline(classId, redlineBytes);
+    m_msgConfigInfo.msgs_redline_bytes_cid[classId] = (unsigned int)redlineBytes;
+
+    ApplyRedline_i();
+
+    m_snapshotSlot->Publish(
+        CMsgServerSnapshot::CreateInstance(
+            m_msgServer, m_msgConfigInfo, m_watermark, m_credentials));
+}
+
+size_t
+CMsgServer::GetClassOutputRedline(unsigned char classId) const
+{
+    size_t redlineBytes = m_redlineTable->GetClassRedline(classId);
+    if (redlineBytes == 0)
+    {
+        redlineBytes = GetOutputRedline();
+    }
+
+    return redlineBytes;
+}
+
+void
+CMsgServer::SetUserOutputRedline(const RTP_MSG_USER& user,
+                                 size_t              redlineBytes)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_reactor == NULL || m_msgServer == NULL)
+    {
+        return;
+    }
+
+    m_redlineTable->SetUserRedline(user, redlineBytes);
+}
+
+size_t
+CMsgServer::GetUserOutputRedline(const RTP_MSG_USER& user) const
+{
+    return m_redlineTable->GetRedline(user);
+}
+
+size_t
+CMsgServer::GetClassSendingBytes(unsigned char classId) const
+{
+    CProStlVector<RTP_MSG_USER> users;
+    m_redlineTable->GetUsers(classId, users);
+
+    size_t sendingBytes = 0;
+
+    {
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
+
+        CMsgServerSnapshot* snapshot = (CMsgServerSnapshot*)guard.Get();
+        if (snapshot != NULL)
+        {
+            int i = 0;
+            int c = (int)users.size();
+
+            for (; i < c; ++i)
+            {
+                sendingBytes += snapshot->msgServer->GetSendingBytes(&users[i]);
+            }
+        }
+    }
+
+    return sendingBytes;
+}
+
+size_t
+CMsgServer::GetClassUserCount(unsigned char classId) const
+{
+    return m_redlineTable->GetUserCount(classId);
+}
+
 size_t
 CMsgServer::GetSendingBytes(const RTP_MSG_USER& user) const
 {
     size_t sendingBytes = 0;
 
     {
-        CProThreadMutexGuard mon(m_lock);
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        if (m_msgServer != NULL)
+        CMsgServerSnapshot* snapshot = (CMsgServerSnapshot*)guard.Get();
+        if (snapshot != NULL)
         {
-            sendingBytes = m_msgServer->GetSendingBytes(&user);
+            sendingBytes = snapshot->msgServer->GetSendingBytes(&user);
         }
     }
 
     return sendingBytes;
 }
 
+void
+CMsgServer::SetOutputWatermarks(size_t highBytes,
+                                size_t lowBytes)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_reactor == NULL || m_watermark == NULL)
+    {
+        return;
+    }
+
+    m_watermark->SetMarks(highBytes, lowBytes);
+    m_watermark->GetMarks(&highBytes, &lowBytes);
+    m_msgConfigInfo.msgs_output_high_water = (unsigned int)highBytes;
+    m_msgConfigInfo.msgs_output_low_water  = (unsigned int)lowBytes;
+
+    m_snapshotSlot->Publish(
+        CMsgServerSnapshot::CreateInstance(
+            m_msgServer, m_msgConfigInfo, m_watermark, m_credentials));
+}
+
+void
+CMsgServer::GetOutputWatermarks(size_t* highBytes,
+                                size_t* lowBytes) const
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (highBytes != NULL)
+    {
+        *highBytes = m_msgConfigInfo.msgs_output_high_water;
+    }
+    if (lowBytes != NULL)
+    {
+        *lowBytes  = m_msgConfigInfo.msgs_output_low_water;
+    }
+}
+
+bool
+CMsgServer::CreateGroup(uint64_t groupId)
+{
+    return m_groupTable->CreateGroup(groupId);
+}
+
+void
+CMsgServer::DeleteGroup(uint64_t groupId)
+{
+    m_groupTable->DeleteGroup(groupId);
+}
+
+bool
+CMsgServer::JoinGroup(uint64_t            groupId,
+                      const RTP_MSG_USER& user)
+{
+    return m_groupTable->JoinGroup(groupId, user);
+}
+
+void
+CMsgServer::LeaveGroup(uint64_t            groupId,
+                       const RTP_MSG_USER& user)
+{
+    m_groupTable->LeaveGroup(groupId, user);
+}
+
+size_t
+CMsgServer::GetGroupMemberCount(uint64_t groupId) const
+{
+    return m_groupTable->GetMemberCount(groupId);
+}
+
+bool
+CMsgServer::PublishMsg(uint64_t    groupId,
+                       const void* buf,
+                       size_t      size,
+                       uint16_t    charset)
+{
+    return PublishMsg2(groupId, buf, size, NULL, 0, charset);
+}
+
+bool
+CMsgServer::PublishMsg2(uint64_t    groupId,
+                        const void* buf1,
+                        size_t      size1,
+                        const void* buf2,  /* = NULL */
+                        size_t      size2, /* = 0 */
+                        uint16_t    charset)
+{
+    CMsgGroupMembers* members = m_groupTable->GetMembers(groupId);
+    if (members == NULL)
+    {
+        return false;
+    }
+
+    bool ret = true;
+
+    {
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
+
+        CMsgServerSnapshot* snapshot = (CMsgServerSnapshot*)guard.Get();
+        if (snapshot == NULL)
+        {
+            ret = false;
+        }
+        else
+        {
+            const CProStlVector<RTP_MSG_USER>& users = members->users;
+
+            size_t i = 0;
+            size_t c = users.size();
+
+            while (i < c)
+            {
+                size_t count = c - i;
+                if (count > 255)
+                {
+                    count = 255;
+                }
+
+                if (!SendMsg2_i(snapshot, m_redlineTable, m_metrics,
+                    buf1, size1, buf2, size2, charset, &users[i], (unsigned char)count))
+                {
+                    ret = false;
+                }
+
+                i += count;
+            }
+        }
+    }
+
+    members->Release();
+
+    return ret;
+}
+
+bool
+CMsgServer::PublishBuffer(uint64_t          groupId,
+                          const CMsgBuffer* msgBuffer,
+                          uint16_t          charset)
+{
+    assert(msgBuffer != NULL);
+    if (msgBuffer == NULL)
+    {
+        return false;
+    }
+
+    return PublishMsg2(groupId, msgBuffer->GetData(), msgBuffer->GetSize(), NULL, 0, charset);
+}
+
+void
+CMsgServer::ApplyRedline_i()
+{
+    /*
+     * libpronet's redlines also cover the messages it routes between users,
+     * so they are never raised for the overrides. the redline to the users
+     * stays msgs_redline_bytes, and the one to the C2S links follows class
+     * 255. SendMsg2_i() applies the other overrides to the server's messages
+     */
+    size_t c2sRedlineBytes = m_redlineTable->GetClassRedline(255);
+    if (c2sRedlineBytes == 0)
+    {
+        c2sRedlineBytes = m_c2sRedlineBytes;
+    }
+
+    m_msgServer->SetOutputRedlineToC2s(c2sRedlineBytes);
+}
+
+bool
+CMsgServer::IsCurrent(IRtpMsgServer* msgServer) const
+{
+    if (msgServer == NULL)
+    {
+        return false;
+    }
+
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
+
+    CMsgServerSnapshot* snapshot = (CMsgServerSnapshot*)guard.Get();
+
+    return snapshot != NULL && snapshot->msgServer == msgServer;
+}
+
+void
+CMsgServer::InitUserState(const RTP_MSG_USER& user,
+                          const RTP_MSG_USER* c2sUser)
+{
+    if (c2sUser == NULL)
+    {
+        m_redlineTable->AddUser(user);
+    }
+
+    m_metrics->AddHandshakeOk(user);
+}
+
+void
+CMsgServer::ReleaseUserState(const RTP_MSG_USER& user,
+                             int                 errorCode,
+                             int                 sslCode)
+{
+    m_metrics->AddClose(user, errorCode, sslCode);
+    m_groupTable->LeaveAllGroups(user);
+    m_redlineTable->RemoveUser(user);
+
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
+
+    CMsgServerSnapshot* snapshot = (CMsgServerSnapshot*)guard.Get();
+    if (snapshot != NULL && snapshot->watermark != NULL)
+    {
+        snapshot->watermark->Remove(user);
+    }
+}
+
+bool
+CMsgServer::ProcessGroupCtrl(const void*         buf,
+                             size_t              size,
+                             uint16_t            charset,
+                             const RTP_MSG_USER* srcUser)
+{
+    assert(srcUser != NULL);
+    if (charset != MSG_GROUP_CTRL_CHARSET || srcUser == NULL)
+    {
+        return false;
+    }
+
+    unsigned char op      = 0;
+    uint64_t      groupId = 0;
+    if (!MsgGroupUnpackCtrl(buf, size, &op, &groupId))
+    {
+        return true;
+    }
+
+    if (op == MSG_GROUP_OP_JOIN)
+    {
+        m_groupTable->JoinGroup(groupId, *srcUser);
+    }
+    else
+    {
+        m_groupTable->LeaveGroup(groupId, *srcUser);
+    }
+
+    return true;
+}
+
+bool
+CMsgServer::UnpackCoalesced(IRtpMsgServer*      msgServer,
+                            const void*         buf,
+                            size_t              size,
+                            uint16_t            charset,
+                            const RTP_MSG_USER* srcUser)
+{
+    if (charset != MSG_COALESCE_CHARSET)
+    {
+        return false;
+    }
+
+    size_t      offset      = 0;
+    const void* item        = NULL;
+    size_t      itemSize    = 0;
+    uint16_t    itemCharset = 0;
+
+    while (MsgCoalesceNext(buf, size, &offset, &item, &itemSize, &itemCharset))
+    {
+        OnRecvMsg(msgServer, item, itemSize, itemCharset, srcUser);
+    }
+
+    return true;
+}
+
 bool
 CMsgServer::OnCheckUser(IRtpMsgServer*      msgServer,
                         const RTP_MSG_USER* user,
@@ -630,46 +1445,55 @@ CMsgServer::OnCheckUser(IRtpMsgServer*      msgServer,
     }
 
     {
-        CProThreadMutexGuard mon(m_lock);
+        CMsgSnapshotGuard guard(*m_snapshotSlot);
 
-        if (m_reactor == NULL || m_msgServer == NULL)
+        CMsgServerSnapshot* snapshot = (CMsgServerSnapshot*)guard.Get();
+        if (snapshot == NULL)
         {
             return false;
         }
 
-        if (msgServer != m_msgServer)
+        if (msgServer != snapshot->msgServer)
         {
             return false;
         }
 
-        const char* password = NULL;
+        *appData = 0; /* You can do something. */
 
-        if (user->classId == 1)        /* 1-... */
-        {
-            password = m_msgConfigInfo.msgs_password_cid1.c_str();
-        }
-        else if (user->classId == 2)   /* 2-... */
+        if (snapshot->configInfo.msgs_auth_threads > 0)
         {
-            password = m_msgConfigInfo.msgs_password_cid2.c_str();
-        }
-        else if (user->classId == 255) /* 255-... */
-        {
-            password = m_msgConfigInfo.msgs_password_cid255.c_str();
+            /*
+             * refused until the worker's verdict. see msg_auth.h
+             */
+            MSG_AUTH_REQUEST request;
+            request.user = *user;
+            if (c2sUser != NULL)
+            {
+                request.c2sUser = *c2sUser;
+            }
+            strncpy_pro(request.userPublicIp, sizeof(request.userPublicIp), userPublicIp);
+            memcpy(request.hash, hash, sizeof(request.hash));
+            memcpy(request.nonce, nonce, sizeof(request.nonce));
+
+            const MSG_AUTH_RESULT result = m_authPool->Check(request);
+            if (result != MSG_AUTH_OK)
+            {
+                m_metrics->AddHandshakeFailed(*user, result == MSG_AUTH_REJECTED);
+
+                return false;
+            }
         }
-        else                           /* others */
+        else if (!CheckRtpServiceData(nonce,
+            FindPassword_i(snapshot->configInfo, snapshot->credentials, *user), hash))
         {
-            password = m_msgConfigInfo.msgs_password_cidx.c_str();
-        }
+            m_metrics->AddHandshakeFailed(*user, true);
 
-        if (!CheckRtpServiceData(nonce, password, hash))
-        {
             return false;
         }
 
-        *userId  = user->UserId();
-        *instId  = user->instId;
-        *appData = 0; /* You can do something. */
-        *isC2s   = c2sUser == NULL && user->classId == 255;
+        *userId = user->UserId();
+        *instId = user->instId;
+        *isC2s  = c2sUser == NULL && user->classId == 255;
     }
 
     return true;
@@ -691,23 +1515,16 @@ CMsgServer::OnOkUser(IRtpMsgServer*      msgServer,
         return;
     }
 
+    if (!IsCurrent(msgServer))
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgServer == NULL)
-        {
-            return;
-        }
+        return;
+    }
 
-        if (msgServer != m_msgServer)
-        {
-            return;
-        }
+    InitUserState(*user, c2sUser);
 
-        /*
-         * ...
-         */
-    }
+    /*
+     * ...
+     */
 }
 
 void
@@ -723,23 +1540,16 @@ CMsgServer::OnCloseUser(IRtpMsgServer*      msgServer,
         return;
     }
 
+    if (!IsCurrent(msgServer))
     {
-        CProThreadMutexGuard mon(m_lock);
+        return;
+    }
 
-        if (m_reactor == NULL || m_msgServer == NULL)
-        {
-            return;
-        }
+    ReleaseUserState(*user, errorCode, sslCode);
 
-        if (msgServer != m_msgServer)
-        {
-            return;
-        }
-
-        /*
-         * ...
-         */
-    }
+    /*
+     * ...
+     */
 }
 
 void
@@ -754,23 +1564,14 @@ CMsgServer::OnHeartbeatUser(IRtpMsgServer*      msgServer,
         return;
     }
 
+    if (!IsCurrent(msgServer))
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgServer == NULL)
-        {
-            return;
-        }
-
-        if (msgServer != m_msgServer)
-        {
-            return;
-        }
-
-        /*
-         * ...
-         */
+        return;
     }
+
+    /*
+     * ...
+     */
 }
 
 void
@@ -789,21 +1590,58 @@ CMsgServer::OnRecvMsg(IRtpMsgServer*      msgServer,
         return;
     }
 
+    if (!IsCurrent(msgServer))
     {
-        CProThreadMutexGuard mon(m_lock);
+        return;
+    }
 
-        if (m_reactor == NULL || m_msgServer == NULL)
-        {
-            return;
-        }
+    if (UnpackCoalesced(msgServer, buf, size, charset, srcUser))
+    {
+        return;
+    }
 
-        if (msgServer != m_msgServer)
-        {
-            return;
-        }
+    m_metrics->AddRecv(size);
 
-        /*
-         * ...
-         */
+    if (ProcessGroupCtrl(buf, size, charset, srcUser))
+    {
+        return;
     }
+
+    /*
+     * ...
+     */
+}
+
+void
+CMsgServer::OnCheckUserAsync(const MSG_AUTH_REQUEST& request)
+{
+    CMsgSnapshotGuard guard(*m_snapshotSlot);
+
+    CMsgServerSnapshot* snapshot = (CMsgServerSnapshot*)guard.Get();
+    if (snapshot == NULL)
+    {
+        RejectUser(request);
+
+        return;
+    }
+
+    /*
+     * the password is copied by the pool while the snapshot is held
+     */
+    const char* const password =
+        FindPassword_i(snapshot->configInfo, snapshot->credentials, request.user);
+    if (CheckRtpServiceData(request.nonce, password, request.hash))
+    {
+        AcceptUser(request, password);
+    }
+    else
+    {
+        RejectUser(request);
+    }
+}
+
+void
+CMsgServer::OnAuthRequest(const MSG_AUTH_REQUEST& request)
+{
+    OnCheckUserAsync(request);
 }
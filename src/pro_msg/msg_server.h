@@ -19,6 +19,10 @@
 #if !defined(____MSG_SERVER_H____)
 #define ____MSG_SERVER_H____
 
+#include "msg_auth.h"
+#include "msg_buffer.h"
+#include "msg_metrics.h"
+#include "msg_watermark.h"
 #include "pronet/pro_memory_pool.h"
 #include "pronet/pro_ref_count.h"
 #include "pronet/pro_ssl_util.h"
@@ -31,18 +35,26 @@
 /////////////////////////////////////////////////////////////////////////////
 ////
 
+class CMsgAuthPool;
+class CMsgCredentialTable;
+class CMsgGroupTable;
+class CMsgRedlineTable;
+class CMsgSnapshotSlot;
+
 struct MSG_SERVER_CONFIG_INFO
 {
     MSG_SERVER_CONFIG_INFO()
     {
         msgs_mm_type             = RTP_MMT_MSG;
         msgs_hub_port            = 3000;
-        msgs_password_cid1       = "test";
-        msgs_password_cid2       = "test";
-        msgs_password_cid255     = "test";
         msgs_password_cidx       = "test";
         msgs_handshake_timeout   = 20;
         msgs_redline_bytes       = 1024000;
+        msgs_output_high_water   = 0;
+        msgs_output_low_water    = 0;
+        msgs_auth_threads        = 0;
+        msgs_auth_queue_size     = 10000;
+        msgs_auth_timeout        = 20;
 
         msgs_enable_ssl          = true;
         msgs_ssl_forced          = false;
@@ -55,41 +67,45 @@ struct MSG_SERVER_CONFIG_INFO
         msgs_ssl_crlfiles.push_back("");
         msgs_ssl_certfiles.push_back("server.crt");
         msgs_ssl_certfiles.push_back("");
+
+        msgs_password_cid.resize(256, msgs_password_cidx);
+        msgs_redline_bytes_cid.resize(256, 0);
     }
 
     ~MSG_SERVER_CONFIG_INFO()
     {
-        if (!msgs_password_cid1.empty())
-        {
-            ProZeroMemory(&msgs_password_cid1[0], msgs_password_cid1.length());
-        }
-        if (!msgs_password_cid2.empty())
-        {
-            ProZeroMemory(&msgs_password_cid2[0], msgs_password_cid2.length());
-        }
-        if (!msgs_password_cid255.empty())
+        for (int i = 0; i < (int)msgs_password_cid.size(); ++i)
         {
-            ProZeroMemory(&msgs_password_cid255[0], msgs_password_cid255.length());
+            if (!msgs_password_cid[i].empty())
+            {
+                ProZeroMemory(&msgs_password_cid[i][0], msgs_password_cid[i].length());
+            }
+
+            msgs_password_cid[i] = "";
         }
+
         if (!msgs_password_cidx.empty())
         {
             ProZeroMemory(&msgs_password_cidx[0], msgs_password_cidx.length());
         }
 
-        msgs_password_cid1   = "";
-        msgs_password_cid2   = "";
-        msgs_password_cid255 = "";
-        msgs_password_cidx   = "";
+        msgs_password_cidx = "";
     }
 
     RTP_MM_TYPE                  msgs_mm_type;         /* RTP_MMT_MSG_MIN ~ RTP_MMT_MSG_MAX */
     unsigned short               msgs_hub_port;
-    CProStlString                msgs_password_cid1;   /* for 1-... */
-    CProStlString                msgs_password_cid2;   /* for 2-... */
-    CProStlString                msgs_password_cid255; /* for 255-... */
+    CProStlVector<CProStlString> msgs_password_cid;    /* [classId], msgs_password_cidx if not configured */
     CProStlString                msgs_password_cidx;   /* for x-... */
+    CProStlString                msgs_password_file;   /* per-user passwords. see msg_credential.h */
     unsigned int                 msgs_handshake_timeout;
     unsigned int                 msgs_redline_bytes;
+    CProStlVector<unsigned int>  msgs_redline_bytes_cid; /* [classId], 0 for msgs_redline_bytes */
+    unsigned int                 msgs_output_high_water; /* 0 for disabled */
+    unsigned int                 msgs_output_low_water;  /* < msgs_output_high_water */
+    CProStlVector<unsigned int>  msgs_reactor_cpus;      /* empty for unpinned. see CreateReactor() */
+    unsigned int                 msgs_auth_threads;      /* 0 for checking users on the reactor. see msg_auth.h */
+    unsigned int                 msgs_auth_queue_size;
+    unsigned int                 msgs_auth_timeout;      /* seconds, for a check and for a verdict */
 
     bool                         msgs_enable_ssl;
     bool                         msgs_ssl_forced;
@@ -105,12 +121,29 @@ struct MSG_SERVER_CONFIG_INFO
 /////////////////////////////////////////////////////////////////////////////
 ////
 
-class CMsgServer : public IRtpMsgServerObserver, public CProRefCount
+class CMsgServer
+:
+public IRtpMsgServerObserver,
+public IMsgWatermarkObserver,
+public IMsgAuthObserver,
+public CProRefCount
 {
 public:
 
     static CMsgServer* CreateInstance();
 
+    /*
+     * creates a reactor for Init(). Its threads are pinned to cpus, or to
+     * msgs_reactor_cpus if cpus is NULL. The caller should delete it with
+     * ProDeleteReactor() after Fini(). see msg_affinity.h
+     */
+    static IProReactor* CreateReactor(
+        unsigned int                       threadCount,
+        const char*                        argv0,         /* = NULL */
+        const char*                        configFileName,
+        const CProStlVector<unsigned int>* cpus           /* = NULL */
+        );
+
     bool Init(
         IProReactor*   reactor,
         const char*    argv0,         /* = NULL */
@@ -138,6 +171,31 @@ public:
 
     void KickoutUser(const RTP_MSG_USER& user);
 
+    /*
+     * lock-free. see msg_metrics.h
+     */
+    void GetMetrics(MSG_SERVER_METRICS& metrics) const;
+
+    void ResetMetrics();
+
+    /*
+     * true if msgs_auth_threads > 0. see msg_auth.h
+     */
+    bool IsAuthAsync() const;
+
+    /*
+     * gives the verdict of the request. thread-safe, and can be called any
+     * time after OnCheckUserAsync(). password is the one that the request
+     * has been checked against, and the retry of the client is checked with
+     * it. see msg_auth.h
+     */
+    void AcceptUser(
+        const MSG_AUTH_REQUEST& request,
+        const char*             password
+        );
+
+    void RejectUser(const MSG_AUTH_REQUEST& request);
+
     bool SendMsg(
         const void*         buf,
         size_t              size,
@@ -156,11 +214,127 @@ public:
         unsigned char       dstUserCount
         );
 
+    /*
+     * segments[0 ~ segmentCount-1] are sent as one message
+     */
+    bool SendMsgV(
+        const MSG_SEGMENT*  segments,
+        size_t              segmentCount,
+        uint16_t            charset,
+        const RTP_MSG_USER* dstUsers,
+        unsigned char       dstUserCount
+        );
+
+    /*
+     * the same msgBuffer can be sent again and again without being copied
+     */
+    bool SendBuffer(
+        const CMsgBuffer*   msgBuffer,
+        uint16_t            charset,
+        const RTP_MSG_USER* dstUsers,
+        unsigned char       dstUserCount
+        );
+
     void SetOutputRedline(size_t redlineBytes);
 
     size_t GetOutputRedline() const;
 
-    size_t GetSendingBytes(const RTP_MSG_USER& user) const;
+    /*
+     * overrides msgs_redline_bytes for a class. redlineBytes 0 for the
+     * default. it applies to the messages sent by the server, which are
+     * still dropped above msgs_redline_bytes by libpronet, except that the
+     * redline of class 255 is also libpronet's redline to the C2S links
+     */
+    void SetClassOutputRedline(
+        unsigned char classId,
+        size_t        redlineBytes
+        );
+
+    /*
+     * the effective redline of the class
+     */
+    size_t GetClassOutputRedline(unsigned char classId) const;
+
+    /*
+     * overrides the class's redline for a user until the user is closed.
+     * redlineBytes 0 for the class's one. it applies to the messages sent
+     * by the server only
+     */
+    void SetUserOutputRedline(
+        const RTP_MSG_USER& user,
+        size_t              redlineBytes
+        );
+
+    /*
+     * the effective redline of the user
+     */
+    size_t GetUserOutputRedline(const RTP_MSG_USER& user) const;
+
+    /*
+     * the total queued bytes of the direct users of the class
+     */
+    size_t GetClassSendingBytes(unsigned char classId) const;
+
+    size_t GetClassUserCount(unsigned char classId) const;
+
+    virtual size_t GetSendingBytes(const RTP_MSG_USER& user) const;
+
+    /*
+     * OnOutputHighWater() is called once when the queued bytes of a user
+     * reach highBytes, and OnOutputLowWater() is called once when they fall
+     * to lowBytes again. highBytes 0 for disabled
+     */
+    void SetOutputWatermarks(
+        size_t highBytes,
+        size_t lowBytes
+        );
+
+    void GetOutputWatermarks(
+        size_t* highBytes,
+        size_t* lowBytes
+        ) const;
+
+    bool CreateGroup(uint64_t groupId); /* > 0 */
+
+    void DeleteGroup(uint64_t groupId);
+
+    bool JoinGroup(
+        uint64_t            groupId,
+        const RTP_MSG_USER& user
+        );
+
+    void LeaveGroup(
+        uint64_t            groupId,
+        const RTP_MSG_USER& user
+        );
+
+    size_t GetGroupMemberCount(uint64_t groupId) const;
+
+    /*
+     * fans the message out to all members of the group, 255 users per
+     * IRtpMsgServer::SendMsg2(). false if no such group or a batch failed
+     */
+    bool PublishMsg(
+        uint64_t    groupId,
+        const void* buf,
+        size_t      size,
+        uint16_t    charset
+        );
+
+    bool PublishMsg2(
+        uint64_t    groupId,
+        const void* buf1,
+        size_t      size1,
+        const void* buf2,  /* = NULL */
+        size_t      size2, /* = 0 */
+        uint16_t    charset
+        );
+
+    bool PublishBuffer(
+        uint64_t          groupId,
+        const CMsgBuffer* msgBuffer,
+        uint16_t          charset
+        );
 
 protected:
 
@@ -168,6 +342,52 @@ protected:
 
     virtual ~CMsgServer();
 
+    /*
+     * lock-free. true if msgServer is the current one of this server
+     */
+    bool IsCurrent(IRtpMsgServer* msgServer) const;
+
+    /*
+     * accounts a new user. c2sUser is NULL for a direct user
+     */
+    void InitUserState(
+        const RTP_MSG_USER& user,
+        const RTP_MSG_USER* c2sUser
+        );
+
+    /*
+     * drops the groups, the redline and the watermark state of a closed
+     * user, and counts the close
+     */
+    void ReleaseUserState(
+        const RTP_MSG_USER& user,
+        int                 errorCode,
+        int                 sslCode
+        );
+
+    /*
+     * true if the message is a group control message. it's consumed here
+     */
+    bool ProcessGroupCtrl(
+        const void*         buf,
+        size_t              size,
+        uint16_t            charset,
+        const RTP_MSG_USER* srcUser
+        );
+
+    /*
+     * true if buf is a batch of coalesced messages. Its messages have been
+     * passed to OnRecvMsg() one by one then. An override of OnRecvMsg()
+     * should call it first. see msg_coalesce.h
+     */
+    bool UnpackCoalesced(
+        IRtpMsgServer*      msgServer,
+        const void*         buf,
+        size_t              size,
+        uint16_t            charset,
+        const RTP_MSG_USER* srcUser
+        );
+
     virtual bool OnCheckUser(
         IRtpMsgServer*      msgServer,
         const RTP_MSG_USER* user,
@@ -210,13 +430,54 @@ protected:
         const RTP_MSG_USER* srcUser
         );
 
+    /*
+     * called on an auth worker if msgs_auth_threads > 0, after the handshake
+     * of the request has been refused. the default one checks the password
+     * of the user's class, and accepts or rejects the user at once
+     */
+    virtual void OnCheckUserAsync(const MSG_AUTH_REQUEST& request);
+
+    /*
+     * called on the sending thread
+     */
+    virtual void OnOutputHighWater(
+        const RTP_MSG_USER& user,
+        size_t              sendingBytes
+        )
+    {
+    }
+
+    /*
+     * called on the reactor
+     */
+    virtual void OnOutputLowWater(
+        const RTP_MSG_USER& user,
+        size_t              sendingBytes
+        )
+    {
+    }
+
 protected:
 
     IProReactor*                     m_reactor;
     MSG_SERVER_CONFIG_INFO           m_msgConfigInfo;
     PRO_SSL_SERVER_CONFIG*           m_sslConfig;
     IRtpMsgServer*                   m_msgServer;
-    mutable CProRecursiveThreadMutex m_lock;
+    CMsgSnapshotSlot*                m_snapshotSlot; /* for the hot paths */
+    CMsgGroupTable*                  m_groupTable;
+    CMsgRedlineTable*                m_redlineTable;
+    size_t                           m_c2sRedlineBytes; /* libpronet's own */
+    CMsgAuthPool*                    m_authPool;
+    CMsgWatermark*                   m_watermark;
+    CMsgCredentialTable*             m_credentials;  /* NULL if no msgs_password_file */
+    CMsgMetrics*                     m_metrics;      /* lock-free */
+    mutable CProRecursiveThreadMutex m_lock;         /* for Init()/Fini() and the settings */
+
+private:
+
+    virtual void OnAuthRequest(const MSG_AUTH_REQUEST& request);
+
+    void ApplyRedline_i();
 
     DECLARE_SGI_POOL(0)
 };
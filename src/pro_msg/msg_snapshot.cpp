@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+#include "msg_snapshot.h"
+#include "msg_client2.h"
+#include "msg_coalesce.h"
+#include "msg_credential.h"
+#include "msg_pending.h"
+#include "msg_server.h"
+#include "msg_watermark.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static std::atomic<unsigned int> g_s_nextStripe(0);
+static thread_local unsigned int g_s_stripe = (unsigned int)-1;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+unsigned long
+CMsgSnapshot::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CMsgSnapshot::Release()
+{
+    return CProRefCount::Release();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgServerSnapshot*
+CMsgServerSnapshot::CreateInstance(IRtpMsgServer*                msgServer,
+                                   const MSG_SERVER_CONFIG_INFO& configInfo,
+                                   CMsgWatermark*                watermark,   /* = NULL */
+                                   CMsgCredentialTable*          credentials) /* = NULL */
+{
+    assert(msgServer != NULL);
+    if (msgServer == NULL)
+    {
+        return NULL;
+    }
+
+    return new CMsgServerSnapshot(msgServer, configInfo, watermark, credentials);
+}
+
+CMsgServerSnapshot::CMsgServerSnapshot(IRtpMsgServer*                msgServer2,
+                                       const MSG_SERVER_CONFIG_INFO& configInfo2,
+                                       CMsgWatermark*                watermark2,
+                                       CMsgCredentialTable*          credentials2)
+:
+msgServer(msgServer2),
+configInfo(configInfo2),
+watermark(watermark2),
+credentials(credentials2)
+{
+    msgServer->AddRef();
+    if (watermark != NULL)
+    {
+        watermark->AddRef();
+    }
+    if (credentials != NULL)
+    {
+        credentials->AddRef();
+    }
+}
+
+CMsgServerSnapshot::~CMsgServerSnapshot()
+{
+    if (credentials != NULL)
+    {
+        credentials->Release();
+    }
+    if (watermark != NULL)
+    {
+        watermark->Release();
+    }
+    msgServer->Release();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgClientSnapshot*
+CMsgClientSnapshot::CreateInstance(IRtpMsgClient*      msgClient,
+                                   IMsgClientObserver* observer,  /* = NULL */
+                                   CMsgWatermark*      watermark, /* = NULL */
+                                   CMsgCoalescer*      coalescer, /* = NULL */
+                                   CMsgPendingQueue*   pending)   /* = NULL */
+{
+    assert(msgClient != NULL);
+    if (msgClient == NULL)
+    {
+        return NULL;
+    }
+
+    return new CMsgClientSnapshot(msgClient, observer, watermark, coalescer, pending);
+}
+
+CMsgClientSnapshot::CMsgClientSnapshot(IRtpMsgClient*      msgClient2,
+                                       IMsgClientObserver* observer2,
+                                       CMsgWatermark*      watermark2,
+                                       CMsgCoalescer*      coalescer2,
+                                       CMsgPendingQueue*   pending2)
+:
+msgClient(msgClient2),
+observer(observer2),
+watermark(watermark2),
+coalescer(coalescer2),
+pending(pending2)
+{
+    msgClient->AddRef();
+    if (observer != NULL)
+    {
+        observer->AddRef();
+    }
+    if (watermark != NULL)
+    {
+        watermark->AddRef();
+    }
+    if (coalescer != NULL)
+    {
+        coalescer->AddRef();
+    }
+    if (pending != NULL)
+    {
+        pending->AddRef();
+    }
+}
+
+CMsgClientSnapshot::~CMsgClientSnapshot()
+{
+    if (pending != NULL)
+    {
+        pending->Release();
+    }
+    if (coalescer != NULL)
+    {
+        coalescer->Release();
+    }
+    if (watermark != NULL)
+    {
+        watermark->Release();
+    }
+    if (observer != NULL)
+    {
+        observer->Release();
+    }
+    msgClient->Release();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgRedlineSnapshot*
+CMsgRedlineSnapshot::CreateInstance(const CProStlMap<RTP_MSG_USER, size_t>& userRedlines)
+{
+    return new CMsgRedlineSnapshot(userRedlines);
+}
+
+CMsgRedlineSnapshot::CMsgRedlineSnapshot(const CProStlMap<RTP_MSG_USER, size_t>& userRedlines2)
+:
+userRedlines(userRedlines2)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgSnapshotSlot::CMsgSnapshotSlot()
+: m_current(NULL),
+  m_retiredCount(0)
+{
+    for (int i = 0; i < MSG_SNAPSHOT_STRIPES; ++i)
+    {
+        m_stripes[i].readers = 0;
+    }
+}
+
+CMsgSnapshotSlot::~CMsgSnapshotSlot()
+{
+    /*
+     * The owner is being destroyed, so there is no reader anymore.
+     */
+    CMsgSnapshot* current = m_current.exchange(NULL);
+    if (current != NULL)
+    {
+        current->Release();
+    }
+
+    int i = 0;
+    int c = (int)m_retired.size();
+
+    for (; i < c; ++i)
+    {
+        m_retired[i].snapshot->Release();
+    }
+
+    m_retired.clear();
+    m_retiredCount = 0;
+}
+
+unsigned int
+CMsgSnapshotSlot::Enter()
+{
+    if (g_s_stripe == (unsigned int)-1)
+    {
+        g_s_stripe = g_s_nextStripe++ % MSG_SNAPSHOT_STRIPES;
+    }
+
+    unsigned int stripe = g_s_stripe;
+    ++m_stripes[stripe].readers;
+
+    return stripe;
+}
+
+void
+CMsgSnapshotSlot::Leave(unsigned int stripe)
+{
+    assert(stripe < MSG_SNAPSHOT_STRIPES);
+
+    if (--m_stripes[stripe].readers != 0 || m_retiredCount.load() == 0)
+    {
+        return;
+    }
+
+    CProStlVector<CMsgSnapshot*> snapshots;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        Reclaim_i(snapshots);
+    }
+
+    Release_i(snapshots);
+}
+
+void
+CMsgSnapshotSlot::Publish(CMsgSnapshot* snapshot)
+{
+    CProStlVector<CMsgSnapshot*> snapshots;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        CMsgSnapshot* old = m_current.exchange(snapshot);
+        if (old != NULL)
+        {
+            RETIRED_SNAPSHOT retired;
+            retired.snapshot    = old;
+            retired.busyStripes = (1U << MSG_SNAPSHOT_STRIPES) - 1;
+
+            m_retired.push_back(retired);
+
+            /*
+             * counted before Reclaim_i() reads the stripes, so a reader
+             * that leaves after the reading sees it and reclaims
+             */
+            ++m_retiredCount;
+        }
+
+        Reclaim_i(snapshots);
+    }
+
+    Release_i(snapshots);
+}
+
+void
+CMsgSnapshotSlot::Reclaim_i(CProStlVector<CMsgSnapshot*>& snapshots)
+{
+    if (m_retired.size() == 0)
+    {
+        return;
+    }
+
+    /*
+     * A reader that enters after the exchange() in Publish() can only see
+     * the new snapshot. Once a stripe is seen idle after a retirement, none
+     * of its readers can still hold the retired snapshot. The stripes are
+     * read under m_lock, i.e., after every exchange() so far.
+     */
+    unsigned int idleStripes = 0;
+
+    for (int i = 0; i < MSG_SNAPSHOT_STRIPES; ++i)
+    {
+        if (m_stripes[i].readers.load() == 0)
+        {
+            idleStripes |= 1U << i;
+        }
+    }
+
+    size_t j = 0;
+    size_t i = 0;
+    size_t c = m_retired.size();
+
+    for (; i < c; ++i)
+    {
+        RETIRED_SNAPSHOT& retired = m_retired[i];
+        retired.busyStripes &= ~idleStripes;
+
+        if (retired.busyStripes == 0)
+        {
+            snapshots.push_back(retired.snapshot);
+        }
+        else
+        {
+            m_retired[j++] = retired;
+        }
+    }
+
+    m_retired.resize(j);
+    m_retiredCount = (long)j;
+}
+
+void
+CMsgSnapshotSlot::Release_i(const CProStlVector<CMsgSnapshot*>& snapshots)
+{
+    int i = 0;
+    int c = (int)snapshots.size();
+
+    for (; i < c; ++i)
+    {
+        snapshots[i]->Release();
+    }
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+/*
+ * A snapshot is an immutable, reference-counted object that describes the
+ * current state of its owner (e.g., which IRtpMsgServer is alive). The owner
+ * publishes a new snapshot under its own lock, and the hot paths read the
+ * current one through a CMsgSnapshotGuard without taking any shared lock.
+ *
+ * A replaced snapshot is retired, and it will be released as soon as each
+ * stripe that had readers at the replacement has been seen idle. Readers are
+ * counted on per-thread stripes, so they don't bounce one cache line between
+ * the reactor threads, and the last reader leaving a stripe releases what has
+ * become unreachable.
+ */
+
+#if !defined(MSG_SNAPSHOT_H)
+#define MSG_SNAPSHOT_H
+
+#include "msg_server.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define MSG_SNAPSHOT_STRIPES 16
+
+class CMsgCoalescer;
+class CMsgCredentialTable;
+class CMsgPendingQueue;
+class CMsgWatermark;
+class IMsgClientObserver;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgSnapshot : public CProRefCount
+{
+public:
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+protected:
+
+    CMsgSnapshot()
+    {
+    }
+
+    virtual ~CMsgSnapshot()
+    {
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgServerSnapshot : public CMsgSnapshot
+{
+public:
+
+    static CMsgServerSnapshot* CreateInstance(
+        IRtpMsgServer*                msgServer,
+        const MSG_SERVER_CONFIG_INFO& configInfo,
+        CMsgWatermark*                watermark,  /* = NULL */
+        CMsgCredentialTable*          credentials /* = NULL */
+        );
+
+    IRtpMsgServer* const         msgServer;
+    const MSG_SERVER_CONFIG_INFO configInfo;
+    CMsgWatermark* const         watermark;
+    CMsgCredentialTable* const   credentials;
+
+private:
+
+    CMsgServerSnapshot(
+        IRtpMsgServer*                msgServer2,
+        const MSG_SERVER_CONFIG_INFO& configInfo2,
+        CMsgWatermark*                watermark2,
+        CMsgCredentialTable*          credentials2
+        );
+
+    virtual ~CMsgServerSnapshot();
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgClientSnapshot : public CMsgSnapshot
+{
+public:
+
+    static CMsgClientSnapshot* CreateInstance(
+        IRtpMsgClient*      msgClient,
+        IMsgClientObserver* observer,  /* = NULL */
+        CMsgWatermark*      watermark, /* = NULL */
+        CMsgCoalescer*      coalescer, /* = NULL */
+        CMsgPendingQueue*   pending    /* = NULL */
+        );
+
+    IRtpMsgClient* const      msgClient;
+    IMsgClientObserver* const observer;
+    CMsgWatermark* const      watermark;
+    CMsgCoalescer* const      coalescer;
+    CMsgPendingQueue* const   pending;   /* non-NULL while sends are held or drained */
+
+private:
+
+    CMsgClientSnapshot(
+        IRtpMsgClient*      msgClient2,
+        IMsgClientObserver* observer2,
+        CMsgWatermark*      watermark2,
+        CMsgCoalescer*      coalescer2,
+        CMsgPendingQueue*   pending2
+        );
+
+    virtual ~CMsgClientSnapshot();
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgRedlineSnapshot : public CMsgSnapshot
+{
+public:
+
+    static CMsgRedlineSnapshot* CreateInstance(
+        const CProStlMap<RTP_MSG_USER, size_t>& userRedlines
+        );
+
+    const CProStlMap<RTP_MSG_USER, size_t> userRedlines;
+
+private:
+
+    CMsgRedlineSnapshot(const CProStlMap<RTP_MSG_USER, size_t>& userRedlines2);
+
+    virtual ~CMsgRedlineSnapshot()
+    {
+    }
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgSnapshotSlot
+{
+public:
+
+    CMsgSnapshotSlot();
+
+    ~CMsgSnapshotSlot();
+
+    /*
+     * lock-free. the return value is the reader's stripe
+     */
+    unsigned int Enter();
+
+    /*
+     * lock-free unless any snapshot is retired and the stripe gets idle
+     */
+    void Leave(unsigned int stripe);
+
+    /*
+     * valid only between Enter() and Leave()
+     */
+    CMsgSnapshot* Get() const
+    {
+        return m_current.load();
+    }
+
+    /*
+     * the slot takes over the caller's reference. snapshot can be NULL
+     */
+    void Publish(CMsgSnapshot* snapshot);
+
+private:
+
+    /*
+     * the reclaimed snapshots are released by the caller out of m_lock
+     */
+    void Reclaim_i(CProStlVector<CMsgSnapshot*>& snapshots);
+
+    static void Release_i(const CProStlVector<CMsgSnapshot*>& snapshots);
+
+private:
+
+    struct READER_STRIPE
+    {
+        std::atomic<long> readers;
+        char              reserved[64 - sizeof(std::atomic<long>)];
+    };
+
+    struct RETIRED_SNAPSHOT
+    {
+        CMsgSnapshot* snapshot;
+        unsigned int  busyStripes; /* not seen idle since the retirement */
+    };
+
+    READER_STRIPE                   m_stripes[MSG_SNAPSHOT_STRIPES];
+    std::atomic<CMsgSnapshot*>      m_current;
+    std::atomic<long>               m_retiredCount;
+    CProStlVector<RETIRED_SNAPSHOT> m_retired;
+    CProThreadMutex                 m_lock;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CMsgSnapshotGuard
+{
+public:
+
+    CMsgSnapshotGuard(CMsgSnapshotSlot& slot)
+    : m_slot(slot)
+    {
+        m_stripe = m_slot.Enter();
+    }
+
+    ~CMsgSnapshotGuard()
+    {
+        m_slot.Leave(m_stripe);
+    }
+
+    CMsgSnapshot* Get() const
+    {
+        return m_slot.Get();
+    }
+
+private:
+
+    CMsgSnapshotSlot& m_slot;
+    unsigned int      m_stripe;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* MSG_SNAPSHOT_H */
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+#include "msg_watermark.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_net.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_timer_factory.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CMsgWatermark*
+CMsgWatermark::CreateInstance()
+{
+    return new CMsgWatermark;
+}
+
+CMsgWatermark::CMsgWatermark()
+: m_highBytes(0),
+  m_lowBytes(0)
+{
+    m_observer = NULL;
+    m_reactor  = NULL;
+    m_timerId  = 0;
+}
+
+CMsgWatermark::~CMsgWatermark()
+{
+    Fini();
+}
+
+bool
+CMsgWatermark::Init(IMsgWatermarkObserver* observer,
+                    IProReactor*           reactor,
+                    size_t                 highBytes, /* 0 for disabled */
+                    size_t                 lowBytes)  /* < highBytes */
+{
+    assert(observer != NULL);
+    assert(reactor != NULL);
+    if (observer == NULL || reactor == NULL)
+    {
+        return false;
+    }
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        assert(m_observer == NULL);
+        assert(m_reactor == NULL);
+        if (m_observer != NULL || m_reactor != NULL)
+        {
+            return false;
+        }
+
+        observer->AddRef();
+        m_observer = observer;
+        m_reactor  = reactor;
+    }
+
+    SetMarks(highBytes, lowBytes);
+
+    if (highBytes > 0 && !IsEnabled())
+    {
+        Fini();
+
+        return false;
+    }
+
+    return true;
+}
+
+void
+CMsgWatermark::Fini()
+{
+    IMsgWatermarkObserver* observer = NULL;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_observer == NULL || m_reactor == NULL)
+        {
+            return;
+        }
+
+        if (m_timerId != 0)
+        {
+            m_reactor->CancelTimer(m_timerId);
+            m_timerId = 0;
+        }
+
+        m_highUsers.clear();
+        m_reactor = NULL;
+        observer = m_observer;
+        m_observer = NULL;
+    }
+
+    observer->Release();
+}
+
+unsigned long
+CMsgWatermark::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CMsgWatermark::Release()
+{
+    return CProRefCount::Release();
+}
+
+void
+CMsgWatermark::SetMarks(size_t highBytes,
+                        size_t lowBytes)
+{
+    if (lowBytes >= highBytes)
+    {
+        lowBytes = highBytes / 2;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_reactor == NULL)
+    {
+        return;
+    }
+
+    /*
+     * the poll timer runs only while the marks are enabled
+     */
+    if (highBytes > 0 && m_timerId == 0)
+    {
+        m_timerId = m_reactor->SetupTimer(
+            this, MSG_WATERMARK_POLL_INTERVAL, MSG_WATERMARK_POLL_INTERVAL);
+        if (m_timerId == 0)
+        {
+            highBytes = 0;
+            lowBytes  = 0;
+        }
+    }
+    else if (highBytes == 0 && m_timerId != 0)
+    {
+        m_reactor->CancelTimer(m_timerId);
+        m_timerId = 0;
+
+        m_highUsers.clear();
+    }
+
+    m_highBytes = highBytes;
+    m_lowBytes  = lowBytes;
+
+    /*
+     * the destinations above the old high mark will be reported by the
+     * next poll if they are below the new low mark
+     */
+}
+
+void
+CMsgWatermark::GetMarks(size_t* highBytes,
+                        size_t* lowBytes) const
+{
+    if (highBytes != NULL)
+    {
+        *highBytes = m_highBytes.load();
+    }
+    if (lowBytes != NULL)
+    {
+        *lowBytes  = m_lowBytes.load();
+    }
+}
+
+void
+CMsgWatermark::Check(const RTP_MSG_USER& user,
+                     size_t              sendingBytes)
+{
+    const size_t highBytes = m_highBytes.load();
+    if (highBytes == 0 || sendingBytes < highBytes)
+    {
+        return;
+    }
+
+    IMsgWatermarkObserver* observer = NULL;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_observer == NULL || m_reactor == NULL)
+        {
+            return;
+        }
+
+        if (!m_highUsers.insert(user).second)
+        {
+            return;
+        }
+
+        m_observer->AddRef();
+        observer = m_observer;
+    }
+
+    observer->OnOutputHighWater(user, sendingBytes);
+    observer->Release();
+}
+
+void
+CMsgWatermark::Remove(const RTP_MSG_USER& user)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    m_highUsers.erase(user);
+}
+
+void
+CMsgWatermark::OnTimer(void*    factory,
+                       uint64_t timerId,
+                       int64_t  tick,
+                       int64_t  userData)
+{
+    assert(factory != NULL);
+    assert(timerId > 0);
+    if (factory == NULL || timerId == 0)
+    {
+        return;
+    }
+
+    IMsgWatermarkObserver*      observer = NULL;
+    CProStlVector<RTP_MSG_USER> users;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_observer == NULL || m_reactor == NULL)
+        {
+            return;
+        }
+
+        if (timerId != m_timerId || m_highUsers.size() == 0)
+        {
+            return;
+        }
+
+        users.assign(m_highUsers.begin(), m_highUsers.end());
+
+        m_observer->AddRef();
+        observer = m_observer;
+    }
+
+    const size_t lowBytes = m_lowBytes.load();
+
+    int i = 0;
+    int c = (int)users.size();
+
+    for (; i < c; ++i)
+    {
+        size_t sendingBytes = observer->GetSendingBytes(users[i]);
+        if (sendingBytes > lowBytes)
+        {
+            continue;
+        }
+
+        bool erased = false;
+
+        {
+            CProThreadMutexGuard mon(m_lock);
+
+            erased = m_highUsers.erase(users[i]) > 0;
+        }
+
+        if (erased)
+        {
+            observer->OnOutputLowWater(users[i], sendingBytes);
+        }
+    }
+
+    observer->Release();
+}
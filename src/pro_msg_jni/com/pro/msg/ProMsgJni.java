@@ -18,6 +18,8 @@
 
 package com.pro.msg;
 
+import java.nio.ByteBuffer;
+
 /*
  * please refer to "libpronet/pub/inc/pronet/rtp_msg.h"
  *
@@ -50,6 +52,36 @@ public class ProMsgJni
         }
     }
 
+    /*
+     * a user packed in a long, (classId << 56) | (userId << 16) | instId.
+     * it's used by the *Packed() methods and the packed listeners, so no
+     * PRO_MSG_USER is allocated per message
+     */
+    public static long packUser(
+        short classId,
+        long  userId,
+        int   instId
+        )
+    {
+        return ((long)(classId & 0xFF) << 56) | ((userId & 0xFFFFFFFFFFL) << 16) |
+            (instId & 0xFFFF);
+    }
+
+    public static short packedClassId(long user)
+    {
+        return (short)(user >>> 56);
+    }
+
+    public static long packedUserId(long user)
+    {
+        return (user >>> 16) & 0xFFFFFFFFFFL;
+    }
+
+    public static int packedInstId(long user)
+    {
+        return (int)(user & 0xFFFF);
+    }
+
     public interface MsgClientListener
     {
         /*
@@ -131,6 +163,201 @@ public class ProMsgJni
             );
     }
 
+    /*
+     * optional. a MsgClientListener that also implements this interface is
+     * told when the queued bytes reach the high mark and fall to the low mark
+     */
+    public interface MsgClientWatermarkListener
+    {
+        /*
+         * signature: (JJ)V
+         */
+        void msgClientOnOutputHighWater(
+            long msgClient,
+            long sendingBytes
+            );
+
+        /*
+         * signature: (JJ)V
+         */
+        void msgClientOnOutputLowWater(
+            long msgClient,
+            long sendingBytes
+            );
+    }
+
+    /*
+     * optional. a MsgClientListener that also implements this interface is
+     * told when the sends held while reconnecting are dropped, by the
+     * msgc_pending_msgs, msgc_offline_bytes and msgc_offline_age limits, or
+     * by the new connection, and when a coalesced batch is refused
+     */
+    public interface MsgClientDropListener
+    {
+        /*
+         * signature: (JJJ)V
+         */
+        void msgClientOnSendDropped(
+            long msgClient,
+            long msgCount,
+            long bytes
+            );
+    }
+
+    /*
+     * optional. a MsgServerListener that also implements this interface is
+     * told when the queued bytes of a user reach the high mark and fall to
+     * the low mark
+     */
+    public interface MsgServerWatermarkListener
+    {
+        /*
+         * signature: (JLcom/pro/msg/ProMsgJni$PRO_MSG_USER;J)V
+         */
+        void msgServerOnOutputHighWater(
+            long         msgServer,
+            PRO_MSG_USER user,
+            long         sendingBytes
+            );
+
+        /*
+         * signature: (JLcom/pro/msg/ProMsgJni$PRO_MSG_USER;J)V
+         */
+        void msgServerOnOutputLowWater(
+            long         msgServer,
+            PRO_MSG_USER user,
+            long         sendingBytes
+            );
+    }
+
+    /*
+     * optional. a MsgClientListener that also implements this interface gets
+     * the received messages here instead of msgClientOnRecv(), without a
+     * byte[] or a PRO_MSG_USER being allocated.
+     *
+     * buf holds the message at [0, size). it's a buffer added with
+     * msgClientAddRecvBuffer() if a free one is big enough, or else a view
+     * over the native receive buffer. either way it's valid only during the
+     * call and must not be written. its position and limit are not set
+     */
+    public interface MsgClientDirectListener
+    {
+        /*
+         * signature: (JLjava/nio/ByteBuffer;IISJI)V
+         */
+        void msgClientOnRecvDirect(
+            long       msgClient,
+            ByteBuffer buf,
+            int        size,
+            int        charset,
+            short      srcClassId,
+            long       srcUserId,
+            int        srcInstId
+            );
+    }
+
+    /*
+     * optional. the same as MsgClientDirectListener, for msgServerOnRecvMsg()
+     * and msgServerAddRecvBuffer()
+     */
+    public interface MsgServerDirectListener
+    {
+        /*
+         * signature: (JLjava/nio/ByteBuffer;IISJI)V
+         */
+        void msgServerOnRecvMsgDirect(
+            long       msgServer,
+            ByteBuffer buf,
+            int        size,
+            int        charset,
+            short      srcClassId,
+            long       srcUserId,
+            int        srcInstId
+            );
+    }
+
+    /*
+     * optional. a MsgClientListener that also implements this interface can
+     * get many messages in one call. it's off until msgClientSetRecvBatch()
+     * is called with maxBytes > 0.
+     *
+     * buf holds count records at [0, size), each of them is (big-endian):
+     *
+     *     [0..3]   payload size
+     *     [4..5]   charset
+     *     [6..7]   srcInstId
+     *     [8..15]  (srcClassId << 40) | srcUserId
+     *     [16..]   payload
+     *
+     * buf is valid only during the call and must not be written. its
+     * position and limit are not set. a message that doesn't fit in maxBytes
+     * is passed alone, in a larger buffer. the calls aren't made with a
+     * native lock held, so the listener may send from them
+     */
+    public interface MsgClientBatchListener
+    {
+        /*
+         * signature: (JLjava/nio/ByteBuffer;II)V
+         */
+        void msgClientOnRecvBatch(
+            long       msgClient,
+            ByteBuffer buf,
+            int        size,
+            int        count
+            );
+    }
+
+    /*
+     * optional. the same as MsgClientBatchListener, for msgServerOnRecvMsg()
+     * and msgServerSetRecvBatch()
+     */
+    public interface MsgServerBatchListener
+    {
+        /*
+         * signature: (JLjava/nio/ByteBuffer;II)V
+         */
+        void msgServerOnRecvMsgBatch(
+            long       msgServer,
+            ByteBuffer buf,
+            int        size,
+            int        count
+            );
+    }
+
+    /*
+     * optional. a MsgClientListener that also implements this interface gets
+     * the received messages here instead of msgClientOnRecv(), with srcUser
+     * packed. see packUser()
+     */
+    public interface MsgClientPackedListener
+    {
+        /*
+         * signature: (J[BIJ)V
+         */
+        void msgClientOnRecvPacked(
+            long   msgClient,
+            byte[] buf,
+            int    charset,
+            long   srcUser
+            );
+    }
+
+    /*
+     * optional. the same as MsgClientPackedListener, for msgServerOnRecvMsg()
+     */
+    public interface MsgServerPackedListener
+    {
+        /*
+         * signature: (J[BIJ)V
+         */
+        void msgServerOnRecvMsgPacked(
+            long   msgServer,
+            byte[] buf,
+            int    charset,
+            long   srcUser
+            );
+    }
+
     public static native void getCoreVersion(
         short[] major_1,
         short[] minor_1,
@@ -139,8 +366,48 @@ public class ProMsgJni
 
     public static native boolean init(int threadCount); /* 1 ~ (2/20) ~ 100 */
 
+    /*
+     * the same as init(), with the threads of the default reactor pinned to
+     * cpus, e.g., "0-3,8". null or "" for unpinned. Linux only
+     */
+    public static native boolean initOnCpus(
+        int    threadCount, /* 1 ~ (2/20) ~ 100 */
+        String cpus         /* = null */
+        );
+
     public static native void fini();
 
+    /*
+     * true by default. a native thread that calls a listener is attached to
+     * the JVM once and stays attached until it exits. false for attaching
+     * and detaching it around every call
+     */
+    public static native void setPersistentAttach(boolean persistent);
+
+    /*
+     * a reactor with threads of its own, so some clients and servers can be
+     * kept apart from the others. bit n of cpuMask pins the threads to CPU
+     * n, on Linux only. 0 for unpinned. init() must be called first
+     */
+    public static native long reactorCreate(
+        int  threadCount, /* 1 ~ (2/20) ~ 100 */
+        long cpuMask      /* = 0 */
+        );
+
+    /*
+     * the same as reactorCreate(), with a CPU list such as "0-3,8" instead
+     * of a mask, for CPUs above 63
+     */
+    public static native long reactorCreateOnCpus(
+        int    threadCount, /* 1 ~ (2/20) ~ 100 */
+        String cpus         /* = null */
+        );
+
+    /*
+     * false if a client or a server is still running on it
+     */
+    public static native boolean reactorDelete(long reactor);
+
     /*---------------------------------------------------------------------*/
 
     public static native long msgClientCreate(
@@ -154,6 +421,21 @@ public class ProMsgJni
         String            localIp     /* = null */
         );
 
+    /*
+     * the same as msgClientCreate(), on a reactor from reactorCreate()
+     */
+    public static native long msgClientCreateOnReactor(
+        long              reactor,    /* 0 for the default */
+        MsgClientListener listener,
+        String            configFileName,
+        short             mmType,     /* = 0, 10 ~ 69 */
+        String            serverIp,   /* = null */
+        int               serverPort, /* = 0, 1 ~ 65535 */
+        PRO_MSG_USER      user,       /* = null */
+        String            password,   /* = null */
+        String            localIp     /* = null */
+        );
+
     public static native void msgClientDelete(long client);
 
     public static native short msgClientGetMmType(long client);
@@ -185,6 +467,59 @@ public class ProMsgJni
         PRO_MSG_USER[] dstUsers /* count <= 255 */
         );
 
+    /*
+     * buf must be a direct ByteBuffer. [offset, offset + size) is sent
+     * without being copied into the native heap first
+     */
+    public static native boolean msgClientSendMsgDirect(
+        long           client,
+        ByteBuffer     buf,
+        int            offset,
+        int            size,
+        int            charset, /* 0 ~ 65535 */
+        PRO_MSG_USER[] dstUsers /* count <= 255 */
+        );
+
+    public static native boolean msgClientSendMsgV(
+        long           client,
+        byte[][]       bufs,    /* sent as one message */
+        int            charset, /* 0 ~ 65535 */
+        PRO_MSG_USER[] dstUsers /* count <= 255 */
+        );
+
+    public static native boolean msgClientSendBuffer(
+        long           client,
+        long           buffer,
+        int            charset, /* 0 ~ 65535 */
+        PRO_MSG_USER[] dstUsers /* count <= 255 */
+        );
+
+    /*
+     * the same as msgClientSendMsg(), with dstUsers packed. see packUser()
+     */
+    public static native boolean msgClientSendMsgPacked(
+        long   client,
+        byte[] buf,
+        int    charset, /* 0 ~ 65535 */
+        long[] dstUsers /* count <= 255 */
+        );
+
+    public static native boolean msgClientSendMsgDirectPacked(
+        long       client,
+        ByteBuffer buf,
+        int        offset,
+        int        size,
+        int        charset, /* 0 ~ 65535 */
+        long[]     dstUsers /* count <= 255 */
+        );
+
+    public static native boolean msgClientSendBufferPacked(
+        long   client,
+        long   buffer,
+        int    charset, /* 0 ~ 65535 */
+        long[] dstUsers /* count <= 255 */
+        );
+
     public static native void msgClientSetOutputRedline(
         long client,
         long redlineBytes
@@ -194,8 +529,68 @@ public class ProMsgJni
 
     public static native long msgClientGetSendingBytes(long client);
 
+    public static native void msgClientSetOutputWatermarks(
+        long client,
+        long highBytes, /* 0 for disabled */
+        long lowBytes   /* < highBytes */
+        );
+
+    /*
+     * buffer must be a direct ByteBuffer. see MsgClientDirectListener. one
+     * buffer is enough for a client
+     */
+    public static native boolean msgClientAddRecvBuffer(
+        long       client,
+        ByteBuffer buffer
+        );
+
+    /*
+     * see MsgClientBatchListener. the messages are passed when maxBytes
+     * would be exceeded, or every maxDelayInMs. a larger maxBytes means
+     * fewer calls and a longer delay. don't call it in msgClientOnRecvBatch()
+     */
+    public static native boolean msgClientSetRecvBatch(
+        long client,
+        int  maxBytes,    /* 0 for disabled */
+        int  maxDelayInMs /* > 0 */
+        );
+
+    /*
+     * packs consecutive small messages to the same destinations into one
+     * message, which is sent when it reaches maxBytes or maxMsgs, or after
+     * maxDelayInUs. the receivers unpack it by themselves, so they must be
+     * built with this version
+     */
+    public static native void msgClientSetCoalescing(
+        long client,
+        int  maxBytes,    /* 0 for disabled */
+        int  maxMsgs,     /* > 1 */
+        int  maxDelayInUs /* > 0 */
+        );
+
+    /*
+     * with maxIntervalInSeconds > 0, the delay of the n-th reconnection
+     * since the last msgClientOnOkMsg() is random in
+     * [0, min(maxIntervalInSeconds, intervalInSeconds * 2^n)]
+     */
+    public static native void msgClientSetReconnectInterval(
+        long client,
+        int  intervalInSeconds,   /* > 0 */
+        int  maxIntervalInSeconds /* 0 for a fixed interval */
+        );
+
     public static native boolean msgClientReconnect(long client);
 
+    public static native boolean msgClientJoinGroup(
+        long client,
+        long groupId
+        );
+
+    public static native boolean msgClientLeaveGroup(
+        long client,
+        long groupId
+        );
+
     /*---------------------------------------------------------------------*/
 
     public static native long msgServerCreate(
@@ -205,6 +600,17 @@ public class ProMsgJni
         int               serviceHubPort /* = 0, 1 ~ 65535 */
         );
 
+    /*
+     * the same as msgServerCreate(), on a reactor from reactorCreate()
+     */
+    public static native long msgServerCreateOnReactor(
+        long              reactor,       /* 0 for the default */
+        MsgServerListener listener,
+        String            configFileName,
+        short             mmType,        /* = 0, 10 ~ 69 */
+        int               serviceHubPort /* = 0, 1 ~ 65535 */
+        );
+
     public static native void msgServerDelete(long server);
 
     public static native short msgServerGetMmType(long server);
@@ -238,6 +644,58 @@ public class ProMsgJni
         PRO_MSG_USER[] dstUsers /* count <= 255 */
         );
 
+    /*
+     * the same as msgClientSendMsgDirect()
+     */
+    public static native boolean msgServerSendMsgDirect(
+        long           server,
+        ByteBuffer     buf,
+        int            offset,
+        int            size,
+        int            charset, /* 0 ~ 65535 */
+        PRO_MSG_USER[] dstUsers /* count <= 255 */
+        );
+
+    public static native boolean msgServerSendMsgV(
+        long           server,
+        byte[][]       bufs,    /* sent as one message */
+        int            charset, /* 0 ~ 65535 */
+        PRO_MSG_USER[] dstUsers /* count <= 255 */
+        );
+
+    public static native boolean msgServerSendBuffer(
+        long           server,
+        long           buffer,
+        int            charset, /* 0 ~ 65535 */
+        PRO_MSG_USER[] dstUsers /* count <= 255 */
+        );
+
+    /*
+     * the same as msgServerSendMsg(), with dstUsers packed. see packUser()
+     */
+    public static native boolean msgServerSendMsgPacked(
+        long   server,
+        byte[] buf,
+        int    charset, /* 0 ~ 65535 */
+        long[] dstUsers /* count <= 255 */
+        );
+
+    public static native boolean msgServerSendMsgDirectPacked(
+        long       server,
+        ByteBuffer buf,
+        int        offset,
+        int        size,
+        int        charset, /* 0 ~ 65535 */
+        long[]     dstUsers /* count <= 255 */
+        );
+
+    public static native boolean msgServerSendBufferPacked(
+        long   server,
+        long   buffer,
+        int    charset, /* 0 ~ 65535 */
+        long[] dstUsers /* count <= 255 */
+        );
+
     public static native void msgServerSetOutputRedline(
         long server,
         long redlineBytes
@@ -245,11 +703,156 @@ public class ProMsgJni
 
     public static native long msgServerGetOutputRedline(long server);
 
+    /*
+     * redlineBytes 0 for the default. it applies to the messages sent by the
+     * server, and for class 255 also to the C2S links. the messages routed
+     * between users stay within msgServerSetOutputRedline()
+     */
+    public static native void msgServerSetClassOutputRedline(
+        long  server,
+        short classId,     /* 1 ~ 255 */
+        long  redlineBytes
+        );
+
+    /*
+     * until the user is closed. redlineBytes 0 for the class's one. it
+     * applies to the messages sent by the server only
+     */
+    public static native void msgServerSetUserOutputRedline(
+        long         server,
+        PRO_MSG_USER user,
+        long         redlineBytes
+        );
+
     public static native long msgServerGetSendingBytes(
         long         server,
         PRO_MSG_USER user
         );
 
+    /*
+     * the total queued bytes of the direct users of the class
+     */
+    public static native long msgServerGetClassSendingBytes(
+        long  server,
+        short classId /* 1 ~ 255 */
+        );
+
+    public static native void msgServerSetOutputWatermarks(
+        long server,
+        long highBytes, /* 0 for disabled */
+        long lowBytes   /* < highBytes */
+        );
+
+    /*
+     * buffer must be a direct ByteBuffer. see MsgServerDirectListener. add
+     * one buffer per reactor thread, or the messages beyond them are passed
+     * as views
+     */
+    public static native boolean msgServerAddRecvBuffer(
+        long       server,
+        ByteBuffer buffer
+        );
+
+    /*
+     * see MsgServerBatchListener. the messages are passed when maxBytes
+     * would be exceeded, or every maxDelayInMs. a larger maxBytes means
+     * fewer calls and a longer delay. don't call it in msgServerOnRecvMsgBatch()
+     */
+    public static native boolean msgServerSetRecvBatch(
+        long server,
+        int  maxBytes,    /* 0 for disabled */
+        int  maxDelayInMs /* > 0 */
+        );
+
+    public static native boolean msgServerCreateGroup(
+        long server,
+        long groupId /* > 0 */
+        );
+
+    public static native void msgServerDeleteGroup(
+        long server,
+        long groupId
+        );
+
+    public static native boolean msgServerJoinGroup(
+        long         server,
+        long         groupId,
+        PRO_MSG_USER user
+        );
+
+    public static native void msgServerLeaveGroup(
+        long         server,
+        long         groupId,
+        PRO_MSG_USER user
+        );
+
+    public static native long msgServerGetGroupMemberCount(
+        long server,
+        long groupId
+        );
+
+    public static native boolean msgServerPublishMsg(
+        long   server,
+        long   groupId,
+        byte[] buf,
+        int    charset /* 0 ~ 65535 */
+        );
+
+    public static native boolean msgServerPublishBuffer(
+        long server,
+        long groupId,
+        long buffer,
+        int  charset /* 0 ~ 65535 */
+        );
+
+    /*
+     * the layout of the array of msgServerGetMetrics(). see msg_metrics.h
+     */
+    public static final int METRICS_MSGS_IN           = 0;
+    public static final int METRICS_BYTES_IN          = 1;
+    public static final int METRICS_MSGS_OUT          = 2;
+    public static final int METRICS_BYTES_OUT         = 3;
+    public static final int METRICS_REDLINE_DROPS     = 4;
+    public static final int METRICS_HANDSHAKES_OK     = 5;
+    public static final int METRICS_HANDSHAKES_FAILED = 6;
+    public static final int METRICS_KICKOUTS          = 7;
+    public static final int METRICS_CLOSES            = 8;
+    public static final int METRICS_CLOSES_DROPPED    = 9;
+    public static final int METRICS_USERS             = 10;
+    public static final int METRICS_AUTH_REJECTS_CID  = 16;  /* + classId */
+    public static final int METRICS_USERS_CID         = 272; /* + classId */
+    public static final int METRICS_SIZE              = 528;
+
+    /*
+     * lock-free. metrics is filled without being reallocated, so it can be
+     * polled as often as needed
+     */
+    public static native boolean msgServerGetMetrics(
+        long   server,
+        long[] metrics /* length >= METRICS_SIZE */
+        );
+
+    /*
+     * fills reasons with pairs of (errorCode << 32 | sslCode, count), by
+     * count, descending. the return value is the number of pairs
+     */
+    public static native int msgServerGetCloseReasons(
+        long   server,
+        long[] reasons
+        );
+
+    public static native void msgServerResetMetrics(long server);
+
+    /*---------------------------------------------------------------------*/
+
+    /*
+     * an immutable copy of buf. it can be sent again and again without
+     * being copied, until msgBufferDelete() is called
+     */
+    public static native long msgBufferCreate(byte[] buf);
+
+    public static native void msgBufferDelete(long buffer);
+
     static
     {
         System.loadLibrary("pro_shared");
@@ -17,6 +17,8 @@
  */
 
 #include "com_pro_msg_ProMsgJni.h"
+#include "jni_handle_table.h"
+#include "jni_reactor.h"
 #include "jni_util.h"
 #include "msg_client_jni.h"
 #include "msg_server_jni.h"
@@ -26,7 +28,11 @@
 #include "pronet/pro_time_util.h"
 #include "pronet/pro_version.h"
 #include "pronet/pro_z.h"
+#include "../pro_msg/msg_affinity.h"
+#include "../pro_msg/msg_buffer.h"
+#include "../pro_msg/msg_metrics.h"
 #include <jni.h>
+#include <atomic>
 
 #if defined(__cplusplus)
 extern "C" {
@@ -57,11 +63,30 @@ struct JAVA_USER_META
     DECLARE_SGI_POOL(0)
 };
 
-static IProReactor*      g_s_reactor = NULL;
-static CProStlSet<jlong> g_s_clients;
-static CProStlSet<jlong> g_s_servers;
-static JAVA_USER_META    g_s_meta;
-static CProThreadMutex   g_s_lock;
+struct JAVA_SEGMENTS
+{
+    CProStlVector<jbyteArray>  arrays;
+    CProStlVector<jbyte*>      elements;
+    CProStlVector<MSG_SEGMENT> segments;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/*
+ * g_s_meta is published once by init(), and then read without any lock. It
+ * is kept until the process exits, because a callback on another thread
+ * may be reading it while fini() is running.
+ *
+ * g_s_reactor is the default reactor, and g_s_reactors are the ones created
+ * by reactorCreate()
+ */
+static CJniReactor*                 g_s_reactor = NULL;
+static CJniHandleTable              g_s_reactors;
+static CJniHandleTable              g_s_clients;
+static CJniHandleTable              g_s_servers;
+static CJniHandleTable              g_s_buffers;
+static std::atomic<JAVA_USER_META*> g_s_meta(NULL);
+static CProThreadMutex              g_s_lock;
 
 /////////////////////////////////////////////////////////////////////////////
 ////
@@ -95,27 +120,22 @@ NewJavaUser_i(JNIEnv*             env,
         return NULL;
     }
 
-    jobject javaUser = NULL;
-
+    const JAVA_USER_META* const meta = g_s_meta.load();
+    if (meta == NULL)
     {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_meta.clazz == NULL)
-        {
-            return NULL;
-        }
+        return NULL;
+    }
 
-        javaUser = env->NewObject(
-            g_s_meta.clazz,
-            g_s_meta.mid_ctor3,
-            (jshort)user.classId,
-            (jlong) user.UserId(),
-            (jint)  user.instId
-            );
-        if (env->ExceptionCheck())
-        {
-            javaUser = NULL;
-        }
+    jobject javaUser = env->NewObject(
+        meta->clazz,
+        meta->mid_ctor3,
+        (jshort)user.classId,
+        (jlong) user.UserId(),
+        (jint)  user.instId
+        );
+    if (env->ExceptionCheck())
+    {
+        javaUser = NULL;
     }
 
     return javaUser;
@@ -134,51 +154,331 @@ MSG_USER_java2cpp_i(JNIEnv*       env,
         return;
     }
 
+    const JAVA_USER_META* const meta = g_s_meta.load();
+    if (meta == NULL)
     {
-        CProThreadMutexGuard mon(g_s_lock);
+        return;
+    }
+
+    jshort classId = env->GetShortField(javaUser, meta->fid_classId);
+    jlong  userId  = env->GetLongField (javaUser, meta->fid_userId);
+    jint   instId  = env->GetIntField  (javaUser, meta->fid_instId);
+    if (classId <= 0 || classId > 255 || userId < 0 || instId < 0 || instId > 65535)
+    {
+        return;
+    }
+
+    cppUser.classId = (unsigned char)classId;
+    cppUser.UserId((uint64_t)userId);
+    cppUser.instId  = (uint16_t)instId;
+}
+
+static
+void
+MSG_USER_cpp2java_i(JNIEnv*             env,
+                    const RTP_MSG_USER& cppUser,
+                    jobject             javaUser)
+{
+    if (env == NULL || javaUser == NULL)
+    {
+        return;
+    }
+
+    const JAVA_USER_META* const meta = g_s_meta.load();
+    if (meta == NULL)
+    {
+        return;
+    }
+
+    env->SetShortField(javaUser, meta->fid_classId, (jshort)cppUser.classId);
+    env->SetLongField (javaUser, meta->fid_userId , (jlong) cppUser.UserId());
+    env->SetIntField  (javaUser, meta->fid_instId , (jint)  cppUser.instId);
+}
+
+/* static */
+jlong
+PackJavaUser_i(const RTP_MSG_USER& user)
+{
+    return (jlong)(((uint64_t)user.classId << 56) | (user.UserId() << 16) | user.instId);
+}
+
+/*
+ * [1, 255] users with one copy. the same as MSG_USER_java2cpp_i(), an
+ * invalid user is zeroed
+ */
+static
+bool
+GetPackedUsers_i(JNIEnv*        env,
+                 jlongArray     javaUsers,
+                 RTP_MSG_USER   cppUsers[255],
+                 unsigned char* count)
+{
+    jsize c = env->GetArrayLength(javaUsers);
+    if (c <= 0 || c > 255)
+    {
+        return false;
+    }
+
+    jlong packedUsers[255];
+    env->GetLongArrayRegion(javaUsers, 0, c, packedUsers);
+    if (env->ExceptionCheck())
+    {
+        return false;
+    }
+
+    for (int i = 0; i < (int)c; ++i)
+    {
+        const uint64_t packedUser = (uint64_t)packedUsers[i];
 
-        if (g_s_meta.clazz == NULL)
+        cppUsers[i].classId = (unsigned char)(packedUser >> 56);
+        cppUsers[i].UserId((packedUser >> 16) & 0xFFFFFFFFFFULL);
+        cppUsers[i].instId  = (uint16_t)packedUser;
+        if (cppUsers[i].classId == 0)
         {
-            return;
+            cppUsers[i].Zero();
         }
+    }
+
+    *count = (unsigned char)c;
+
+    return true;
+}
+
+/*
+ * lock-free. the caller should release the return value
+ */
+static
+CMsgClientJni*
+GetClient_i(jlong client)
+{
+    return (CMsgClientJni*)g_s_clients.Get(client);
+}
+
+static
+CMsgServerJni*
+GetServer_i(jlong server)
+{
+    return (CMsgServerJni*)g_s_servers.Get(server);
+}
+
+static
+CMsgBuffer*
+GetBuffer_i(jlong buffer)
+{
+    return (CMsgBuffer*)g_s_buffers.Get(buffer);
+}
+
+/*
+ * with g_s_lock held. 0 for the default reactor. the return value has a
+ * reference and a user, which PutJniReactor_i() drops
+ */
+static
+CJniReactor*
+TakeJniReactor_i(jlong reactor)
+{
+    CJniReactor* jniReactor = NULL;
 
-        jshort classId = env->GetShortField(javaUser, g_s_meta.fid_classId);
-        jlong  userId  = env->GetLongField (javaUser, g_s_meta.fid_userId);
-        jint   instId  = env->GetIntField  (javaUser, g_s_meta.fid_instId);
-        if (classId <= 0 || classId > 255 || userId < 0 || instId < 0 || instId > 65535)
+    if (reactor == 0)
+    {
+        jniReactor = g_s_reactor;
+        if (jniReactor != NULL)
         {
-            return;
+            jniReactor->AddRef();
         }
+    }
+    else
+    {
+        jniReactor = (CJniReactor*)g_s_reactors.Get(reactor);
+    }
 
-        cppUser.classId = (unsigned char)classId;
-        cppUser.UserId((uint64_t)userId);
-        cppUser.instId  = (uint16_t)instId;
+    if (jniReactor == NULL)
+    {
+        return NULL;
+    }
+
+    if (!jniReactor->AddUser())
+    {
+        jniReactor->Release();
+
+        return NULL;
     }
+
+    return jniReactor;
 }
 
 static
 void
-MSG_USER_cpp2java_i(JNIEnv*             env,
-                    const RTP_MSG_USER& cppUser,
-                    jobject             javaUser)
+PutJniReactor_i(CJniReactor* jniReactor)
 {
-    if (env == NULL || javaUser == NULL)
+    jniReactor->RemoveUser();
+    jniReactor->Release();
+}
+
+static
+void
+DeleteClient_i(CMsgClientJni* client)
+{
+    CJniReactor* const jniReactor = client->GetJniReactor();
+
+    client->Fini();
+    if (jniReactor != NULL)
     {
-        return;
+        PutJniReactor_i(jniReactor);
     }
+    client->Release();
+}
+
+static
+void
+DeleteServer_i(CMsgServerJni* server)
+{
+    CJniReactor* const jniReactor = server->GetJniReactor();
 
+    server->Fini();
+    if (jniReactor != NULL)
     {
-        CProThreadMutexGuard mon(g_s_lock);
+        PutJniReactor_i(jniReactor);
+    }
+    server->Release();
+}
+
+/*
+ * null gives an empty list. see MsgParseCpuList()
+ */
+static
+bool
+GetCpuList_i(JNIEnv*                      env,
+             jstring                      cpus,
+             CProStlVector<unsigned int>& cppCpus)
+{
+    cppCpus.clear();
 
-        if (g_s_meta.clazz == NULL)
+    if (cpus == NULL)
+    {
+        return true;
+    }
+
+    char cppText[1024] = "";
+    cppText[sizeof(cppText) - 1] = '\0';
+
+    jsize uniSize = env->GetStringLength(cpus);
+    jsize utfSize = env->GetStringUTFLength(cpus);
+    if (utfSize >= (jsize)sizeof(cppText))
+    {
+        return false;
+    }
+    if (utfSize > 0)
+    {
+        env->GetStringUTFRegion(cpus, 0, uniSize, cppText);
+    }
+
+    if (env->ExceptionCheck())
+    {
+        return false;
+    }
+
+    return MsgParseCpuList(cppText, cppCpus);
+}
+
+static
+jlong
+CreateReactor_i(unsigned int                       threadCount,
+                const CProStlVector<unsigned int>& cpus)
+{
+    CProThreadMutexGuard mon(g_s_lock);
+
+    assert(g_s_reactor != NULL);
+    if (g_s_reactor == NULL)
+    {
+        return 0;
+    }
+
+    CJniReactor* const reactor = CJniReactor::CreateInstance(threadCount, cpus);
+    if (reactor == NULL)
+    {
+        return 0;
+    }
+
+    jlong handle = g_s_reactors.Add(reactor);
+    if (handle == 0)
+    {
+        reactor->Release();
+    }
+
+    return handle;
+}
+
+static
+void
+ReleaseJavaSegments_i(JNIEnv*        env,
+                      JAVA_SEGMENTS& javaSegments)
+{
+    int i = 0;
+    int c = (int)javaSegments.elements.size();
+
+    for (; i < c; ++i)
+    {
+        env->ReleaseByteArrayElements(
+            javaSegments.arrays[i], javaSegments.elements[i], JNI_ABORT);
+    }
+
+    i = 0;
+    c = (int)javaSegments.arrays.size();
+
+    for (; i < c; ++i)
+    {
+        env->DeleteLocalRef(javaSegments.arrays[i]);
+    }
+
+    javaSegments.arrays.clear();
+    javaSegments.elements.clear();
+    javaSegments.segments.clear();
+}
+
+static
+bool
+GetJavaSegments_i(JNIEnv*        env,
+                  jobjectArray   bufs,
+                  JAVA_SEGMENTS& javaSegments)
+{
+    int i = 0;
+    int c = (int)env->GetArrayLength(bufs);
+
+    if (c <= 0)
+    {
+        return false;
+    }
+
+    for (; i < c; ++i)
+    {
+        jbyteArray buf = (jbyteArray)env->GetObjectArrayElement(bufs, i);
+        if (buf == NULL || env->ExceptionCheck())
         {
-            return;
+            ReleaseJavaSegments_i(env, javaSegments);
+
+            return false;
+        }
+
+        javaSegments.arrays.push_back(buf);
+
+        jsize  buf_size = env->GetArrayLength(buf);
+        jbyte* buf_p    = env->GetByteArrayElements(buf, NULL);
+        if (buf_p == NULL || env->ExceptionCheck())
+        {
+            ReleaseJavaSegments_i(env, javaSegments);
+
+            return false;
         }
 
-        env->SetShortField(javaUser, g_s_meta.fid_classId, (jshort)cppUser.classId);
-        env->SetLongField (javaUser, g_s_meta.fid_userId , (jlong) cppUser.UserId());
-        env->SetIntField  (javaUser, g_s_meta.fid_instId , (jint)  cppUser.instId);
+        javaSegments.elements.push_back(buf_p);
+
+        MSG_SEGMENT segment;
+        segment.buf  = buf_p;
+        segment.size = buf_size;
+        javaSegments.segments.push_back(segment);
     }
+
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -259,6 +559,19 @@ JNICALL
 Java_com_pro_msg_ProMsgJni_init(JNIEnv* env,
                                 jclass  clazz,
                                 jint    threadCount) /* 1 ~ (2/20) ~ 100 */
+{
+    jboolean ret = Java_com_pro_msg_ProMsgJni_initOnCpus(env, clazz, threadCount, NULL);
+
+    return ret;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_initOnCpus(JNIEnv* env,
+                                      jclass  clazz,
+                                      jint    threadCount, /* 1 ~ (2/20) ~ 100 */
+                                      jstring cpus)        /* = null */
 {
     assert(threadCount > 0);
     assert(threadCount <= 100);
@@ -267,8 +580,14 @@ Java_com_pro_msg_ProMsgJni_init(JNIEnv* env,
         return JNI_FALSE;
     }
 
-    IProReactor*   reactor = NULL;
-    JAVA_USER_META meta;
+    CProStlVector<unsigned int> cppCpus;
+    if (!GetCpuList_i(env, cpus, cppCpus))
+    {
+        return JNI_FALSE;
+    }
+
+    CJniReactor*    reactor = NULL;
+    JAVA_USER_META* meta    = NULL;
 
     {
         CProThreadMutexGuard mon(g_s_lock);
@@ -279,56 +598,62 @@ Java_com_pro_msg_ProMsgJni_init(JNIEnv* env,
             return JNI_FALSE;
         }
 
-        reactor = ProCreateReactor((unsigned int)threadCount);
+        reactor = CJniReactor::CreateInstance((unsigned int)threadCount, cppCpus);
         if (reactor == NULL)
         {
             goto EXIT;
         }
 
-        jclass clazz = env->FindClass("com/pro/msg/ProMsgJni$PRO_MSG_USER");
-        if (clazz == NULL || env->ExceptionCheck())
+        if (g_s_meta.load() == NULL)
         {
-            goto EXIT;
-        }
+            meta = new JAVA_USER_META;
 
-        meta.clazz = (jclass)env->NewGlobalRef(clazz);
-        if (meta.clazz == NULL || env->ExceptionCheck())
-        {
-            goto EXIT;
-        }
+            jclass clazz = env->FindClass("com/pro/msg/ProMsgJni$PRO_MSG_USER");
+            if (clazz == NULL || env->ExceptionCheck())
+            {
+                goto EXIT;
+            }
 
-        meta.mid_ctor0 = env->GetMethodID(meta.clazz, "<init>", "()V");
-        if (meta.mid_ctor0 == NULL || env->ExceptionCheck())
-        {
-            goto EXIT;
-        }
+            meta->clazz = (jclass)env->NewGlobalRef(clazz);
+            if (meta->clazz == NULL || env->ExceptionCheck())
+            {
+                goto EXIT;
+            }
 
-        meta.mid_ctor3 = env->GetMethodID(meta.clazz, "<init>", "(SJI)V");
-        if (meta.mid_ctor3 == NULL || env->ExceptionCheck())
-        {
-            goto EXIT;
-        }
+            meta->mid_ctor0 = env->GetMethodID(meta->clazz, "<init>", "()V");
+            if (meta->mid_ctor0 == NULL || env->ExceptionCheck())
+            {
+                goto EXIT;
+            }
 
-        meta.fid_classId = env->GetFieldID(meta.clazz, "classId", "S");
-        if (meta.fid_classId == NULL || env->ExceptionCheck())
-        {
-            goto EXIT;
-        }
+            meta->mid_ctor3 = env->GetMethodID(meta->clazz, "<init>", "(SJI)V");
+            if (meta->mid_ctor3 == NULL || env->ExceptionCheck())
+            {
+                goto EXIT;
+            }
 
-        meta.fid_userId = env->GetFieldID(meta.clazz, "userId", "J");
-        if (meta.fid_userId == NULL || env->ExceptionCheck())
-        {
-            goto EXIT;
-        }
+            meta->fid_classId = env->GetFieldID(meta->clazz, "classId", "S");
+            if (meta->fid_classId == NULL || env->ExceptionCheck())
+            {
+                goto EXIT;
+            }
 
-        meta.fid_instId = env->GetFieldID(meta.clazz, "instId", "I");
-        if (meta.fid_instId == NULL || env->ExceptionCheck())
-        {
-            goto EXIT;
+            meta->fid_userId = env->GetFieldID(meta->clazz, "userId", "J");
+            if (meta->fid_userId == NULL || env->ExceptionCheck())
+            {
+                goto EXIT;
+            }
+
+            meta->fid_instId = env->GetFieldID(meta->clazz, "instId", "I");
+            if (meta->fid_instId == NULL || env->ExceptionCheck())
+            {
+                goto EXIT;
+            }
+
+            g_s_meta = meta;
         }
 
         g_s_reactor = reactor;
-        g_s_meta    = meta;
     }
 
     {{{
@@ -351,12 +676,19 @@ Java_com_pro_msg_ProMsgJni_init(JNIEnv* env,
 
 EXIT:
 
-    if (meta.clazz != NULL)
+    if (meta != NULL)
     {
-        env->DeleteGlobalRef(meta.clazz);
+        if (meta->clazz != NULL)
+        {
+            env->DeleteGlobalRef(meta->clazz);
+        }
+        delete meta;
     }
 
-    ProDeleteReactor(reactor);
+    if (reactor != NULL)
+    {
+        reactor->Release();
+    }
 
     return JNI_FALSE;
 }
@@ -367,9 +699,10 @@ JNICALL
 Java_com_pro_msg_ProMsgJni_fini(JNIEnv* env,
                                 jclass  clazz)
 {
-    IProReactor*      reactor = NULL;
-    CProStlSet<jlong> clients;
-    CProStlSet<jlong> servers;
+    CJniReactor*                 reactor = NULL;
+    CProStlVector<CProRefCount*> clients;
+    CProStlVector<CProRefCount*> servers;
+    CProStlVector<CProRefCount*> reactors;
 
     {
         CProThreadMutexGuard mon(g_s_lock);
@@ -379,48 +712,152 @@ Java_com_pro_msg_ProMsgJni_fini(JNIEnv* env,
             return;
         }
 
-        env->DeleteGlobalRef(g_s_meta.clazz);
-        g_s_meta.clazz = NULL;
-
-        servers = g_s_servers;
-        g_s_servers.clear();
-        clients = g_s_clients;
-        g_s_clients.clear();
+        g_s_servers.RemoveAll(servers);
+        g_s_clients.RemoveAll(clients);
+        g_s_reactors.RemoveAll(reactors);
         reactor = g_s_reactor;
         g_s_reactor = NULL;
     }
 
-    auto itr = servers.begin();
-    auto end = servers.end();
+    int i = 0;
+    int c = (int)servers.size();
 
-    for (; itr != end; ++itr)
+    for (; i < c; ++i)
     {
-        CMsgServerJni* p = (CMsgServerJni*)*itr;
-        p->Fini();
-        p->Release();
+        DeleteServer_i((CMsgServerJni*)servers[i]);
     }
 
-    itr = clients.begin();
-    end = clients.end();
+    i = 0;
+    c = (int)clients.size();
 
-    for (; itr != end; ++itr)
+    for (; i < c; ++i)
     {
-        CMsgClientJni* p = (CMsgClientJni*)*itr;
-        p->Fini();
-        p->Release();
+        DeleteClient_i((CMsgClientJni*)clients[i]);
+    }
+
+    /*
+     * the reactors have no users now
+     */
+    i = 0;
+    c = (int)reactors.size();
+
+    for (; i < c; ++i)
+    {
+        reactors[i]->Release();
     }
 
-    ProDeleteReactor(reactor);
+    reactor->Release();
 }
 
-/*-------------------------------------------------------------------------*/
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_setPersistentAttach(JNIEnv*  env,
+                                               jclass   clazz,
+                                               jboolean persistent)
+{
+    JniUtilSetPersistent(persistent != JNI_FALSE);
+}
 
 JNIEXPORT
 jlong
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgClientCreate(JNIEnv* env,
-                                           jclass  clazz,
-                                           jobject listener,
+Java_com_pro_msg_ProMsgJni_reactorCreate(JNIEnv* env,
+                                         jclass  clazz,
+                                         jint    threadCount, /* 1 ~ (2/20) ~ 100 */
+                                         jlong   cpuMask)     /* = 0 */
+{
+    assert(threadCount > 0);
+    assert(threadCount <= 100);
+    if (threadCount <= 0 || threadCount > 100)
+    {
+        return 0;
+    }
+
+    CProStlVector<unsigned int> cpus;
+
+    for (unsigned int i = 0; i < 64; ++i)
+    {
+        if (((uint64_t)cpuMask >> i) & 1)
+        {
+            cpus.push_back(i);
+        }
+    }
+
+    jlong ret = CreateReactor_i((unsigned int)threadCount, cpus);
+
+    return ret;
+}
+
+JNIEXPORT
+jlong
+JNICALL
+Java_com_pro_msg_ProMsgJni_reactorCreateOnCpus(JNIEnv* env,
+                                               jclass  clazz,
+                                               jint    threadCount, /* 1 ~ (2/20) ~ 100 */
+                                               jstring cpus)        /* = null */
+{
+    assert(threadCount > 0);
+    assert(threadCount <= 100);
+    if (threadCount <= 0 || threadCount > 100)
+    {
+        return 0;
+    }
+
+    CProStlVector<unsigned int> cppCpus;
+    if (!GetCpuList_i(env, cpus, cppCpus))
+    {
+        return 0;
+    }
+
+    jlong ret = CreateReactor_i((unsigned int)threadCount, cppCpus);
+
+    return ret;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_reactorDelete(JNIEnv* env,
+                                         jclass  clazz,
+                                         jlong   reactor)
+{
+    if (reactor == 0)
+    {
+        return JNI_FALSE;
+    }
+
+    CJniReactor* const reactor2 = (CJniReactor*)g_s_reactors.Get(reactor);
+    if (reactor2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    if (!reactor2->Close())
+    {
+        reactor2->Release();
+
+        return JNI_FALSE;
+    }
+
+    CProRefCount* const p = g_s_reactors.Remove(reactor);
+    if (p != NULL)
+    {
+        p->Release();
+    }
+    reactor2->Release();
+
+    return JNI_TRUE;
+}
+
+/*-------------------------------------------------------------------------*/
+
+JNIEXPORT
+jlong
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgClientCreate(JNIEnv* env,
+                                           jclass  clazz,
+                                           jobject listener,
                                            jstring configFileName,
                                            jshort  mmType,     /* = 0, 10 ~ 69 */
                                            jstring serverIp,   /* = null */
@@ -428,6 +865,28 @@ Java_com_pro_msg_ProMsgJni_msgClientCreate(JNIEnv* env,
                                            jobject user,       /* = null */
                                            jstring password,   /* = null */
                                            jstring localIp)    /* = null */
+{
+    jlong ret = Java_com_pro_msg_ProMsgJni_msgClientCreateOnReactor(
+        env, clazz, 0, listener, configFileName, mmType, serverIp, serverPort, user, password,
+        localIp);
+
+    return ret;
+}
+
+JNIEXPORT
+jlong
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgClientCreateOnReactor(JNIEnv* env,
+                                                    jclass  clazz,
+                                                    jlong   reactor,    /* 0 for the default */
+                                                    jobject listener,
+                                                    jstring configFileName,
+                                                    jshort  mmType,     /* = 0, 10 ~ 69 */
+                                                    jstring serverIp,   /* = null */
+                                                    jint    serverPort, /* = 0, 1 ~ 65535 */
+                                                    jobject user,       /* = null */
+                                                    jstring password,   /* = null */
+                                                    jstring localIp)    /* = null */
 {
     assert(listener != NULL);
     assert(configFileName != NULL);
@@ -523,7 +982,7 @@ Java_com_pro_msg_ProMsgJni_msgClientCreate(JNIEnv* env,
         }
     }
 
-    CMsgClientJni* client = NULL;
+    jlong handle = 0;
 
     {
         CProThreadMutexGuard mon(g_s_lock);
@@ -534,24 +993,44 @@ Java_com_pro_msg_ProMsgJni_msgClientCreate(JNIEnv* env,
             return 0;
         }
 
-        client = CMsgClientJni::CreateInstance(env, listener);
+        CJniReactor* const jniReactor = TakeJniReactor_i(reactor);
+        if (jniReactor == NULL)
+        {
+            return 0;
+        }
+
+        CMsgClientJni* const client = CMsgClientJni::CreateInstance(env, listener);
         if (client == NULL)
         {
+            PutJniReactor_i(jniReactor);
+
             return 0;
         }
 
-        if (!client->Init(g_s_reactor, NULL, cppConfigFileName, cppMmType,
-            cppServerIp, cppServerPort, &cppUser, cppPassword, cppLocalIp))
+        handle = g_s_clients.Add(client);
+        if (handle == 0)
         {
             client->Release();
+            PutJniReactor_i(jniReactor);
 
             return 0;
         }
 
-        g_s_clients.insert((jlong)client);
+        client->SetHandle(handle);
+        client->SetJniReactor(jniReactor);
+
+        if (!client->Init(jniReactor->GetReactor(), NULL, cppConfigFileName, cppMmType,
+            cppServerIp, cppServerPort, &cppUser, cppPassword, cppLocalIp))
+        {
+            g_s_clients.Remove(handle);
+            client->Release();
+            PutJniReactor_i(jniReactor);
+
+            return 0;
+        }
     }
 
-    return (jlong)client;
+    return handle;
 }
 
 JNIEXPORT
@@ -566,25 +1045,11 @@ Java_com_pro_msg_ProMsgJni_msgClientDelete(JNIEnv* env,
         return;
     }
 
+    CMsgClientJni* const p = (CMsgClientJni*)g_s_clients.Remove(client);
+    if (p != NULL)
     {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_reactor == NULL)
-        {
-            return;
-        }
-
-        if (g_s_clients.find(client) == g_s_clients.end())
-        {
-            return;
-        }
-
-        g_s_clients.erase(client);
+        DeleteClient_i(p);
     }
-
-    CMsgClientJni* p = (CMsgClientJni*)client;
-    p->Fini();
-    p->Release();
 }
 
 JNIEXPORT
@@ -600,17 +1065,7 @@ Java_com_pro_msg_ProMsgJni_msgClientGetMmType(JNIEnv* evn,
         return 0;
     }
 
-    CMsgClientJni* client2 = NULL;
-
-    {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_clients.find(client) != g_s_clients.end())
-        {
-            client2 = (CMsgClientJni*)client;
-            client2->AddRef();
-        }
-    }
+    CMsgClientJni* const client2 = GetClient_i(client);
 
     jshort mmType = 0;
 
@@ -636,17 +1091,7 @@ Java_com_pro_msg_ProMsgJni_msgClientGetUser(JNIEnv* env,
         return NULL;
     }
 
-    CMsgClientJni* client2 = NULL;
-
-    {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_clients.find(client) != g_s_clients.end())
-        {
-            client2 = (CMsgClientJni*)client;
-            client2->AddRef();
-        }
-    }
+    CMsgClientJni* const client2 = GetClient_i(client);
 
     jobject javaUser = NULL;
 
@@ -675,17 +1120,7 @@ Java_com_pro_msg_ProMsgJni_msgClientGetSslSuite(JNIEnv* env,
         return NULL;
     }
 
-    CMsgClientJni* client2 = NULL;
-
-    {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_clients.find(client) != g_s_clients.end())
-        {
-            client2 = (CMsgClientJni*)client;
-            client2->AddRef();
-        }
-    }
+    CMsgClientJni* const client2 = GetClient_i(client);
 
     jstring javaSuiteName = NULL;
 
@@ -714,17 +1149,7 @@ Java_com_pro_msg_ProMsgJni_msgClientGetLocalIp(JNIEnv* env,
         return NULL;
     }
 
-    CMsgClientJni* client2 = NULL;
-
-    {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_clients.find(client) != g_s_clients.end())
-        {
-            client2 = (CMsgClientJni*)client;
-            client2->AddRef();
-        }
-    }
+    CMsgClientJni* const client2 = GetClient_i(client);
 
     jstring javaLocalIp = NULL;
 
@@ -753,17 +1178,7 @@ Java_com_pro_msg_ProMsgJni_msgClientGetLocalPort(JNIEnv* env,
         return 0;
     }
 
-    CMsgClientJni* client2 = NULL;
-
-    {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_clients.find(client) != g_s_clients.end())
-        {
-            client2 = (CMsgClientJni*)client;
-            client2->AddRef();
-        }
-    }
+    CMsgClientJni* const client2 = GetClient_i(client);
 
     jint localPort = 0;
 
@@ -789,17 +1204,7 @@ Java_com_pro_msg_ProMsgJni_msgClientGetRemoteIp(JNIEnv* env,
         return NULL;
     }
 
-    CMsgClientJni* client2 = NULL;
-
-    {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_clients.find(client) != g_s_clients.end())
-        {
-            client2 = (CMsgClientJni*)client;
-            client2->AddRef();
-        }
-    }
+    CMsgClientJni* const client2 = GetClient_i(client);
 
     jstring javaRemoteIp = NULL;
 
@@ -828,17 +1233,7 @@ Java_com_pro_msg_ProMsgJni_msgClientGetRemotePort(JNIEnv* env,
         return 0;
     }
 
-    CMsgClientJni* client2 = NULL;
-
-    {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_clients.find(client) != g_s_clients.end())
-        {
-            client2 = (CMsgClientJni*)client;
-            client2->AddRef();
-        }
-    }
+    CMsgClientJni* const client2 = GetClient_i(client);
 
     jint remotePort = 0;
 
@@ -911,23 +1306,10 @@ Java_com_pro_msg_ProMsgJni_msgClientSendMsg2(JNIEnv*      env,
         }
     }
 
-    CMsgClientJni* client2 = NULL;
-
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
     {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_reactor == NULL)
-        {
-            return JNI_FALSE;
-        }
-
-        if (g_s_clients.find(client) == g_s_clients.end())
-        {
-            return JNI_FALSE;
-        }
-
-        client2 = (CMsgClientJni*)client;
-        client2->AddRef();
+        return JNI_FALSE;
     }
 
     jsize  buf1_size = env->GetArrayLength(buf1);
@@ -974,386 +1356,1769 @@ Java_com_pro_msg_ProMsgJni_msgClientSendMsg2(JNIEnv*      env,
 }
 
 JNIEXPORT
-void
+jboolean
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgClientSetOutputRedline(JNIEnv* env,
-                                                     jclass  clazz,
-                                                     jlong   client,
-                                                     jlong   redlineBytes)
+Java_com_pro_msg_ProMsgJni_msgClientSendMsgDirect(JNIEnv*      env,
+                                                  jclass       clazz,
+                                                  jlong        client,
+                                                  jobject      buf,
+                                                  jint         offset,
+                                                  jint         size,
+                                                  jint         charset,  /* 0 ~ 65535 */
+                                                  jobjectArray dstUsers) /* count <= 255 */
 {
     assert(client != 0);
-    if (client == 0 || redlineBytes <= 0)
+    if (client == 0 || buf == NULL || offset < 0 || size <= 0 || charset < 0 || charset > 65535 ||
+        dstUsers == NULL)
     {
-        return;
+        return JNI_FALSE;
+    }
+
+    /*
+     * no copy. the address of a direct buffer is stable
+     */
+    char* buf_p    = (char*)env->GetDirectBufferAddress(buf);
+    jlong buf_size = env->GetDirectBufferCapacity(buf);
+    if (buf_p == NULL || buf_size < 0 || env->ExceptionCheck() ||
+        (jlong)offset + (jlong)size > buf_size)
+    {
+        return JNI_FALSE;
     }
 
-    CMsgClientJni* client2 = NULL;
+    CProStlVector<RTP_MSG_USER> cppDstUsers;
 
     {
-        CProThreadMutexGuard mon(g_s_lock);
+        int i = 0;
+        int c = (int)env->GetArrayLength(dstUsers);
 
-        if (g_s_reactor == NULL)
+        if (c <= 0 || c > 255)
         {
-            return;
+            return JNI_FALSE;
         }
 
-        if (g_s_clients.find(client) == g_s_clients.end())
+        for (; i < c; ++i)
         {
-            return;
+            jobject javaUser = env->GetObjectArrayElement(dstUsers, i);
+            if (javaUser == NULL || env->ExceptionCheck())
+            {
+                return JNI_FALSE;
+            }
+
+            RTP_MSG_USER cppUser;
+            MSG_USER_java2cpp_i(env, javaUser, cppUser);
+
+            cppDstUsers.push_back(cppUser);
+            env->DeleteLocalRef(javaUser);
         }
+    }
 
-        client2 = (CMsgClientJni*)client;
-        client2->AddRef();
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return JNI_FALSE;
     }
 
-    client2->SetOutputRedline((size_t)redlineBytes);
+    bool ret = client2->SendMsg(
+        buf_p + offset,
+        size,
+        (uint16_t)charset,
+        &cppDstUsers[0],
+        (unsigned char)cppDstUsers.size()
+        );
     client2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
 }
 
 JNIEXPORT
-jlong
+jboolean
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgClientGetOutputRedline(JNIEnv* env,
-                                                     jclass  clazz,
-                                                     jlong   client)
+Java_com_pro_msg_ProMsgJni_msgClientSendMsgV(JNIEnv*      env,
+                                             jclass       clazz,
+                                             jlong        client,
+                                             jobjectArray bufs,
+                                             jint         charset,  /* 0 ~ 65535 */
+                                             jobjectArray dstUsers) /* count <= 255 */
 {
     assert(client != 0);
-    if (client == 0)
+    if (client == 0 || bufs == NULL || charset < 0 || charset > 65535 || dstUsers == NULL)
     {
-        return 0;
+        return JNI_FALSE;
     }
 
-    CMsgClientJni* client2 = NULL;
+    CProStlVector<RTP_MSG_USER> cppDstUsers;
 
     {
-        CProThreadMutexGuard mon(g_s_lock);
+        int i = 0;
+        int c = (int)env->GetArrayLength(dstUsers);
+
+        if (c <= 0 || c > 255)
+        {
+            return JNI_FALSE;
+        }
 
-        if (g_s_clients.find(client) != g_s_clients.end())
+        for (; i < c; ++i)
         {
-            client2 = (CMsgClientJni*)client;
-            client2->AddRef();
+            jobject javaUser = env->GetObjectArrayElement(dstUsers, i);
+            if (javaUser == NULL || env->ExceptionCheck())
+            {
+                return JNI_FALSE;
+            }
+
+            RTP_MSG_USER cppUser;
+            MSG_USER_java2cpp_i(env, javaUser, cppUser);
+
+            cppDstUsers.push_back(cppUser);
+            env->DeleteLocalRef(javaUser);
         }
     }
 
-    jlong redlineBytes = 0;
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return JNI_FALSE;
+    }
 
-    if (client2 != NULL)
+    JAVA_SEGMENTS javaSegments;
+    if (!GetJavaSegments_i(env, bufs, javaSegments))
     {
-        redlineBytes = client2->GetOutputRedline();
         client2->Release();
-    }
 
-    return redlineBytes;
-}
+        return JNI_FALSE;
+    }
 
-JNIEXPORT
-jlong
+    bool ret = client2->SendMsgV(
+        &javaSegments.segments[0],
+        javaSegments.segments.size(),
+        (uint16_t)charset,
+        &cppDstUsers[0],
+        (unsigned char)cppDstUsers.size()
+        );
+    ReleaseJavaSegments_i(env, javaSegments);
+    client2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgClientGetSendingBytes(JNIEnv* env,
-                                                    jclass  clazz,
-                                                    jlong   client)
+Java_com_pro_msg_ProMsgJni_msgClientSendBuffer(JNIEnv*      env,
+                                               jclass       clazz,
+                                               jlong        client,
+                                               jlong        buffer,
+                                               jint         charset,  /* 0 ~ 65535 */
+                                               jobjectArray dstUsers) /* count <= 255 */
 {
     assert(client != 0);
-    if (client == 0)
+    assert(buffer != 0);
+    if (client == 0 || buffer == 0 || charset < 0 || charset > 65535 || dstUsers == NULL)
     {
-        return 0;
+        return JNI_FALSE;
     }
 
-    CMsgClientJni* client2 = NULL;
+    CProStlVector<RTP_MSG_USER> cppDstUsers;
 
     {
-        CProThreadMutexGuard mon(g_s_lock);
+        int i = 0;
+        int c = (int)env->GetArrayLength(dstUsers);
+
+        if (c <= 0 || c > 255)
+        {
+            return JNI_FALSE;
+        }
 
-        if (g_s_clients.find(client) != g_s_clients.end())
+        for (; i < c; ++i)
         {
-            client2 = (CMsgClientJni*)client;
-            client2->AddRef();
+            jobject javaUser = env->GetObjectArrayElement(dstUsers, i);
+            if (javaUser == NULL || env->ExceptionCheck())
+            {
+                return JNI_FALSE;
+            }
+
+            RTP_MSG_USER cppUser;
+            MSG_USER_java2cpp_i(env, javaUser, cppUser);
+
+            cppDstUsers.push_back(cppUser);
+            env->DeleteLocalRef(javaUser);
         }
     }
 
-    jlong sendingBytes = 0;
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return JNI_FALSE;
+    }
 
-    if (client2 != NULL)
+    CMsgBuffer* const buffer2 = GetBuffer_i(buffer);
+    if (buffer2 == NULL)
     {
-        sendingBytes = client2->GetSendingBytes();
         client2->Release();
+
+        return JNI_FALSE;
     }
 
-    return sendingBytes;
+    bool ret = client2->SendBuffer(
+        buffer2,
+        (uint16_t)charset,
+        &cppDstUsers[0],
+        (unsigned char)cppDstUsers.size()
+        );
+    buffer2->Release();
+    client2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
 }
 
 JNIEXPORT
 jboolean
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgClientReconnect(JNIEnv* env,
-                                              jclass  clazz,
-                                              jlong   client)
+Java_com_pro_msg_ProMsgJni_msgClientSendMsgPacked(JNIEnv*    env,
+                                                  jclass     clazz,
+                                                  jlong      client,
+                                                  jbyteArray buf,
+                                                  jint       charset,  /* 0 ~ 65535 */
+                                                  jlongArray dstUsers) /* count <= 255 */
 {
     assert(client != 0);
-    if (client == 0)
+    if (client == 0 || buf == NULL || charset < 0 || charset > 65535 || dstUsers == NULL)
     {
         return JNI_FALSE;
     }
 
-    CMsgClientJni* client2 = NULL;
-
+    RTP_MSG_USER  cppDstUsers[255];
+    unsigned char cppDstUserCount = 0;
+    if (!GetPackedUsers_i(env, dstUsers, cppDstUsers, &cppDstUserCount))
     {
-        CProThreadMutexGuard mon(g_s_lock);
+        return JNI_FALSE;
+    }
 
-        if (g_s_reactor == NULL)
-        {
-            return JNI_FALSE;
-        }
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return JNI_FALSE;
+    }
 
-        if (g_s_clients.find(client) == g_s_clients.end())
-        {
-            return JNI_FALSE;
-        }
+    jsize  buf_size = env->GetArrayLength(buf);
+    jbyte* buf_p    = env->GetByteArrayElements(buf, NULL);
+    if (buf_size <= 0 || buf_p == NULL || env->ExceptionCheck())
+    {
+        client2->Release();
 
-        client2 = (CMsgClientJni*)client;
-        client2->AddRef();
+        return JNI_FALSE;
     }
 
-    bool ret = client2->Reconnect();
+    bool ret = client2->SendMsg(
+        buf_p,
+        buf_size,
+        (uint16_t)charset,
+        cppDstUsers,
+        cppDstUserCount
+        );
+    env->ReleaseByteArrayElements(buf, buf_p, JNI_ABORT);
     client2->Release();
 
     return ret ? JNI_TRUE : JNI_FALSE;
 }
 
-/*-------------------------------------------------------------------------*/
-
 JNIEXPORT
-jlong
+jboolean
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerCreate(JNIEnv* env,
-                                           jclass  clazz,
-                                           jobject listener,
-                                           jstring configFileName,
-                                           jshort  mmType,         /* = 0, 10 ~ 69 */
-                                           jint    serviceHubPort) /* = 0, 1 ~ 65535 */
+Java_com_pro_msg_ProMsgJni_msgClientSendMsgDirectPacked(JNIEnv*    env,
+                                                        jclass     clazz,
+                                                        jlong      client,
+                                                        jobject    buf,
+                                                        jint       offset,
+                                                        jint       size,
+                                                        jint       charset,  /* 0 ~ 65535 */
+                                                        jlongArray dstUsers) /* count <= 255 */
 {
-    assert(listener != NULL);
-    assert(configFileName != NULL);
-    if (listener == NULL || configFileName == NULL)
+    assert(client != 0);
+    if (client == 0 || buf == NULL || offset < 0 || size <= 0 || charset < 0 || charset > 65535 ||
+        dstUsers == NULL)
     {
-        return 0;
+        return JNI_FALSE;
     }
 
-    char           cppConfigFileName[1024] = "";
-    RTP_MM_TYPE    cppMmType               = 0;
-    unsigned short cppServiceHubPort       = 0;
-
-    cppConfigFileName[sizeof(cppConfigFileName) - 1] = '\0';
-
+    char* buf_p    = (char*)env->GetDirectBufferAddress(buf);
+    jlong buf_size = env->GetDirectBufferCapacity(buf);
+    if (buf_p == NULL || buf_size < 0 || env->ExceptionCheck() ||
+        (jlong)offset + (jlong)size > buf_size)
     {
-        jsize uniSize = env->GetStringLength(configFileName);
-        jsize utfSize = env->GetStringUTFLength(configFileName);
-        if (utfSize > 0 && utfSize < (jsize)sizeof(cppConfigFileName))
-        {
-            env->GetStringUTFRegion(configFileName, 0, uniSize, cppConfigFileName);
-        }
-
-        if (env->ExceptionCheck())
-        {
-            return 0;
-        }
+        return JNI_FALSE;
     }
 
-    if (mmType >= (jshort)RTP_MMT_MSG_MIN && mmType <= (jshort)RTP_MMT_MSG_MAX)
+    RTP_MSG_USER  cppDstUsers[255];
+    unsigned char cppDstUserCount = 0;
+    if (!GetPackedUsers_i(env, dstUsers, cppDstUsers, &cppDstUserCount))
     {
-        cppMmType = (RTP_MM_TYPE)mmType;
+        return JNI_FALSE;
     }
 
-    if (serviceHubPort > 0 && serviceHubPort <= 65535)
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
     {
-        cppServiceHubPort = (unsigned short)serviceHubPort;
+        return JNI_FALSE;
     }
 
-    CMsgServerJni* server = NULL;
+    bool ret = client2->SendMsg(
+        buf_p + offset,
+        size,
+        (uint16_t)charset,
+        cppDstUsers,
+        cppDstUserCount
+        );
+    client2->Release();
 
-    {
-        CProThreadMutexGuard mon(g_s_lock);
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
 
-        assert(g_s_reactor != NULL);
-        if (g_s_reactor == NULL)
-        {
-            return 0;
-        }
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgClientSendBufferPacked(JNIEnv*    env,
+                                                     jclass     clazz,
+                                                     jlong      client,
+                                                     jlong      buffer,
+                                                     jint       charset,  /* 0 ~ 65535 */
+                                                     jlongArray dstUsers) /* count <= 255 */
+{
+    assert(client != 0);
+    assert(buffer != 0);
+    if (client == 0 || buffer == 0 || charset < 0 || charset > 65535 || dstUsers == NULL)
+    {
+        return JNI_FALSE;
+    }
 
-        server = CMsgServerJni::CreateInstance(env, listener);
-        if (server == NULL)
-        {
-            return 0;
-        }
+    RTP_MSG_USER  cppDstUsers[255];
+    unsigned char cppDstUserCount = 0;
+    if (!GetPackedUsers_i(env, dstUsers, cppDstUsers, &cppDstUserCount))
+    {
+        return JNI_FALSE;
+    }
 
-        if (!server->Init(g_s_reactor, NULL, cppConfigFileName, cppMmType, cppServiceHubPort))
-        {
-            server->Release();
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return JNI_FALSE;
+    }
 
-            return 0;
-        }
+    CMsgBuffer* const buffer2 = GetBuffer_i(buffer);
+    if (buffer2 == NULL)
+    {
+        client2->Release();
 
-        g_s_servers.insert((jlong)server);
+        return JNI_FALSE;
     }
 
-    return (jlong)server;
+    bool ret = client2->SendBuffer(
+        buffer2,
+        (uint16_t)charset,
+        cppDstUsers,
+        cppDstUserCount
+        );
+    buffer2->Release();
+    client2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
 }
 
 JNIEXPORT
 void
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerDelete(JNIEnv* env,
-                                           jclass  clazz,
-                                           jlong   server)
+Java_com_pro_msg_ProMsgJni_msgClientSetOutputRedline(JNIEnv* env,
+                                                     jclass  clazz,
+                                                     jlong   client,
+                                                     jlong   redlineBytes)
 {
-    if (server == 0)
+    assert(client != 0);
+    if (client == 0 || redlineBytes <= 0)
     {
         return;
     }
 
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
     {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_reactor == NULL)
-        {
-            return;
-        }
-
-        if (g_s_servers.find(server) == g_s_servers.end())
-        {
-            return;
-        }
-
-        g_s_servers.erase(server);
+        return;
     }
 
-    CMsgServerJni* p = (CMsgServerJni*)server;
-    p->Fini();
-    p->Release();
+    client2->SetOutputRedline((size_t)redlineBytes);
+    client2->Release();
 }
 
 JNIEXPORT
-jshort
+jlong
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerGetMmType(JNIEnv* evn,
-                                              jclass  clazz,
-                                              jlong   server)
+Java_com_pro_msg_ProMsgJni_msgClientGetOutputRedline(JNIEnv* env,
+                                                     jclass  clazz,
+                                                     jlong   client)
 {
-    assert(server != 0);
-    if (server == 0)
+    assert(client != 0);
+    if (client == 0)
     {
         return 0;
     }
 
-    CMsgServerJni* server2 = NULL;
-
-    {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_servers.find(server) != g_s_servers.end())
-        {
-            server2 = (CMsgServerJni*)server;
-            server2->AddRef();
-        }
-    }
+    CMsgClientJni* const client2 = GetClient_i(client);
 
-    jshort mmType = 0;
+    jlong redlineBytes = 0;
 
-    if (server2 != NULL)
+    if (client2 != NULL)
     {
-        mmType = server2->GetMmType();
-        server2->Release();
+        redlineBytes = client2->GetOutputRedline();
+        client2->Release();
     }
 
-    return mmType;
+    return redlineBytes;
 }
 
 JNIEXPORT
-jint
+jlong
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerGetServicePort(JNIEnv* env,
-                                                   jclass  clazz,
-                                                   jlong   server)
+Java_com_pro_msg_ProMsgJni_msgClientGetSendingBytes(JNIEnv* env,
+                                                    jclass  clazz,
+                                                    jlong   client)
 {
-    assert(server != 0);
-    if (server == 0)
+    assert(client != 0);
+    if (client == 0)
     {
         return 0;
     }
 
-    CMsgServerJni* server2 = NULL;
+    CMsgClientJni* const client2 = GetClient_i(client);
 
-    {
-        CProThreadMutexGuard mon(g_s_lock);
+    jlong sendingBytes = 0;
 
-        if (g_s_servers.find(server) != g_s_servers.end())
-        {
-            server2 = (CMsgServerJni*)server;
-            server2->AddRef();
-        }
+    if (client2 != NULL)
+    {
+        sendingBytes = client2->GetSendingBytes();
+        client2->Release();
     }
 
-    jint servicePort = 0;
+    return sendingBytes;
+}
 
-    if (server2 != NULL)
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgClientSetOutputWatermarks(JNIEnv* env,
+                                                        jclass  clazz,
+                                                        jlong   client,
+                                                        jlong   highBytes,
+                                                        jlong   lowBytes)
+{
+    assert(client != 0);
+    if (client == 0 || highBytes < 0 || lowBytes < 0)
     {
-        servicePort = server2->GetServicePort();
-        server2->Release();
+        return;
     }
 
-    return servicePort;
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return;
+    }
+
+    client2->SetOutputWatermarks((size_t)highBytes, (size_t)lowBytes);
+    client2->Release();
 }
 
 JNIEXPORT
-jstring
+jboolean
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerGetSslSuite(JNIEnv* env,
-                                                jclass  clazz,
+Java_com_pro_msg_ProMsgJni_msgClientAddRecvBuffer(JNIEnv* env,
+                                                  jclass  clazz,
+                                                  jlong   client,
+                                                  jobject buffer)
+{
+    assert(client != 0);
+    assert(buffer != NULL);
+    if (client == 0 || buffer == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    bool ret = client2->AddRecvBuffer(env, buffer);
+    client2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgClientSetRecvBatch(JNIEnv* env,
+                                                 jclass  clazz,
+                                                 jlong   client,
+                                                 jint    maxBytes,
+                                                 jint    maxDelayInMs)
+{
+    assert(client != 0);
+    if (client == 0)
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    size_t        maxBytes2     = maxBytes     > 0 ? (size_t)maxBytes            : 0;
+    unsigned long maxDelayInMs2 = maxDelayInMs > 0 ? (unsigned long)maxDelayInMs : 0;
+
+    bool ret = client2->SetRecvBatch(maxBytes2, maxDelayInMs2);
+    client2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgClientSetCoalescing(JNIEnv* env,
+                                                  jclass  clazz,
+                                                  jlong   client,
+                                                  jint    maxBytes,
+                                                  jint    maxMsgs,
+                                                  jint    maxDelayInUs)
+{
+    assert(client != 0);
+    if (client == 0 || maxBytes < 0 || maxMsgs < 0 || maxDelayInUs < 0)
+    {
+        return;
+    }
+
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return;
+    }
+
+    client2->SetCoalescing((size_t)maxBytes, (size_t)maxMsgs, (unsigned int)maxDelayInUs);
+    client2->Release();
+}
+
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgClientSetReconnectInterval(JNIEnv* env,
+                                                         jclass  clazz,
+                                                         jlong   client,
+                                                         jint    intervalInSeconds,
+                                                         jint    maxIntervalInSeconds)
+{
+    assert(client != 0);
+    if (client == 0 || intervalInSeconds <= 0 || maxIntervalInSeconds < 0)
+    {
+        return;
+    }
+
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return;
+    }
+
+    client2->SetReconnectInterval(
+        (unsigned int)intervalInSeconds, (unsigned int)maxIntervalInSeconds);
+    client2->Release();
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgClientReconnect(JNIEnv* env,
+                                              jclass  clazz,
+                                              jlong   client)
+{
+    assert(client != 0);
+    if (client == 0)
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    bool ret = client2->Reconnect();
+    client2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgClientJoinGroup(JNIEnv* env,
+                                              jclass  clazz,
+                                              jlong   client,
+                                              jlong   groupId)
+{
+    assert(client != 0);
+    if (client == 0)
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    bool ret = client2->JoinGroup((uint64_t)groupId);
+    client2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgClientLeaveGroup(JNIEnv* env,
+                                               jclass  clazz,
+                                               jlong   client,
+                                               jlong   groupId)
+{
+    assert(client != 0);
+    if (client == 0)
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgClientJni* const client2 = GetClient_i(client);
+    if (client2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    bool ret = client2->LeaveGroup((uint64_t)groupId);
+    client2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+/*-------------------------------------------------------------------------*/
+
+JNIEXPORT
+jlong
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerCreate(JNIEnv* env,
+                                           jclass  clazz,
+                                           jobject listener,
+                                           jstring configFileName,
+                                           jshort  mmType,         /* = 0, 10 ~ 69 */
+                                           jint    serviceHubPort) /* = 0, 1 ~ 65535 */
+{
+    jlong ret = Java_com_pro_msg_ProMsgJni_msgServerCreateOnReactor(
+        env, clazz, 0, listener, configFileName, mmType, serviceHubPort);
+
+    return ret;
+}
+
+JNIEXPORT
+jlong
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerCreateOnReactor(JNIEnv* env,
+                                                    jclass  clazz,
+                                                    jlong   reactor,        /* 0 for the default */
+                                                    jobject listener,
+                                                    jstring configFileName,
+                                                    jshort  mmType,         /* = 0, 10 ~ 69 */
+                                                    jint    serviceHubPort) /* = 0, 1 ~ 65535 */
+{
+    assert(listener != NULL);
+    assert(configFileName != NULL);
+    if (listener == NULL || configFileName == NULL)
+    {
+        return 0;
+    }
+
+    char           cppConfigFileName[1024] = "";
+    RTP_MM_TYPE    cppMmType               = 0;
+    unsigned short cppServiceHubPort       = 0;
+
+    cppConfigFileName[sizeof(cppConfigFileName) - 1] = '\0';
+
+    {
+        jsize uniSize = env->GetStringLength(configFileName);
+        jsize utfSize = env->GetStringUTFLength(configFileName);
+        if (utfSize > 0 && utfSize < (jsize)sizeof(cppConfigFileName))
+        {
+            env->GetStringUTFRegion(configFileName, 0, uniSize, cppConfigFileName);
+        }
+
+        if (env->ExceptionCheck())
+        {
+            return 0;
+        }
+    }
+
+    if (mmType >= (jshort)RTP_MMT_MSG_MIN && mmType <= (jshort)RTP_MMT_MSG_MAX)
+    {
+        cppMmType = (RTP_MM_TYPE)mmType;
+    }
+
+    if (serviceHubPort > 0 && serviceHubPort <= 65535)
+    {
+        cppServiceHubPort = (unsigned short)serviceHubPort;
+    }
+
+    jlong handle = 0;
+
+    {
+        CProThreadMutexGuard mon(g_s_lock);
+
+        assert(g_s_reactor != NULL);
+        if (g_s_reactor == NULL)
+        {
+            return 0;
+        }
+
+        CJniReactor* const jniReactor = TakeJniReactor_i(reactor);
+        if (jniReactor == NULL)
+        {
+            return 0;
+        }
+
+        CMsgServerJni* const server = CMsgServerJni::CreateInstance(env, listener);
+        if (server == NULL)
+        {
+            PutJniReactor_i(jniReactor);
+
+            return 0;
+        }
+
+        handle = g_s_servers.Add(server);
+        if (handle == 0)
+        {
+            server->Release();
+            PutJniReactor_i(jniReactor);
+
+            return 0;
+        }
+
+        server->SetHandle(handle);
+        server->SetJniReactor(jniReactor);
+
+        if (!server->Init(jniReactor->GetReactor(), NULL, cppConfigFileName, cppMmType,
+            cppServiceHubPort))
+        {
+            g_s_servers.Remove(handle);
+            server->Release();
+            PutJniReactor_i(jniReactor);
+
+            return 0;
+        }
+    }
+
+    return handle;
+}
+
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerDelete(JNIEnv* env,
+                                           jclass  clazz,
+                                           jlong   server)
+{
+    if (server == 0)
+    {
+        return;
+    }
+
+    CMsgServerJni* const p = (CMsgServerJni*)g_s_servers.Remove(server);
+    if (p != NULL)
+    {
+        DeleteServer_i(p);
+    }
+}
+
+JNIEXPORT
+jshort
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerGetMmType(JNIEnv* evn,
+                                              jclass  clazz,
+                                              jlong   server)
+{
+    assert(server != 0);
+    if (server == 0)
+    {
+        return 0;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+
+    jshort mmType = 0;
+
+    if (server2 != NULL)
+    {
+        mmType = server2->GetMmType();
+        server2->Release();
+    }
+
+    return mmType;
+}
+
+JNIEXPORT
+jint
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerGetServicePort(JNIEnv* env,
+                                                   jclass  clazz,
+                                                   jlong   server)
+{
+    assert(server != 0);
+    if (server == 0)
+    {
+        return 0;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+
+    jint servicePort = 0;
+
+    if (server2 != NULL)
+    {
+        servicePort = server2->GetServicePort();
+        server2->Release();
+    }
+
+    return servicePort;
+}
+
+JNIEXPORT
+jstring
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerGetSslSuite(JNIEnv* env,
+                                                jclass  clazz,
+                                                jlong   server,
+                                                jobject user)
+{
+    assert(server != 0);
+    assert(user != NULL);
+    if (server == 0 || user == NULL)
+    {
+        return NULL;
+    }
+
+    RTP_MSG_USER cppUser;
+    MSG_USER_java2cpp_i(env, user, cppUser);
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+
+    jstring javaSuiteName = NULL;
+
+    if (server2 != NULL)
+    {
+        char cppSuiteName[64] = "";
+        server2->GetSslSuite(cppUser, cppSuiteName);
+
+        javaSuiteName = NewJavaString_i(env, cppSuiteName);
+        server2->Release();
+    }
+
+    return javaSuiteName;
+}
+
+JNIEXPORT
+jlong
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerGetUserCount(JNIEnv* env,
+                                                 jclass  clazz,
+                                                 jlong   server)
+{
+    assert(server != 0);
+    if (server == 0)
+    {
+        return 0;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+
+    jlong userCount = 0;
+
+    if (server2 != NULL)
+    {
+        userCount = server2->GetUserCount();
+        server2->Release();
+    }
+
+    return userCount;
+}
+
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerKickoutUser(JNIEnv* env,
+                                                jclass  clazz,
+                                                jlong   server,
+                                                jobject user)
+{
+    assert(server != 0);
+    if (server == 0 || user == NULL)
+    {
+        return;
+    }
+
+    RTP_MSG_USER cppUser;
+    MSG_USER_java2cpp_i(env, user, cppUser);
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return;
+    }
+
+    server2->KickoutUser(cppUser);
+    server2->Release();
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSendMsg(JNIEnv*      env,
+                                            jclass       clazz,
+                                            jlong        server,
+                                            jbyteArray   buf,
+                                            jint         charset,  /* 0 ~ 65535 */
+                                            jobjectArray dstUsers) /* count <= 255 */
+{
+    jboolean ret = Java_com_pro_msg_ProMsgJni_msgServerSendMsg2(
+        env, clazz, server, buf, NULL, charset, dstUsers);
+
+    return ret;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSendMsg2(JNIEnv*      env,
+                                             jclass       clazz,
+                                             jlong        server,
+                                             jbyteArray   buf1,
+                                             jbyteArray   buf2,     /* = null */
+                                             jint         charset,  /* 0 ~ 65535 */
+                                             jobjectArray dstUsers) /* count <= 255 */
+{
+    assert(server != 0);
+    if (server == 0 || buf1 == NULL || charset < 0 || charset > 65535 || dstUsers == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    CProStlVector<RTP_MSG_USER> cppDstUsers;
+
+    {
+        int i = 0;
+        int c = (int)env->GetArrayLength(dstUsers);
+
+        if (c <= 0 || c > 255)
+        {
+            return JNI_FALSE;
+        }
+
+        for (; i < c; ++i)
+        {
+            jobject javaUser = env->GetObjectArrayElement(dstUsers, i);
+            if (javaUser == NULL || env->ExceptionCheck())
+            {
+                return JNI_FALSE;
+            }
+
+            RTP_MSG_USER cppUser;
+            MSG_USER_java2cpp_i(env, javaUser, cppUser);
+
+            cppDstUsers.push_back(cppUser);
+            env->DeleteLocalRef(javaUser);
+        }
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    jsize  buf1_size = env->GetArrayLength(buf1);
+    jbyte* buf1_p    = env->GetByteArrayElements(buf1, NULL);
+    if (buf1_size <= 0 || buf1_p == NULL || env->ExceptionCheck())
+    {
+        server2->Release();
+
+        return JNI_FALSE;
+    }
+
+    jsize  buf2_size = 0;
+    jbyte* buf2_p    = NULL;
+    if (buf2 != NULL)
+    {
+        buf2_size = env->GetArrayLength(buf2);
+        buf2_p    = env->GetByteArrayElements(buf2, NULL);
+        if (buf2_size <= 0 || buf2_p == NULL || env->ExceptionCheck())
+        {
+            env->ReleaseByteArrayElements(buf1, buf1_p, JNI_ABORT);
+            server2->Release();
+
+            return JNI_FALSE;
+        }
+    }
+
+    bool ret = server2->SendMsg2(
+        buf1_p,
+        buf1_size,
+        buf2_p,
+        buf2_size,
+        (uint16_t)charset,
+        &cppDstUsers[0],
+        (unsigned char)cppDstUsers.size()
+        );
+    env->ReleaseByteArrayElements(buf1, buf1_p, JNI_ABORT);
+    if (buf2 != NULL)
+    {
+        env->ReleaseByteArrayElements(buf2, buf2_p, JNI_ABORT);
+    }
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSendMsgDirect(JNIEnv*      env,
+                                                  jclass       clazz,
+                                                  jlong        server,
+                                                  jobject      buf,
+                                                  jint         offset,
+                                                  jint         size,
+                                                  jint         charset,  /* 0 ~ 65535 */
+                                                  jobjectArray dstUsers) /* count <= 255 */
+{
+    assert(server != 0);
+    if (server == 0 || buf == NULL || offset < 0 || size <= 0 || charset < 0 || charset > 65535 ||
+        dstUsers == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    /*
+     * no copy. the address of a direct buffer is stable
+     */
+    char* buf_p    = (char*)env->GetDirectBufferAddress(buf);
+    jlong buf_size = env->GetDirectBufferCapacity(buf);
+    if (buf_p == NULL || buf_size < 0 || env->ExceptionCheck() ||
+        (jlong)offset + (jlong)size > buf_size)
+    {
+        return JNI_FALSE;
+    }
+
+    CProStlVector<RTP_MSG_USER> cppDstUsers;
+
+    {
+        int i = 0;
+        int c = (int)env->GetArrayLength(dstUsers);
+
+        if (c <= 0 || c > 255)
+        {
+            return JNI_FALSE;
+        }
+
+        for (; i < c; ++i)
+        {
+            jobject javaUser = env->GetObjectArrayElement(dstUsers, i);
+            if (javaUser == NULL || env->ExceptionCheck())
+            {
+                return JNI_FALSE;
+            }
+
+            RTP_MSG_USER cppUser;
+            MSG_USER_java2cpp_i(env, javaUser, cppUser);
+
+            cppDstUsers.push_back(cppUser);
+            env->DeleteLocalRef(javaUser);
+        }
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    bool ret = server2->SendMsg(
+        buf_p + offset,
+        size,
+        (uint16_t)charset,
+        &cppDstUsers[0],
+        (unsigned char)cppDstUsers.size()
+        );
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSendMsgV(JNIEnv*      env,
+                                             jclass       clazz,
+                                             jlong        server,
+                                             jobjectArray bufs,
+                                             jint         charset,  /* 0 ~ 65535 */
+                                             jobjectArray dstUsers) /* count <= 255 */
+{
+    assert(server != 0);
+    if (server == 0 || bufs == NULL || charset < 0 || charset > 65535 || dstUsers == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    CProStlVector<RTP_MSG_USER> cppDstUsers;
+
+    {
+        int i = 0;
+        int c = (int)env->GetArrayLength(dstUsers);
+
+        if (c <= 0 || c > 255)
+        {
+            return JNI_FALSE;
+        }
+
+        for (; i < c; ++i)
+        {
+            jobject javaUser = env->GetObjectArrayElement(dstUsers, i);
+            if (javaUser == NULL || env->ExceptionCheck())
+            {
+                return JNI_FALSE;
+            }
+
+            RTP_MSG_USER cppUser;
+            MSG_USER_java2cpp_i(env, javaUser, cppUser);
+
+            cppDstUsers.push_back(cppUser);
+            env->DeleteLocalRef(javaUser);
+        }
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    JAVA_SEGMENTS javaSegments;
+    if (!GetJavaSegments_i(env, bufs, javaSegments))
+    {
+        server2->Release();
+
+        return JNI_FALSE;
+    }
+
+    bool ret = server2->SendMsgV(
+        &javaSegments.segments[0],
+        javaSegments.segments.size(),
+        (uint16_t)charset,
+        &cppDstUsers[0],
+        (unsigned char)cppDstUsers.size()
+        );
+    ReleaseJavaSegments_i(env, javaSegments);
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSendBuffer(JNIEnv*      env,
+                                               jclass       clazz,
+                                               jlong        server,
+                                               jlong        buffer,
+                                               jint         charset,  /* 0 ~ 65535 */
+                                               jobjectArray dstUsers) /* count <= 255 */
+{
+    assert(server != 0);
+    assert(buffer != 0);
+    if (server == 0 || buffer == 0 || charset < 0 || charset > 65535 || dstUsers == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    CProStlVector<RTP_MSG_USER> cppDstUsers;
+
+    {
+        int i = 0;
+        int c = (int)env->GetArrayLength(dstUsers);
+
+        if (c <= 0 || c > 255)
+        {
+            return JNI_FALSE;
+        }
+
+        for (; i < c; ++i)
+        {
+            jobject javaUser = env->GetObjectArrayElement(dstUsers, i);
+            if (javaUser == NULL || env->ExceptionCheck())
+            {
+                return JNI_FALSE;
+            }
+
+            RTP_MSG_USER cppUser;
+            MSG_USER_java2cpp_i(env, javaUser, cppUser);
+
+            cppDstUsers.push_back(cppUser);
+            env->DeleteLocalRef(javaUser);
+        }
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgBuffer* const buffer2 = GetBuffer_i(buffer);
+    if (buffer2 == NULL)
+    {
+        server2->Release();
+
+        return JNI_FALSE;
+    }
+
+    bool ret = server2->SendBuffer(
+        buffer2,
+        (uint16_t)charset,
+        &cppDstUsers[0],
+        (unsigned char)cppDstUsers.size()
+        );
+    buffer2->Release();
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSendMsgPacked(JNIEnv*    env,
+                                                  jclass     clazz,
+                                                  jlong      server,
+                                                  jbyteArray buf,
+                                                  jint       charset,  /* 0 ~ 65535 */
+                                                  jlongArray dstUsers) /* count <= 255 */
+{
+    assert(server != 0);
+    if (server == 0 || buf == NULL || charset < 0 || charset > 65535 || dstUsers == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    RTP_MSG_USER  cppDstUsers[255];
+    unsigned char cppDstUserCount = 0;
+    if (!GetPackedUsers_i(env, dstUsers, cppDstUsers, &cppDstUserCount))
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    jsize  buf_size = env->GetArrayLength(buf);
+    jbyte* buf_p    = env->GetByteArrayElements(buf, NULL);
+    if (buf_size <= 0 || buf_p == NULL || env->ExceptionCheck())
+    {
+        server2->Release();
+
+        return JNI_FALSE;
+    }
+
+    bool ret = server2->SendMsg(
+        buf_p,
+        buf_size,
+        (uint16_t)charset,
+        cppDstUsers,
+        cppDstUserCount
+        );
+    env->ReleaseByteArrayElements(buf, buf_p, JNI_ABORT);
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSendMsgDirectPacked(JNIEnv*    env,
+                                                        jclass     clazz,
+                                                        jlong      server,
+                                                        jobject    buf,
+                                                        jint       offset,
+                                                        jint       size,
+                                                        jint       charset,  /* 0 ~ 65535 */
+                                                        jlongArray dstUsers) /* count <= 255 */
+{
+    assert(server != 0);
+    if (server == 0 || buf == NULL || offset < 0 || size <= 0 || charset < 0 || charset > 65535 ||
+        dstUsers == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    char* buf_p    = (char*)env->GetDirectBufferAddress(buf);
+    jlong buf_size = env->GetDirectBufferCapacity(buf);
+    if (buf_p == NULL || buf_size < 0 || env->ExceptionCheck() ||
+        (jlong)offset + (jlong)size > buf_size)
+    {
+        return JNI_FALSE;
+    }
+
+    RTP_MSG_USER  cppDstUsers[255];
+    unsigned char cppDstUserCount = 0;
+    if (!GetPackedUsers_i(env, dstUsers, cppDstUsers, &cppDstUserCount))
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    bool ret = server2->SendMsg(
+        buf_p + offset,
+        size,
+        (uint16_t)charset,
+        cppDstUsers,
+        cppDstUserCount
+        );
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSendBufferPacked(JNIEnv*    env,
+                                                     jclass     clazz,
+                                                     jlong      server,
+                                                     jlong      buffer,
+                                                     jint       charset,  /* 0 ~ 65535 */
+                                                     jlongArray dstUsers) /* count <= 255 */
+{
+    assert(server != 0);
+    assert(buffer != 0);
+    if (server == 0 || buffer == 0 || charset < 0 || charset > 65535 || dstUsers == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    RTP_MSG_USER  cppDstUsers[255];
+    unsigned char cppDstUserCount = 0;
+    if (!GetPackedUsers_i(env, dstUsers, cppDstUsers, &cppDstUserCount))
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgBuffer* const buffer2 = GetBuffer_i(buffer);
+    if (buffer2 == NULL)
+    {
+        server2->Release();
+
+        return JNI_FALSE;
+    }
+
+    bool ret = server2->SendBuffer(
+        buffer2,
+        (uint16_t)charset,
+        cppDstUsers,
+        cppDstUserCount
+        );
+    buffer2->Release();
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSetOutputRedline(JNIEnv* env,
+                                                     jclass  clazz,
+                                                     jlong   server,
+                                                     jlong   redlineBytes)
+{
+    assert(server != 0);
+    if (server == 0 || redlineBytes <= 0)
+    {
+        return;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return;
+    }
+
+    server2->SetOutputRedline((size_t)redlineBytes);
+    server2->Release();
+}
+
+JNIEXPORT
+jlong
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerGetOutputRedline(JNIEnv* env,
+                                                     jclass  clazz,
+                                                     jlong   server)
+{
+    assert(server != 0);
+    if (server == 0)
+    {
+        return 0;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+
+    jlong redlineBytes = 0;
+
+    if (server2 != NULL)
+    {
+        redlineBytes = server2->GetOutputRedline();
+        server2->Release();
+    }
+
+    return redlineBytes;
+}
+
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSetClassOutputRedline(JNIEnv* env,
+                                                          jclass  clazz,
+                                                          jlong   server,
+                                                          jshort  classId,
+                                                          jlong   redlineBytes)
+{
+    assert(server != 0);
+    if (server == 0 || classId <= 0 || classId > 255 || redlineBytes < 0)
+    {
+        return;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return;
+    }
+
+    server2->SetClassOutputRedline((unsigned char)classId, (size_t)redlineBytes);
+    server2->Release();
+}
+
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSetUserOutputRedline(JNIEnv* env,
+                                                         jclass  clazz,
+                                                         jlong   server,
+                                                         jobject user,
+                                                         jlong   redlineBytes)
+{
+    assert(server != 0);
+    if (server == 0 || user == NULL || redlineBytes < 0)
+    {
+        return;
+    }
+
+    RTP_MSG_USER cppUser;
+    MSG_USER_java2cpp_i(env, user, cppUser);
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return;
+    }
+
+    server2->SetUserOutputRedline(cppUser, (size_t)redlineBytes);
+    server2->Release();
+}
+
+JNIEXPORT
+jlong
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerGetSendingBytes(JNIEnv* env,
+                                                    jclass  clazz,
+                                                    jlong   server,
+                                                    jobject user)
+{
+    assert(server != 0);
+    if (server == 0 || user == NULL)
+    {
+        return 0;
+    }
+
+    RTP_MSG_USER cppUser;
+    MSG_USER_java2cpp_i(env, user, cppUser);
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+
+    jlong sendingBytes = 0;
+
+    if (server2 != NULL)
+    {
+        sendingBytes = server2->GetSendingBytes(cppUser);
+        server2->Release();
+    }
+
+    return sendingBytes;
+}
+
+JNIEXPORT
+jlong
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerGetClassSendingBytes(JNIEnv* env,
+                                                         jclass  clazz,
+                                                         jlong   server,
+                                                         jshort  classId)
+{
+    assert(server != 0);
+    if (server == 0 || classId <= 0 || classId > 255)
+    {
+        return 0;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+
+    jlong sendingBytes = 0;
+
+    if (server2 != NULL)
+    {
+        sendingBytes = server2->GetClassSendingBytes((unsigned char)classId);
+        server2->Release();
+    }
+
+    return sendingBytes;
+}
+
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSetOutputWatermarks(JNIEnv* env,
+                                                        jclass  clazz,
+                                                        jlong   server,
+                                                        jlong   highBytes,
+                                                        jlong   lowBytes)
+{
+    assert(server != 0);
+    if (server == 0 || highBytes < 0 || lowBytes < 0)
+    {
+        return;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return;
+    }
+
+    server2->SetOutputWatermarks((size_t)highBytes, (size_t)lowBytes);
+    server2->Release();
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerAddRecvBuffer(JNIEnv* env,
+                                                  jclass  clazz,
+                                                  jlong   server,
+                                                  jobject buffer)
+{
+    assert(server != 0);
+    assert(buffer != NULL);
+    if (server == 0 || buffer == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    bool ret = server2->AddRecvBuffer(env, buffer);
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerSetRecvBatch(JNIEnv* env,
+                                                 jclass  clazz,
+                                                 jlong   server,
+                                                 jint    maxBytes,
+                                                 jint    maxDelayInMs)
+{
+    assert(server != 0);
+    if (server == 0)
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    size_t        maxBytes2     = maxBytes     > 0 ? (size_t)maxBytes            : 0;
+    unsigned long maxDelayInMs2 = maxDelayInMs > 0 ? (unsigned long)maxDelayInMs : 0;
+
+    bool ret = server2->SetRecvBatch(maxBytes2, maxDelayInMs2);
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerCreateGroup(JNIEnv* env,
+                                                jclass  clazz,
                                                 jlong   server,
-                                                jobject user)
+                                                jlong   groupId)
+{
+    assert(server != 0);
+    if (server == 0 || groupId == 0)
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    bool ret = server2->CreateGroup((uint64_t)groupId);
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerDeleteGroup(JNIEnv* env,
+                                                jclass  clazz,
+                                                jlong   server,
+                                                jlong   groupId)
+{
+    assert(server != 0);
+    if (server == 0)
+    {
+        return;
+    }
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return;
+    }
+
+    server2->DeleteGroup((uint64_t)groupId);
+    server2->Release();
+}
+
+JNIEXPORT
+jboolean
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerJoinGroup(JNIEnv* env,
+                                              jclass  clazz,
+                                              jlong   server,
+                                              jlong   groupId,
+                                              jobject user)
+{
+    assert(server != 0);
+    if (server == 0 || user == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    RTP_MSG_USER cppUser;
+    MSG_USER_java2cpp_i(env, user, cppUser);
+
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    bool ret = server2->JoinGroup((uint64_t)groupId, cppUser);
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT
+void
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerLeaveGroup(JNIEnv* env,
+                                               jclass  clazz,
+                                               jlong   server,
+                                               jlong   groupId,
+                                               jobject user)
 {
     assert(server != 0);
-    assert(user != NULL);
     if (server == 0 || user == NULL)
     {
-        return NULL;
+        return;
     }
 
     RTP_MSG_USER cppUser;
     MSG_USER_java2cpp_i(env, user, cppUser);
 
-    CMsgServerJni* server2 = NULL;
-
-    {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_servers.find(server) != g_s_servers.end())
-        {
-            server2 = (CMsgServerJni*)server;
-            server2->AddRef();
-        }
-    }
-
-    jstring javaSuiteName = NULL;
-
-    if (server2 != NULL)
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
     {
-        char cppSuiteName[64] = "";
-        server2->GetSslSuite(cppUser, cppSuiteName);
-
-        javaSuiteName = NewJavaString_i(env, cppSuiteName);
-        server2->Release();
+        return;
     }
 
-    return javaSuiteName;
+    server2->LeaveGroup((uint64_t)groupId, cppUser);
+    server2->Release();
 }
 
 JNIEXPORT
 jlong
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerGetUserCount(JNIEnv* env,
-                                                 jclass  clazz,
-                                                 jlong   server)
+Java_com_pro_msg_ProMsgJni_msgServerGetGroupMemberCount(JNIEnv* env,
+                                                        jclass  clazz,
+                                                        jlong   server,
+                                                        jlong   groupId)
 {
     assert(server != 0);
     if (server == 0)
@@ -1361,302 +3126,278 @@ Java_com_pro_msg_ProMsgJni_msgServerGetUserCount(JNIEnv* env,
         return 0;
     }
 
-    CMsgServerJni* server2 = NULL;
-
-    {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_servers.find(server) != g_s_servers.end())
-        {
-            server2 = (CMsgServerJni*)server;
-            server2->AddRef();
-        }
-    }
+    CMsgServerJni* const server2 = GetServer_i(server);
 
-    jlong userCount = 0;
+    jlong memberCount = 0;
 
     if (server2 != NULL)
     {
-        userCount = server2->GetUserCount();
+        memberCount = server2->GetGroupMemberCount((uint64_t)groupId);
         server2->Release();
     }
 
-    return userCount;
+    return memberCount;
 }
 
 JNIEXPORT
-void
+jboolean
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerKickoutUser(JNIEnv* env,
-                                                jclass  clazz,
-                                                jlong   server,
-                                                jobject user)
+Java_com_pro_msg_ProMsgJni_msgServerPublishMsg(JNIEnv*    env,
+                                               jclass     clazz,
+                                               jlong      server,
+                                               jlong      groupId,
+                                               jbyteArray buf,
+                                               jint       charset) /* 0 ~ 65535 */
 {
     assert(server != 0);
-    if (server == 0 || user == NULL)
+    if (server == 0 || buf == NULL || charset < 0 || charset > 65535)
     {
-        return;
+        return JNI_FALSE;
     }
 
-    RTP_MSG_USER cppUser;
-    MSG_USER_java2cpp_i(env, user, cppUser);
-
-    CMsgServerJni* server2 = NULL;
-
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
     {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_reactor == NULL)
-        {
-            return;
-        }
+        return JNI_FALSE;
+    }
 
-        if (g_s_servers.find(server) == g_s_servers.end())
-        {
-            return;
-        }
+    jsize  buf_size = env->GetArrayLength(buf);
+    jbyte* buf_p    = env->GetByteArrayElements(buf, NULL);
+    if (buf_size <= 0 || buf_p == NULL || env->ExceptionCheck())
+    {
+        server2->Release();
 
-        server2 = (CMsgServerJni*)server;
-        server2->AddRef();
+        return JNI_FALSE;
     }
 
-    server2->KickoutUser(cppUser);
+    bool ret = server2->PublishMsg((uint64_t)groupId, buf_p, buf_size, (uint16_t)charset);
+    env->ReleaseByteArrayElements(buf, buf_p, JNI_ABORT);
     server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
 }
 
 JNIEXPORT
 jboolean
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerSendMsg(JNIEnv*      env,
-                                            jclass       clazz,
-                                            jlong        server,
-                                            jbyteArray   buf,
-                                            jint         charset,  /* 0 ~ 65535 */
-                                            jobjectArray dstUsers) /* count <= 255 */
+Java_com_pro_msg_ProMsgJni_msgServerPublishBuffer(JNIEnv* env,
+                                                  jclass  clazz,
+                                                  jlong   server,
+                                                  jlong   groupId,
+                                                  jlong   buffer,
+                                                  jint    charset) /* 0 ~ 65535 */
 {
-    jboolean ret = Java_com_pro_msg_ProMsgJni_msgServerSendMsg2(
-        env, clazz, server, buf, NULL, charset, dstUsers);
+    assert(server != 0);
+    assert(buffer != 0);
+    if (server == 0 || buffer == 0 || charset < 0 || charset > 65535)
+    {
+        return JNI_FALSE;
+    }
 
-    return ret;
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return JNI_FALSE;
+    }
+
+    CMsgBuffer* const buffer2 = GetBuffer_i(buffer);
+    if (buffer2 == NULL)
+    {
+        server2->Release();
+
+        return JNI_FALSE;
+    }
+
+    bool ret = server2->PublishBuffer((uint64_t)groupId, buffer2, (uint16_t)charset);
+    buffer2->Release();
+    server2->Release();
+
+    return ret ? JNI_TRUE : JNI_FALSE;
 }
 
 JNIEXPORT
 jboolean
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerSendMsg2(JNIEnv*      env,
-                                             jclass       clazz,
-                                             jlong        server,
-                                             jbyteArray   buf1,
-                                             jbyteArray   buf2,     /* = null */
-                                             jint         charset,  /* 0 ~ 65535 */
-                                             jobjectArray dstUsers) /* count <= 255 */
+Java_com_pro_msg_ProMsgJni_msgServerGetMetrics(JNIEnv*    env,
+                                               jclass     clazz,
+                                               jlong      server,
+                                               jlongArray metrics) /* length >= METRICS_SIZE */
 {
     assert(server != 0);
-    if (server == 0 || buf1 == NULL || charset < 0 || charset > 65535 || dstUsers == NULL)
+    assert(metrics != NULL);
+    if (server == 0 || metrics == NULL ||
+        env->GetArrayLength(metrics) < com_pro_msg_ProMsgJni_METRICS_SIZE)
     {
         return JNI_FALSE;
     }
 
-    CProStlVector<RTP_MSG_USER> cppDstUsers;
-
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
     {
-        int i = 0;
-        int c = (int)env->GetArrayLength(dstUsers);
+        return JNI_FALSE;
+    }
 
-        if (c <= 0 || c > 255)
-        {
-            return JNI_FALSE;
-        }
+    MSG_SERVER_METRICS metrics2;
+    server2->GetMetrics(metrics2);
+    server2->Release();
 
-        for (; i < c; ++i)
-        {
-            jobject javaUser = env->GetObjectArrayElement(dstUsers, i);
-            if (javaUser == NULL || env->ExceptionCheck())
-            {
-                return JNI_FALSE;
-            }
+    jlong values[com_pro_msg_ProMsgJni_METRICS_SIZE] = { 0 };
 
-            RTP_MSG_USER cppUser;
-            MSG_USER_java2cpp_i(env, javaUser, cppUser);
+    values[com_pro_msg_ProMsgJni_METRICS_MSGS_IN]           = (jlong)metrics2.msgsIn;
+    values[com_pro_msg_ProMsgJni_METRICS_BYTES_IN]          = (jlong)metrics2.bytesIn;
+    values[com_pro_msg_ProMsgJni_METRICS_MSGS_OUT]          = (jlong)metrics2.msgsOut;
+    values[com_pro_msg_ProMsgJni_METRICS_BYTES_OUT]         = (jlong)metrics2.bytesOut;
+    values[com_pro_msg_ProMsgJni_METRICS_REDLINE_DROPS]     = (jlong)metrics2.redlineDrops;
+    values[com_pro_msg_ProMsgJni_METRICS_HANDSHAKES_OK]     = (jlong)metrics2.handshakesOk;
+    values[com_pro_msg_ProMsgJni_METRICS_HANDSHAKES_FAILED] = (jlong)metrics2.handshakesFailed;
+    values[com_pro_msg_ProMsgJni_METRICS_KICKOUTS]          = (jlong)metrics2.kickouts;
+    values[com_pro_msg_ProMsgJni_METRICS_CLOSES]            = (jlong)metrics2.closes;
+    values[com_pro_msg_ProMsgJni_METRICS_CLOSES_DROPPED]    = (jlong)metrics2.closesDropped;
+    values[com_pro_msg_ProMsgJni_METRICS_USERS]             = (jlong)metrics2.users;
 
-            cppDstUsers.push_back(cppUser);
-            env->DeleteLocalRef(javaUser);
-        }
+    for (int i = 0; i < 256; ++i)
+    {
+        values[com_pro_msg_ProMsgJni_METRICS_AUTH_REJECTS_CID + i] =
+            (jlong)metrics2.authRejectsCid[i];
+        values[com_pro_msg_ProMsgJni_METRICS_USERS_CID + i] = (jlong)metrics2.usersCid[i];
     }
 
-    CMsgServerJni* server2 = NULL;
+    env->SetLongArrayRegion(metrics, 0, com_pro_msg_ProMsgJni_METRICS_SIZE, values);
+
+    return env->ExceptionCheck() ? JNI_FALSE : JNI_TRUE;
+}
 
+JNIEXPORT
+jint
+JNICALL
+Java_com_pro_msg_ProMsgJni_msgServerGetCloseReasons(JNIEnv*    env,
+                                                    jclass     clazz,
+                                                    jlong      server,
+                                                    jlongArray reasons)
+{
+    assert(server != 0);
+    assert(reasons != NULL);
+    if (server == 0 || reasons == NULL)
     {
-        CProThreadMutexGuard mon(g_s_lock);
+        return 0;
+    }
 
-        if (g_s_reactor == NULL)
-        {
-            return JNI_FALSE;
-        }
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
+    {
+        return 0;
+    }
 
-        if (g_s_servers.find(server) == g_s_servers.end())
-        {
-            return JNI_FALSE;
-        }
+    MSG_SERVER_METRICS metrics;
+    server2->GetMetrics(metrics);
+    server2->Release();
 
-        server2 = (CMsgServerJni*)server;
-        server2->AddRef();
+    int count = (int)metrics.closeReasons.size();
+    if (count > (int)env->GetArrayLength(reasons) / 2)
+    {
+        count = (int)env->GetArrayLength(reasons) / 2;
     }
 
-    jsize  buf1_size = env->GetArrayLength(buf1);
-    jbyte* buf1_p    = env->GetByteArrayElements(buf1, NULL);
-    if (buf1_size <= 0 || buf1_p == NULL || env->ExceptionCheck())
+    jlong values[MSG_METRICS_CLOSE_REASONS * 2];
+
+    for (int i = 0; i < count; ++i)
     {
-        server2->Release();
+        const MSG_CLOSE_REASON& reason = metrics.closeReasons[i];
 
-        return JNI_FALSE;
+        values[i * 2]     = (jlong)(((uint64_t)(uint32_t)reason.errorCode << 32) |
+            (uint32_t)reason.sslCode);
+        values[i * 2 + 1] = (jlong)reason.count;
     }
 
-    jsize  buf2_size = 0;
-    jbyte* buf2_p    = NULL;
-    if (buf2 != NULL)
+    if (count > 0)
     {
-        buf2_size = env->GetArrayLength(buf2);
-        buf2_p    = env->GetByteArrayElements(buf2, NULL);
-        if (buf2_size <= 0 || buf2_p == NULL || env->ExceptionCheck())
+        env->SetLongArrayRegion(reasons, 0, count * 2, values);
+        if (env->ExceptionCheck())
         {
-            env->ReleaseByteArrayElements(buf1, buf1_p, JNI_ABORT);
-            server2->Release();
-
-            return JNI_FALSE;
+            return 0;
         }
     }
 
-    bool ret = server2->SendMsg2(
-        buf1_p,
-        buf1_size,
-        buf2_p,
-        buf2_size,
-        (uint16_t)charset,
-        &cppDstUsers[0],
-        (unsigned char)cppDstUsers.size()
-        );
-    env->ReleaseByteArrayElements(buf1, buf1_p, JNI_ABORT);
-    if (buf2 != NULL)
-    {
-        env->ReleaseByteArrayElements(buf2, buf2_p, JNI_ABORT);
-    }
-    server2->Release();
-
-    return ret ? JNI_TRUE : JNI_FALSE;
+    return count;
 }
 
 JNIEXPORT
 void
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerSetOutputRedline(JNIEnv* env,
-                                                     jclass  clazz,
-                                                     jlong   server,
-                                                     jlong   redlineBytes)
+Java_com_pro_msg_ProMsgJni_msgServerResetMetrics(JNIEnv* env,
+                                                 jclass  clazz,
+                                                 jlong   server)
 {
     assert(server != 0);
-    if (server == 0 || redlineBytes <= 0)
+    if (server == 0)
     {
         return;
     }
 
-    CMsgServerJni* server2 = NULL;
-
+    CMsgServerJni* const server2 = GetServer_i(server);
+    if (server2 == NULL)
     {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_reactor == NULL)
-        {
-            return;
-        }
-
-        if (g_s_servers.find(server) == g_s_servers.end())
-        {
-            return;
-        }
-
-        server2 = (CMsgServerJni*)server;
-        server2->AddRef();
+        return;
     }
 
-    server2->SetOutputRedline((size_t)redlineBytes);
+    server2->ResetMetrics();
     server2->Release();
 }
 
+/*-------------------------------------------------------------------------*/
+
 JNIEXPORT
 jlong
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerGetOutputRedline(JNIEnv* env,
-                                                     jclass  clazz,
-                                                     jlong   server)
+Java_com_pro_msg_ProMsgJni_msgBufferCreate(JNIEnv*    env,
+                                           jclass     clazz,
+                                           jbyteArray buf)
 {
-    assert(server != 0);
-    if (server == 0)
+    if (buf == NULL)
     {
         return 0;
     }
 
-    CMsgServerJni* server2 = NULL;
-
+    jsize  buf_size = env->GetArrayLength(buf);
+    jbyte* buf_p    = env->GetByteArrayElements(buf, NULL);
+    if (buf_size <= 0 || buf_p == NULL || env->ExceptionCheck())
     {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_servers.find(server) != g_s_servers.end())
-        {
-            server2 = (CMsgServerJni*)server;
-            server2->AddRef();
-        }
+        return 0;
     }
 
-    jlong redlineBytes = 0;
+    CMsgBuffer* buffer = CMsgBuffer::CreateInstance(buf_p, buf_size, NULL, 0);
+    env->ReleaseByteArrayElements(buf, buf_p, JNI_ABORT);
+    if (buffer == NULL)
+    {
+        return 0;
+    }
 
-    if (server2 != NULL)
+    jlong handle = g_s_buffers.Add(buffer);
+    if (handle == 0)
     {
-        redlineBytes = server2->GetOutputRedline();
-        server2->Release();
+        buffer->Release();
     }
 
-    return redlineBytes;
+    return handle;
 }
 
 JNIEXPORT
-jlong
+void
 JNICALL
-Java_com_pro_msg_ProMsgJni_msgServerGetSendingBytes(JNIEnv* env,
-                                                    jclass  clazz,
-                                                    jlong   server,
-                                                    jobject user)
+Java_com_pro_msg_ProMsgJni_msgBufferDelete(JNIEnv* env,
+                                           jclass  clazz,
+                                           jlong   buffer)
 {
-    assert(server != 0);
-    if (server == 0 || user == NULL)
-    {
-        return 0;
-    }
-
-    RTP_MSG_USER cppUser;
-    MSG_USER_java2cpp_i(env, user, cppUser);
-
-    CMsgServerJni* server2 = NULL;
-
+    if (buffer == 0)
     {
-        CProThreadMutexGuard mon(g_s_lock);
-
-        if (g_s_servers.find(server) != g_s_servers.end())
-        {
-            server2 = (CMsgServerJni*)server;
-            server2->AddRef();
-        }
+        return;
     }
 
-    jlong sendingBytes = 0;
-
-    if (server2 != NULL)
+    CProRefCount* const p = g_s_buffers.Remove(buffer);
+    if (p != NULL)
     {
-        sendingBytes = server2->GetSendingBytes(cppUser);
-        server2->Release();
+        p->Release();
     }
-
-    return sendingBytes;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -7,6 +7,34 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
+#undef com_pro_msg_ProMsgJni_METRICS_MSGS_IN
+#define com_pro_msg_ProMsgJni_METRICS_MSGS_IN 0L
+#undef com_pro_msg_ProMsgJni_METRICS_BYTES_IN
+#define com_pro_msg_ProMsgJni_METRICS_BYTES_IN 1L
+#undef com_pro_msg_ProMsgJni_METRICS_MSGS_OUT
+#define com_pro_msg_ProMsgJni_METRICS_MSGS_OUT 2L
+#undef com_pro_msg_ProMsgJni_METRICS_BYTES_OUT
+#define com_pro_msg_ProMsgJni_METRICS_BYTES_OUT 3L
+#undef com_pro_msg_ProMsgJni_METRICS_REDLINE_DROPS
+#define com_pro_msg_ProMsgJni_METRICS_REDLINE_DROPS 4L
+#undef com_pro_msg_ProMsgJni_METRICS_HANDSHAKES_OK
+#define com_pro_msg_ProMsgJni_METRICS_HANDSHAKES_OK 5L
+#undef com_pro_msg_ProMsgJni_METRICS_HANDSHAKES_FAILED
+#define com_pro_msg_ProMsgJni_METRICS_HANDSHAKES_FAILED 6L
+#undef com_pro_msg_ProMsgJni_METRICS_KICKOUTS
+#define com_pro_msg_ProMsgJni_METRICS_KICKOUTS 7L
+#undef com_pro_msg_ProMsgJni_METRICS_CLOSES
+#define com_pro_msg_ProMsgJni_METRICS_CLOSES 8L
+#undef com_pro_msg_ProMsgJni_METRICS_CLOSES_DROPPED
+#define com_pro_msg_ProMsgJni_METRICS_CLOSES_DROPPED 9L
+#undef com_pro_msg_ProMsgJni_METRICS_USERS
+#define com_pro_msg_ProMsgJni_METRICS_USERS 10L
+#undef com_pro_msg_ProMsgJni_METRICS_AUTH_REJECTS_CID
+#define com_pro_msg_ProMsgJni_METRICS_AUTH_REJECTS_CID 16L
+#undef com_pro_msg_ProMsgJni_METRICS_USERS_CID
+#define com_pro_msg_ProMsgJni_METRICS_USERS_CID 272L
+#undef com_pro_msg_ProMsgJni_METRICS_SIZE
+#define com_pro_msg_ProMsgJni_METRICS_SIZE 528L
 /*
  * Class:     com_pro_msg_ProMsgJni
  * Method:    getCoreVersion
@@ -23,6 +51,14 @@ JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_getCoreVersion
 JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_init
   (JNIEnv *, jclass, jint);
 
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    initOnCpus
+ * Signature: (ILjava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_initOnCpus
+  (JNIEnv *, jclass, jint, jstring);
+
 /*
  * Class:     com_pro_msg_ProMsgJni
  * Method:    fini
@@ -31,6 +67,38 @@ JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_init
 JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_fini
   (JNIEnv *, jclass);
 
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    setPersistentAttach
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_setPersistentAttach
+  (JNIEnv *, jclass, jboolean);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    reactorCreate
+ * Signature: (IJ)J
+ */
+JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_reactorCreate
+  (JNIEnv *, jclass, jint, jlong);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    reactorCreateOnCpus
+ * Signature: (ILjava/lang/String;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_reactorCreateOnCpus
+  (JNIEnv *, jclass, jint, jstring);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    reactorDelete
+ * Signature: (J)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_reactorDelete
+  (JNIEnv *, jclass, jlong);
+
 /*
  * Class:     com_pro_msg_ProMsgJni
  * Method:    msgClientCreate
@@ -39,6 +107,14 @@ JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_fini
 JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgClientCreate
   (JNIEnv *, jclass, jobject, jstring, jshort, jstring, jint, jobject, jstring, jstring);
 
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientCreateOnReactor
+ * Signature: (JLcom/pro/msg/ProMsgJni/MsgClientListener;Ljava/lang/String;SLjava/lang/String;ILcom/pro/msg/ProMsgJni/PRO_MSG_USER;Ljava/lang/String;Ljava/lang/String;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgClientCreateOnReactor
+  (JNIEnv *, jclass, jlong, jobject, jstring, jshort, jstring, jint, jobject, jstring, jstring);
+
 /*
  * Class:     com_pro_msg_ProMsgJni
  * Method:    msgClientDelete
@@ -119,6 +195,54 @@ JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientSendMsg
 JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientSendMsg2
   (JNIEnv *, jclass, jlong, jbyteArray, jbyteArray, jint, jobjectArray);
 
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientSendMsgDirect
+ * Signature: (JLjava/nio/ByteBuffer;III[Lcom/pro/msg/ProMsgJni/PRO_MSG_USER;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientSendMsgDirect
+  (JNIEnv *, jclass, jlong, jobject, jint, jint, jint, jobjectArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientSendMsgV
+ * Signature: (J[[BI[Lcom/pro/msg/ProMsgJni/PRO_MSG_USER;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientSendMsgV
+  (JNIEnv *, jclass, jlong, jobjectArray, jint, jobjectArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientSendBuffer
+ * Signature: (JJI[Lcom/pro/msg/ProMsgJni/PRO_MSG_USER;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientSendBuffer
+  (JNIEnv *, jclass, jlong, jlong, jint, jobjectArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientSendMsgPacked
+ * Signature: (J[BI[J)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientSendMsgPacked
+  (JNIEnv *, jclass, jlong, jbyteArray, jint, jlongArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientSendMsgDirectPacked
+ * Signature: (JLjava/nio/ByteBuffer;III[J)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientSendMsgDirectPacked
+  (JNIEnv *, jclass, jlong, jobject, jint, jint, jint, jlongArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientSendBufferPacked
+ * Signature: (JJI[J)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientSendBufferPacked
+  (JNIEnv *, jclass, jlong, jlong, jint, jlongArray);
+
 /*
  * Class:     com_pro_msg_ProMsgJni
  * Method:    msgClientSetOutputRedline
@@ -143,6 +267,46 @@ JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgClientGetOutputRedline
 JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgClientGetSendingBytes
   (JNIEnv *, jclass, jlong);
 
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientSetOutputWatermarks
+ * Signature: (JJJ)V
+ */
+JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_msgClientSetOutputWatermarks
+  (JNIEnv *, jclass, jlong, jlong, jlong);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientAddRecvBuffer
+ * Signature: (JLjava/nio/ByteBuffer;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientAddRecvBuffer
+  (JNIEnv *, jclass, jlong, jobject);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientSetRecvBatch
+ * Signature: (JII)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientSetRecvBatch
+  (JNIEnv *, jclass, jlong, jint, jint);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientSetCoalescing
+ * Signature: (JIII)V
+ */
+JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_msgClientSetCoalescing
+  (JNIEnv *, jclass, jlong, jint, jint, jint);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientSetReconnectInterval
+ * Signature: (JII)V
+ */
+JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_msgClientSetReconnectInterval
+  (JNIEnv *, jclass, jlong, jint, jint);
+
 /*
  * Class:     com_pro_msg_ProMsgJni
  * Method:    msgClientReconnect
@@ -151,6 +315,22 @@ JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgClientGetSendingBytes
 JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientReconnect
   (JNIEnv *, jclass, jlong);
 
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientJoinGroup
+ * Signature: (JJ)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientJoinGroup
+  (JNIEnv *, jclass, jlong, jlong);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgClientLeaveGroup
+ * Signature: (JJ)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientLeaveGroup
+  (JNIEnv *, jclass, jlong, jlong);
+
 /*
  * Class:     com_pro_msg_ProMsgJni
  * Method:    msgServerCreate
@@ -159,6 +339,14 @@ JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgClientReconnect
 JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgServerCreate
   (JNIEnv *, jclass, jobject, jstring, jshort, jint);
 
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerCreateOnReactor
+ * Signature: (JLcom/pro/msg/ProMsgJni/MsgServerListener;Ljava/lang/String;SI)J
+ */
+JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgServerCreateOnReactor
+  (JNIEnv *, jclass, jlong, jobject, jstring, jshort, jint);
+
 /*
  * Class:     com_pro_msg_ProMsgJni
  * Method:    msgServerDelete
@@ -223,6 +411,54 @@ JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerSendMsg
 JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerSendMsg2
   (JNIEnv *, jclass, jlong, jbyteArray, jbyteArray, jint, jobjectArray);
 
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerSendMsgDirect
+ * Signature: (JLjava/nio/ByteBuffer;III[Lcom/pro/msg/ProMsgJni/PRO_MSG_USER;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerSendMsgDirect
+  (JNIEnv *, jclass, jlong, jobject, jint, jint, jint, jobjectArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerSendMsgV
+ * Signature: (J[[BI[Lcom/pro/msg/ProMsgJni/PRO_MSG_USER;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerSendMsgV
+  (JNIEnv *, jclass, jlong, jobjectArray, jint, jobjectArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerSendBuffer
+ * Signature: (JJI[Lcom/pro/msg/ProMsgJni/PRO_MSG_USER;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerSendBuffer
+  (JNIEnv *, jclass, jlong, jlong, jint, jobjectArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerSendMsgPacked
+ * Signature: (J[BI[J)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerSendMsgPacked
+  (JNIEnv *, jclass, jlong, jbyteArray, jint, jlongArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerSendMsgDirectPacked
+ * Signature: (JLjava/nio/ByteBuffer;III[J)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerSendMsgDirectPacked
+  (JNIEnv *, jclass, jlong, jobject, jint, jint, jint, jlongArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerSendBufferPacked
+ * Signature: (JJI[J)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerSendBufferPacked
+  (JNIEnv *, jclass, jlong, jlong, jint, jlongArray);
+
 /*
  * Class:     com_pro_msg_ProMsgJni
  * Method:    msgServerSetOutputRedline
@@ -239,6 +475,22 @@ JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_msgServerSetOutputRedline
 JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgServerGetOutputRedline
   (JNIEnv *, jclass, jlong);
 
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerSetClassOutputRedline
+ * Signature: (JSJ)V
+ */
+JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_msgServerSetClassOutputRedline
+  (JNIEnv *, jclass, jlong, jshort, jlong);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerSetUserOutputRedline
+ * Signature: (JLcom/pro/msg/ProMsgJni/PRO_MSG_USER;J)V
+ */
+JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_msgServerSetUserOutputRedline
+  (JNIEnv *, jclass, jlong, jobject, jlong);
+
 /*
  * Class:     com_pro_msg_ProMsgJni
  * Method:    msgServerGetSendingBytes
@@ -247,6 +499,134 @@ JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgServerGetOutputRedline
 JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgServerGetSendingBytes
   (JNIEnv *, jclass, jlong, jobject);
 
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerGetClassSendingBytes
+ * Signature: (JS)J
+ */
+JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgServerGetClassSendingBytes
+  (JNIEnv *, jclass, jlong, jshort);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerSetOutputWatermarks
+ * Signature: (JJJ)V
+ */
+JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_msgServerSetOutputWatermarks
+  (JNIEnv *, jclass, jlong, jlong, jlong);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerAddRecvBuffer
+ * Signature: (JLjava/nio/ByteBuffer;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerAddRecvBuffer
+  (JNIEnv *, jclass, jlong, jobject);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerSetRecvBatch
+ * Signature: (JII)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerSetRecvBatch
+  (JNIEnv *, jclass, jlong, jint, jint);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerCreateGroup
+ * Signature: (JJ)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerCreateGroup
+  (JNIEnv *, jclass, jlong, jlong);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerDeleteGroup
+ * Signature: (JJ)V
+ */
+JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_msgServerDeleteGroup
+  (JNIEnv *, jclass, jlong, jlong);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerJoinGroup
+ * Signature: (JJLcom/pro/msg/ProMsgJni/PRO_MSG_USER;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerJoinGroup
+  (JNIEnv *, jclass, jlong, jlong, jobject);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerLeaveGroup
+ * Signature: (JJLcom/pro/msg/ProMsgJni/PRO_MSG_USER;)V
+ */
+JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_msgServerLeaveGroup
+  (JNIEnv *, jclass, jlong, jlong, jobject);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerGetGroupMemberCount
+ * Signature: (JJ)J
+ */
+JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgServerGetGroupMemberCount
+  (JNIEnv *, jclass, jlong, jlong);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerPublishMsg
+ * Signature: (JJ[BI)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerPublishMsg
+  (JNIEnv *, jclass, jlong, jlong, jbyteArray, jint);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerPublishBuffer
+ * Signature: (JJJI)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerPublishBuffer
+  (JNIEnv *, jclass, jlong, jlong, jlong, jint);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerGetMetrics
+ * Signature: (J[J)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_pro_msg_ProMsgJni_msgServerGetMetrics
+  (JNIEnv *, jclass, jlong, jlongArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerGetCloseReasons
+ * Signature: (J[J)I
+ */
+JNIEXPORT jint JNICALL Java_com_pro_msg_ProMsgJni_msgServerGetCloseReasons
+  (JNIEnv *, jclass, jlong, jlongArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgServerResetMetrics
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_msgServerResetMetrics
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgBufferCreate
+ * Signature: ([B)J
+ */
+JNIEXPORT jlong JNICALL Java_com_pro_msg_ProMsgJni_msgBufferCreate
+  (JNIEnv *, jclass, jbyteArray);
+
+/*
+ * Class:     com_pro_msg_ProMsgJni
+ * Method:    msgBufferDelete
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_pro_msg_ProMsgJni_msgBufferDelete
+  (JNIEnv *, jclass, jlong);
+
 #ifdef __cplusplus
 }
 #endif
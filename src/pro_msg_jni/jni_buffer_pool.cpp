@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "jni_buffer_pool.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_z.h"
+#include <jni.h>
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CJniBufferPool::CJniBufferPool()
+{
+    m_empty = true;
+}
+
+CJniBufferPool::~CJniBufferPool()
+{
+    /*
+     * Clear() should have been called
+     */
+    assert(m_buffers.size() == 0);
+}
+
+bool
+CJniBufferPool::Add(JNIEnv* env,
+                    jobject buffer)
+{
+    assert(env != NULL);
+    assert(buffer != NULL);
+    if (env == NULL || buffer == NULL)
+    {
+        return false;
+    }
+
+    void*  address  = env->GetDirectBufferAddress(buffer);
+    jlong  capacity = env->GetDirectBufferCapacity(buffer);
+    if (address == NULL || capacity <= 0 || env->ExceptionCheck())
+    {
+        return false;
+    }
+
+    jobject buffer2 = env->NewGlobalRef(buffer);
+    if (buffer2 == NULL || env->ExceptionCheck())
+    {
+        return false;
+    }
+
+    JNI_BUFFER* const buffer3 = new JNI_BUFFER;
+    buffer3->buffer   = buffer2;
+    buffer3->address  = address;
+    buffer3->capacity = (size_t)capacity;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        m_buffers.push_back(buffer3);
+        m_freeBuffers.push_back(buffer3);
+        m_empty = false;
+    }
+
+    return true;
+}
+
+void
+CJniBufferPool::Clear(JNIEnv* env)
+{
+    CProStlVector<JNI_BUFFER*> buffers;
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        buffers = m_buffers;
+        m_buffers.clear();
+        m_freeBuffers.clear();
+        m_empty = true;
+    }
+
+    int i = 0;
+    int c = (int)buffers.size();
+
+    for (; i < c; ++i)
+    {
+        if (env != NULL)
+        {
+            env->DeleteGlobalRef(buffers[i]->buffer);
+        }
+        delete buffers[i];
+    }
+}
+
+JNI_BUFFER*
+CJniBufferPool::Get(size_t size)
+{
+    if (m_empty.load())
+    {
+        return NULL;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    int i = 0;
+    int c = (int)m_freeBuffers.size();
+
+    for (; i < c; ++i)
+    {
+        JNI_BUFFER* const buffer = m_freeBuffers[i];
+        if (buffer->capacity >= size)
+        {
+            m_freeBuffers[i] = m_freeBuffers[c - 1];
+            m_freeBuffers.pop_back();
+
+            return buffer;
+        }
+    }
+
+    return NULL;
+}
+
+void
+CJniBufferPool::Put(JNI_BUFFER* buffer)
+{
+    assert(buffer != NULL);
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    m_freeBuffers.push_back(buffer);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * Direct ByteBuffers supplied by Java, into which the received messages are
+ * copied before they are passed to a listener. A buffer is taken by one
+ * callback at a time, so a pool with one buffer per reactor thread is never
+ * short.
+ */
+
+#if !defined(JNI_BUFFER_POOL_H)
+#define JNI_BUFFER_POOL_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include <jni.h>
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+struct JNI_BUFFER
+{
+    jobject buffer;   /* a global reference */
+    void*   address;
+    size_t  capacity;
+
+    DECLARE_SGI_POOL(0)
+};
+
+class CJniBufferPool
+{
+public:
+
+    CJniBufferPool();
+
+    ~CJniBufferPool();
+
+    /*
+     * buffer must be a direct ByteBuffer
+     */
+    bool Add(
+        JNIEnv* env,
+        jobject buffer
+        );
+
+    void Clear(JNIEnv* env);
+
+    /*
+     * lock-free if the pool is empty. NULL if no free buffer can hold size
+     * bytes
+     */
+    JNI_BUFFER* Get(size_t size);
+
+    void Put(JNI_BUFFER* buffer);
+
+private:
+
+    CProStlVector<JNI_BUFFER*> m_buffers;
+    CProStlVector<JNI_BUFFER*> m_freeBuffers;
+    std::atomic<bool>          m_empty;
+    CProThreadMutex            m_lock;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* JNI_BUFFER_POOL_H */
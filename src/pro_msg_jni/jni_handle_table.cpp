@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "jni_handle_table.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_time_util.h"
+#include "pronet/pro_z.h"
+#include <jni.h>
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+/*
+ * A live slot has an odd generation, and a free one has an even generation.
+ * So a handle with an even generation is never valid.
+ */
+#define PINS_MASK 0xFFFFFFFFULL
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CJniHandleTable::CJniHandleTable()
+{
+    for (int i = 0; i < JNI_HANDLE_SEGMENTS; ++i)
+    {
+        m_segments[i] = NULL;
+    }
+
+    m_slotCount = 0;
+}
+
+CJniHandleTable::~CJniHandleTable()
+{
+    for (int i = 0; i < JNI_HANDLE_SEGMENTS; ++i)
+    {
+        delete[] m_segments[i].load();
+        m_segments[i] = NULL;
+    }
+}
+
+jlong
+CJniHandleTable::Add(CProRefCount* object)
+{
+    assert(object != NULL);
+    if (object == NULL)
+    {
+        return 0;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    uint32_t index = 0;
+
+    if (m_freeSlots.size() > 0)
+    {
+        index = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else
+    {
+        if (m_slotCount >= JNI_HANDLE_SEGMENTS * JNI_HANDLE_SEGMENT_SLOTS)
+        {
+            return 0;
+        }
+
+        index = m_slotCount;
+
+        std::atomic<HANDLE_SLOT*>& segment = m_segments[index / JNI_HANDLE_SEGMENT_SLOTS];
+        if (segment.load() == NULL)
+        {
+            segment = new HANDLE_SLOT[JNI_HANDLE_SEGMENT_SLOTS];
+        }
+
+        ++m_slotCount;
+    }
+
+    HANDLE_SLOT* const slot       = GetSlot_i(index);
+    const uint32_t     generation = (uint32_t)(slot->state.load() >> 32) + 1;
+
+    /*
+     * nobody pins a free slot, so the pins are 0 here
+     */
+    slot->object = object;
+    slot->state  = (uint64_t)generation << 32;
+
+    return (jlong)(((uint64_t)generation << 32) | (index + 1));
+}
+
+CProRefCount*
+CJniHandleTable::Get(jlong handle) const
+{
+    const uint32_t generation = (uint32_t)((uint64_t)handle >> 32);
+    const uint32_t index      = (uint32_t)handle - 1;
+
+    if ((generation & 1) == 0)
+    {
+        return NULL;
+    }
+
+    HANDLE_SLOT* const slot = GetSlot_i(index);
+    if (slot == NULL)
+    {
+        return NULL;
+    }
+
+    uint64_t state = slot->state.load();
+
+    do
+    {
+        if ((uint32_t)(state >> 32) != generation)
+        {
+            return NULL;
+        }
+    }
+    while (!slot->state.compare_exchange_weak(state, state + 1));
+
+    CProRefCount* const object = slot->object.load();
+    object->AddRef();
+
+    slot->state.fetch_sub(1);
+
+    return object;
+}
+
+CProRefCount*
+CJniHandleTable::Remove(jlong handle)
+{
+    const uint32_t generation = (uint32_t)((uint64_t)handle >> 32);
+    const uint32_t index      = (uint32_t)handle - 1;
+
+    if ((generation & 1) == 0)
+    {
+        return NULL;
+    }
+
+    CProThreadMutexGuard mon(m_lock);
+
+    return Remove_i(index, generation);
+}
+
+void
+CJniHandleTable::RemoveAll(CProStlVector<CProRefCount*>& objects)
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    for (uint32_t i = 0; i < m_slotCount; ++i)
+    {
+        const uint32_t generation = (uint32_t)(GetSlot_i(i)->state.load() >> 32);
+        if ((generation & 1) == 0)
+        {
+            continue;
+        }
+
+        CProRefCount* const object = Remove_i(i, generation);
+        if (object != NULL)
+        {
+            objects.push_back(object);
+        }
+    }
+}
+
+CJniHandleTable::HANDLE_SLOT*
+CJniHandleTable::GetSlot_i(uint32_t index) const
+{
+    if (index >= JNI_HANDLE_SEGMENTS * JNI_HANDLE_SEGMENT_SLOTS)
+    {
+        return NULL;
+    }
+
+    HANDLE_SLOT* const segment = m_segments[index / JNI_HANDLE_SEGMENT_SLOTS].load();
+    if (segment == NULL)
+    {
+        return NULL;
+    }
+
+    return segment + index % JNI_HANDLE_SEGMENT_SLOTS;
+}
+
+CProRefCount*
+CJniHandleTable::Remove_i(uint32_t index,
+                          uint32_t generation)
+{
+    HANDLE_SLOT* const slot = GetSlot_i(index);
+    if (slot == NULL)
+    {
+        return NULL;
+    }
+
+    uint64_t state = slot->state.load();
+
+    do
+    {
+        if ((uint32_t)(state >> 32) != generation)
+        {
+            return NULL;
+        }
+    }
+    while (!slot->state.compare_exchange_weak(
+        state, ((uint64_t)(generation + 1) << 32) | (state & PINS_MASK)));
+
+    /*
+     * a pin lasts for an AddRef(), so this is short
+     */
+    while ((slot->state.load() & PINS_MASK) != 0)
+    {
+        ProSleep(0);
+    }
+
+    CProRefCount* const object = slot->object.exchange(NULL);
+    m_freeSlots.push_back(index);
+
+    return object;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * The handles of the objects passed to Java. A handle is
+ * (generation << 32) | (index + 1), so a stale handle is rejected without
+ * any lock, even after its slot has been reused.
+ *
+ * Get() pins the slot while it takes a reference, and Remove() waits for
+ * the pins to go away before it gives the table's reference back, so an
+ * object is never referenced after it has been removed.
+ */
+
+#if !defined(JNI_HANDLE_TABLE_H)
+#define JNI_HANDLE_TABLE_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include <jni.h>
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define JNI_HANDLE_SEGMENT_SLOTS 4096
+#define JNI_HANDLE_SEGMENTS      256
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CJniHandleTable
+{
+public:
+
+    CJniHandleTable();
+
+    ~CJniHandleTable();
+
+    /*
+     * the table takes over the caller's reference. 0 if the table is full
+     */
+    jlong Add(CProRefCount* object);
+
+    /*
+     * lock-free. the caller should release the return value. NULL if the
+     * handle isn't valid
+     */
+    CProRefCount* Get(jlong handle) const;
+
+    /*
+     * the caller takes over the table's reference. NULL if the handle isn't
+     * valid
+     */
+    CProRefCount* Remove(jlong handle);
+
+    /*
+     * the caller takes over the table's references
+     */
+    void RemoveAll(CProStlVector<CProRefCount*>& objects);
+
+private:
+
+    struct HANDLE_SLOT
+    {
+        HANDLE_SLOT()
+        {
+            state  = 0;
+            object = NULL;
+        }
+
+        std::atomic<uint64_t>      state;  /* (generation << 32) | pins */
+        std::atomic<CProRefCount*> object;
+
+        DECLARE_SGI_POOL(0)
+    };
+
+    HANDLE_SLOT* GetSlot_i(uint32_t index) const;
+
+    CProRefCount* Remove_i(
+        uint32_t index,
+        uint32_t generation
+        );
+
+private:
+
+    std::atomic<HANDLE_SLOT*> m_segments[JNI_HANDLE_SEGMENTS];
+    uint32_t                  m_slotCount;
+    CProStlVector<uint32_t>   m_freeSlots;
+    CProThreadMutex           m_lock;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* JNI_HANDLE_TABLE_H */
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "jni_reactor.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_net.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_z.h"
+#include "../pro_msg/msg_affinity.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CJniReactor*
+CJniReactor::CreateInstance(unsigned int                       threadCount,
+                            const CProStlVector<unsigned int>& cpus)
+{
+    assert(threadCount > 0);
+    if (threadCount == 0)
+    {
+        return NULL;
+    }
+
+    IProReactor* const reactor = MsgCreateReactor(threadCount, cpus);
+    if (reactor == NULL)
+    {
+        return NULL;
+    }
+
+    return new CJniReactor(reactor);
+}
+
+CJniReactor::CJniReactor(IProReactor* reactor)
+: m_reactor(reactor)
+{
+    m_users  = 0;
+    m_closed = false;
+}
+
+CJniReactor::~CJniReactor()
+{
+    ProDeleteReactor(m_reactor);
+}
+
+unsigned long
+CJniReactor::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CJniReactor::Release()
+{
+    return CProRefCount::Release();
+}
+
+bool
+CJniReactor::AddUser()
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_closed)
+    {
+        return false;
+    }
+
+    ++m_users;
+
+    return true;
+}
+
+void
+CJniReactor::RemoveUser()
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    assert(m_users > 0);
+    if (m_users > 0)
+    {
+        --m_users;
+    }
+}
+
+bool
+CJniReactor::Close()
+{
+    CProThreadMutexGuard mon(m_lock);
+
+    if (m_users > 0)
+    {
+        return false;
+    }
+
+    m_closed = true;
+
+    return true;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * A reactor for Java. The default one is created by init(), and the others
+ * by reactorCreate(), so some clients and servers can run on threads of
+ * their own. A reactor can't be deleted while a client or a server is still
+ * running on it.
+ */
+
+#if !defined(JNI_REACTOR_H)
+#define JNI_REACTOR_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class IProReactor;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CJniReactor : public CProRefCount
+{
+public:
+
+    /*
+     * cpus is empty for unpinned. see MsgCreateReactor()
+     */
+    static CJniReactor* CreateInstance(
+        unsigned int                       threadCount,
+        const CProStlVector<unsigned int>& cpus
+        );
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+    IProReactor* GetReactor() const
+    {
+        return m_reactor;
+    }
+
+    /*
+     * false if it has been closed
+     */
+    bool AddUser();
+
+    void RemoveUser();
+
+    /*
+     * false if it still has users. no user can be added after it succeeds
+     */
+    bool Close();
+
+private:
+
+    CJniReactor(IProReactor* reactor);
+
+    virtual ~CJniReactor();
+
+private:
+
+    IProReactor* const      m_reactor;
+    unsigned long           m_users;
+    bool                    m_closed;
+    mutable CProThreadMutex m_lock;
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* JNI_REACTOR_H */
@@ -0,0 +1,516 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+#include "jni_recv_batch.h"
+#include "jni_util.h"
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_net.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_timer_factory.h"
+#include "pronet/pro_z.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include "../pro_msg/msg_affinity.h"
+#include <jni.h>
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static std::atomic<unsigned int> g_s_nextStripe(0);
+static thread_local unsigned int g_s_stripe = (unsigned int)-1;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+static
+void
+PutBe_i(char*    p,
+        uint64_t value,
+        int      bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i)
+    {
+        p[i]    = (char)(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+CJniRecvBatch*
+CJniRecvBatch::CreateInstance(JNIEnv*   env,
+                              jobject   listener,
+                              jmethodID onRecvBatch)
+{
+    assert(env != NULL);
+    assert(listener != NULL);
+    assert(onRecvBatch != NULL);
+    if (env == NULL || listener == NULL || onRecvBatch == NULL)
+    {
+        return NULL;
+    }
+
+    jobject listener2 = env->NewGlobalRef(listener);
+    if (listener2 == NULL || env->ExceptionCheck())
+    {
+        return NULL;
+    }
+
+    return new CJniRecvBatch(listener2, onRecvBatch);
+}
+
+CJniRecvBatch::CJniRecvBatch(jobject   listener,
+                             jmethodID onRecvBatch)
+:
+m_listener(listener),
+m_onRecvBatch(onRecvBatch)
+{
+    m_owner   = 0;
+    m_enabled = false;
+    m_reactor = NULL;
+    m_timerId = 0;
+}
+
+CJniRecvBatch::~CJniRecvBatch()
+{
+    Fini();
+
+    JNIEnv* env = JniUtilAttach();
+    if (env != NULL)
+    {
+        env->DeleteGlobalRef(m_listener);
+        JniUtilDetach();
+    }
+}
+
+bool
+CJniRecvBatch::SetParams(IProReactor*  reactor,
+                         size_t        maxBytes,
+                         unsigned long maxDelayInMs)
+{
+    assert(reactor != NULL || maxBytes == 0);
+    if (reactor == NULL && maxBytes > 0)
+    {
+        return false;
+    }
+
+    if (maxBytes > 0 && maxBytes < JNI_BATCH_HEADER_SIZE + 1)
+    {
+        maxBytes = JNI_BATCH_HEADER_SIZE + 1;
+    }
+    if (maxDelayInMs == 0)
+    {
+        maxDelayInMs = 1;
+    }
+
+    JNIEnv* env = JniUtilAttach();
+    if (env == NULL)
+    {
+        return false;
+    }
+
+    bool ret = true;
+    bool claimed[JNI_BATCH_STRIPES];
+
+    {
+        CProThreadMutexGuard mon(m_lock);
+
+        if (m_reactor != NULL)
+        {
+            m_reactor->CancelTimer(m_timerId);
+            m_reactor = NULL;
+            m_timerId = 0;
+        }
+
+        m_enabled = false;
+
+        /*
+         * the pending messages are delivered with the old buffers. a buffer
+         * of the old size is deleted when it comes back
+         */
+        for (int i = 0; i < JNI_BATCH_STRIPES; ++i)
+        {
+            BATCH_STRIPE& stripe = m_stripes[i];
+
+            CProThreadMutexGuard mon2(stripe.lock);
+
+            Flush_i(stripe);
+
+            if (stripe.current != NULL)
+            {
+                DeleteBuffer_i(env, stripe.current);
+                stripe.current = NULL;
+            }
+
+            int j = 0;
+            int c = (int)stripe.spares.size();
+
+            for (; j < c; ++j)
+            {
+                DeleteBuffer_i(env, stripe.spares[j]);
+            }
+
+            stripe.spares.clear();
+            stripe.capacity = maxBytes;
+
+            claimed[i] = Claim_i(stripe);
+        }
+
+        if (maxBytes > 0)
+        {
+            m_timerId = reactor->SetupTimer(this, maxDelayInMs, maxDelayInMs);
+            if (m_timerId > 0)
+            {
+                m_reactor = reactor;
+                m_enabled = true;
+            }
+            else
+            {
+                ret = false;
+            }
+        }
+    }
+
+    for (int i = 0; i < JNI_BATCH_STRIPES; ++i)
+    {
+        if (claimed[i])
+        {
+            Deliver_i(m_stripes[i]);
+        }
+    }
+
+    JniUtilDetach();
+
+    return ret;
+}
+
+void
+CJniRecvBatch::Fini()
+{
+    SetParams(NULL, 0, 0);
+}
+
+unsigned long
+CJniRecvBatch::AddRef()
+{
+    return CProRefCount::AddRef();
+}
+
+unsigned long
+CJniRecvBatch::Release()
+{
+    return CProRefCount::Release();
+}
+
+bool
+CJniRecvBatch::Add(const void*         buf,
+                   size_t              size,
+                   uint16_t            charset,
+                   const RTP_MSG_USER& srcUser)
+{
+    if (!m_enabled.load())
+    {
+        return false;
+    }
+
+    if (g_s_stripe == (unsigned int)-1)
+    {
+        g_s_stripe = g_s_nextStripe++ % JNI_BATCH_STRIPES;
+    }
+
+    BATCH_STRIPE& stripe     = m_stripes[g_s_stripe];
+    const size_t  recordSize = JNI_BATCH_HEADER_SIZE + size;
+    bool          claimed    = false;
+
+    {
+        CProThreadMutexGuard mon(stripe.lock);
+
+        if (stripe.capacity == 0)
+        {
+            return false;
+        }
+
+        if (stripe.current != NULL &&
+            stripe.current->size + recordSize > stripe.current->capacity)
+        {
+            Flush_i(stripe);
+        }
+
+        BATCH_BUFFER* buffer = NULL;
+
+        if (recordSize > stripe.capacity)
+        {
+            /*
+             * a batch of its own, queued behind the ones flushed before it
+             */
+            JNIEnv* env = JniUtilAttach();
+            if (env != NULL)
+            {
+                buffer = CreateBuffer_i(env, recordSize);
+                JniUtilDetach();
+            }
+        }
+        else if (stripe.current != NULL)
+        {
+            buffer = stripe.current;
+        }
+        else if (stripe.spares.size() > 0)
+        {
+            buffer = stripe.spares.back();
+            stripe.spares.pop_back();
+            stripe.current = buffer;
+        }
+        else
+        {
+            JNIEnv* env = JniUtilAttach();
+            if (env != NULL)
+            {
+                buffer = CreateBuffer_i(env, stripe.capacity);
+                JniUtilDetach();
+            }
+            stripe.current = buffer;
+        }
+
+        if (buffer == NULL)
+        {
+            return false;
+        }
+
+        char* const p = buffer->buf + buffer->size;
+
+        PutBe_i(p,      size,                 4);
+        PutBe_i(p + 4,  charset,              2);
+        PutBe_i(p + 6,  srcUser.instId,       2);
+        PutBe_i(p + 8,  ((uint64_t)srcUser.classId << 40) | srcUser.UserId(), 8);
+        memcpy(p + JNI_BATCH_HEADER_SIZE, buf, size);
+
+        buffer->size  += recordSize;
+        buffer->count += 1;
+
+        if (buffer != stripe.current)
+        {
+            stripe.full.push_back(buffer);
+        }
+
+        claimed = Claim_i(stripe);
+    }
+
+    if (claimed)
+    {
+        Deliver_i(stripe);
+    }
+
+    return true;
+}
+
+void
+CJniRecvBatch::OnTimer(void*    factory,
+                       uint64_t timerId,
+                       int64_t  tick,
+                       int64_t  userData)
+{
+    assert(factory != NULL);
+    assert(timerId > 0);
+    if (factory == NULL || timerId == 0)
+    {
+        return;
+    }
+
+    if (!m_enabled.load())
+    {
+        return;
+    }
+
+    for (int i = 0; i < JNI_BATCH_STRIPES; ++i)
+    {
+        BATCH_STRIPE& stripe  = m_stripes[i];
+        bool          claimed = false;
+
+        {
+            CProThreadMutexGuard mon(stripe.lock);
+
+            Flush_i(stripe);
+            claimed = Claim_i(stripe);
+        }
+
+        if (claimed)
+        {
+            Deliver_i(stripe);
+        }
+    }
+}
+
+void
+CJniRecvBatch::Flush_i(BATCH_STRIPE& stripe)
+{
+    if (stripe.current == NULL || stripe.current->count == 0)
+    {
+        return;
+    }
+
+    stripe.full.push_back(stripe.current);
+    stripe.current = NULL;
+}
+
+bool
+CJniRecvBatch::Claim_i(BATCH_STRIPE& stripe)
+{
+    if (stripe.delivering || stripe.full.size() == 0)
+    {
+        return false;
+    }
+
+    stripe.delivering = true;
+
+    return true;
+}
+
+void
+CJniRecvBatch::Deliver_i(BATCH_STRIPE& stripe)
+{
+    JNIEnv*       env    = JniUtilAttach();
+    BATCH_BUFFER* buffer = NULL;
+
+    while (1)
+    {
+        {
+            CProThreadMutexGuard mon(stripe.lock);
+
+            if (buffer != NULL)
+            {
+                Recycle_i(env, stripe, buffer);
+                buffer = NULL;
+            }
+
+            if (stripe.full.size() == 0)
+            {
+                stripe.delivering = false;
+                break;
+            }
+
+            buffer = stripe.full.front();
+            stripe.full.pop_front();
+        }
+
+        if (env != NULL)
+        {
+            env->CallVoidMethod(
+                m_listener,
+                m_onRecvBatch,
+                (jlong)  m_owner,
+                (jobject)buffer->javaBuf,
+                (jint)   buffer->size,
+                (jint)   buffer->count
+                );
+
+            /*
+             * the next upcall would fail with an exception pending
+             */
+            if (env->ExceptionCheck())
+            {
+                env->ExceptionClear();
+            }
+        }
+    }
+
+    if (env != NULL)
+    {
+        JniUtilDetach();
+    }
+}
+
+void
+CJniRecvBatch::Recycle_i(JNIEnv*       env,
+                         BATCH_STRIPE& stripe,
+                         BATCH_BUFFER* buffer)
+{
+    assert(buffer != NULL);
+
+    buffer->size  = 0;
+    buffer->count = 0;
+
+    if (buffer->capacity == stripe.capacity &&
+        stripe.spares.size() < JNI_BATCH_SPARES)
+    {
+        stripe.spares.push_back(buffer);
+    }
+    else if (env != NULL)
+    {
+        DeleteBuffer_i(env, buffer);
+    }
+}
+
+CJniRecvBatch::BATCH_BUFFER*
+CJniRecvBatch::CreateBuffer_i(JNIEnv* env,
+                              size_t  capacity)
+{
+    assert(env != NULL);
+    assert(capacity > 0);
+
+    /*
+     * not touched here, so the pages go to the node of the reactor thread
+     * that fills the stripe
+     */
+    char* const buf = (char*)MsgAllocLocal(capacity);
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+
+    jobject javaBuf  = env->NewDirectByteBuffer(buf, (jlong)capacity);
+    jobject javaBuf2 = NULL;
+    if (javaBuf != NULL && !env->ExceptionCheck())
+    {
+        javaBuf2 = env->NewGlobalRef(javaBuf);
+        env->DeleteLocalRef(javaBuf);
+    }
+    if (javaBuf2 == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        MsgFreeLocal(buf, capacity);
+
+        return NULL;
+    }
+
+    BATCH_BUFFER* const buffer = new BATCH_BUFFER;
+    buffer->buf      = buf;
+    buffer->javaBuf  = javaBuf2;
+    buffer->capacity = capacity;
+    buffer->size     = 0;
+    buffer->count    = 0;
+
+    return buffer;
+}
+
+void
+CJniRecvBatch::DeleteBuffer_i(JNIEnv*       env,
+                              BATCH_BUFFER* buffer)
+{
+    assert(env != NULL);
+    assert(buffer != NULL);
+
+    env->DeleteGlobalRef(buffer->javaBuf);
+    MsgFreeLocal(buffer->buf, buffer->capacity);
+
+    delete buffer;
+}
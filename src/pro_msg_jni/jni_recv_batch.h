@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2018-2019 Eric Tung <libpronet@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file is part of LibProMsg (https://github.com/libpronet/libpromsg)
+ */
+
+
+/*
+ * Batched delivery of received messages to a Java listener. The messages
+ * are appended to a native buffer of the receiving thread's stripe, and the
+ * whole buffer is passed to Java in one upcall as a direct ByteBuffer when
+ * the next message would not fit, or when the timer fires. Each record is:
+ *
+ *     [0..3]   payload size, big-endian
+ *     [4..5]   charset, big-endian
+ *     [6..7]   srcUser.instId, big-endian
+ *     [8..15]  srcUser, (classId << 40) | userId, big-endian
+ *     [16..]   payload
+ *
+ * A larger maxBytes trades latency for fewer upcalls. A message larger than
+ * the buffer gets a buffer of its own, and it's passed as a batch of one.
+ *
+ * A flushed buffer is queued on its stripe, and it's passed to Java after
+ * the stripe's lock is released, by one thread at a time, in the order of
+ * flushing. So the listener may send or receive on the same stripe, and the
+ * other threads of the stripe don't wait for the upcall.
+ */
+
+#if !defined(JNI_RECV_BATCH_H)
+#define JNI_RECV_BATCH_H
+
+#include "pronet/pro_memory_pool.h"
+#include "pronet/pro_ref_count.h"
+#include "pronet/pro_stl.h"
+#include "pronet/pro_thread_mutex.h"
+#include "pronet/pro_timer_factory.h"
+#include "pronet/rtp_base.h"
+#include "pronet/rtp_msg.h"
+#include <jni.h>
+#include <atomic>
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#define JNI_BATCH_HEADER_SIZE 16
+#define JNI_BATCH_STRIPES     8
+#define JNI_BATCH_SPARES      2 /* recycled buffers per stripe */
+
+class IProReactor;
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+class CJniRecvBatch : public IProOnTimer, public CProRefCount
+{
+public:
+
+    /*
+     * onRecvBatch is (JLjava/nio/ByteBuffer;II)V, called with the owner
+     */
+    static CJniRecvBatch* CreateInstance(
+        JNIEnv*   env,
+        jobject   listener,
+        jmethodID onRecvBatch
+        );
+
+    /*
+     * call it before any message is added
+     */
+    void SetOwner(jlong owner)
+    {
+        m_owner = owner;
+    }
+
+    /*
+     * maxBytes 0 for disabled. the pending messages are still delivered.
+     * don't call it in the listener's batch callback
+     */
+    bool SetParams(
+        IProReactor*  reactor,
+        size_t        maxBytes,
+        unsigned long maxDelayInMs
+        );
+
+    void Fini();
+
+    virtual unsigned long AddRef();
+
+    virtual unsigned long Release();
+
+    /*
+     * false if the message isn't batched, and the caller should deliver it
+     * itself
+     */
+    bool Add(
+        const void*         buf,
+        size_t              size,
+        uint16_t            charset,
+        const RTP_MSG_USER& srcUser
+        );
+
+private:
+
+    struct BATCH_BUFFER
+    {
+        char*   buf;
+        jobject javaBuf;  /* a global reference over buf */
+        size_t  capacity;
+        size_t  size;
+        size_t  count;
+
+        DECLARE_SGI_POOL(0)
+    };
+
+    struct BATCH_STRIPE
+    {
+        BATCH_STRIPE()
+        {
+            current    = NULL;
+            capacity   = 0;
+            delivering = false;
+        }
+
+        CProThreadMutex              lock;
+        BATCH_BUFFER*                current;    /* being filled */
+        CProStlDeque<BATCH_BUFFER*>  full;       /* flushed, to be delivered */
+        CProStlVector<BATCH_BUFFER*> spares;
+        size_t                       capacity;   /* maxBytes, 0 for disabled */
+        bool                         delivering; /* a thread is in Deliver_i() */
+
+        DECLARE_SGI_POOL(0)
+    };
+
+    CJniRecvBatch(
+        jobject   listener,
+        jmethodID onRecvBatch
+        );
+
+    virtual ~CJniRecvBatch();
+
+    virtual void OnTimer(
+        void*    factory,
+        uint64_t timerId,
+        int64_t  tick,
+        int64_t  userData
+        );
+
+    /*
+     * with stripe.lock held. queues the current buffer
+     */
+    static void Flush_i(BATCH_STRIPE& stripe);
+
+    /*
+     * with stripe.lock held. true if the caller is to call Deliver_i()
+     */
+    static bool Claim_i(BATCH_STRIPE& stripe);
+
+    /*
+     * without stripe.lock held. passes the queued buffers to Java
+     */
+    void Deliver_i(BATCH_STRIPE& stripe);
+
+    /*
+     * with stripe.lock held
+     */
+    static void Recycle_i(
+        JNIEnv*       env,
+        BATCH_STRIPE& stripe,
+        BATCH_BUFFER* buffer
+        );
+
+    static BATCH_BUFFER* CreateBuffer_i(
+        JNIEnv* env,
+        size_t  capacity
+        );
+
+    static void DeleteBuffer_i(
+        JNIEnv*       env,
+        BATCH_BUFFER* buffer
+        );
+
+private:
+
+    const jobject     m_listener;    /* a global reference */
+    const jmethodID   m_onRecvBatch;
+    jlong             m_owner;
+    BATCH_STRIPE      m_stripes[JNI_BATCH_STRIPES];
+    std::atomic<bool> m_enabled;
+    IProReactor*      m_reactor;
+    uint64_t          m_timerId;
+    CProThreadMutex   m_lock;        /* for SetParams()/Fini() */
+
+    DECLARE_SGI_POOL(0)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+////
+
+#endif /* JNI_RECV_BATCH_H */
@@ -27,6 +27,7 @@
 #endif
 
 #include <jni.h>
+#include <atomic>
 
 #if defined(__cplusplus)
 extern "C" {
@@ -35,12 +36,13 @@ extern "C" {
 /////////////////////////////////////////////////////////////////////////////
 ////
 
-static JavaVM*       g_s_jvm = NULL;
-static jint          g_s_ver = 0;
+static JavaVM*           g_s_jvm        = NULL;
+static jint              g_s_ver        = 0;
+static std::atomic<bool> g_s_persistent(true);
 #if defined(_WIN32)
-static unsigned long g_s_key = (unsigned long)-1;
+static unsigned long     g_s_key        = FLS_OUT_OF_INDEXES;
 #else
-static pthread_key_t g_s_key = (pthread_key_t)-1;
+static pthread_key_t     g_s_key        = (pthread_key_t)-1;
 #endif
 
 /////////////////////////////////////////////////////////////////////////////
@@ -67,6 +69,24 @@ JniUtilCleanup_i(void*)
     g_s_jvm->DetachCurrentThread();
 }
 
+#if defined(_WIN32)
+
+/*
+ * unlike TLS, FLS calls it when a thread exits
+ */
+static
+void
+WINAPI
+JniUtilFlsCleanup_i(void* env)
+{
+    if (env != NULL)
+    {
+        JniUtilCleanup_i(env);
+    }
+}
+
+#endif
+
 /////////////////////////////////////////////////////////////////////////////
 ////
 
@@ -85,7 +105,7 @@ JniUtilOnLoad(JavaVM* jvm,
     g_s_ver = jdkVer;
 
 #if defined(_WIN32)
-    g_s_key = ::TlsAlloc();
+    g_s_key = ::FlsAlloc(&JniUtilFlsCleanup_i);
 #else
     pthread_key_create(&g_s_key, &JniUtilCleanup_i);
 #endif
@@ -109,7 +129,7 @@ JniUtilAttach()
     }
 
 #if defined(_WIN32)
-    env = (JNIEnv*)::TlsGetValue(g_s_key);
+    env = (JNIEnv*)::FlsGetValue(g_s_key);
 #else
     env = (JNIEnv*)pthread_getspecific(g_s_key);
 #endif
@@ -129,7 +149,7 @@ JniUtilAttach()
     }
 
 #if defined(_WIN32)
-    ::TlsSetValue(g_s_key, env);
+    ::FlsSetValue(g_s_key, env);
 #else
     pthread_setspecific(g_s_key, env);
 #endif
@@ -148,11 +168,25 @@ JniUtilDetach()
     JNIEnv* env = NULL;
 
 #if defined(_WIN32)
-    env = (JNIEnv*)::TlsGetValue(g_s_key);
+    env = (JNIEnv*)::FlsGetValue(g_s_key);
 #else
     env = (JNIEnv*)pthread_getspecific(g_s_key);
 #endif
     if (env == NULL)
+    {
+        return; /* a Java thread */
+    }
+
+    /*
+     * nobody above us would clear it, and it would break the next callback
+     * on this thread
+     */
+    if (env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+    }
+
+    if (g_s_persistent.load())
     {
         return;
     }
@@ -160,12 +194,18 @@ JniUtilDetach()
     g_s_jvm->DetachCurrentThread();
 
 #if defined(_WIN32)
-    ::TlsSetValue(g_s_key, NULL);
+    ::FlsSetValue(g_s_key, NULL);
 #else
     pthread_setspecific(g_s_key, NULL);
 #endif
 }
 
+void
+JniUtilSetPersistent(bool persistent)
+{
+    g_s_persistent = persistent;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 ////
 
@@ -33,12 +33,26 @@ void
 JniUtilOnLoad(JavaVM* jvm,
               jint    jdkVer);
 
+/*
+ * attaches the calling thread if needed. a thread attached here stays
+ * attached until it exits, unless persistent attaching is turned off
+ */
 JNIEnv*
 JniUtilAttach();
 
+/*
+ * ends a callback. it clears the listener's pending exception, and it
+ * detaches the thread only if persistent attaching is turned off
+ */
 void
 JniUtilDetach();
 
+/*
+ * true by default
+ */
+void
+JniUtilSetPersistent(bool persistent);
+
 /////////////////////////////////////////////////////////////////////////////
 ////
 
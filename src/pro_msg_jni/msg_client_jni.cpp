@@ -43,6 +43,10 @@ jobject
 NewJavaUser_i(JNIEnv*             env,
               const RTP_MSG_USER& user);
 
+extern
+jlong
+PackJavaUser_i(const RTP_MSG_USER& user);
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif
@@ -71,6 +75,12 @@ CMsgClientJni::CreateInstance(JNIEnv* env,
     jmethodID onRecvMsg      = NULL;
     jmethodID onCloseMsg     = NULL;
     jmethodID onHeartbeatMsg = NULL;
+    jmethodID onHighWater    = NULL;
+    jmethodID onLowWater     = NULL;
+    jmethodID onRecvDirect   = NULL;
+    jmethodID onRecvBatch    = NULL;
+    jmethodID onRecvPacked   = NULL;
+    jmethodID onSendDropped  = NULL;
 
     onOkMsg = env->GetMethodID(clazz, "msgClientOnOk",
         "(JLcom/pro/msg/ProMsgJni$PRO_MSG_USER;Ljava/lang/String;)V");
@@ -98,14 +108,76 @@ CMsgClientJni::CreateInstance(JNIEnv* env,
         return NULL;
     }
 
+    /*
+     * optional, for MsgClientWatermarkListener
+     */
+    onHighWater = env->GetMethodID(clazz, "msgClientOnOutputHighWater", "(JJ)V");
+    if (onHighWater == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        onHighWater = NULL;
+    }
+
+    onLowWater = env->GetMethodID(clazz, "msgClientOnOutputLowWater", "(JJ)V");
+    if (onLowWater == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        onLowWater = NULL;
+    }
+
+    /*
+     * optional, for MsgClientDirectListener
+     */
+    onRecvDirect = env->GetMethodID(clazz, "msgClientOnRecvDirect",
+        "(JLjava/nio/ByteBuffer;IISJI)V");
+    if (onRecvDirect == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        onRecvDirect = NULL;
+    }
+
+    /*
+     * optional, for MsgClientPackedListener
+     */
+    onRecvPacked = env->GetMethodID(clazz, "msgClientOnRecvPacked", "(J[BIJ)V");
+    if (onRecvPacked == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        onRecvPacked = NULL;
+    }
+
+    /*
+     * optional, for MsgClientBatchListener
+     */
+    onRecvBatch = env->GetMethodID(clazz, "msgClientOnRecvBatch", "(JLjava/nio/ByteBuffer;II)V");
+    if (onRecvBatch == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        onRecvBatch = NULL;
+    }
+
+    /*
+     * optional, for MsgClientDropListener
+     */
+    onSendDropped = env->GetMethodID(clazz, "msgClientOnSendDropped", "(JJJ)V");
+    if (onSendDropped == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        onSendDropped = NULL;
+    }
+
     jobject listener2 = env->NewGlobalRef(listener);
     if (listener2 == NULL || env->ExceptionCheck())
     {
         return NULL;
     }
 
-    CMsgClientJni* client = new CMsgClientJni(
-        listener2, onOkMsg, onRecvMsg, onCloseMsg, onHeartbeatMsg);
+    CMsgClientJni* client = new CMsgClientJni(listener2, onOkMsg, onRecvMsg, onCloseMsg,
+        onHeartbeatMsg, onHighWater, onLowWater, onRecvDirect, onRecvPacked, onSendDropped);
+    if (onRecvBatch != NULL)
+    {
+        client->m_recvBatch = CJniRecvBatch::CreateInstance(env, listener, onRecvBatch);
+    }
 
     return client;
 }
@@ -114,26 +186,80 @@ CMsgClientJni::CMsgClientJni(jobject   listener,
                              jmethodID onOkMsg,
                              jmethodID onRecvMsg,
                              jmethodID onCloseMsg,
-                             jmethodID onHeartbeatMsg)
+                             jmethodID onHeartbeatMsg,
+                             jmethodID onOutputHighWater, /* = NULL */
+                             jmethodID onOutputLowWater,  /* = NULL */
+                             jmethodID onRecvDirect,      /* = NULL */
+                             jmethodID onRecvPacked,      /* = NULL */
+                             jmethodID onSendDropped)     /* = NULL */
 :
 m_listener(listener),
 m_onOkMsg(onOkMsg),
 m_onRecvMsg(onRecvMsg),
 m_onCloseMsg(onCloseMsg),
-m_onHeartbeatMsg(onHeartbeatMsg)
+m_onHeartbeatMsg(onHeartbeatMsg),
+m_onOutputHighWater(onOutputHighWater),
+m_onOutputLowWater(onOutputLowWater),
+m_onRecvDirect(onRecvDirect),
+m_onRecvPacked(onRecvPacked),
+m_onSendDropped(onSendDropped)
 {
+    m_recvBuffers = new CJniBufferPool;
+    m_recvBatch   = NULL;
+    m_handle      = 0;
+    m_jniReactor  = NULL;
 }
 
 CMsgClientJni::~CMsgClientJni()
 {
     Fini();
 
+    if (m_recvBatch != NULL)
+    {
+        m_recvBatch->Fini();
+        m_recvBatch->Release();
+        m_recvBatch = NULL;
+    }
+
     JNIEnv* env = JniUtilAttach();
+    m_recvBuffers->Clear(env);
     if (env != NULL)
     {
         env->DeleteGlobalRef(m_listener);
         JniUtilDetach();
     }
+
+    delete m_recvBuffers;
+    m_recvBuffers = NULL;
+}
+
+void
+CMsgClientJni::SetHandle(jlong handle)
+{
+    m_handle = handle;
+    if (m_recvBatch != NULL)
+    {
+        m_recvBatch->SetOwner(handle);
+    }
+}
+
+bool
+CMsgClientJni::AddRecvBuffer(JNIEnv* env,
+                             jobject buffer)
+{
+    return m_recvBuffers->Add(env, buffer);
+}
+
+bool
+CMsgClientJni::SetRecvBatch(size_t        maxBytes,
+                            unsigned long maxDelayInMs)
+{
+    if (m_recvBatch == NULL || m_jniReactor == NULL)
+    {
+        return false;
+    }
+
+    return m_recvBatch->SetParams(m_jniReactor->GetReactor(), maxBytes, maxDelayInMs);
 }
 
 void
@@ -150,18 +276,9 @@ CMsgClientJni::OnOkMsg(IRtpMsgClient*      msgClient,
         return;
     }
 
+    if (!AcceptConnection(msgClient))
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgClient == NULL)
-        {
-            return;
-        }
-
-        if (msgClient != m_msgClient)
-        {
-            return;
-        }
+        return;
     }
 
     JNIEnv* env = JniUtilAttach();
@@ -190,7 +307,7 @@ CMsgClientJni::OnOkMsg(IRtpMsgClient*      msgClient,
     env->CallVoidMethod(
         m_listener,
         m_onOkMsg,
-        (jlong)  this,
+        (jlong)  m_handle,
         (jobject)javaUser,
         (jstring)javaPublicIp
         );
@@ -215,18 +332,19 @@ CMsgClientJni::OnRecvMsg(IRtpMsgClient*      msgClient,
         return;
     }
 
+    if (!IsCurrent(msgClient))
     {
-        CProThreadMutexGuard mon(m_lock);
+        return;
+    }
 
-        if (m_reactor == NULL || m_msgClient == NULL)
-        {
-            return;
-        }
+    if (UnpackCoalesced(msgClient, buf, size, charset, srcUser))
+    {
+        return;
+    }
 
-        if (msgClient != m_msgClient)
-        {
-            return;
-        }
+    if (m_recvBatch != NULL && m_recvBatch->Add(buf, size, charset, *srcUser))
+    {
+        return;
     }
 
     JNIEnv* env = JniUtilAttach();
@@ -235,6 +353,14 @@ CMsgClientJni::OnRecvMsg(IRtpMsgClient*      msgClient,
         return;
     }
 
+    if (m_onRecvDirect != NULL)
+    {
+        RecvDirect_i(env, buf, size, charset, *srcUser);
+        JniUtilDetach();
+
+        return;
+    }
+
     jbyteArray javaBuf = env->NewByteArray((jsize)size);
     if (javaBuf == NULL || env->ExceptionCheck())
     {
@@ -252,6 +378,25 @@ CMsgClientJni::OnRecvMsg(IRtpMsgClient*      msgClient,
         return;
     }
 
+    /*
+     * no PRO_MSG_USER is allocated
+     */
+    if (m_onRecvPacked != NULL)
+    {
+        env->CallVoidMethod(
+            m_listener,
+            m_onRecvPacked,
+            (jlong)     m_handle,
+            (jbyteArray)javaBuf,
+            (jint)      charset,
+            (jlong)     PackJavaUser_i(*srcUser)
+            );
+        env->DeleteLocalRef(javaBuf);
+        JniUtilDetach();
+
+        return;
+    }
+
     jobject javaUser = NewJavaUser_i(env, *srcUser);
     if (javaUser == NULL)
     {
@@ -264,7 +409,7 @@ CMsgClientJni::OnRecvMsg(IRtpMsgClient*      msgClient,
     env->CallVoidMethod(
         m_listener,
         m_onRecvMsg,
-        (jlong)     this,
+        (jlong)     m_handle,
         (jbyteArray)javaBuf,
         (jint)      charset,
         (jobject)   javaUser
@@ -286,18 +431,9 @@ CMsgClientJni::OnCloseMsg(IRtpMsgClient* msgClient,
         return;
     }
 
+    if (!LoseConnection(msgClient))
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgClient == NULL)
-        {
-            return;
-        }
-
-        if (msgClient != m_msgClient)
-        {
-            return;
-        }
+        return;
     }
 
     JNIEnv* env = JniUtilAttach();
@@ -309,7 +445,7 @@ CMsgClientJni::OnCloseMsg(IRtpMsgClient* msgClient,
     env->CallVoidMethod(
         m_listener,
         m_onCloseMsg,
-        (jlong)   this,
+        (jlong)   m_handle,
         (jint)    errorCode,
         (jint)    sslCode,
         (jboolean)(tcpConnected ? JNI_TRUE : JNI_FALSE)
@@ -327,18 +463,9 @@ CMsgClientJni::OnHeartbeatMsg(IRtpMsgClient* msgClient,
         return;
     }
 
+    if (!IsCurrent(msgClient))
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgClient == NULL)
-        {
-            return;
-        }
-
-        if (msgClient != m_msgClient)
-        {
-            return;
-        }
+        return;
     }
 
     JNIEnv* env = JniUtilAttach();
@@ -350,8 +477,120 @@ CMsgClientJni::OnHeartbeatMsg(IRtpMsgClient* msgClient,
     env->CallVoidMethod(
         m_listener,
         m_onHeartbeatMsg,
-        (jlong)this,
+        (jlong)m_handle,
         (jlong)peerAliveTick
         );
     JniUtilDetach();
 }
+
+void
+CMsgClientJni::OnOutputHighWater(const RTP_MSG_USER& user,
+                                 size_t              sendingBytes)
+{
+    CallWatermark_i(m_onOutputHighWater, sendingBytes);
+}
+
+void
+CMsgClientJni::OnOutputLowWater(const RTP_MSG_USER& user,
+                                size_t              sendingBytes)
+{
+    CallWatermark_i(m_onOutputLowWater, sendingBytes);
+}
+
+void
+CMsgClientJni::OnSendDropped(size_t msgCount,
+                             size_t bytes)
+{
+    if (m_onSendDropped == NULL)
+    {
+        return;
+    }
+
+    JNIEnv* env = JniUtilAttach();
+    if (env == NULL)
+    {
+        return;
+    }
+
+    env->CallVoidMethod(
+        m_listener,
+        m_onSendDropped,
+        (jlong)m_handle,
+        (jlong)msgCount,
+        (jlong)bytes
+        );
+    JniUtilDetach();
+}
+
+void
+CMsgClientJni::CallWatermark_i(jmethodID method,
+                               size_t    sendingBytes)
+{
+    if (method == NULL)
+    {
+        return;
+    }
+
+    JNIEnv* env = JniUtilAttach();
+    if (env == NULL)
+    {
+        return;
+    }
+
+    env->CallVoidMethod(
+        m_listener,
+        method,
+        (jlong)m_handle,
+        (jlong)sendingBytes
+        );
+    JniUtilDetach();
+}
+
+void
+CMsgClientJni::RecvDirect_i(JNIEnv*             env,
+                             const void*         buf,
+                             size_t              size,
+                             uint16_t            charset,
+                             const RTP_MSG_USER& srcUser)
+{
+    JNI_BUFFER* const pooled  = m_recvBuffers->Get(size);
+    jobject           javaBuf = NULL;
+
+    if (pooled != NULL)
+    {
+        memcpy(pooled->address, buf, size);
+        javaBuf = pooled->buffer;
+    }
+    else
+    {
+        /*
+         * a view over the receive buffer. it's valid only during the call
+         */
+        javaBuf = env->NewDirectByteBuffer((void*)buf, (jlong)size);
+        if (javaBuf == NULL || env->ExceptionCheck())
+        {
+            return;
+        }
+    }
+
+    env->CallVoidMethod(
+        m_listener,
+        m_onRecvDirect,
+        (jlong)  m_handle,
+        (jobject)javaBuf,
+        (jint)   size,
+        (jint)   charset,
+        (jshort) srcUser.classId,
+        (jlong)  srcUser.UserId(),
+        (jint)   srcUser.instId
+        );
+
+    if (pooled != NULL)
+    {
+        m_recvBuffers->Put(pooled);
+    }
+    else
+    {
+        env->DeleteLocalRef(javaBuf);
+    }
+}
@@ -19,6 +19,9 @@
 #if !defined(MSG_CLIENT_JNI_H)
 #define MSG_CLIENT_JNI_H
 
+#include "jni_buffer_pool.h"
+#include "jni_reactor.h"
+#include "jni_recv_batch.h"
 #include "pronet/pro_memory_pool.h"
 #include "pronet/rtp_base.h"
 #include "pronet/rtp_msg.h"
@@ -37,6 +40,42 @@ public:
         jobject listener
         );
 
+    /*
+     * the handle passed to the listener. call it before Init()
+     */
+    void SetHandle(jlong handle);
+
+    /*
+     * the reactor passed to Init(). the caller keeps its reference and its
+     * user count, and drops them after Fini()
+     */
+    void SetJniReactor(CJniReactor* jniReactor)
+    {
+        m_jniReactor = jniReactor;
+    }
+
+    CJniReactor* GetJniReactor() const
+    {
+        return m_jniReactor;
+    }
+
+    /*
+     * for the direct listener. a received message is copied into a free
+     * buffer that can hold it, or else it's passed as a view
+     */
+    bool AddRecvBuffer(
+        JNIEnv* env,
+        jobject buffer
+        );
+
+    /*
+     * for the batch listener. maxBytes 0 for one upcall per message
+     */
+    bool SetRecvBatch(
+        size_t        maxBytes,
+        unsigned long maxDelayInMs
+        );
+
 private:
 
     CMsgClientJni(
@@ -44,7 +83,12 @@ private:
         jmethodID onOkMsg,
         jmethodID onRecvMsg,
         jmethodID onCloseMsg,
-        jmethodID onHeartbeatMsg
+        jmethodID onHeartbeatMsg,
+        jmethodID onOutputHighWater, /* = NULL */
+        jmethodID onOutputLowWater,  /* = NULL */
+        jmethodID onRecvDirect,      /* = NULL */
+        jmethodID onRecvPacked,      /* = NULL */
+        jmethodID onSendDropped      /* = NULL */
         );
 
     virtual ~CMsgClientJni();
@@ -75,6 +119,34 @@ private:
         int64_t        peerAliveTick
         );
 
+    virtual void OnOutputHighWater(
+        const RTP_MSG_USER& user,
+        size_t              sendingBytes
+        );
+
+    virtual void OnOutputLowWater(
+        const RTP_MSG_USER& user,
+        size_t              sendingBytes
+        );
+
+    virtual void OnSendDropped(
+        size_t msgCount,
+        size_t bytes
+        );
+
+    void CallWatermark_i(
+        jmethodID method,
+        size_t    sendingBytes
+        );
+
+    void RecvDirect_i(
+        JNIEnv*             env,
+        const void*         buf,
+        size_t              size,
+        uint16_t            charset,
+        const RTP_MSG_USER& srcUser
+        );
+
 private:
 
     const jobject   m_listener;
@@ -82,6 +154,15 @@ private:
     const jmethodID m_onRecvMsg;
     const jmethodID m_onCloseMsg;
     const jmethodID m_onHeartbeatMsg;
+    const jmethodID m_onOutputHighWater;
+    const jmethodID m_onOutputLowWater;
+    const jmethodID m_onRecvDirect;
+    const jmethodID m_onRecvPacked;
+    const jmethodID m_onSendDropped;
+    CJniBufferPool* m_recvBuffers;
+    CJniRecvBatch*  m_recvBatch;   /* NULL if not a batch listener */
+    jlong           m_handle;
+    CJniReactor*    m_jniReactor;
 
     DECLARE_SGI_POOL(0)
 };
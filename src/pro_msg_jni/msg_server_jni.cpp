@@ -23,6 +23,7 @@
 #include "pronet/pro_z.h"
 #include "pronet/rtp_base.h"
 #include "pronet/rtp_msg.h"
+#include "../pro_msg/msg_group.h"
 #include "../pro_msg/msg_server.h"
 #include <jni.h>
 
@@ -43,6 +44,10 @@ jobject
 NewJavaUser_i(JNIEnv*             env,
               const RTP_MSG_USER& user);
 
+extern
+jlong
+PackJavaUser_i(const RTP_MSG_USER& user);
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif
@@ -71,6 +76,11 @@ CMsgServerJni::CreateInstance(JNIEnv* env,
     jmethodID onCloseUser     = NULL;
     jmethodID onHeartbeatUser = NULL;
     jmethodID onRecvMsg       = NULL;
+    jmethodID onHighWater     = NULL;
+    jmethodID onLowWater      = NULL;
+    jmethodID onRecvDirect    = NULL;
+    jmethodID onRecvBatch     = NULL;
+    jmethodID onRecvPacked    = NULL;
 
     onOkUser = env->GetMethodID(clazz, "msgServerOnOkUser",
         "(JLcom/pro/msg/ProMsgJni$PRO_MSG_USER;Ljava/lang/String;)V");
@@ -100,14 +110,68 @@ CMsgServerJni::CreateInstance(JNIEnv* env,
         return NULL;
     }
 
+    /*
+     * optional, for MsgServerWatermarkListener
+     */
+    onHighWater = env->GetMethodID(clazz, "msgServerOnOutputHighWater",
+        "(JLcom/pro/msg/ProMsgJni$PRO_MSG_USER;J)V");
+    if (onHighWater == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        onHighWater = NULL;
+    }
+
+    onLowWater = env->GetMethodID(clazz, "msgServerOnOutputLowWater",
+        "(JLcom/pro/msg/ProMsgJni$PRO_MSG_USER;J)V");
+    if (onLowWater == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        onLowWater = NULL;
+    }
+
+    /*
+     * optional, for MsgServerDirectListener
+     */
+    onRecvDirect = env->GetMethodID(clazz, "msgServerOnRecvMsgDirect",
+        "(JLjava/nio/ByteBuffer;IISJI)V");
+    if (onRecvDirect == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        onRecvDirect = NULL;
+    }
+
+    /*
+     * optional, for MsgServerPackedListener
+     */
+    onRecvPacked = env->GetMethodID(clazz, "msgServerOnRecvMsgPacked", "(J[BIJ)V");
+    if (onRecvPacked == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        onRecvPacked = NULL;
+    }
+
+    /*
+     * optional, for MsgServerBatchListener
+     */
+    onRecvBatch = env->GetMethodID(clazz, "msgServerOnRecvMsgBatch", "(JLjava/nio/ByteBuffer;II)V");
+    if (onRecvBatch == NULL || env->ExceptionCheck())
+    {
+        env->ExceptionClear();
+        onRecvBatch = NULL;
+    }
+
     jobject listener2 = env->NewGlobalRef(listener);
     if (listener2 == NULL || env->ExceptionCheck())
     {
         return NULL;
     }
 
-    CMsgServerJni* server = new CMsgServerJni(
-        listener2, onOkUser, onCloseUser, onHeartbeatUser, onRecvMsg);
+    CMsgServerJni* server = new CMsgServerJni(listener2, onOkUser, onCloseUser,
+        onHeartbeatUser, onRecvMsg, onHighWater, onLowWater, onRecvDirect, onRecvPacked);
+    if (onRecvBatch != NULL)
+    {
+        server->m_recvBatch = CJniRecvBatch::CreateInstance(env, listener, onRecvBatch);
+    }
 
     return server;
 }
@@ -116,26 +180,78 @@ CMsgServerJni::CMsgServerJni(jobject   listener,
                              jmethodID onOkUser,
                              jmethodID onCloseUser,
                              jmethodID onHeartbeatUser,
-                             jmethodID onRecvMsg)
+                             jmethodID onRecvMsg,
+                             jmethodID onOutputHighWater, /* = NULL */
+                             jmethodID onOutputLowWater,  /* = NULL */
+                             jmethodID onRecvDirect,      /* = NULL */
+                             jmethodID onRecvPacked)      /* = NULL */
 :
 m_listener(listener),
 m_onOkUser(onOkUser),
 m_onCloseUser(onCloseUser),
 m_onHeartbeatUser(onHeartbeatUser),
-m_onRecvMsg(onRecvMsg)
+m_onRecvMsg(onRecvMsg),
+m_onOutputHighWater(onOutputHighWater),
+m_onOutputLowWater(onOutputLowWater),
+m_onRecvDirect(onRecvDirect),
+m_onRecvPacked(onRecvPacked)
 {
+    m_recvBuffers = new CJniBufferPool;
+    m_recvBatch   = NULL;
+    m_handle      = 0;
+    m_jniReactor  = NULL;
 }
 
 CMsgServerJni::~CMsgServerJni()
 {
     Fini();
 
+    if (m_recvBatch != NULL)
+    {
+        m_recvBatch->Fini();
+        m_recvBatch->Release();
+        m_recvBatch = NULL;
+    }
+
     JNIEnv* env = JniUtilAttach();
+    m_recvBuffers->Clear(env);
     if (env != NULL)
     {
         env->DeleteGlobalRef(m_listener);
         JniUtilDetach();
     }
+
+    delete m_recvBuffers;
+    m_recvBuffers = NULL;
+}
+
+void
+CMsgServerJni::SetHandle(jlong handle)
+{
+    m_handle = handle;
+    if (m_recvBatch != NULL)
+    {
+        m_recvBatch->SetOwner(handle);
+    }
+}
+
+bool
+CMsgServerJni::AddRecvBuffer(JNIEnv* env,
+                             jobject buffer)
+{
+    return m_recvBuffers->Add(env, buffer);
+}
+
+bool
+CMsgServerJni::SetRecvBatch(size_t        maxBytes,
+                            unsigned long maxDelayInMs)
+{
+    if (m_recvBatch == NULL || m_jniReactor == NULL)
+    {
+        return false;
+    }
+
+    return m_recvBatch->SetParams(m_jniReactor->GetReactor(), maxBytes, maxDelayInMs);
 }
 
 void
@@ -154,20 +270,13 @@ CMsgServerJni::OnOkUser(IRtpMsgServer*      msgServer,
         return;
     }
 
+    if (!IsCurrent(msgServer))
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgServer == NULL)
-        {
-            return;
-        }
-
-        if (msgServer != m_msgServer)
-        {
-            return;
-        }
+        return;
     }
 
+    InitUserState(*user, c2sUser);
+
     JNIEnv* env = JniUtilAttach();
     if (env == NULL)
     {
@@ -194,7 +303,7 @@ CMsgServerJni::OnOkUser(IRtpMsgServer*      msgServer,
     env->CallVoidMethod(
         m_listener,
         m_onOkUser,
-        (jlong)  this,
+        (jlong)  m_handle,
         (jobject)javaUser,
         (jstring)javaPublicIp
         );
@@ -216,20 +325,13 @@ CMsgServerJni::OnCloseUser(IRtpMsgServer*      msgServer,
         return;
     }
 
+    if (!IsCurrent(msgServer))
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgServer == NULL)
-        {
-            return;
-        }
-
-        if (msgServer != m_msgServer)
-        {
-            return;
-        }
+        return;
     }
 
+    ReleaseUserState(*user, errorCode, sslCode);
+
     JNIEnv* env = JniUtilAttach();
     if (env == NULL)
     {
@@ -247,7 +349,7 @@ CMsgServerJni::OnCloseUser(IRtpMsgServer*      msgServer,
     env->CallVoidMethod(
         m_listener,
         m_onCloseUser,
-        (jlong)  this,
+        (jlong)  m_handle,
         (jobject)javaUser,
         (jint)   errorCode,
         (jint)   sslCode
@@ -268,18 +370,9 @@ CMsgServerJni::OnHeartbeatUser(IRtpMsgServer*      msgServer,
         return;
     }
 
+    if (!IsCurrent(msgServer))
     {
-        CProThreadMutexGuard mon(m_lock);
-
-        if (m_reactor == NULL || m_msgServer == NULL)
-        {
-            return;
-        }
-
-        if (msgServer != m_msgServer)
-        {
-            return;
-        }
+        return;
     }
 
     JNIEnv* env = JniUtilAttach();
@@ -299,7 +392,7 @@ CMsgServerJni::OnHeartbeatUser(IRtpMsgServer*      msgServer,
     env->CallVoidMethod(
         m_listener,
         m_onHeartbeatUser,
-        (jlong)  this,
+        (jlong)  m_handle,
         (jobject)javaUser,
         (jlong)  peerAliveTick
         );
@@ -323,18 +416,26 @@ CMsgServerJni::OnRecvMsg(IRtpMsgServer*      msgServer,
         return;
     }
 
+    if (!IsCurrent(msgServer))
     {
-        CProThreadMutexGuard mon(m_lock);
+        return;
+    }
 
-        if (m_reactor == NULL || m_msgServer == NULL)
-        {
-            return;
-        }
+    if (UnpackCoalesced(msgServer, buf, size, charset, srcUser))
+    {
+        return;
+    }
 
-        if (msgServer != m_msgServer)
-        {
-            return;
-        }
+    m_metrics->AddRecv(size);
+
+    if (ProcessGroupCtrl(buf, size, charset, srcUser))
+    {
+        return;
+    }
+
+    if (m_recvBatch != NULL && m_recvBatch->Add(buf, size, charset, *srcUser))
+    {
+        return;
     }
 
     JNIEnv* env = JniUtilAttach();
@@ -343,6 +444,14 @@ CMsgServerJni::OnRecvMsg(IRtpMsgServer*      msgServer,
         return;
     }
 
+    if (m_onRecvDirect != NULL)
+    {
+        RecvDirect_i(env, buf, size, charset, *srcUser);
+        JniUtilDetach();
+
+        return;
+    }
+
     jbyteArray javaBuf = env->NewByteArray((jsize)size);
     if (javaBuf == NULL || env->ExceptionCheck())
     {
@@ -360,6 +469,25 @@ CMsgServerJni::OnRecvMsg(IRtpMsgServer*      msgServer,
         return;
     }
 
+    /*
+     * no PRO_MSG_USER is allocated
+     */
+    if (m_onRecvPacked != NULL)
+    {
+        env->CallVoidMethod(
+            m_listener,
+            m_onRecvPacked,
+            (jlong)     m_handle,
+            (jbyteArray)javaBuf,
+            (jint)      charset,
+            (jlong)     PackJavaUser_i(*srcUser)
+            );
+        env->DeleteLocalRef(javaBuf);
+        JniUtilDetach();
+
+        return;
+    }
+
     jobject javaUser = NewJavaUser_i(env, *srcUser);
     if (javaUser == NULL)
     {
@@ -372,7 +500,7 @@ CMsgServerJni::OnRecvMsg(IRtpMsgServer*      msgServer,
     env->CallVoidMethod(
         m_listener,
         m_onRecvMsg,
-        (jlong)     this,
+        (jlong)     m_handle,
         (jbyteArray)javaBuf,
         (jint)      charset,
         (jobject)   javaUser
@@ -381,3 +509,101 @@ CMsgServerJni::OnRecvMsg(IRtpMsgServer*      msgServer,
     env->DeleteLocalRef(javaBuf);
     JniUtilDetach();
 }
+
+void
+CMsgServerJni::OnOutputHighWater(const RTP_MSG_USER& user,
+                                 size_t              sendingBytes)
+{
+    CallWatermark_i(m_onOutputHighWater, user, sendingBytes);
+}
+
+void
+CMsgServerJni::OnOutputLowWater(const RTP_MSG_USER& user,
+                                size_t              sendingBytes)
+{
+    CallWatermark_i(m_onOutputLowWater, user, sendingBytes);
+}
+
+void
+CMsgServerJni::CallWatermark_i(jmethodID           method,
+                               const RTP_MSG_USER& user,
+                               size_t              sendingBytes)
+{
+    if (method == NULL)
+    {
+        return;
+    }
+
+    JNIEnv* env = JniUtilAttach();
+    if (env == NULL)
+    {
+        return;
+    }
+
+    jobject javaUser = NewJavaUser_i(env, user);
+    if (javaUser == NULL)
+    {
+        JniUtilDetach();
+
+        return;
+    }
+
+    env->CallVoidMethod(
+        m_listener,
+        method,
+        (jlong)  m_handle,
+        (jobject)javaUser,
+        (jlong)  sendingBytes
+        );
+    env->DeleteLocalRef(javaUser);
+    JniUtilDetach();
+}
+
+void
+CMsgServerJni::RecvDirect_i(JNIEnv*             env,
+                             const void*         buf,
+                             size_t              size,
+                             uint16_t            charset,
+                             const RTP_MSG_USER& srcUser)
+{
+    JNI_BUFFER* const pooled  = m_recvBuffers->Get(size);
+    jobject           javaBuf = NULL;
+
+    if (pooled != NULL)
+    {
+        memcpy(pooled->address, buf, size);
+        javaBuf = pooled->buffer;
+    }
+    else
+    {
+        /*
+         * a view over the receive buffer. it's valid only during the call
+         */
+        javaBuf = env->NewDirectByteBuffer((void*)buf, (jlong)size);
+        if (javaBuf == NULL || env->ExceptionCheck())
+        {
+            return;
+        }
+    }
+
+    env->CallVoidMethod(
+        m_listener,
+        m_onRecvDirect,
+        (jlong)  m_handle,
+        (jobject)javaBuf,
+        (jint)   size,
+        (jint)   charset,
+        (jshort) srcUser.classId,
+        (jlong)  srcUser.UserId(),
+        (jint)   srcUser.instId
+        );
+
+    if (pooled != NULL)
+    {
+        m_recvBuffers->Put(pooled);
+    }
+    else
+    {
+        env->DeleteLocalRef(javaBuf);
+    }
+}